@@ -46,10 +46,24 @@
 #include <glib.h>
 #include <glib/gstdio.h>
 #include <glib/gi18n.h>
+#ifndef WINDOWS
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#endif
 
 /* TODO in the future we could have support for other shells (change command strings), or not use a shell at all */
 #define BASH_LOCATION "/bin/bash"
 
+/**
+ * Where supported, the GPX data is passed to and from GPSBabel through pipes,
+ *  so that it is parsed (or written) at the same time as GPSBabel is running.
+ * Set this to false to always use intermediate files.
+ */
+#define VIK_SETTINGS_BABEL_STREAMING "babel_streaming"
+
 /**
  * Path to gpsbabel
  */
@@ -161,6 +175,62 @@ static void babel_watch ( GPid pid,
   g_spawn_close_pid ( pid );
 }
 
+/**
+ * babel_spawn:
+ * @args:         The command line arguments passed to GPSBabel
+ * @babel_stdin:  If not NULL, returns a pipe to the standard input of GPSBabel
+ * @pid:          Returns the process id
+ * @babel_stdout: Returns a pipe from the standard output of GPSBabel
+ *
+ * Returns: %TRUE on successful invocation of GPSBabel command
+ */
+static gboolean babel_spawn ( gchar **args, gint *babel_stdin, GPid *pid, gint *babel_stdout )
+{
+  GError *error = NULL;
+
+  if ( vik_debug ) {
+    (void)g_printf ( "%s:", __FUNCTION__ );
+    for ( guint i=0; args[i]; i++ )
+      (void)g_printf ( " %s", args[i] );
+    (void)g_printf ( "\n" );
+  }
+
+  if (!g_spawn_async_with_pipes (NULL, args, NULL, G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL, pid, babel_stdin, babel_stdout, NULL, &error)) {
+    g_warning ("Async command failed: %s", error->message);
+    g_error_free(error);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/**
+ * babel_read_diag:
+ *
+ * Pass each line of GPSBabel output to the callback until GPSBabel finishes
+ */
+static void babel_read_diag ( GPid pid, gint babel_stdout, BabelStatusFunc cb, gpointer user_data )
+{
+  gchar line[512] = "";
+  // NB Normal buffering still provides each line as soon as it has been written,
+  //  but without a read for every character
+  FILE *diag = fdopen(babel_stdout, "r");
+
+  while (fgets(line, sizeof(line), diag)) {
+    if ( cb )
+      cb(BABEL_DIAG_OUTPUT, line, user_data);
+  }
+  if ( cb )
+    cb(BABEL_DONE, NULL, user_data);
+  fclose(diag);
+  diag = NULL;
+
+  g_child_watch_add ( pid, (GChildWatchFunc) babel_watch, NULL );
+
+  // Useful to see in case of any errors,
+  //  although they don't always occur on the last line output
+  g_debug ( "%s: last received line is=\"%s\"", __FUNCTION__, line );
+}
+
 /**
  * babel_general_convert:
  * @args: The command line arguments passed to GPSBabel
@@ -174,48 +244,160 @@ static void babel_watch ( GPid pid,
  */
 static gboolean babel_general_convert( BabelStatusFunc cb, gchar **args, gpointer user_data )
 {
-  gboolean ret = FALSE;
   GPid pid;
-  GError *error = NULL;
   gint babel_stdout;
 
-  if ( vik_debug ) {
-    (void)g_printf ( "%s:", __FUNCTION__ );
-    for ( guint i=0; args[i]; i++ )
-      (void)g_printf ( " %s", args[i] );
-    (void)g_printf ( "\n" );
-  }
+  if ( !babel_spawn ( args, NULL, &pid, &babel_stdout ) )
+    return FALSE;
 
-  if (!g_spawn_async_with_pipes (NULL, args, NULL, G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL, &pid, NULL, &babel_stdout, NULL, &error)) {
-    g_warning ("Async command failed: %s", error->message);
-    g_error_free(error);
-    ret = FALSE;
-  } else {
+  babel_read_diag ( pid, babel_stdout, cb, user_data );
+  return TRUE;
+}
 
-    gchar line[512];
-    FILE *diag;
-    diag = fdopen(babel_stdout, "r");
-    setvbuf(diag, NULL, _IONBF, 0);
+static gboolean babel_streaming ( void )
+{
+#ifdef WINDOWS
+  return FALSE;
+#else
+  gboolean streaming = TRUE;
+  gboolean tmp;
+  if ( a_settings_get_boolean ( VIK_SETTINGS_BABEL_STREAMING, &tmp ) )
+    streaming = tmp;
+  return streaming;
+#endif
+}
 
-    while (fgets(line, sizeof(line), diag)) {
-      if ( cb )
-        cb(BABEL_DIAG_OUTPUT, line, user_data);
+/**
+ * babel_make_dst:
+ * @is_fifo: Returns whether the file is a named pipe
+ *
+ * Create somewhere for the GPX output to be written to.
+ * When possible this is a named pipe, so the output can be read as it is produced.
+ * The pipe is made inside a new private directory, since (unlike for a file)
+ *  there is no way to create one under a unique name in a shared directory safely.
+ *
+ * Returns: The file name (to be freed by babel_remove_dst() after use) or NULL on failure
+ */
+static gchar *babel_make_dst ( gboolean *is_fifo )
+{
+  gchar *name_dst = NULL;
+  *is_fifo = FALSE;
+#ifndef WINDOWS
+  if ( babel_streaming() ) {
+    gchar *dir = g_build_filename ( g_get_tmp_dir(), "viking-babel.XXXXXX", NULL );
+#if GLIB_CHECK_VERSION (2, 30, 0)
+    if ( g_mkdtemp ( dir ) ) {
+#else
+    if ( mkdtemp ( dir ) ) {
+#endif
+      name_dst = g_build_filename ( dir, "output.gpx", NULL );
+      if ( mkfifo ( name_dst, 0600 ) == 0 ) {
+        g_debug ("%s: named pipe: %s", __FUNCTION__, name_dst);
+        *is_fifo = TRUE;
+        g_free ( dir );
+        return name_dst;
+      }
+      g_free ( name_dst );
+      name_dst = NULL;
+      (void)g_rmdir ( dir );
     }
-    if ( cb )
-      cb(BABEL_DONE, NULL, user_data);
-    fclose(diag);
-    diag = NULL;
+    g_free ( dir );
+  }
+#endif
+  int fd_dst = g_file_open_tmp ( "tmp-viking.XXXXXX", &name_dst, NULL );
+  if ( fd_dst < 0 )
+    return NULL;
+  g_debug ("%s: temporary file: %s", __FUNCTION__, name_dst);
+  close(fd_dst);
+  return name_dst;
+}
+
+/**
+ * babel_remove_dst:
+ *
+ * Remove and free what babel_make_dst() created
+ */
+static void babel_remove_dst ( gchar *name_dst, gboolean is_fifo )
+{
+  (void)g_remove(name_dst);
+  if ( is_fifo ) {
+    gchar *dir = g_path_get_dirname ( name_dst );
+    (void)g_rmdir ( dir );
+    g_free ( dir );
+  }
+  g_free(name_dst);
+}
 
-    g_child_watch_add ( pid, (GChildWatchFunc) babel_watch, NULL );
+#ifndef WINDOWS
+static GThread *babel_thread_new ( const gchar *name, GThreadFunc func, gpointer data )
+{
+#if GLIB_CHECK_VERSION (2, 32, 0)
+  return g_thread_new ( name, func, data );
+#else
+  return g_thread_create ( func, data, TRUE, NULL );
+#endif
+}
 
-    // Useful to see in case of any errors,
-    //  although they don't always occur on the last line output
-    g_debug ( "%s: last received line is=\"%s\"", __FUNCTION__, line );
-    ret = TRUE;
+typedef struct {
+  GPid pid;
+  gint babel_stdout;
+  gint hold_fd;
+  BabelStatusFunc cb;
+  gpointer user_data;
+} BabelDiag;
+
+static gpointer babel_diag_thread ( BabelDiag *bd )
+{
+  babel_read_diag ( bd->pid, bd->babel_stdout, bd->cb, bd->user_data );
+  // GPSBabel has finished, so allow the reader to see the end of the data
+  close ( bd->hold_fd );
+  return NULL;
+}
+
+/**
+ * babel_general_convert_from_fifo:
+ *
+ * As babel_general_convert_from() when name_dst is a named pipe:
+ *  the GPX is parsed as GPSBabel writes it, while the output of GPSBabel
+ *  is passed to the callback from another thread.
+ */
+static gboolean babel_general_convert_from_fifo ( VikTrwLayer *vt, BabelStatusFunc cb, gchar **args, const gchar *name_dst, gpointer user_data )
+{
+  // Opening the read end first (without waiting for a writer) means opening the write end doesn't block.
+  // Holding the write end open then ensures the end of file is only seen once GPSBabel has finished,
+  //  rather than straight away should GPSBabel not have opened the pipe yet.
+  int rfd = g_open ( name_dst, O_RDONLY | O_NONBLOCK, 0 );
+  if ( rfd < 0 )
+    return FALSE;
+  int wfd = g_open ( name_dst, O_WRONLY, 0 );
+  if ( wfd < 0 ) {
+    close ( rfd );
+    return FALSE;
   }
-    
+  fcntl ( rfd, F_SETFL, fcntl ( rfd, F_GETFL ) & ~O_NONBLOCK );
+
+  BabelDiag bd = { 0, -1, wfd, cb, user_data };
+  if ( !babel_spawn ( args, NULL, &bd.pid, &bd.babel_stdout ) ) {
+    close ( wfd );
+    close ( rfd );
+    return FALSE;
+  }
+  GThread *thread = babel_thread_new ( "babel_diag", (GThreadFunc)babel_diag_thread, &bd );
+
+  gboolean ret = TRUE;
+  FILE *f = fdopen ( rfd, "r" );
+  if ( vt )
+    ret = a_gpx_read_file ( vt, f );
+  // Read anything not consumed by the parser (or when no data is wanted),
+  //  otherwise GPSBabel could be stuck writing to the pipe
+  gchar buf[4096];
+  while ( fread ( buf, 1, sizeof(buf), f ) > 0 );
+  fclose ( f );
+
+  g_thread_join ( thread );
   return ret;
 }
+#endif
 
 /**
  * babel_general_convert_from:
@@ -231,14 +413,21 @@ static gboolean babel_general_convert( BabelStatusFunc cb, gchar **args, gpointe
  * to import the GPX data into layer vt. Assumes that upon
  * running the command, the data will appear in the (usually
  * temporary) file name_dst.
+ * When name_dst is a named pipe the data is imported whilst the command runs,
+ * in which case cb is called from another thread.
  *
  * Returns: %TRUE on success
  */
-static gboolean babel_general_convert_from( VikTrwLayer *vt, BabelStatusFunc cb, gchar **args, const gchar *name_dst, gpointer user_data )
+static gboolean babel_general_convert_from( VikTrwLayer *vt, BabelStatusFunc cb, gchar **args, const gchar *name_dst, gboolean is_fifo, gpointer user_data )
 {
   gboolean ret = FALSE;
   FILE *f = NULL;
     
+#ifndef WINDOWS
+  if ( is_fifo )
+    return babel_general_convert_from_fifo ( vt, cb, args, name_dst, user_data );
+#endif
+
   if (babel_general_convert(cb, args, user_data)) {
 
     /* No data actually required but still need to have run gpsbabel anyway
@@ -277,15 +466,12 @@ static gboolean babel_general_convert_from( VikTrwLayer *vt, BabelStatusFunc cb,
 gboolean a_babel_convert_from_filter( VikTrwLayer *vt, const char *babelargs, const char *from, const char *babelfilters, BabelStatusFunc cb, gpointer user_data, gpointer not_used )
 {
   int i,j;
-  int fd_dst;
   gchar *name_dst = NULL;
+  gboolean is_fifo;
   gboolean ret = FALSE;
   gchar *args[64];
 
-  if ((fd_dst = g_file_open_tmp("tmp-viking.XXXXXX", &name_dst, NULL)) >= 0) {
-    g_debug ("%s: temporary file: %s", __FUNCTION__, name_dst);
-    close(fd_dst);
-
+  if ((name_dst = babel_make_dst(&is_fifo))) {
     if (gpsbabel_loc ) {
       gchar **sub_args = g_strsplit(babelargs, " ", 0);
       gchar **sub_filters = NULL;
@@ -315,15 +501,14 @@ gboolean a_babel_convert_from_filter( VikTrwLayer *vt, const char *babelargs, co
       args[i++] = name_dst;
       args[i] = NULL;
 
-      ret = babel_general_convert_from ( vt, cb, args, name_dst, user_data );
+      ret = babel_general_convert_from ( vt, cb, args, name_dst, is_fifo, user_data );
 
       g_strfreev(sub_args);
       if (sub_filters)
           g_strfreev(sub_filters);
     } else
       g_critical("gpsbabel not found in PATH");
-    (void)g_remove(name_dst);
-    g_free(name_dst);
+    babel_remove_dst ( name_dst, is_fifo );
   }
 
   return ret;
@@ -346,13 +531,12 @@ gboolean a_babel_convert_from_filter( VikTrwLayer *vt, const char *babelargs, co
  */
 gboolean a_babel_convert_from_shellcommand ( VikTrwLayer *vt, const char *input_cmd, const char *input_file_type, BabelStatusFunc cb, gpointer user_data, gpointer not_used )
 {
-  int fd_dst;
   gchar *name_dst = NULL;
+  gboolean is_fifo;
   gboolean ret = FALSE;
   gchar **args;  
 
-  if ((fd_dst = g_file_open_tmp("tmp-viking.XXXXXX", &name_dst, NULL)) >= 0) {
-    g_debug ("%s: temporary file: %s", __FUNCTION__, name_dst);
+  if ((name_dst = babel_make_dst(&is_fifo))) {
     gchar *shell_command;
     if ( input_file_type )
       shell_command = g_strdup_printf("%s | %s -i %s -f - -o gpx -F %s",
@@ -361,7 +545,6 @@ gboolean a_babel_convert_from_shellcommand ( VikTrwLayer *vt, const char *input_
       shell_command = g_strdup_printf("%s > %s", input_cmd, name_dst);
 
     g_debug("%s: %s", __FUNCTION__, shell_command);
-    close(fd_dst);
 
     args = g_malloc(sizeof(gchar *)*4);
     args[0] = BASH_LOCATION;
@@ -369,11 +552,10 @@ gboolean a_babel_convert_from_shellcommand ( VikTrwLayer *vt, const char *input_
     args[2] = shell_command;
     args[3] = NULL;
 
-    ret = babel_general_convert_from ( vt, cb, args, name_dst, user_data );
+    ret = babel_general_convert_from ( vt, cb, args, name_dst, is_fifo, user_data );
     g_free ( args );
     g_free ( shell_command );
-    (void)g_remove(name_dst);
-    g_free(name_dst);
+    babel_remove_dst ( name_dst, is_fifo );
   }
 
   return ret;
@@ -475,6 +657,64 @@ static gboolean babel_general_convert_to( VikTrwLayer *vt, VikTrack *trk, BabelS
   return babel_general_convert (cb, args, user_data);
 }
 
+#ifndef WINDOWS
+typedef struct {
+  VikTrwLayer *vt;
+  VikTrack *trk;
+  FILE *f;
+} BabelWriter;
+
+/*
+ * Returns: (as a pointer) FALSE if the GPX could not be completely written
+ */
+static gpointer babel_writer_thread ( BabelWriter *bw )
+{
+  // Should GPSBabel stop early, get a write error rather than the whole program being terminated
+  sigset_t set;
+  sigemptyset ( &set );
+  sigaddset ( &set, SIGPIPE );
+  pthread_sigmask ( SIG_BLOCK, &set, NULL );
+
+  // As per a_file_export(), without invisible tracks and waypoints
+  GpxWritingOptions options = { FALSE, FALSE, FALSE, FALSE };
+  gboolean ok;
+  if ( bw->trk ) {
+    options.is_route = bw->trk->is_route;
+    ok = a_gpx_write_track_file ( bw->trk, bw->f, &options );
+  }
+  else
+    ok = a_gpx_write_file ( bw->vt, bw->f, &options );
+  // Let GPSBabel see the end of its input
+  if ( fclose ( bw->f ) != 0 )
+    ok = FALSE;
+  return GINT_TO_POINTER(ok);
+}
+
+/**
+ * babel_general_convert_to_stream:
+ *
+ * As babel_general_convert_to() but the GPX is written straight into the
+ *  standard input of GPSBabel (so args should specify '-f -')
+ */
+static gboolean babel_general_convert_to_stream( VikTrwLayer *vt, VikTrack *trk, BabelStatusFunc cb, gchar **args, gpointer user_data )
+{
+  GPid pid;
+  gint babel_stdin, babel_stdout;
+
+  if ( !babel_spawn ( args, &babel_stdin, &pid, &babel_stdout ) )
+    return FALSE;
+
+  BabelWriter bw = { vt, trk, fdopen ( babel_stdin, "w" ) };
+  GThread *thread = babel_thread_new ( "babel_writer", (GThreadFunc)babel_writer_thread, &bw );
+  babel_read_diag ( pid, babel_stdout, cb, user_data );
+  if ( !GPOINTER_TO_INT(g_thread_join ( thread )) ) {
+    g_warning ( "%s: failed to write all the data to GPSBabel", __FUNCTION__ );
+    return FALSE;
+  }
+  return TRUE;
+}
+#endif
+
 /**
  * a_babel_convert_to:
  * @vt:             The TRW layer from which data is taken.
@@ -488,6 +728,7 @@ static gboolean babel_general_convert_to( VikTrwLayer *vt, VikTrack *trk, BabelS
  * Exports data using gpsbabel.  This routine is synchronous;
  * that is, it will block the calling program until the conversion is done. To avoid blocking, call
  * this routine from a worker thread.
+ * Where possible the GPX is streamed into GPSBabel as it is written, rather than via a temporary file.
  *
  * Returns: %TRUE on successful invocation of GPSBabel command
  */
@@ -498,35 +739,53 @@ gboolean a_babel_convert_to( VikTrwLayer *vt, VikTrack *track, const char *babel
   gchar *name_src = NULL;
   gboolean ret = FALSE;
   gchar *args[64];  
+  gboolean streaming = FALSE;
 
-  if ((fd_src = g_file_open_tmp("tmp-viking.XXXXXX", &name_src, NULL)) >= 0) {
+  if (!gpsbabel_loc) {
+    g_critical("gpsbabel not found in PATH");
+    return FALSE;
+  }
+
+#ifndef WINDOWS
+  streaming = babel_streaming();
+#endif
+  if (!streaming) {
+    if ((fd_src = g_file_open_tmp("tmp-viking.XXXXXX", &name_src, NULL)) < 0)
+      return FALSE;
     g_debug ("%s: temporary file: %s", __FUNCTION__, name_src);
     close(fd_src);
+  }
 
-    if (gpsbabel_loc ) {
-      gchar **sub_args = g_strsplit(babelargs, " ", 0);
+  gchar **sub_args = g_strsplit(babelargs, " ", 0);
 
-      i = 0;
-      if (unbuffer_loc)
-        args[i++] = unbuffer_loc;
-      args[i++] = gpsbabel_loc;
-      args[i++] = "-i";
-      args[i++] = "gpx";
-      for (j = 0; sub_args[j]; j++)
-        /* some version of gpsbabel can not take extra blank arg */
-        if (sub_args[j][0] != '\0')
-          args[i++] = sub_args[j];
-      args[i++] = "-f";
-      args[i++] = name_src;
-      args[i++] = "-F";
-      args[i++] = (char *)to;
-      args[i] = NULL;
+  i = 0;
+  if (unbuffer_loc) {
+    args[i++] = unbuffer_loc;
+    if (streaming)
+      args[i++] = "-p"; // Pass on the standard input
+  }
+  args[i++] = gpsbabel_loc;
+  args[i++] = "-i";
+  args[i++] = "gpx";
+  for (j = 0; sub_args[j]; j++)
+    /* some version of gpsbabel can not take extra blank arg */
+    if (sub_args[j][0] != '\0')
+      args[i++] = sub_args[j];
+  args[i++] = "-f";
+  args[i++] = streaming ? "-" : name_src;
+  args[i++] = "-F";
+  args[i++] = (char *)to;
+  args[i] = NULL;
 
-      ret = babel_general_convert_to ( vt, track, cb, args, name_src, user_data );
+#ifndef WINDOWS
+  if (streaming)
+    ret = babel_general_convert_to_stream ( vt, track, cb, args, user_data );
+  else
+#endif
+    ret = babel_general_convert_to ( vt, track, cb, args, name_src, user_data );
 
-      g_strfreev(sub_args);
-    } else
-      g_critical("gpsbabel not found in PATH");
+  g_strfreev(sub_args);
+  if (name_src) {
     (void)g_remove(name_src);
     g_free(name_src);
   }
@@ -30,12 +30,37 @@
 #include "uibuilder.h"
 #include "globals.h"
 #include "preferences.h"
+#include "perfstats.h"
 
 static GThreadPool *thread_pool_remote = NULL;
 static GThreadPool *thread_pool_local = NULL;
 #ifdef HAVE_LIBMAPNIK
 static GThreadPool *thread_pool_local_mapnik = NULL;
 #endif
+// Per pool (indexed by Background_Pool_Type):
+//  the number of jobs below interactive priority currently running,
+static gint running_low[3] = { 0 };
+//  the configured number of threads and the extra ones currently allowed
+static gint pool_base_threads[3] = { 0 };
+static gint pool_extra_threads[3] = { 0 };
+G_LOCK_DEFINE_STATIC(pool_threads);
+static guint job_sequence = 0; // Only used from the main thread
+
+// How many later jobs of the next higher priority a waiting job can be passed by,
+//  so lower priority jobs still get started while higher priority ones keep arriving
+#define BACKGROUND_PRIORITY_AGING 50
+
+// Jobs of the same kind (pool, function and priority) limited to running only so many at once
+typedef struct {
+  Background_Pool_Type bp;
+  vik_thr_func func;
+  Background_Priority priority;
+  gint max_concurrent;
+  gint active; // Given to the pool and not yet finished
+  GList *held; // Waiting for one of the active jobs to finish, in the order they will be started
+} JobGroup;
+static GSList *job_groups = NULL;
+G_LOCK_DEFINE_STATIC(job_groups);
 static gboolean stop_all_threads = FALSE;
 
 static GtkWidget *bgwindow = NULL;
@@ -47,7 +72,11 @@ static GSList *windows_to_update = NULL;
 
 static gint bgitemcount = 0;
 
-#define VIK_BG_NUM_ARGS 7
+// Progress from the threads is shown periodically, rather than as each item completes
+#define BACKGROUND_PROGRESS_INTERVAL 250
+static guint progress_source_id = 0;
+
+#define VIK_BG_NUM_ARGS 13
 
 enum
 {
@@ -60,15 +89,45 @@ enum
 void a_background_update_status ( VikWindow *vw, gpointer data )
 {
   static gchar buf[20];
-  g_snprintf(buf, sizeof(buf), _("%d items"), bgitemcount);
+  g_snprintf(buf, sizeof(buf), _("%d items"), g_atomic_int_get(&bgitemcount));
   vik_window_statusbar_update ( vw, buf, VIK_STATUSBAR_ITEMS );
 }
 
 static void background_thread_update ()
 {
+  a_perf_set ( PERF_BACKGROUND_QUEUE, g_atomic_int_get(&bgitemcount) );
   g_slist_foreach ( windows_to_update, (GFunc) a_background_update_status, NULL );
 }
 
+static gboolean background_progress_flush_row ( GtkTreeModel *model, GtkTreePath *path, GtkTreeIter *iter, gpointer data )
+{
+  gpointer *args;
+  gdouble shown;
+  gtk_tree_model_get ( model, iter, PROGRESS_COLUMN, &shown, DATA_COLUMN, &args, -1 );
+  // Hundredths of a percent
+  gdouble progress = GPOINTER_TO_INT(g_atomic_pointer_get(&args[7])) / 100.0;
+  if ( progress != shown )
+    gtk_list_store_set ( GTK_LIST_STORE(model), iter, PROGRESS_COLUMN, progress, -1 );
+  return FALSE;
+}
+
+/**
+ * Copy the progress recorded by the threads into the background window and statusbar
+ * Runs with the GDK lock held, so the rows (and hence their args) can not go away meanwhile
+ */
+static gboolean background_progress_flush ( gpointer data )
+{
+  gtk_tree_model_foreach ( GTK_TREE_MODEL(bgstore), background_progress_flush_row, NULL );
+  background_thread_update ();
+
+  GtkTreeIter iter;
+  if ( gtk_tree_model_get_iter_first ( GTK_TREE_MODEL(bgstore), &iter ) )
+    return TRUE;
+  // Nothing left to watch
+  progress_source_id = 0;
+  return FALSE;
+}
+
 /**
  * a_background_thread_progress:
  * @callbackdata: Thread data
@@ -78,18 +137,15 @@ int a_background_thread_progress ( gpointer callbackdata, gdouble fraction )
 {
   gpointer *args = (gpointer *) callbackdata;
   int res = a_background_testcancel ( callbackdata );
-  if (args[5] != NULL) {
-    gdouble myfraction = fabs(fraction);
-    if ( myfraction > 1.0 )
-      myfraction = 1.0;
-    gdk_threads_enter();
-    gtk_list_store_set( GTK_LIST_STORE(bgstore), (GtkTreeIter *) args[5], PROGRESS_COLUMN, myfraction*100, -1 );
-    gdk_threads_leave();
-  }
+  gdouble myfraction = fabs(fraction);
+  if ( myfraction > 1.0 )
+    myfraction = 1.0;
+  // Just record it - shown by background_progress_flush() without this thread waiting on the GDK lock
+  g_atomic_pointer_set ( &args[7], GINT_TO_POINTER((gint)(myfraction*10000)) );
 
   args[6] = GINT_TO_POINTER(GPOINTER_TO_INT(args[6])-1);
-  bgitemcount--;
-  background_thread_update();
+  g_atomic_int_add ( &bgitemcount, -1 );
+  a_perf_count ( PERF_BACKGROUND_COMPLETED, 1 );
   return res;
 }
 
@@ -102,7 +158,7 @@ static void thread_die ( gpointer args[VIK_BG_NUM_ARGS] )
 
   if ( GPOINTER_TO_INT(args[6]) )
   {
-    bgitemcount -= GPOINTER_TO_INT(args[6]);
+    g_atomic_int_add ( &bgitemcount, -GPOINTER_TO_INT(args[6]) );
     background_thread_update ();
   }
 
@@ -125,15 +181,159 @@ int a_background_testcancel ( gpointer callbackdata )
   return 0;
 }
 
+static GThreadPool *get_pool ( Background_Pool_Type bp )
+{
+  if ( bp == BACKGROUND_POOL_REMOTE )
+    return thread_pool_remote;
+#ifdef HAVE_LIBMAPNIK
+  else if ( bp == BACKGROUND_POOL_LOCAL_MAPNIK )
+    return thread_pool_local_mapnik;
+#endif
+  return thread_pool_local;
+}
+
+/**
+ * Change the number of extra threads allowed for the pool
+ */
+static void pool_adjust_extra_threads ( Background_Pool_Type bp, gint change )
+{
+  G_LOCK(pool_threads);
+  pool_extra_threads[bp] += change;
+  g_thread_pool_set_max_threads ( get_pool(bp), pool_base_threads[bp] + pool_extra_threads[bp], NULL );
+  G_UNLOCK(pool_threads);
+}
+
+/**
+ * Order of waiting jobs in a pool: by priority then first come, first served,
+ *  except that each priority level below counts as BACKGROUND_PRIORITY_AGING jobs later,
+ *  so a lower priority job is not kept waiting forever by a stream of higher priority ones.
+ * The order of two jobs never changes whilst they wait, as needed for the pool's sorted queue.
+ */
+static gint background_job_compare ( gconstpointer a, gconstpointer b, gpointer user_data )
+{
+  gpointer *args_a = (gpointer *) a;
+  gpointer *args_b = (gpointer *) b;
+  guint key_a = GPOINTER_TO_UINT(args_a[9]) + GPOINTER_TO_INT(args_a[8]) * BACKGROUND_PRIORITY_AGING;
+  guint key_b = GPOINTER_TO_UINT(args_b[9]) + GPOINTER_TO_INT(args_b[8]) * BACKGROUND_PRIORITY_AGING;
+  // Wrap around safe
+  gint diff = (gint)(key_a - key_b);
+  if ( diff )
+    return diff < 0 ? -1 : 1;
+  gint prio_a = GPOINTER_TO_INT(args_a[8]);
+  gint prio_b = GPOINTER_TO_INT(args_b[8]);
+  return prio_a < prio_b ? -1 : (prio_a > prio_b ? 1 : 0);
+}
+
+/**
+ * Hand the job to its pool
+ */
+static void background_job_push ( gpointer args[VIK_BG_NUM_ARGS] )
+{
+  Background_Pool_Type bp = GPOINTER_TO_INT(args[10]);
+
+  // When all the threads are occupied by long running lower priority jobs (e.g. downloading many zoom levels)
+  //  allow an extra thread, so what is being looked at is not stuck behind them
+  if ( GPOINTER_TO_INT(args[8]) == BACKGROUND_PRIORITY_INTERACTIVE &&
+       g_atomic_int_get(&running_low[bp]) >= pool_base_threads[bp] ) {
+    args[11] = GINT_TO_POINTER(1);
+    pool_adjust_extra_threads ( bp, 1 );
+  }
+
+  g_thread_pool_push ( get_pool(bp), args, NULL );
+}
+
+/**
+ * Returns: Whether the job can be given to the pool now,
+ *          otherwise it is held until another job of the same kind finishes
+ */
+static gboolean job_group_start ( gpointer args[VIK_BG_NUM_ARGS], gint max_concurrent )
+{
+  Background_Pool_Type bp = GPOINTER_TO_INT(args[10]);
+  vik_thr_func func = args[1];
+  Background_Priority priority = GPOINTER_TO_INT(args[8]);
+  gboolean start = TRUE;
+
+  G_LOCK(job_groups);
+  JobGroup *group = NULL;
+  GSList *iter;
+  for ( iter = job_groups; iter; iter = iter->next ) {
+    JobGroup *jg = iter->data;
+    if ( jg->bp == bp && jg->func == func && jg->priority == priority ) {
+      group = jg;
+      break;
+    }
+  }
+  if ( !group ) {
+    group = g_malloc0 ( sizeof(JobGroup) );
+    group->bp = bp;
+    group->func = func;
+    group->priority = priority;
+    job_groups = g_slist_prepend ( job_groups, group );
+  }
+  // The most recently requested limit applies
+  group->max_concurrent = max_concurrent;
+  args[12] = group;
+
+  if ( group->active < group->max_concurrent )
+    group->active++;
+  else {
+    group->held = g_list_insert_sorted_with_data ( group->held, args, background_job_compare, NULL );
+    start = FALSE;
+  }
+  G_UNLOCK(job_groups);
+  return start;
+}
+
+/**
+ * A job of a limited kind has finished, so start the next one of that kind (if any)
+ */
+static void job_group_finish ( JobGroup *group )
+{
+  gpointer *next = NULL;
+
+  G_LOCK(job_groups);
+  if ( group->held ) {
+    next = group->held->data;
+    group->held = g_list_delete_link ( group->held, group->held );
+  }
+  else {
+    group->active--;
+    if ( !group->active ) {
+      job_groups = g_slist_remove ( job_groups, group );
+      g_free ( group );
+    }
+  }
+  G_UNLOCK(job_groups);
+
+  if ( next )
+    background_job_push ( next );
+}
+
 static void thread_helper ( gpointer args[VIK_BG_NUM_ARGS], gpointer user_data )
 {
   /* unpack args */
   vik_thr_func func = args[1];
   gpointer userdata = args[2];
+  Background_Pool_Type bp = GPOINTER_TO_INT(args[10]);
+  gboolean low = GPOINTER_TO_INT(args[8]) != BACKGROUND_PRIORITY_INTERACTIVE;
 
   g_debug(__FUNCTION__);
 
-  func ( userdata, args );
+  // No need to start jobs cancelled while they were waiting
+  if ( a_background_testcancel ( args ) == 0 ) {
+    if ( low )
+      g_atomic_int_inc ( &running_low[bp] );
+    func ( userdata, args );
+    if ( low )
+      g_atomic_int_add ( &running_low[bp], -1 );
+  }
+
+  // Give back the extra thread this job was allowed
+  if ( GPOINTER_TO_INT(args[11]) )
+    pool_adjust_extra_threads ( bp, -1 );
+
+  if ( args[12] )
+    job_group_finish ( args[12] );
 
   gdk_threads_enter();
   if ( ! args[0] )
@@ -146,6 +346,9 @@ static void thread_helper ( gpointer args[VIK_BG_NUM_ARGS], gpointer user_data )
 /**
  * a_background_thread:
  * @bp:      Which pool this thread should run in
+ * @priority: How urgently the job should be started relative to others in the pool
+ * @max_concurrent: The most jobs with this function and priority to run in the pool at once,
+ *                  any more wait until one finishes (0 for no limit other than the pool's size)
  * @parent:
  * @message:
  * @func: worker function
@@ -156,7 +359,7 @@ static void thread_helper ( gpointer args[VIK_BG_NUM_ARGS], gpointer user_data )
  *
  * Function to enlist new background function.
  */
-void a_background_thread ( Background_Pool_Type bp, GtkWindow *parent, const gchar *message, vik_thr_func func, gpointer userdata, vik_thr_free_func userdata_free_func, vik_thr_free_func userdata_cancel_cleanup_func, gint number_items )
+void a_background_thread ( Background_Pool_Type bp, Background_Priority priority, gint max_concurrent, GtkWindow *parent, const gchar *message, vik_thr_func func, gpointer userdata, vik_thr_free_func userdata_free_func, vik_thr_free_func userdata_cancel_cleanup_func, gint number_items )
 {
   GtkTreeIter *piter = g_malloc ( sizeof ( GtkTreeIter ) );
   gpointer *args = g_malloc ( sizeof(gpointer) * VIK_BG_NUM_ARGS );
@@ -170,8 +373,15 @@ void a_background_thread ( Background_Pool_Type bp, GtkWindow *parent, const gch
   args[4] = userdata_cancel_cleanup_func;
   args[5] = piter;
   args[6] = GINT_TO_POINTER(number_items);
+  args[7] = GINT_TO_POINTER(0);
+  args[8] = GINT_TO_POINTER(priority);
+  args[9] = GUINT_TO_POINTER(job_sequence++);
+  args[10] = GINT_TO_POINTER(bp);
+  args[11] = GINT_TO_POINTER(0);
+  args[12] = NULL;
 
-  bgitemcount += number_items;
+  g_atomic_int_add ( &bgitemcount, number_items );
+  a_perf_set ( PERF_BACKGROUND_QUEUE, g_atomic_int_get(&bgitemcount) );
 
   gtk_list_store_append ( bgstore, piter );
   gtk_list_store_set ( bgstore, piter,
@@ -180,15 +390,14 @@ void a_background_thread ( Background_Pool_Type bp, GtkWindow *parent, const gch
 		       DATA_COLUMN, args,
 		       -1 );
 
+  if ( !progress_source_id )
+    progress_source_id = gdk_threads_add_timeout ( BACKGROUND_PROGRESS_INTERVAL, background_progress_flush, NULL );
+
+  if ( max_concurrent > 0 && !job_group_start ( args, max_concurrent ) )
+    return;
+
   /* run the thread in the background */
-  if ( bp == BACKGROUND_POOL_REMOTE )
-    g_thread_pool_push( thread_pool_remote, args, NULL );
-#ifdef HAVE_LIBMAPNIK
-  else if ( bp == BACKGROUND_POOL_LOCAL_MAPNIK )
-    g_thread_pool_push( thread_pool_local_mapnik, args, NULL );
-#endif
-  else
-    g_thread_pool_push( thread_pool_local, args, NULL );
+  background_job_push ( args );
 }
 
 /**
@@ -286,6 +495,8 @@ void a_background_post_init()
     max_threads = maxt;
 
   thread_pool_remote = g_thread_pool_new ( (GFunc) thread_helper, NULL, max_threads, FALSE, NULL );
+  pool_base_threads[BACKGROUND_POOL_REMOTE] = max_threads;
+  g_thread_pool_set_sort_function ( thread_pool_remote, background_job_compare, NULL );
 
   if ( a_settings_get_integer ( VIK_SETTINGS_BACKGROUND_MAX_THREADS_LOCAL, &maxt ) )
     max_threads = maxt;
@@ -295,11 +506,15 @@ void a_background_post_init()
   }
 
   thread_pool_local = g_thread_pool_new ( (GFunc) thread_helper, NULL, max_threads, FALSE, NULL );
+  pool_base_threads[BACKGROUND_POOL_LOCAL] = max_threads;
+  g_thread_pool_set_sort_function ( thread_pool_local, background_job_compare, NULL );
 
 #ifdef HAVE_LIBMAPNIK
   // implicit use of 'MAPNIK_PREFS_NAMESPACE' to avoid dependency issues
   guint mapnik_threads = a_preferences_get("mapnik.background_max_threads_local_mapnik")->u;
   thread_pool_local_mapnik = g_thread_pool_new ( (GFunc) thread_helper, NULL, mapnik_threads, FALSE, NULL );
+  pool_base_threads[BACKGROUND_POOL_LOCAL_MAPNIK] = mapnik_threads;
+  g_thread_pool_set_sort_function ( thread_pool_local_mapnik, background_job_compare, NULL );
 #endif
 
   GtkCellRenderer *renderer;
@@ -363,6 +578,9 @@ void a_background_uninit()
   g_thread_pool_free ( thread_pool_local_mapnik, TRUE, FALSE );
 #endif
 
+  if ( progress_source_id )
+    g_source_remove ( progress_source_id );
+
   gtk_list_store_clear ( bgstore );
   g_object_unref ( bgstore );
 
@@ -41,7 +41,15 @@ typedef enum {
 #endif
 } Background_Pool_Type;
 
-void a_background_thread ( Background_Pool_Type bp, GtkWindow *parent, const gchar *message, vik_thr_func func, gpointer userdata, vik_thr_free_func userdata_free_func, vik_thr_free_func userdata_cancel_cleanup_func, gint number_items );
+// Within a pool, waiting jobs are started in this order (and then in the order submitted)
+//  although a lower priority job is only passed by a limited number of later higher priority ones
+typedef enum {
+  BACKGROUND_PRIORITY_INTERACTIVE, // i.e. Needed for what is being displayed now
+  BACKGROUND_PRIORITY_BULK,        // i.e. Tasks the user explicitly asked for, which may take a long time
+  BACKGROUND_PRIORITY_PREFETCH,    // i.e. Nice to have
+} Background_Priority;
+
+void a_background_thread ( Background_Pool_Type bp, Background_Priority priority, gint max_concurrent, GtkWindow *parent, const gchar *message, vik_thr_func func, gpointer userdata, vik_thr_free_func userdata_free_func, vik_thr_free_func userdata_cancel_cleanup_func, gint number_items );
 int a_background_thread_progress ( gpointer callbackdata, gdouble fraction );
 int a_background_testcancel ( gpointer callbackdata );
 void a_background_show_window ();
@@ -514,6 +514,7 @@ static void
 _async_load_attributions ( BingMapSource *self )
 {
 	a_background_thread ( BACKGROUND_POOL_REMOTE,
+	                      BACKGROUND_PRIORITY_PREFETCH, 0,
 	                      /*VIK_GTK_WINDOW_FROM_WIDGET(vp)*/NULL,
 	                      _("Bing attribution Loading"),
 	                      (vik_thr_func) _load_attributions_thread,
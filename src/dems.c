@@ -23,6 +23,7 @@
 
 #include "dems.h"
 #include "background.h"
+#include "perfstats.h"
 
 typedef struct {
   VikDEM *dem;
@@ -31,6 +32,8 @@ typedef struct {
 
 GHashTable *loaded_dems = NULL;
 /* filename -> DEM */
+/* Since DEMs are loaded and used in background threads, access to the hash table is protected */
+G_LOCK_DEFINE_STATIC(loaded_dems);
 
 static void loaded_dem_free ( LoadedDEM *ldem )
 {
@@ -40,8 +43,11 @@ static void loaded_dem_free ( LoadedDEM *ldem )
 
 void a_dems_uninit ()
 {
+  G_LOCK(loaded_dems);
   if ( loaded_dems )
     g_hash_table_destroy ( loaded_dems );
+  loaded_dems = NULL;
+  G_UNLOCK(loaded_dems);
 }
 
 /* To load a dem. if it was already loaded, will simply
@@ -51,6 +57,7 @@ VikDEM *a_dems_load(const gchar *filename)
 {
   LoadedDEM *ldem;
 
+  G_LOCK(loaded_dems);
   /* dems init hash table */
   if ( ! loaded_dems )
     loaded_dems = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, (GDestroyNotify) loaded_dem_free );
@@ -58,29 +65,48 @@ VikDEM *a_dems_load(const gchar *filename)
   ldem = (LoadedDEM *) g_hash_table_lookup ( loaded_dems, filename );
   if ( ldem ) {
     ldem->ref_count++;
+    G_UNLOCK(loaded_dems);
     return ldem->dem;
+  }
+  G_UNLOCK(loaded_dems);
+
+  /* Don't hold the lock whilst reading the file as that may take a while */
+  gint64 start = a_perf_now ();
+  VikDEM *dem = vik_dem_new_from_file ( filename );
+  a_perf_record ( "io", "DEM load", start );
+  if ( ! dem )
+    return NULL;
+
+  G_LOCK(loaded_dems);
+  /* Check another thread didn't get there first */
+  ldem = (LoadedDEM *) g_hash_table_lookup ( loaded_dems, filename );
+  if ( ldem ) {
+    ldem->ref_count++;
+    vik_dem_free ( dem );
+    dem = ldem->dem;
   } else {
-    VikDEM *dem = vik_dem_new_from_file ( filename );
-    if ( ! dem )
-      return NULL;
     ldem = g_malloc ( sizeof(LoadedDEM) );
     ldem->ref_count = 1;
     ldem->dem = dem;
     g_hash_table_insert ( loaded_dems, g_strdup(filename), ldem );
-    return dem;
   }
+  G_UNLOCK(loaded_dems);
+  return dem;
 }
 
 void a_dems_unref(const gchar *filename)
 {
-  LoadedDEM *ldem = (LoadedDEM *) g_hash_table_lookup ( loaded_dems, filename );
+  G_LOCK(loaded_dems);
+  LoadedDEM *ldem = loaded_dems ? (LoadedDEM *) g_hash_table_lookup ( loaded_dems, filename ) : NULL;
   if ( !ldem ) {
     /* This is fine - probably means the loaded list was aborted / not completed for some reason */
+    G_UNLOCK(loaded_dems);
     return;
   }
   ldem->ref_count--;
   if ( ldem->ref_count == 0 )
     g_hash_table_remove ( loaded_dems, filename );
+  G_UNLOCK(loaded_dems);
 }
 
 /* to get a DEM that was already loaded.
@@ -89,10 +115,13 @@ void a_dems_unref(const gchar *filename)
  */
 VikDEM *a_dems_get(const gchar *filename)
 {
-  LoadedDEM *ldem = g_hash_table_lookup ( loaded_dems, filename );
+  VikDEM *dem = NULL;
+  G_LOCK(loaded_dems);
+  LoadedDEM *ldem = loaded_dems ? g_hash_table_lookup ( loaded_dems, filename ) : NULL;
   if ( ldem )
-    return ldem->dem;
-  return NULL;
+    dem = ldem->dem;
+  G_UNLOCK(loaded_dems);
+  return dem;
 }
 
 
@@ -195,44 +224,51 @@ gint16 a_dems_list_get_elev_by_coord ( GList *dems, const VikCoord *coord )
   return VIK_DEM_INVALID_ELEVATION;
 }
 
-typedef struct {
-  const VikCoord *coord;
-  VikDemInterpol method;
-  gint elev;
-} CoordElev;
-
-static gboolean get_elev_by_coord(gpointer key, LoadedDEM *ldem, CoordElev *ce)
+/**
+ * dem_get_elev:
+ *
+ * Returns: The elevation from this particular DEM, or VIK_DEM_INVALID_ELEVATION if it's not covered
+ */
+static gint16 dem_get_elev ( VikDEM *dem, const VikCoord *coord, VikDemInterpol method )
 {
-  VikDEM *dem = ldem->dem;
   gdouble lat, lon;
 
   if ( dem->horiz_units == VIK_DEM_HORIZ_LL_ARCSECONDS ) {
     struct LatLon ll_tmp;
-    vik_coord_to_latlon (ce->coord, &ll_tmp );
+    vik_coord_to_latlon ( coord, &ll_tmp );
     lat = ll_tmp.lat * 3600;
     lon = ll_tmp.lon * 3600;
   } else if (dem->horiz_units == VIK_DEM_HORIZ_UTM_METERS) {
-    static struct UTM utm_tmp;
+    struct UTM utm_tmp;
+    vik_coord_to_utm ( coord, &utm_tmp );
     if (utm_tmp.zone != dem->utm_zone)
-      return FALSE;
-    vik_coord_to_utm (ce->coord, &utm_tmp);
+      return VIK_DEM_INVALID_ELEVATION;
     lat = utm_tmp.northing;
     lon = utm_tmp.easting;
   } else
-    return FALSE;
+    return VIK_DEM_INVALID_ELEVATION;
 
-  switch (ce->method) {
+  switch (method) {
     case VIK_DEM_INTERPOL_NONE:
-      ce->elev = vik_dem_get_east_north(dem, lon, lat);
-      break;
+      return vik_dem_get_east_north(dem, lon, lat);
     case VIK_DEM_INTERPOL_SIMPLE:
-      ce->elev = vik_dem_get_simple_interpol(dem, lon, lat);
-      break;
+      return vik_dem_get_simple_interpol(dem, lon, lat);
     case VIK_DEM_INTERPOL_BEST:
-      ce->elev = vik_dem_get_shepard_interpol(dem, lon, lat);
-      break;
+      return vik_dem_get_shepard_interpol(dem, lon, lat);
     default: break;
   }
+  return VIK_DEM_INVALID_ELEVATION;
+}
+
+typedef struct {
+  const VikCoord *coord;
+  VikDemInterpol method;
+  gint elev;
+} CoordElev;
+
+static gboolean get_elev_by_coord(gpointer key, LoadedDEM *ldem, CoordElev *ce)
+{
+  ce->elev = dem_get_elev ( ldem->dem, ce->coord, ce->method );
   return (ce->elev != VIK_DEM_INVALID_ELEVATION);
 }
 
@@ -241,14 +277,146 @@ gint16 a_dems_get_elev_by_coord ( const VikCoord *coord, VikDemInterpol method )
 {
   CoordElev ce;
 
-  if (!loaded_dems)
+  G_LOCK(loaded_dems);
+  if (!loaded_dems) {
+    G_UNLOCK(loaded_dems);
     return VIK_DEM_INVALID_ELEVATION;
+  }
 
   ce.coord = coord;
   ce.method = method;
   ce.elev = VIK_DEM_INVALID_ELEVATION;
 
-  if(!g_hash_table_find(loaded_dems, (GHRFunc)get_elev_by_coord, &ce))
+  gpointer found = g_hash_table_find(loaded_dems, (GHRFunc)get_elev_by_coord, &ce);
+  G_UNLOCK(loaded_dems);
+  if ( !found )
     return VIK_DEM_INVALID_ELEVATION;
   return ce.elev;
 }
+
+/**************************************************************
+ * BATCH LOOKUPS
+ **************************************************************/
+struct _VikDemsBatch {
+  VikDemInterpol method;
+  guint n_dems;
+  VikDEM **dems;
+  gchar **filenames;
+};
+
+/**
+ * a_dems_batch_new:
+ *
+ * Take a snapshot of the currently loaded DEMs, referencing each one so they stay loaded
+ *  whilst the batch is in use.
+ * Lookups on the batch do not touch the shared table, so they can be safely made
+ *  from many threads at once.
+ */
+VikDemsBatch *a_dems_batch_new ( VikDemInterpol method )
+{
+  VikDemsBatch *batch = g_malloc0 ( sizeof(VikDemsBatch) );
+  batch->method = method;
+
+  G_LOCK(loaded_dems);
+  if ( loaded_dems ) {
+    batch->n_dems = g_hash_table_size ( loaded_dems );
+    batch->dems = g_new0 ( VikDEM*, batch->n_dems );
+    batch->filenames = g_new0 ( gchar*, batch->n_dems+1 );
+
+    GHashTableIter iter;
+    gpointer key, value;
+    guint ii = 0;
+    g_hash_table_iter_init ( &iter, loaded_dems );
+    while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+      LoadedDEM *ldem = value;
+      ldem->ref_count++;
+      batch->dems[ii] = ldem->dem;
+      batch->filenames[ii] = g_strdup ( key );
+      ii++;
+    }
+  }
+  G_UNLOCK(loaded_dems);
+  return batch;
+}
+
+void a_dems_batch_free ( VikDemsBatch *batch )
+{
+  guint ii;
+  for ( ii = 0; ii < batch->n_dems; ii++ )
+    a_dems_unref ( batch->filenames[ii] );
+  g_strfreev ( batch->filenames );
+  g_free ( batch->dems );
+  g_free ( batch );
+}
+
+guint a_dems_batch_get_count ( VikDemsBatch *batch )
+{
+  return batch->n_dems;
+}
+
+/**
+ * a_dems_batch_find:
+ *
+ * Returns: The index of the first DEM whose area covers the coordinate, or -1 if none do.
+ *  Useful for grouping lookups that will use the same DEM data.
+ */
+gint a_dems_batch_find ( VikDemsBatch *batch, const VikCoord *coord )
+{
+  struct LatLon ll;
+  struct UTM utm;
+  gboolean have_ll = FALSE, have_utm = FALSE;
+  guint ii;
+  for ( ii = 0; ii < batch->n_dems; ii++ ) {
+    VikDEM *dem = batch->dems[ii];
+    gdouble east, north;
+    if ( dem->horiz_units == VIK_DEM_HORIZ_LL_ARCSECONDS ) {
+      if ( !have_ll ) {
+        vik_coord_to_latlon ( coord, &ll );
+        have_ll = TRUE;
+      }
+      east = ll.lon * 3600;
+      north = ll.lat * 3600;
+    } else if ( dem->horiz_units == VIK_DEM_HORIZ_UTM_METERS ) {
+      if ( !have_utm ) {
+        vik_coord_to_utm ( coord, &utm );
+        have_utm = TRUE;
+      }
+      if ( utm.zone != dem->utm_zone )
+        continue;
+      east = utm.easting;
+      north = utm.northing;
+    } else
+      continue;
+
+    if ( east >= dem->min_east && east <= dem->max_east &&
+         north >= dem->min_north && north <= dem->max_north )
+      return ii;
+  }
+  return -1;
+}
+
+/**
+ * a_dems_batch_get_elev:
+ * @index: The DEM to try first, normally from a_dems_batch_find(). Use -1 for no preference.
+ *
+ * Returns: The elevation, or VIK_DEM_INVALID_ELEVATION
+ */
+gint16 a_dems_batch_get_elev ( VikDemsBatch *batch, gint index, const VikCoord *coord )
+{
+  gint16 elev = VIK_DEM_INVALID_ELEVATION;
+  if ( index >= 0 && (guint)index < batch->n_dems ) {
+    elev = dem_get_elev ( batch->dems[index], coord, batch->method );
+    if ( elev != VIK_DEM_INVALID_ELEVATION )
+      return elev;
+  }
+  // Otherwise try any other DEM (e.g. on the edge between DEMs)
+  guint ii;
+  for ( ii = 0; ii < batch->n_dems; ii++ ) {
+    if ( (gint)ii == index )
+      continue;
+    elev = dem_get_elev ( batch->dems[ii], coord, batch->method );
+    if ( elev != VIK_DEM_INVALID_ELEVATION )
+      return elev;
+  }
+  return elev;
+}
@@ -42,6 +42,14 @@ GList *a_dems_list_copy ( GList *dems );
 gint16 a_dems_list_get_elev_by_coord ( GList *dems, const VikCoord *coord );
 gint16 a_dems_get_elev_by_coord ( const VikCoord *coord, VikDemInterpol method);
 
+typedef struct _VikDemsBatch VikDemsBatch;
+
+VikDemsBatch *a_dems_batch_new ( VikDemInterpol method );
+void a_dems_batch_free ( VikDemsBatch *batch );
+guint a_dems_batch_get_count ( VikDemsBatch *batch );
+gint a_dems_batch_find ( VikDemsBatch *batch, const VikCoord *coord );
+gint16 a_dems_batch_get_elev ( VikDemsBatch *batch, gint index, const VikCoord *coord );
+
 G_END_DECLS
 
 #endif
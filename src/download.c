@@ -46,6 +46,7 @@
 
 #include "curl_download.h"
 #include "preferences.h"
+#include "perfstats.h"
 #include "globals.h"
 #include "vik_compat.h"
 
@@ -381,7 +382,9 @@ static DownloadResult_t download( const char *hostname, const char *uri, const c
   }
 
   /* Call the backend function */
+  gint64 start = a_perf_now ();
   CURL_download_t ret = curl_download_get_url ( hostname, uri, f, options, ftp, &cdo, handle );
+  a_perf_record ( "io", "Download", start );
 
   DownloadResult_t result = DOWNLOAD_SUCCESS;
 
@@ -45,6 +45,7 @@
 #include <glib/gi18n.h>
 
 #include "file.h"
+#include "filejournal.h"
 #include "misc/strtod.h"
 
 #define TEST_BOOLEAN(str) (! ((str)[0] == '\0' || (str)[0] == '0' || (str)[0] == 'n' || (str)[0] == 'N' || (str)[0] == 'f' || (str)[0] == 'F') )
@@ -131,8 +132,15 @@ void file_write_layer_param ( FILE *f, const gchar *name, VikLayerParamType type
       }
 }
 
-static void write_layer_params_and_data ( VikLayer *l, FILE *f )
+/*
+ * @skeleton: When TRUE the data of TrackWaypoint layers is not written
+ *
+ * Returns: FALSE if the layer failed to write its data
+ */
+static gboolean write_layer_params_and_data ( VikLayer *l, FILE *f, gboolean skeleton )
 {
+  gboolean ok = TRUE;
+
   VikLayerParam *params = vik_layer_get_interface(l->type)->params;
   VikLayerFuncGetParam get_param = vik_layer_get_interface(l->type)->get_param;
 
@@ -150,21 +158,29 @@ static void write_layer_params_and_data ( VikLayer *l, FILE *f )
       file_write_layer_param(f, params[i].name, params[i].type, data);
     }
   }
-  if ( vik_layer_get_interface(l->type)->write_file_data )
+  if ( vik_layer_get_interface(l->type)->write_file_data && !(skeleton && l->type == VIK_LAYER_TRW) )
   {
     fprintf ( f, "\n\n~LayerData\n" );
-    vik_layer_get_interface(l->type)->write_file_data ( l, f );
+    ok = vik_layer_get_interface(l->type)->write_file_data ( l, f );
     fprintf ( f, "~EndLayerData\n" );
   }
   /* foreach param:
      write param, and get_value, etc.
      then run layer data, and that's it.
   */
+  return ok;
 }
 
-static void file_write ( VikAggregateLayer *top, FILE *f, gpointer vp )
+/*
+ * @skeleton: When TRUE only write the structure of the file - i.e. without the viewport position
+ *            or the tracks and waypoints. See a_file_write_skeleton()
+ *
+ * Returns: FALSE if any of the writing failed
+ */
+static gboolean file_write ( VikAggregateLayer *top, FILE *f, gpointer vp, gboolean skeleton )
 {
   Stack *stack = NULL;
+  gboolean ok = TRUE;
   VikLayer *current_layer;
   struct LatLon ll;
   VikViewportDrawMode mode;
@@ -189,9 +205,11 @@ static void file_write ( VikAggregateLayer *top, FILE *f, gpointer vp )
 
   fprintf ( f, "#VIKING GPS Data file " VIKING_URL "\n" );
   fprintf ( f, "FILE_VERSION=%d\n", VIKING_FILE_VERSION );
-  fprintf ( f, "\nxmpp=%f\nympp=%f\nlat=%f\nlon=%f\nmode=%s\ncolor=%s\nhighlightcolor=%s\ndrawscale=%s\ndrawcentermark=%s\ndrawhighlight=%s\n",
-      vik_viewport_get_xmpp ( VIK_VIEWPORT(vp) ), vik_viewport_get_ympp ( VIK_VIEWPORT(vp) ), ll.lat, ll.lon,
-      modestring, vik_viewport_get_background_color(VIK_VIEWPORT(vp)),
+  if ( !skeleton )
+    fprintf ( f, "\nxmpp=%f\nympp=%f\nlat=%f\nlon=%f\nmode=%s\n",
+        vik_viewport_get_xmpp ( VIK_VIEWPORT(vp) ), vik_viewport_get_ympp ( VIK_VIEWPORT(vp) ), ll.lat, ll.lon, modestring );
+  fprintf ( f, "color=%s\nhighlightcolor=%s\ndrawscale=%s\ndrawcentermark=%s\ndrawhighlight=%s\n",
+      vik_viewport_get_background_color(VIK_VIEWPORT(vp)),
       vik_viewport_get_highlight_color(VIK_VIEWPORT(vp)),
       vik_viewport_get_draw_scale(VIK_VIEWPORT(vp)) ? "t" : "f",
       vik_viewport_get_draw_centermark(VIK_VIEWPORT(vp)) ? "t" : "f",
@@ -204,7 +222,8 @@ static void file_write ( VikAggregateLayer *top, FILE *f, gpointer vp )
   {
     current_layer = VIK_LAYER(((GList *)stack->data)->data);
     fprintf ( f, "\n~Layer %s\n", vik_layer_get_interface(current_layer->type)->fixed_layer_name );
-    write_layer_params_and_data ( current_layer, f );
+    if ( !write_layer_params_and_data ( current_layer, f, skeleton ) )
+      ok = FALSE;
     if ( current_layer->type == VIK_LAYER_AGGREGATE && !vik_aggregate_layer_is_empty(VIK_AGGREGATE_LAYER(current_layer)) )
     {
       push(&stack);
@@ -241,6 +260,10 @@ static void file_write ( VikAggregateLayer *top, FILE *f, gpointer vp )
   when layer->next == NULL ...
   we move on.
 */
+  // Catches any failure of the plain fprintf()s too
+  if ( ferror ( f ) )
+    ok = FALSE;
+  return ok;
 }
 
 static void string_list_delete ( gpointer key, gpointer l, gpointer user_data )
@@ -672,10 +695,23 @@ VikLoadType_t a_file_load ( VikAggregateLayer *top, VikViewport *vp, VikTrwLayer
   // Attempt loading the primary file type first - our internal .vik file:
   if ( check_magic ( f, VIK_MAGIC, VIK_MAGIC_LEN ) )
   {
+    GList *existing = g_list_copy ( (GList*)vik_aggregate_layer_get_children ( top ) );
     if ( file_read ( top, f, dirpath, vp ) )
       load_answer = LOAD_TYPE_VIK_SUCCESS;
     else
       load_answer = LOAD_TYPE_VIK_FAILURE_NON_FATAL;
+
+    // Apply any changes saved since the file was last written in full
+    if ( g_strcmp0 ( filename, "-" ) ) {
+      GList *new_layers = NULL;
+      const GList *iter;
+      for ( iter = vik_aggregate_layer_get_children ( top ); iter; iter = iter->next )
+        if ( !g_list_find ( existing, iter->data ) )
+          new_layers = g_list_append ( new_layers, iter->data );
+      a_file_journal_loaded ( top, vp, filename, new_layers, existing == NULL );
+      g_list_free ( new_layers );
+    }
+    g_list_free ( existing );
   }
   else if ( a_jpg_magic_check ( filename ) ) {
     if ( ! a_jpg_load_file ( top, filename, vp ) )
@@ -735,19 +771,11 @@ VikLoadType_t a_file_load ( VikAggregateLayer *top, VikViewport *vp, VikTrwLayer
   return load_answer;
 }
 
-gboolean a_file_save ( VikAggregateLayer *top, gpointer vp, const gchar *filename )
+/*
+ * Write the file from within its directory, so relative paths in .vik files work
+ */
+static gboolean file_write_in_dir ( VikAggregateLayer *top, FILE *f, gpointer vp, const gchar *filename, gboolean skeleton )
 {
-  FILE *f;
-
-  if (strncmp(filename, "file://", 7) == 0)
-    filename = filename + 7;
-
-  f = g_fopen(filename, "w");
-
-  if ( ! f )
-    return FALSE;
-
-  // Enable relative paths in .vik files to work
   gchar *cwd = g_get_current_dir();
   gchar *dir = g_path_get_dirname ( filename );
   if ( dir ) {
@@ -757,7 +785,7 @@ gboolean a_file_save ( VikAggregateLayer *top, gpointer vp, const gchar *filenam
     g_free (dir);
   }
 
-  file_write ( top, f, vp );
+  gboolean ok = file_write ( top, f, vp, skeleton );
 
   // Restore previous working directory
   if ( cwd ) {
@@ -766,13 +794,68 @@ gboolean a_file_save ( VikAggregateLayer *top, gpointer vp, const gchar *filenam
     }
     g_free (cwd);
   }
+  return ok;
+}
 
-  fclose(f);
+gboolean a_file_save ( VikAggregateLayer *top, gpointer vp, const gchar *filename )
+{
+  FILE *f;
+
+  if (strncmp(filename, "file://", 7) == 0)
+    filename = filename + 7;
+
+  // Only the changes need saving?
+  if ( a_file_journal_save ( top, VIK_VIEWPORT(vp), filename ) )
+    return TRUE;
+
+  f = g_fopen(filename, "w");
+
+  if ( ! f )
+    return FALSE;
+
+  gboolean ok = file_write_in_dir ( top, f, vp, filename, FALSE );
+
+  // Buffered data may only fail to be written on closing
+  if ( fclose(f) != 0 )
+    ok = FALSE;
   f = NULL;
 
+  if ( !ok ) {
+    g_warning ( "%s: failed to write %s", __FUNCTION__, filename );
+    return FALSE;
+  }
+
+  a_file_journal_saved ( top, VIK_VIEWPORT(vp), filename );
+
   return TRUE;
 }
 
+/**
+ * a_file_write_skeleton:
+ *
+ * Returns: The text of the .vik file for @top without any of the tracks and waypoints,
+ *          nor the viewport position. Free with g_free().
+ */
+gchar *a_file_write_skeleton ( VikAggregateLayer *top, VikViewport *vp, const gchar *filename )
+{
+  FILE *f = tmpfile ();
+  if ( !f )
+    return NULL;
+
+  if ( !file_write_in_dir ( top, f, vp, filename, TRUE ) ) {
+    fclose ( f );
+    return NULL;
+  }
+
+  GString *str = g_string_new ( NULL );
+  gchar buffer[4096];
+  size_t len;
+  rewind ( f );
+  while ( (len = fread ( buffer, 1, sizeof(buffer), f )) > 0 )
+    g_string_append_len ( str, buffer, len );
+  fclose ( f );
+  return g_string_free ( str, FALSE );
+}
 
 /* example: 
      gboolean is_gpx = a_file_check_ext ( "a/b/c.gpx", ".gpx" );
@@ -816,7 +899,7 @@ gboolean a_file_export ( VikTrwLayer *vtl, const gchar *filename, VikFileType_t
         case FILE_TYPE_GPX:
           // trk defined so can set the option
           options.is_route = trk->is_route;
-          a_gpx_write_track_file ( trk, f, &options );
+          result = a_gpx_write_track_file ( trk, f, &options );
           break;
         default:
           g_critical("Houston, we've had a problem. file_type=%d", file_type);
@@ -827,10 +910,10 @@ gboolean a_file_export ( VikTrwLayer *vtl, const gchar *filename, VikFileType_t
           a_gpsmapper_write_file ( vtl, f );
           break;
         case FILE_TYPE_GPX:
-          a_gpx_write_file ( vtl, f, &options );
+          result = a_gpx_write_file ( vtl, f, &options );
           break;
         case FILE_TYPE_GPSPOINT:
-          a_gpspoint_write_file ( vtl, f );
+          result = a_gpspoint_write_file ( vtl, f );
           break;
         case FILE_TYPE_GEOJSON:
           result = a_geojson_write_file ( vtl, f );
@@ -854,7 +937,9 @@ gboolean a_file_export ( VikTrwLayer *vtl, const gchar *filename, VikFileType_t
           g_critical("Houston, we've had a problem. file_type=%d", file_type);
       }
     }
-    fclose ( f );
+    // Buffered data may only fail to be written on closing
+    if ( fclose ( f ) != 0 )
+      result = FALSE;
     return result;
   }
   return FALSE;
@@ -60,6 +60,7 @@ gchar *append_file_ext ( const gchar *filename, VikFileType_t type );
 
 VikLoadType_t a_file_load ( VikAggregateLayer *top, VikViewport *vp, VikTrwLayer *vtl, const gchar *filename );
 gboolean a_file_save ( VikAggregateLayer *top, gpointer vp, const gchar *filename );
+gchar *a_file_write_skeleton ( VikAggregateLayer *top, VikViewport *vp, const gchar *filename );
 /* Only need to define VikTrack if the file type is FILE_TYPE_GPX_TRACK */
 gboolean a_file_export ( VikTrwLayer *vtl, const gchar *filename, VikFileType_t file_type, VikTrack *trk, gboolean write_hidden );
 gboolean a_file_export_babel ( VikTrwLayer *vtl, const gchar *filename, const gchar *format,
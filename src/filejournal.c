@@ -0,0 +1,870 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 2; tab-width: 2 -*- */
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2026, The Viking developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Journaled saving of .vik files.
+ *
+ * When enabled, a save records only the waypoints, tracks and routes that have
+ *  changed since the last save, by appending their marshalled form to a side
+ *  file ('<file>.journal'). The .vik file itself is only rewritten when
+ *  anything else has changed (e.g. layers added or layer properties edited),
+ *  on 'Save As' or once the journal has grown too large relative to the file.
+ *
+ * Items are identified by their layer (the position of the TrackWaypoint layer
+ *  in the order the file is written) and an id. At a full save the ids are
+ *  simply the order the items are written in the layer's data, which is also
+ *  the order they are created in when the file is read back.
+ *
+ * Changes are found by comparing a hash of every item against that recorded
+ *  at the previous save, which is much quicker than formatting it all again.
+ *
+ * Each save is terminated by a commit record, so an incompletely written save
+ *  is ignored when the journal is replayed on load.
+ * The journal also records the size and a fingerprint of the .vik file it
+ *  applies to, so a journal left next to a file written by something else
+ *  is not applied to it.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <glib/gstdio.h>
+
+#include "viking.h"
+#include "filejournal.h"
+#include "file.h"
+#include "settings.h"
+
+#define JOURNAL_MAGIC "VIKJNL01"
+#define JOURNAL_EXTENSION ".journal"
+#define JOURNAL_DATA_KEY "viking-file-journal"
+
+// The journal is compacted into the file once it exceeds this percentage of the file size
+#define VIK_SETTINGS_FILE_JOURNAL_COMPACT_PERCENT "file_journal_compact_percent"
+#define JOURNAL_COMPACT_PERCENT 25
+// Always allow the journal to grow to at least this size
+#define JOURNAL_COMPACT_MIN_SIZE (1024*1024)
+
+// Amount of the start and of the end of the .vik file used for its fingerprint
+#define FINGERPRINT_SPAN (64*1024)
+
+typedef enum {
+  JOURNAL_WAYPOINT,
+  JOURNAL_TRACK,
+  JOURNAL_ROUTE,
+  JOURNAL_KINDS,
+} JournalKind;
+
+typedef enum {
+  JOURNAL_OP_PUT = 1, // Add or replace an item
+  JOURNAL_OP_DELETE,
+  JOURNAL_OP_VIEW,    // The viewport position
+  JOURNAL_OP_COMMIT,  // End of a save
+} JournalOp;
+
+typedef struct {
+  gchar magic[8];
+  // Marshalled items are raw structures, so only usable by a build with the same layout
+  guint32 sizeof_track;
+  guint32 sizeof_trackpoint;
+  guint32 sizeof_waypoint;
+  guint32 reserved;
+  guint64 base_size;
+  guint64 base_fingerprint;
+} JournalHeader;
+
+typedef struct {
+  guint8 op;
+  guint8 kind;
+  guint16 reserved;
+  guint32 layer;
+  guint32 id;
+  guint32 len;
+  guint32 check;
+} JournalRecord;
+
+typedef struct {
+  gdouble xmpp;
+  gdouble ympp;
+  gdouble lat;
+  gdouble lon;
+  gint32 mode;
+  gint32 reserved;
+} JournalView;
+
+typedef struct {
+  guint32 id;
+  guint64 hash;
+} JournalItem;
+
+typedef struct {
+  GHashTable *items[JOURNAL_KINDS]; // Item pointer -> JournalItem
+  guint32 next_id[JOURNAL_KINDS];
+} JournalLayer;
+
+typedef struct {
+  gchar *filename;
+  gchar *skeleton;
+  guint64 base_size;
+  guint64 base_fingerprint;
+  GPtrArray *layers; // JournalLayer for each TrackWaypoint layer, in file order
+} FileJournal;
+
+static GHashTable *get_items ( VikTrwLayer *vtl, JournalKind kind )
+{
+  switch ( kind ) {
+  case JOURNAL_WAYPOINT: return vik_trw_layer_get_waypoints ( vtl );
+  case JOURNAL_TRACK: return vik_trw_layer_get_tracks ( vtl );
+  default: return vik_trw_layer_get_routes ( vtl );
+  }
+}
+
+/*
+ * Items without a name are not written to the file, so are ignored here too
+ */
+static gboolean item_has_name ( gpointer item, JournalKind kind )
+{
+  if ( kind == JOURNAL_WAYPOINT )
+    return VIK_WAYPOINT(item)->name != NULL;
+  return VIK_TRACK(item)->name != NULL;
+}
+
+/**
+ * Find the TrackWaypoint layers in the same order as file_write() writes them
+ */
+static void collect_trw_layers ( const GList *layers, GPtrArray *trw_layers )
+{
+  const GList *iter;
+  for ( iter = layers; iter; iter = iter->next ) {
+    VikLayer *vl = VIK_LAYER(iter->data);
+    if ( vl->type == VIK_LAYER_TRW )
+      g_ptr_array_add ( trw_layers, vl );
+    else if ( vl->type == VIK_LAYER_AGGREGATE )
+      collect_trw_layers ( vik_aggregate_layer_get_children ( VIK_AGGREGATE_LAYER(vl) ), trw_layers );
+    else if ( vl->type == VIK_LAYER_GPS )
+      collect_trw_layers ( vik_gps_layer_get_children ( VIK_GPS_LAYER(vl) ), trw_layers );
+  }
+}
+
+/*** Hashing ***/
+
+static inline guint64 hash_u64 ( guint64 h, guint64 value )
+{
+  h ^= value;
+  h *= G_GUINT64_CONSTANT(0x100000001b3);
+  return h ^ (h >> 29);
+}
+
+static inline guint64 hash_double ( guint64 h, gdouble value )
+{
+  guint64 bits;
+  memcpy ( &bits, &value, sizeof(bits) );
+  return hash_u64 ( h, bits );
+}
+
+static guint64 hash_string ( guint64 h, const gchar *str )
+{
+  if ( !str )
+    return hash_u64 ( h, G_GUINT64_CONSTANT(0x9e3779b97f4a7c15) );
+  const guchar *p;
+  for ( p = (const guchar*)str; *p; p++ )
+    h = (h ^ *p) * G_GUINT64_CONSTANT(0x100000001b3);
+  return hash_u64 ( h, p - (const guchar*)str );
+}
+
+static inline guint64 hash_coord ( guint64 h, const VikCoord *coord )
+{
+  h = hash_double ( h, coord->north_south );
+  h = hash_double ( h, coord->east_west );
+  return hash_u64 ( h, ((guint64)(guchar)coord->utm_zone << 24) | ((guint64)(guchar)coord->utm_letter << 16) | (guint16)coord->mode );
+}
+
+/*
+ * Hash everything that gets saved in the file
+ */
+static guint64 hash_waypoint ( const VikWaypoint *wp )
+{
+  guint64 h = G_GUINT64_CONSTANT(0xcbf29ce484222325);
+  h = hash_coord ( h, &wp->coord );
+  h = hash_u64 ( h, (wp->visible ? 1 : 0) | (wp->has_timestamp ? 2 : 0) );
+  h = hash_u64 ( h, (guint64)wp->timestamp );
+  h = hash_double ( h, wp->altitude );
+  h = hash_string ( h, wp->name );
+  h = hash_string ( h, wp->comment );
+  h = hash_string ( h, wp->description );
+  h = hash_string ( h, wp->source );
+  h = hash_string ( h, wp->type );
+  h = hash_string ( h, wp->url );
+  h = hash_string ( h, wp->image );
+  h = hash_string ( h, wp->symbol );
+  return h;
+}
+
+static guint64 hash_track ( const VikTrack *trk )
+{
+  guint64 h = G_GUINT64_CONSTANT(0xcbf29ce484222325);
+  h = hash_string ( h, trk->name );
+  h = hash_string ( h, trk->comment );
+  h = hash_string ( h, trk->description );
+  h = hash_string ( h, trk->source );
+  h = hash_string ( h, trk->type );
+  h = hash_u64 ( h, (trk->visible ? 1 : 0) | (trk->is_route ? 2 : 0) | (trk->has_color ? 4 : 0) );
+  h = hash_u64 ( h, ((guint64)trk->draw_name_mode << 8) | trk->max_number_dist_labels );
+  h = hash_u64 ( h, ((guint64)trk->color.red << 32) | ((guint64)trk->color.green << 16) | trk->color.blue );
+
+  GList *iter;
+  for ( iter = trk->trackpoints; iter; iter = iter->next ) {
+    const VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    h = hash_coord ( h, &tp->coord );
+    h = hash_u64 ( h, (tp->newsegment ? 1 : 0) | (tp->has_timestamp ? 2 : 0) | ((guint64)tp->nsats << 8) | ((guint64)(guint32)tp->fix_mode << 32) );
+    h = hash_u64 ( h, (guint64)tp->timestamp );
+    h = hash_double ( h, tp->altitude );
+    h = hash_double ( h, tp->speed );
+    h = hash_double ( h, tp->course );
+    h = hash_double ( h, tp->hdop );
+    h = hash_double ( h, tp->vdop );
+    h = hash_double ( h, tp->pdop );
+    if ( tp->name )
+      h = hash_string ( h, tp->name );
+  }
+  return hash_u64 ( h, g_list_length ( trk->trackpoints ) );
+}
+
+static guint64 hash_item ( gpointer item, JournalKind kind )
+{
+  if ( kind == JOURNAL_WAYPOINT )
+    return hash_waypoint ( VIK_WAYPOINT(item) );
+  return hash_track ( VIK_TRACK(item) );
+}
+
+static guint32 checksum ( const guint8 *data, guint len )
+{
+  guint32 h = 2166136261U;
+  guint ii;
+  for ( ii = 0; ii < len; ii++ )
+    h = (h ^ data[ii]) * 16777619U;
+  return h;
+}
+
+/**
+ * Identify the contents of the .vik file from its size and its start and end.
+ *
+ * Returns: FALSE if the file could not be read
+ */
+static gboolean file_fingerprint ( const gchar *filename, guint64 *size, guint64 *fingerprint )
+{
+  FILE *f = g_fopen ( filename, "rb" );
+  if ( !f )
+    return FALSE;
+
+  gboolean ok = FALSE;
+  guint8 *buffer = g_malloc ( FINGERPRINT_SPAN );
+  if ( fseek ( f, 0, SEEK_END ) == 0 ) {
+    long end = ftell ( f );
+    if ( end >= 0 ) {
+      guint64 h = G_GUINT64_CONSTANT(0xcbf29ce484222325);
+      h = hash_u64 ( h, (guint64)end );
+      long starts[2] = { 0, MAX ( end - FINGERPRINT_SPAN, FINGERPRINT_SPAN ) };
+      gint ii;
+      ok = TRUE;
+      for ( ii = 0; ok && ii < 2; ii++ ) {
+        if ( starts[ii] >= end )
+          break;
+        size_t want = MIN ( (long)FINGERPRINT_SPAN, end - starts[ii] );
+        ok = ( fseek ( f, starts[ii], SEEK_SET ) == 0 && fread ( buffer, 1, want, f ) == want );
+        if ( ok )
+          h = hash_u64 ( h, checksum ( buffer, want ) );
+      }
+      *size = (guint64)end;
+      *fingerprint = h;
+    }
+  }
+  g_free ( buffer );
+  fclose ( f );
+  return ok;
+}
+
+/*** State ***/
+
+static JournalLayer *journal_layer_new ( void )
+{
+  JournalLayer *jl = g_malloc0 ( sizeof(JournalLayer) );
+  gint kind;
+  for ( kind = 0; kind < JOURNAL_KINDS; kind++ )
+    jl->items[kind] = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, g_free );
+  return jl;
+}
+
+static void journal_layer_free ( JournalLayer *jl )
+{
+  gint kind;
+  for ( kind = 0; kind < JOURNAL_KINDS; kind++ )
+    g_hash_table_destroy ( jl->items[kind] );
+  g_free ( jl );
+}
+
+static void journal_layer_add ( JournalLayer *jl, JournalKind kind, gpointer item, guint32 id, guint64 hash )
+{
+  JournalItem *ji = g_malloc ( sizeof(JournalItem) );
+  ji->id = id;
+  ji->hash = hash;
+  g_hash_table_insert ( jl->items[kind], item, ji );
+  if ( id >= jl->next_id[kind] )
+    jl->next_id[kind] = id + 1;
+}
+
+static void file_journal_free ( FileJournal *fj )
+{
+  g_free ( fj->filename );
+  g_free ( fj->skeleton );
+  g_ptr_array_free ( fj->layers, TRUE );
+  g_free ( fj );
+}
+
+static FileJournal *file_journal_new ( const gchar *filename )
+{
+  FileJournal *fj = g_malloc0 ( sizeof(FileJournal) );
+  fj->filename = g_strdup ( filename );
+  fj->layers = g_ptr_array_new_with_free_func ( (GDestroyNotify)journal_layer_free );
+  return fj;
+}
+
+static gchar *journal_filename ( const gchar *filename )
+{
+  return g_strconcat ( filename, JOURNAL_EXTENSION, NULL );
+}
+
+static gboolean journal_write_header ( FileJournal *fj )
+{
+  JournalHeader header;
+  memset ( &header, 0, sizeof(header) );
+  memcpy ( header.magic, JOURNAL_MAGIC, sizeof(header.magic) );
+  header.sizeof_track = sizeof(VikTrack);
+  header.sizeof_trackpoint = sizeof(VikTrackpoint);
+  header.sizeof_waypoint = sizeof(VikWaypoint);
+  header.base_size = fj->base_size;
+  header.base_fingerprint = fj->base_fingerprint;
+
+  gchar *jname = journal_filename ( fj->filename );
+  gboolean ok = FALSE;
+  FILE *f = g_fopen ( jname, "wb" );
+  if ( f ) {
+    ok = ( fwrite ( &header, sizeof(header), 1, f ) == 1 );
+    ok = ( fclose ( f ) == 0 ) && ok;
+  }
+  if ( !ok ) {
+    g_warning ( "%s: could not write %s", __FUNCTION__, jname );
+    (void)g_remove ( jname );
+  }
+  g_free ( jname );
+  return ok;
+}
+
+/*
+ * Attach the journal state to the top layer and the file it was saved in
+ *  (or detach when @fj is NULL)
+ */
+static void journal_attach ( VikAggregateLayer *top, FileJournal *fj )
+{
+  g_object_set_data_full ( G_OBJECT(top), JOURNAL_DATA_KEY, fj, (GDestroyNotify)file_journal_free );
+}
+
+static gboolean journal_enabled ( void )
+{
+  return a_vik_get_journaled_save ();
+}
+
+/*** Writing ***/
+
+static void append_record ( GByteArray *b, JournalOp op, JournalKind kind, guint32 layer, guint32 id, const guint8 *data, guint len )
+{
+  JournalRecord record;
+  memset ( &record, 0, sizeof(record) );
+  record.op = op;
+  record.kind = kind;
+  record.layer = layer;
+  record.id = id;
+  record.len = len;
+  record.check = checksum ( data, len );
+  g_byte_array_append ( b, (guint8*)&record, sizeof(record) );
+  if ( len )
+    g_byte_array_append ( b, data, len );
+}
+
+static void append_put ( GByteArray *b, JournalKind kind, guint32 layer, guint32 id, gpointer item )
+{
+  guint8 *data = NULL;
+  guint len = 0;
+  if ( kind == JOURNAL_WAYPOINT )
+    vik_waypoint_marshall ( VIK_WAYPOINT(item), &data, &len );
+  else
+    vik_track_marshall ( VIK_TRACK(item), &data, &len );
+  append_record ( b, JOURNAL_OP_PUT, kind, layer, id, data, len );
+  g_free ( data );
+}
+
+static void append_view ( GByteArray *b, VikViewport *vp )
+{
+  JournalView view;
+  struct LatLon ll;
+  memset ( &view, 0, sizeof(view) );
+  vik_coord_to_latlon ( vik_viewport_get_center ( vp ), &ll );
+  view.xmpp = vik_viewport_get_xmpp ( vp );
+  view.ympp = vik_viewport_get_ympp ( vp );
+  view.lat = ll.lat;
+  view.lon = ll.lon;
+  view.mode = vik_viewport_get_drawmode ( vp );
+  append_record ( b, JOURNAL_OP_VIEW, 0, 0, 0, (guint8*)&view, sizeof(view) );
+}
+
+/**
+ * a_file_journal_save:
+ * @filename: The .vik file being saved
+ *
+ * Try to save the changes since the last save by appending them to the journal.
+ *
+ * Returns: TRUE if the changes have been saved.
+ *          Otherwise the whole file must be written.
+ */
+gboolean a_file_journal_save ( VikAggregateLayer *top, VikViewport *vp, const gchar *filename )
+{
+  if ( !journal_enabled () )
+    return FALSE;
+
+  FileJournal *fj = g_object_get_data ( G_OBJECT(top), JOURNAL_DATA_KEY );
+  if ( !fj || g_strcmp0 ( fj->filename, filename ) )
+    return FALSE;
+
+  // Anything else changed?
+  gchar *skeleton = a_file_write_skeleton ( top, vp, filename );
+  gboolean same = !g_strcmp0 ( skeleton, fj->skeleton );
+  g_free ( skeleton );
+  if ( !same )
+    return FALSE;
+
+  // Check nothing else has written the file in the meantime
+  guint64 base_size, base_fingerprint;
+  if ( !file_fingerprint ( filename, &base_size, &base_fingerprint ) ||
+       base_size != fj->base_size || base_fingerprint != fj->base_fingerprint )
+    return FALSE;
+
+  gchar *jname = journal_filename ( filename );
+  GStatBuf stat_buf;
+  if ( g_stat ( jname, &stat_buf ) != 0 ) {
+    g_free ( jname );
+    return FALSE;
+  }
+
+  GPtrArray *trw_layers = g_ptr_array_new ();
+  collect_trw_layers ( vik_aggregate_layer_get_children ( top ), trw_layers );
+  if ( trw_layers->len != fj->layers->len ) {
+    g_ptr_array_free ( trw_layers, TRUE );
+    g_free ( jname );
+    return FALSE;
+  }
+
+  GByteArray *b = g_byte_array_new ();
+  GPtrArray *new_layers = g_ptr_array_new_with_free_func ( (GDestroyNotify)journal_layer_free );
+  guint ii;
+  for ( ii = 0; ii < trw_layers->len; ii++ ) {
+    VikTrwLayer *vtl = VIK_TRW_LAYER(g_ptr_array_index ( trw_layers, ii ));
+    JournalLayer *jl = g_ptr_array_index ( fj->layers, ii );
+    JournalLayer *new_jl = journal_layer_new ();
+    JournalKind kind;
+    for ( kind = 0; kind < JOURNAL_KINDS; kind++ ) {
+      new_jl->next_id[kind] = jl->next_id[kind];
+      GHashTableIter iter;
+      gpointer key, value;
+      g_hash_table_iter_init ( &iter, get_items ( vtl, kind ) );
+      while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+        if ( !item_has_name ( value, kind ) )
+          continue;
+        guint64 hash = hash_item ( value, kind );
+        JournalItem *ji = g_hash_table_lookup ( jl->items[kind], value );
+        guint32 id = ji ? ji->id : new_jl->next_id[kind];
+        if ( !ji || ji->hash != hash )
+          append_put ( b, kind, ii, id, value );
+        journal_layer_add ( new_jl, kind, value, id, hash );
+      }
+      // Anything no longer present has been deleted
+      g_hash_table_iter_init ( &iter, jl->items[kind] );
+      while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+        if ( !g_hash_table_lookup ( new_jl->items[kind], key ) )
+          append_record ( b, JOURNAL_OP_DELETE, kind, ii, ((JournalItem*)value)->id, NULL, 0 );
+      }
+    }
+    g_ptr_array_add ( new_layers, new_jl );
+  }
+  g_ptr_array_free ( trw_layers, TRUE );
+
+  append_view ( b, vp );
+  append_record ( b, JOURNAL_OP_COMMIT, 0, 0, 0, NULL, 0 );
+
+  // Time to compact the journal into the file?
+  gint percent = JOURNAL_COMPACT_PERCENT;
+  gint tmp;
+  if ( a_settings_get_integer ( VIK_SETTINGS_FILE_JOURNAL_COMPACT_PERCENT, &tmp ) )
+    percent = tmp;
+  guint64 limit = MAX ( fj->base_size * percent / 100, JOURNAL_COMPACT_MIN_SIZE );
+  gboolean ok = ( (guint64)stat_buf.st_size + b->len <= limit );
+
+  if ( ok ) {
+    FILE *f = g_fopen ( jname, "ab" );
+    ok = ( f != NULL );
+    if ( f ) {
+      ok = ( fwrite ( b->data, 1, b->len, f ) == b->len );
+      ok = ( fclose ( f ) == 0 ) && ok;
+    }
+    if ( !ok )
+      g_warning ( "%s: could not append to %s", __FUNCTION__, jname );
+  }
+
+  if ( ok ) {
+    g_debug ( "%s: journaled %d bytes", __FUNCTION__, b->len );
+    g_ptr_array_free ( fj->layers, TRUE );
+    fj->layers = new_layers;
+  }
+  else
+    g_ptr_array_free ( new_layers, TRUE );
+
+  g_byte_array_free ( b, TRUE );
+  g_free ( jname );
+  return ok;
+}
+
+/**
+ * a_file_journal_saved:
+ * @filename: The .vik file that has just been completely written
+ *
+ * Start a new journal for the file (or remove any old journal when journaling is not in use).
+ */
+void a_file_journal_saved ( VikAggregateLayer *top, VikViewport *vp, const gchar *filename )
+{
+  if ( !journal_enabled () ) {
+    journal_attach ( top, NULL );
+    gchar *jname = journal_filename ( filename );
+    if ( g_file_test ( jname, G_FILE_TEST_EXISTS ) )
+      (void)g_remove ( jname );
+    g_free ( jname );
+    return;
+  }
+
+  FileJournal *fj = file_journal_new ( filename );
+  if ( !file_fingerprint ( filename, &fj->base_size, &fj->base_fingerprint ) ) {
+    file_journal_free ( fj );
+    journal_attach ( top, NULL );
+    return;
+  }
+  fj->skeleton = a_file_write_skeleton ( top, vp, filename );
+
+  // Ids are the order the items have just been written in
+  GPtrArray *trw_layers = g_ptr_array_new ();
+  collect_trw_layers ( vik_aggregate_layer_get_children ( top ), trw_layers );
+  guint ii;
+  for ( ii = 0; ii < trw_layers->len; ii++ ) {
+    VikTrwLayer *vtl = VIK_TRW_LAYER(g_ptr_array_index ( trw_layers, ii ));
+    JournalLayer *jl = journal_layer_new ();
+    JournalKind kind;
+    for ( kind = 0; kind < JOURNAL_KINDS; kind++ ) {
+      GHashTableIter iter;
+      gpointer key, value;
+      g_hash_table_iter_init ( &iter, get_items ( vtl, kind ) );
+      while ( g_hash_table_iter_next ( &iter, &key, &value ) )
+        if ( item_has_name ( value, kind ) )
+          journal_layer_add ( jl, kind, value, jl->next_id[kind], hash_item ( value, kind ) );
+    }
+    g_ptr_array_add ( fj->layers, jl );
+  }
+  g_ptr_array_free ( trw_layers, TRUE );
+
+  if ( journal_write_header ( fj ) )
+    journal_attach ( top, fj );
+  else {
+    file_journal_free ( fj );
+    journal_attach ( top, NULL );
+  }
+}
+
+/*** Reading ***/
+
+static gint compare_uint_keys ( gconstpointer a, gconstpointer b )
+{
+  guint ua = GPOINTER_TO_UINT(*(gpointer*)a);
+  guint ub = GPOINTER_TO_UINT(*(gpointer*)b);
+  return ua < ub ? -1 : ( ua > ub ? 1 : 0 );
+}
+
+/*
+ * Map the ids onto the items of a freshly loaded layer
+ * The keys of the layer's items increase as they are read, so sorting by key gives the file order
+ */
+static GHashTable *loaded_ids ( VikTrwLayer *vtl, JournalKind kind )
+{
+  GHashTable *items = get_items ( vtl, kind );
+  GHashTable *ids = g_hash_table_new ( g_direct_hash, g_direct_equal );
+  GPtrArray *keys = g_ptr_array_sized_new ( g_hash_table_size ( items ) );
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, items );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) )
+    g_ptr_array_add ( keys, key );
+  g_ptr_array_sort ( keys, compare_uint_keys );
+
+  guint ii;
+  guint32 id = 0;
+  for ( ii = 0; ii < keys->len; ii++ ) {
+    gpointer item = g_hash_table_lookup ( items, g_ptr_array_index ( keys, ii ) );
+    if ( item_has_name ( item, kind ) )
+      g_hash_table_insert ( ids, GUINT_TO_POINTER(id++), item );
+  }
+  g_ptr_array_free ( keys, TRUE );
+  return ids;
+}
+
+static void replay_delete ( VikTrwLayer *vtl, JournalKind kind, GHashTable *ids, guint32 id )
+{
+  gpointer item = g_hash_table_lookup ( ids, GUINT_TO_POINTER(id) );
+  if ( !item )
+    return;
+  switch ( kind ) {
+  case JOURNAL_WAYPOINT: vik_trw_layer_delete_waypoint ( vtl, VIK_WAYPOINT(item) ); break;
+  case JOURNAL_TRACK: vik_trw_layer_delete_track ( vtl, VIK_TRACK(item) ); break;
+  default: vik_trw_layer_delete_route ( vtl, VIK_TRACK(item) ); break;
+  }
+  g_hash_table_remove ( ids, GUINT_TO_POINTER(id) );
+}
+
+static void replay_put ( VikTrwLayer *vtl, JournalKind kind, GHashTable *ids, guint32 id, guint8 *data, guint len )
+{
+  replay_delete ( vtl, kind, ids, id );
+
+  gpointer item;
+  gchar *name;
+  if ( kind == JOURNAL_WAYPOINT ) {
+    VikWaypoint *wp = vik_waypoint_unmarshall ( data, len );
+    // The symbol image is only a reference from the process that wrote the journal
+    gchar *symbol = wp->symbol;
+    wp->symbol = NULL;
+    wp->symbol_pixbuf = NULL;
+    vik_waypoint_set_symbol ( wp, symbol );
+    g_free ( symbol );
+    vik_coord_convert ( &(wp->coord), vik_trw_layer_get_coord_mode ( vtl ) );
+    name = g_strdup ( wp->name );
+    vik_trw_layer_add_waypoint ( vtl, name, wp );
+    item = wp;
+  }
+  else {
+    VikTrack *trk = vik_track_unmarshall ( data, len );
+    trk->is_route = ( kind == JOURNAL_ROUTE );
+    vik_track_convert ( trk, vik_trw_layer_get_coord_mode ( vtl ) );
+    name = g_strdup ( trk->name );
+    if ( trk->is_route )
+      vik_trw_layer_add_route ( vtl, name, trk );
+    else
+      vik_trw_layer_add_track ( vtl, name, trk );
+    item = trk;
+  }
+  g_free ( name );
+  g_hash_table_insert ( ids, GUINT_TO_POINTER(id), item );
+}
+
+static void replay_view ( VikViewport *vp, const JournalView *view )
+{
+  struct LatLon ll = { view->lat, view->lon };
+  vik_viewport_set_drawmode ( vp, view->mode );
+  vik_viewport_set_xmpp ( vp, view->xmpp );
+  vik_viewport_set_ympp ( vp, view->ympp );
+  vik_viewport_set_center_latlon ( vp, &ll, TRUE );
+}
+
+/**
+ * Check the journal is for this build and for the current contents of the file
+ */
+static gboolean journal_header_valid ( const gchar *contents, gsize length, const gchar *filename )
+{
+  JournalHeader header;
+  if ( length < sizeof(header) )
+    return FALSE;
+  memcpy ( &header, contents, sizeof(header) );
+  if ( memcmp ( header.magic, JOURNAL_MAGIC, sizeof(header.magic) ) != 0 ||
+       header.sizeof_track != sizeof(VikTrack) ||
+       header.sizeof_trackpoint != sizeof(VikTrackpoint) ||
+       header.sizeof_waypoint != sizeof(VikWaypoint) )
+    return FALSE;
+
+  guint64 base_size, base_fingerprint;
+  return file_fingerprint ( filename, &base_size, &base_fingerprint ) &&
+         base_size == header.base_size && base_fingerprint == header.base_fingerprint;
+}
+
+/**
+ * Apply every committed save in the journal
+ *
+ * Returns: The number of saves applied
+ */
+static guint journal_replay ( const gchar *contents, gsize length, GPtrArray *trw_layers, GHashTable ***ids, VikViewport *vp )
+{
+  guint commits = 0;
+  gsize pos = sizeof(JournalHeader);
+  gsize start = pos;
+  gboolean *touched = g_new0 ( gboolean, trw_layers->len );
+
+  // First find the extent of the committed records, then apply them
+  while ( pos + sizeof(JournalRecord) <= length ) {
+    JournalRecord record;
+    memcpy ( &record, contents + pos, sizeof(record) );
+    gsize next = pos + sizeof(record) + record.len;
+    if ( next > length || record.len > length ||
+         checksum ( (const guint8*)contents + pos + sizeof(record), record.len ) != record.check )
+      break;
+
+    if ( record.op == JOURNAL_OP_COMMIT ) {
+      gsize rpos = start;
+      while ( rpos < pos ) {
+        memcpy ( &record, contents + rpos, sizeof(record) );
+        guint8 *data = (guint8*)contents + rpos + sizeof(record);
+        if ( record.op == JOURNAL_OP_VIEW ) {
+          if ( record.len == sizeof(JournalView) ) {
+            JournalView view;
+            memcpy ( &view, data, sizeof(view) );
+            replay_view ( vp, &view );
+          }
+        }
+        else if ( record.layer < trw_layers->len && record.kind < JOURNAL_KINDS ) {
+          VikTrwLayer *vtl = VIK_TRW_LAYER(g_ptr_array_index ( trw_layers, record.layer ));
+          GHashTable *layer_ids = ids[record.layer][record.kind];
+          if ( record.op == JOURNAL_OP_PUT ) {
+            // Ensure the marshalled data is suitably aligned
+            guint8 *copy = g_malloc ( record.len );
+            memcpy ( copy, data, record.len );
+            replay_put ( vtl, record.kind, layer_ids, record.id, copy, record.len );
+            g_free ( copy );
+          }
+          else if ( record.op == JOURNAL_OP_DELETE )
+            replay_delete ( vtl, record.kind, layer_ids, record.id );
+          touched[record.layer] = TRUE;
+        }
+        rpos += sizeof(record) + record.len;
+      }
+      commits++;
+      start = next;
+    }
+    pos = next;
+  }
+
+  guint ii;
+  for ( ii = 0; ii < trw_layers->len; ii++ )
+    if ( touched[ii] )
+      vik_layer_post_read ( VIK_LAYER(g_ptr_array_index ( trw_layers, ii )), vp, TRUE );
+  g_free ( touched );
+  return commits;
+}
+
+/**
+ * a_file_journal_loaded:
+ * @filename:   The .vik file that has just been read
+ * @new_layers: The layers read from the file
+ * @whole_file: Whether the top layer contains only what was read from the file,
+ *              and thus whether further saves can be journaled
+ *
+ * Apply any journal of changes for the file, and when journaling is in use,
+ *  prepare for subsequent saves to be journaled.
+ */
+void a_file_journal_loaded ( VikAggregateLayer *top, VikViewport *vp, const gchar *filename, GList *new_layers, gboolean whole_file )
+{
+  gchar *jname = journal_filename ( filename );
+  gboolean enabled = journal_enabled () && whole_file;
+  gchar *contents = NULL;
+  gsize length = 0;
+  if ( !g_file_get_contents ( jname, &contents, &length, NULL ) && !enabled ) {
+    g_free ( jname );
+    return;
+  }
+  g_free ( jname );
+
+  GPtrArray *trw_layers = g_ptr_array_new ();
+  collect_trw_layers ( new_layers, trw_layers );
+
+  // Every item currently has the id of its position in the file
+  GHashTable ***ids = g_new ( GHashTable**, trw_layers->len );
+  guint ii;
+  JournalKind kind;
+  gboolean realized = TRUE;
+  for ( ii = 0; ii < trw_layers->len; ii++ ) {
+    VikTrwLayer *vtl = VIK_TRW_LAYER(g_ptr_array_index ( trw_layers, ii ));
+    realized = realized && VIK_LAYER(vtl)->realized;
+    ids[ii] = g_new ( GHashTable*, JOURNAL_KINDS );
+    for ( kind = 0; kind < JOURNAL_KINDS; kind++ )
+      ids[ii][kind] = loaded_ids ( vtl, kind );
+  }
+
+  gboolean replayed = FALSE;
+  if ( contents ) {
+    if ( !journal_header_valid ( contents, length, filename ) )
+      g_warning ( "%s: ignoring journal that does not apply to %s", __FUNCTION__, filename );
+    else if ( !realized )
+      // Items can only be removed from layers in the layers panel
+      g_warning ( "%s: unable to apply journal to %s", __FUNCTION__, filename );
+    else {
+      guint commits = journal_replay ( contents, length, trw_layers, ids, vp );
+      g_debug ( "%s: applied %d journaled saves to %s", __FUNCTION__, commits, filename );
+      replayed = TRUE;
+    }
+    g_free ( contents );
+  }
+
+  if ( enabled && realized ) {
+    FileJournal *fj = file_journal_new ( filename );
+    if ( file_fingerprint ( filename, &fj->base_size, &fj->base_fingerprint ) ) {
+      fj->skeleton = a_file_write_skeleton ( top, vp, filename );
+      for ( ii = 0; ii < trw_layers->len; ii++ ) {
+        JournalLayer *jl = journal_layer_new ();
+        for ( kind = 0; kind < JOURNAL_KINDS; kind++ ) {
+          GHashTableIter iter;
+          gpointer key, value;
+          g_hash_table_iter_init ( &iter, ids[ii][kind] );
+          while ( g_hash_table_iter_next ( &iter, &key, &value ) )
+            journal_layer_add ( jl, kind, value, GPOINTER_TO_UINT(key), hash_item ( value, kind ) );
+        }
+        g_ptr_array_add ( fj->layers, jl );
+      }
+      // Continue any journal that has been applied, otherwise start a new one
+      if ( replayed || journal_write_header ( fj ) )
+        journal_attach ( top, fj );
+      else
+        file_journal_free ( fj );
+    }
+    else
+      file_journal_free ( fj );
+  }
+
+  for ( ii = 0; ii < trw_layers->len; ii++ ) {
+    for ( kind = 0; kind < JOURNAL_KINDS; kind++ )
+      g_hash_table_destroy ( ids[ii][kind] );
+    g_free ( ids[ii] );
+  }
+  g_free ( ids );
+  g_ptr_array_free ( trw_layers, TRUE );
+}
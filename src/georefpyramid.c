@@ -0,0 +1,331 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 2; tab-width: 2 -*- */
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2026, The Viking developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * A multi-resolution tiled version of a (large) image, stored on disk.
+ *
+ * Level 0 is the image itself and each further level is half the size of the
+ *  previous one, until the whole image fits in one tile. Each level is split into
+ *  TILE_SIZE square tiles, saved as separate files, so drawing only needs to read
+ *  the few tiles of the nearest level that are actually visible.
+ *
+ * The pyramid is stored in a directory named from the image's path, size and
+ *  modification time, so modified images get a new pyramid.
+ * The index file is written last, so an incomplete pyramid is never used.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "georefpyramid.h"
+#include "background.h"
+#include "mapcache.h"
+#include "map_ids.h"
+#include "ui_util.h"
+#include "vikmapslayer.h"
+
+#define TILE_SIZE 512
+#define INDEX_FILE "pyramid.ini"
+#define INDEX_GROUP "pyramid"
+
+struct _VikGeorefPyramid {
+  gchar *dir;
+  guint width, height;
+  guint tile_size;
+  guint levels;
+  gchar *extension;
+};
+
+/**
+ * Where the pyramid for the image is stored
+ *
+ * Returns: NULL if the image file can't be found
+ */
+static gchar *pyramid_dir ( const gchar *image )
+{
+  GStatBuf st;
+  if ( g_stat ( image, &st ) != 0 )
+    return NULL;
+
+  gchar *key = g_strdup_printf ( "%s|%" G_GINT64_FORMAT "|%" G_GINT64_FORMAT, image, (gint64)st.st_size, (gint64)st.st_mtime );
+  gchar *hash = g_compute_checksum_for_string ( G_CHECKSUM_MD5, key, -1 );
+  const gchar *maps_dir = maps_layer_default_dir ();
+  gchar *dir = g_build_filename ( maps_dir, "georef", hash, NULL );
+  g_free ( hash );
+  g_free ( key );
+  return dir;
+}
+
+static gchar *tile_filename ( const gchar *dir, guint level, guint tx, guint ty, const gchar *extension )
+{
+  gchar *name = g_strdup_printf ( "%d-%d-%d.%s", level, tx, ty, extension );
+  gchar *filename = g_build_filename ( dir, name, NULL );
+  g_free ( name );
+  return filename;
+}
+
+/**
+ * Size of the level, as made by successive ui_pixbuf_half_size()
+ */
+static void level_size ( guint width, guint height, guint level, guint *lw, guint *lh )
+{
+  while ( level-- ) {
+    width = MAX ( 1, (width + 1) / 2 );
+    height = MAX ( 1, (height + 1) / 2 );
+  }
+  *lw = width;
+  *lh = height;
+}
+
+static guint tiles_in_level ( guint lw, guint lh )
+{
+  return ((lw + TILE_SIZE - 1) / TILE_SIZE) * ((lh + TILE_SIZE - 1) / TILE_SIZE);
+}
+
+/**
+ * vik_georef_pyramid_build:
+ * @threaddata: When run as a background thread, for progress and cancellation (otherwise NULL)
+ *
+ * Create the pyramid for the image on disk (unless it already exists).
+ * NB Decoding the image to make the pyramid needs the whole image in memory,
+ *  but this is only needed once for each image.
+ *
+ * Returns: TRUE if the pyramid is available
+ */
+gboolean vik_georef_pyramid_build ( const gchar *image, gpointer threaddata )
+{
+  gchar *dir = pyramid_dir ( image );
+  if ( !dir )
+    return FALSE;
+
+  gchar *index = g_build_filename ( dir, INDEX_FILE, NULL );
+  gboolean ok = g_file_test ( index, G_FILE_TEST_EXISTS );
+  if ( ok )
+    goto done;
+
+  if ( g_mkdir_with_parents ( dir, 0755 ) != 0 ) {
+    g_warning ( "%s: could not create %s", __FUNCTION__, dir );
+    goto done;
+  }
+
+  GError *error = NULL;
+  GdkPixbuf *level = gdk_pixbuf_new_from_file ( image, &error );
+  if ( !level ) {
+    g_warning ( "%s: %s", __FUNCTION__, error ? error->message : image );
+    g_clear_error ( &error );
+    goto done;
+  }
+
+  guint width = gdk_pixbuf_get_width ( level );
+  guint height = gdk_pixbuf_get_height ( level );
+  // Keep any transparency, otherwise the much smaller JPEGs will do
+  const gchar *type = gdk_pixbuf_get_has_alpha ( level ) ? "png" : "jpeg";
+
+  guint levels = 1, total = 0, done_tiles = 0;
+  guint lw = width, lh = height;
+  total = tiles_in_level ( lw, lh );
+  while ( lw > TILE_SIZE || lh > TILE_SIZE ) {
+    levels++;
+    level_size ( width, height, levels - 1, &lw, &lh );
+    total += tiles_in_level ( lw, lh );
+  }
+
+  ok = TRUE;
+  guint ll;
+  for ( ll = 0; ok && ll < levels; ll++ ) {
+    lw = gdk_pixbuf_get_width ( level );
+    lh = gdk_pixbuf_get_height ( level );
+    guint tx, ty;
+    for ( ty = 0; ok && ty * TILE_SIZE < lh; ty++ ) {
+      for ( tx = 0; ok && tx * TILE_SIZE < lw; tx++ ) {
+        GdkPixbuf *tile = gdk_pixbuf_new_subpixbuf ( level, tx * TILE_SIZE, ty * TILE_SIZE,
+                                                     MIN ( TILE_SIZE, lw - tx * TILE_SIZE ), MIN ( TILE_SIZE, lh - ty * TILE_SIZE ) );
+        gchar *filename = tile_filename ( dir, ll, tx, ty, type );
+        ok = gdk_pixbuf_save ( tile, filename, type, &error, NULL );
+        if ( !ok ) {
+          g_warning ( "%s: %s", __FUNCTION__, error ? error->message : filename );
+          g_clear_error ( &error );
+        }
+        g_free ( filename );
+        g_object_unref ( tile );
+
+        done_tiles++;
+        if ( ok && threaddata && a_background_thread_progress ( threaddata, (gdouble)done_tiles / total ) != 0 )
+          ok = FALSE; // Cancelled
+      }
+    }
+    if ( ok && ll + 1 < levels ) {
+      GdkPixbuf *next = ui_pixbuf_half_size ( level );
+      g_object_unref ( level );
+      level = next;
+      ok = ( level != NULL );
+    }
+  }
+  if ( level )
+    g_object_unref ( level );
+
+  if ( ok ) {
+    GKeyFile *kf = g_key_file_new ();
+    g_key_file_set_integer ( kf, INDEX_GROUP, "width", width );
+    g_key_file_set_integer ( kf, INDEX_GROUP, "height", height );
+    g_key_file_set_integer ( kf, INDEX_GROUP, "tile_size", TILE_SIZE );
+    g_key_file_set_integer ( kf, INDEX_GROUP, "levels", levels );
+    g_key_file_set_string ( kf, INDEX_GROUP, "type", type );
+    gchar *text = g_key_file_to_data ( kf, NULL, NULL );
+    ok = g_file_set_contents ( index, text, -1, &error );
+    if ( !ok ) {
+      g_warning ( "%s: %s", __FUNCTION__, error->message );
+      g_clear_error ( &error );
+    }
+    g_free ( text );
+    g_key_file_free ( kf );
+  }
+
+ done:
+  g_free ( index );
+  g_free ( dir );
+  return ok;
+}
+
+/**
+ * vik_georef_pyramid_open:
+ *
+ * Returns: The pyramid for the image, or NULL if it has not (yet) been built
+ */
+VikGeorefPyramid *vik_georef_pyramid_open ( const gchar *image )
+{
+  gchar *dir = pyramid_dir ( image );
+  if ( !dir )
+    return NULL;
+
+  gchar *index = g_build_filename ( dir, INDEX_FILE, NULL );
+  GKeyFile *kf = g_key_file_new ();
+  VikGeorefPyramid *gp = NULL;
+  if ( g_key_file_load_from_file ( kf, index, G_KEY_FILE_NONE, NULL ) ) {
+    gp = g_malloc0 ( sizeof(VikGeorefPyramid) );
+    gp->width = g_key_file_get_integer ( kf, INDEX_GROUP, "width", NULL );
+    gp->height = g_key_file_get_integer ( kf, INDEX_GROUP, "height", NULL );
+    gp->tile_size = g_key_file_get_integer ( kf, INDEX_GROUP, "tile_size", NULL );
+    gp->levels = g_key_file_get_integer ( kf, INDEX_GROUP, "levels", NULL );
+    gp->extension = g_key_file_get_string ( kf, INDEX_GROUP, "type", NULL );
+    if ( !gp->width || !gp->height || !gp->tile_size || !gp->levels || !gp->extension ) {
+      g_warning ( "%s: invalid %s", __FUNCTION__, index );
+      g_free ( gp->extension );
+      g_free ( gp );
+      gp = NULL;
+    }
+    else
+      gp->dir = g_strdup ( dir );
+  }
+  g_key_file_free ( kf );
+  g_free ( index );
+  g_free ( dir );
+  return gp;
+}
+
+void vik_georef_pyramid_free ( VikGeorefPyramid *gp )
+{
+  if ( !gp )
+    return;
+  g_free ( gp->dir );
+  g_free ( gp->extension );
+  g_free ( gp );
+}
+
+/**
+ * Tiles are kept in the map cache, like any other tiles
+ */
+static GdkPixbuf *get_tile ( VikGeorefPyramid *gp, guint level, guint tx, guint ty )
+{
+  GdkPixbuf *tile = a_mapcache_get ( tx, ty, 0, MAP_ID_GEOREF_PYRAMID, level, 1.0, 1.0, gp->dir );
+  if ( tile )
+    return tile;
+
+  gchar *filename = tile_filename ( gp->dir, level, tx, ty, gp->extension );
+  GError *error = NULL;
+  tile = gdk_pixbuf_new_from_file ( filename, &error );
+  if ( tile )
+    a_mapcache_add ( tile, (mapcache_extra_t) { 0.0 }, tx, ty, 0, MAP_ID_GEOREF_PYRAMID, level, 1.0, 1.0, gp->dir );
+  else {
+    g_warning ( "%s: %s", __FUNCTION__, error ? error->message : filename );
+    g_clear_error ( &error );
+  }
+  g_free ( filename );
+  return tile;
+}
+
+/**
+ * vik_georef_pyramid_draw:
+ * @x, @y:           Screen position of the top left of the image
+ * @xscale, @yscale: Screen pixels per image pixel
+ * @alpha:           Opacity to draw with
+ *
+ * Draw the visible part of the image, from the tiles of the smallest level
+ *  that is no smaller than needed, resizing the tiles as they are drawn.
+ */
+void vik_georef_pyramid_draw ( VikGeorefPyramid *gp, VikViewport *vp, gint x, gint y, gdouble xscale, gdouble yscale, guint8 alpha )
+{
+  if ( xscale <= 0.0 || yscale <= 0.0 )
+    return;
+
+  guint level = 0;
+  gdouble shrink = MAX ( xscale, yscale );
+  while ( level + 1 < gp->levels && shrink <= 0.5 ) {
+    shrink *= 2.0;
+    level++;
+  }
+
+  guint lw, lh;
+  level_size ( gp->width, gp->height, level, &lw, &lh );
+  // Screen pixels per pixel of this level
+  gdouble lx = xscale * gp->width / lw;
+  gdouble ly = yscale * gp->height / lh;
+
+  // Only the tiles overlapping the viewport
+  gint vw = vik_viewport_get_width ( vp );
+  gint vh = vik_viewport_get_height ( vp );
+  gint tx_min = MAX ( 0, (gint)floor ( (-x / lx) / gp->tile_size ) );
+  gint ty_min = MAX ( 0, (gint)floor ( (-y / ly) / gp->tile_size ) );
+  gint tx_max = MIN ( (gint)((lw - 1) / gp->tile_size), (gint)floor ( ((vw - x) / lx) / gp->tile_size ) );
+  gint ty_max = MIN ( (gint)((lh - 1) / gp->tile_size), (gint)floor ( ((vh - y) / ly) / gp->tile_size ) );
+
+  gint tx, ty;
+  for ( ty = ty_min; ty <= ty_max; ty++ ) {
+    // Round both edges, so neighbouring tiles meet exactly
+    gint y0 = y + (gint)round ( ty * gp->tile_size * ly );
+    gint y1 = y + (gint)round ( MIN ( (ty + 1) * gp->tile_size, lh ) * ly );
+    for ( tx = tx_min; tx <= tx_max; tx++ ) {
+      gint x0 = x + (gint)round ( tx * gp->tile_size * lx );
+      gint x1 = x + (gint)round ( MIN ( (tx + 1) * gp->tile_size, lw ) * lx );
+      GdkPixbuf *tile = get_tile ( gp, level, tx, ty );
+      if ( tile ) {
+        vik_viewport_draw_pixbuf_scaled ( vp, tile, alpha, 0, 0, gdk_pixbuf_get_width ( tile ), gdk_pixbuf_get_height ( tile ),
+                                          x0, y0, x1 - x0, y1 - y0 );
+        g_object_unref ( tile );
+      }
+    }
+  }
+}
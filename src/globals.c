@@ -118,6 +118,8 @@ static VikLayerParam prefs_advanced[] = {
   { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_ADVANCED_NAMESPACE "create_track_tooltip", VIK_LAYER_PARAM_BOOLEAN, VIK_LAYER_GROUP_NONE, N_("Show Tooltip during Track Creation:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL, NULL, NULL, NULL, NULL },
   { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_ADVANCED_NAMESPACE "number_recent_files", VIK_LAYER_PARAM_INT, VIK_LAYER_GROUP_NONE, N_("The number of recent files:"), VIK_LAYER_WIDGET_SPINBUTTON, params_recent_files, NULL,
     N_("Only applies to new windows or on application restart. -1 means all available files."), NULL, NULL, NULL },
+  { VIK_LAYER_NUM_TYPES, VIKING_PREFERENCES_ADVANCED_NAMESPACE "journaled_save", VIK_LAYER_PARAM_BOOLEAN, VIK_LAYER_GROUP_NONE, N_("Journaled Saves:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL,
+    N_("When saving a Viking .vik file again, only write the changes to tracks and waypoints into a separate .journal file alongside it. This makes saving large files much quicker, but the .journal file must be kept with the .vik file."), NULL, NULL, NULL },
 };
 
 static gchar * params_startup_methods[] = {N_("Home Location"), N_("Last Location"), N_("Specified File"), N_("Auto Location"), NULL};
@@ -251,6 +253,9 @@ void a_vik_preferences_init ()
 
   tmp.i = 10; // Seemingly GTK's default for the number of recent files
   a_preferences_register(&prefs_advanced[3], tmp, VIKING_PREFERENCES_ADVANCED_GROUP_KEY);
+
+  tmp.b = FALSE;
+  a_preferences_register(&prefs_advanced[4], tmp, VIKING_PREFERENCES_ADVANCED_GROUP_KEY);
 }
 
 vik_degree_format_t a_vik_get_degree_format ( )
@@ -370,6 +375,11 @@ gint a_vik_get_recent_number_files ( )
   return a_preferences_get(VIKING_PREFERENCES_ADVANCED_NAMESPACE "number_recent_files")->i;
 }
 
+gboolean a_vik_get_journaled_save ( )
+{
+  return a_preferences_get(VIKING_PREFERENCES_ADVANCED_NAMESPACE "journaled_save")->b;
+}
+
 // Startup Options
 gboolean a_vik_get_restore_window_state ( )
 {
@@ -211,6 +211,8 @@ gboolean a_vik_get_check_version ( );
 
 gint a_vik_get_recent_number_files ( );
 
+gboolean a_vik_get_journaled_save ( );
+
 /* Group for global preferences */
 #define VIKING_PREFERENCES_GROUP_KEY "viking.globals"
 #define VIKING_PREFERENCES_NAMESPACE "viking.globals."
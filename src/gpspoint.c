@@ -28,6 +28,7 @@
 #endif
 
 #include "viking.h"
+#include "outbuffer.h"
 
 #include <ctype.h>
 #ifdef HAVE_STRING_H
@@ -38,13 +39,13 @@
 /* strtod */
 
 typedef struct {
-  FILE *f;
+  VikOutBuffer *ob;
   gboolean is_route;
 } TP_write_info_type;
 
-static void a_gpspoint_write_track ( const gpointer id, const VikTrack *t, FILE *f );
+static void a_gpspoint_write_track ( VikOutBuffer *ob, const VikTrack *t );
 static void a_gpspoint_write_trackpoint ( VikTrackpoint *tp, TP_write_info_type *write_info );
-static void a_gpspoint_write_waypoint ( const gpointer id, const VikWaypoint *wp, FILE *f );
+static void a_gpspoint_write_waypoint ( const gpointer id, const VikWaypoint *wp, VikOutBuffer *ob );
 
 /* outline for file gpspoint.c
 
@@ -103,29 +104,6 @@ static gdouble line_pdop = VIK_DEFAULT_DOP;
 static void gpspoint_process_tag ( const gchar *tag, guint len );
 static void gpspoint_process_key_and_value ( const gchar *key, guint key_len, const gchar *value, guint value_len );
 
-static gchar *slashdup(const gchar *str)
-{
-  size_t len = strlen(str);
-  size_t need_bs_count, i, j;
-  gchar *rv;
-  for ( i = 0, need_bs_count = 0; i < len; i++ )
-    if ( str[i] == '\\' || str[i] == '"' )
-      need_bs_count++;
-  rv = g_malloc ( (len+need_bs_count+1) * sizeof(gchar) );
-  for ( i = 0, j = 0; i < len; i++, j++ )
-  {
-    if ( str[i] == '\\' || str[i] == '"' )
-      rv[j++] = '\\';
-    rv[j] = str[i];
-    // Basic normalization of strings - replace Linefeed and Carriage returns as blanks.
-    //  although allowed in GPX Spec - Viking file format can't handle multi-line strings yet...
-    if ( str[i] == '\n' || str[i] == '\r' )
-      rv[j] = ' ';
-  }
-  rv[j] = '\0';
-  return rv;
-}
-
 static gchar *deslashndup ( const gchar *str, guint16 len )
 {
   guint16 i,j, bs_count, new_len;
@@ -177,6 +155,8 @@ gboolean a_gpspoint_read_file(VikTrwLayer *trw, FILE *f, const gchar *dirpath )
   current_track = NULL;
   gboolean have_read_something = FALSE;
 
+  vik_trw_layer_begin_bulk_insert ( trw );
+
   while (fgets(line_buffer, VIKING_LINE_SIZE, f))
   {
     gboolean inside_quote = 0;
@@ -377,6 +357,8 @@ gboolean a_gpspoint_read_file(VikTrwLayer *trw, FILE *f, const gchar *dirpath )
     line_dist_label = 0;
   }
 
+  vik_trw_layer_commit_bulk_insert ( trw );
+
   return have_read_something;
 }
 
@@ -565,55 +547,87 @@ static void gpspoint_process_key_and_value ( const gchar *key, guint key_len, co
   }
 }
 
-static void a_gpspoint_write_waypoint ( const gpointer id, const VikWaypoint *wp, FILE *f )
+/*
+ * Append ' key="value"' with any backslashes and quotes in the value escaped
+ */
+static void gpspoint_write_string ( VikOutBuffer *ob, const gchar *key, const gchar *str )
+{
+  vik_out_buffer_append_c ( ob, ' ' );
+  vik_out_buffer_append ( ob, key );
+  vik_out_buffer_append ( ob, "=\"" );
+  const gchar *run = str;
+  const gchar *p;
+  for ( p = str; *p; p++ ) {
+    if ( *p == '\\' || *p == '"' || *p == '\n' || *p == '\r' ) {
+      vik_out_buffer_append_len ( ob, run, p - run );
+      if ( *p == '\\' || *p == '"' ) {
+        vik_out_buffer_append_c ( ob, '\\' );
+        vik_out_buffer_append_c ( ob, *p );
+      }
+      else
+        // Basic normalization of strings - replace Linefeed and Carriage returns as blanks.
+        //  although allowed in GPX Spec - Viking file format can't handle multi-line strings yet...
+        vik_out_buffer_append_c ( ob, ' ' );
+      run = p + 1;
+    }
+  }
+  vik_out_buffer_append_len ( ob, run, p - run );
+  vik_out_buffer_append_c ( ob, '"' );
+}
+
+/*
+ * Append ' key="number"'
+ */
+static void gpspoint_write_double ( VikOutBuffer *ob, const gchar *key, gdouble value )
+{
+  vik_out_buffer_append_c ( ob, ' ' );
+  vik_out_buffer_append ( ob, key );
+  vik_out_buffer_append ( ob, "=\"" );
+  vik_out_buffer_append_double ( ob, value );
+  vik_out_buffer_append_c ( ob, '"' );
+}
+
+static void gpspoint_write_int ( VikOutBuffer *ob, const gchar *key, gint64 value )
+{
+  vik_out_buffer_append_c ( ob, ' ' );
+  vik_out_buffer_append ( ob, key );
+  vik_out_buffer_append ( ob, "=\"" );
+  vik_out_buffer_append_int ( ob, value );
+  vik_out_buffer_append_c ( ob, '"' );
+}
+
+static void gpspoint_write_latlon ( VikOutBuffer *ob, const VikCoord *coord )
 {
   struct LatLon ll;
-  gchar s_lat[COORDS_STR_BUFFER_SIZE];
-  gchar s_lon[COORDS_STR_BUFFER_SIZE];
+  vik_coord_to_latlon ( coord, &ll );
+  gpspoint_write_double ( ob, "latitude", ll.lat );
+  gpspoint_write_double ( ob, "longitude", ll.lon );
+}
+
+static void a_gpspoint_write_waypoint ( const gpointer id, const VikWaypoint *wp, VikOutBuffer *ob )
+{
   // Sanity clauses
   if ( !wp )
     return;
   if ( !(wp->name) )
     return;
 
-  vik_coord_to_latlon ( &(wp->coord), &ll );
-  a_coords_dtostr_buffer ( ll.lat, s_lat );
-  a_coords_dtostr_buffer ( ll.lon, s_lon );
-  gchar *tmp_name = slashdup(wp->name);
-  fprintf ( f, "type=\"waypoint\" latitude=\"%s\" longitude=\"%s\" name=\"%s\"", s_lat, s_lon, tmp_name );
-  g_free ( tmp_name );
+  vik_out_buffer_append ( ob, "type=\"waypoint\"" );
+  gpspoint_write_latlon ( ob, &(wp->coord) );
+  gpspoint_write_string ( ob, "name", wp->name );
 
-  if ( wp->altitude != VIK_DEFAULT_ALTITUDE ) {
-    gchar s_alt[COORDS_STR_BUFFER_SIZE];
-    a_coords_dtostr_buffer ( wp->altitude, s_alt );
-    fprintf ( f, " altitude=\"%s\"", s_alt );
-  }
+  if ( wp->altitude != VIK_DEFAULT_ALTITUDE )
+    gpspoint_write_double ( ob, "altitude", wp->altitude );
   if ( wp->has_timestamp )
-    fprintf ( f, " unixtime=\"%ld\"", wp->timestamp );
+    gpspoint_write_int ( ob, "unixtime", wp->timestamp );
   if ( wp->comment )
-  {
-    gchar *tmp_comment = slashdup(wp->comment);
-    fprintf ( f, " comment=\"%s\"", tmp_comment );
-    g_free ( tmp_comment );
-  }
+    gpspoint_write_string ( ob, "comment", wp->comment );
   if ( wp->description )
-  {
-    gchar *tmp_description = slashdup(wp->description);
-    fprintf ( f, " description=\"%s\"", tmp_description );
-    g_free ( tmp_description );
-  }
+    gpspoint_write_string ( ob, "description", wp->description );
   if ( wp->source )
-  {
-    gchar *tmp_source = slashdup(wp->source);
-    fprintf ( f, " source=\"%s\"", tmp_source );
-    g_free ( tmp_source );
-  }
+    gpspoint_write_string ( ob, "source", wp->source );
   if ( wp->type )
-  {
-    gchar *tmp_type = slashdup(wp->type);
-    fprintf ( f, " xtype=\"%s\"", tmp_type );
-    g_free ( tmp_type );
-  }
+    gpspoint_write_string ( ob, "xtype", wp->type );
   if ( wp->image )
   {
     gchar *tmp_image = NULL;
@@ -627,10 +641,12 @@ static void a_gpspoint_write_waypoint ( const gpointer id, const VikWaypoint *wp
     // if cwd not available - use image filename as is
     // this should be an absolute path as set in thumbnails
     if ( !cwd )
-      tmp_image = slashdup(wp->image);
-
-    if ( tmp_image )
-      fprintf ( f, " image=\"%s\"", tmp_image );
+      gpspoint_write_string ( ob, "image", wp->image );
+    else if ( tmp_image ) {
+      vik_out_buffer_append ( ob, " image=\"" );
+      vik_out_buffer_append ( ob, tmp_image );
+      vik_out_buffer_append_c ( ob, '"' );
+    }
 
     g_free ( cwd );
     g_free ( tmp_image );
@@ -641,81 +657,55 @@ static void a_gpspoint_write_waypoint ( const gpointer id, const VikWaypoint *wp
     // However to keep newly generated .vik files better compatible with older Viking versions
     //   The symbol names will always be lowercase
     gchar *tmp_symbol = g_utf8_strdown(wp->symbol, -1);
-    fprintf ( f, " symbol=\"%s\"", tmp_symbol );
+    vik_out_buffer_append ( ob, " symbol=\"" );
+    vik_out_buffer_append ( ob, tmp_symbol );
+    vik_out_buffer_append_c ( ob, '"' );
     g_free ( tmp_symbol );
   }
   if ( ! wp->visible )
-    fprintf ( f, " visible=\"n\"" );
-  fprintf ( f, "\n" );
+    vik_out_buffer_append ( ob, " visible=\"n\"" );
+  vik_out_buffer_append_c ( ob, '\n' );
 }
 
 static void a_gpspoint_write_trackpoint ( VikTrackpoint *tp, TP_write_info_type *write_info )
 {
-  struct LatLon ll;
-  gchar s_lat[COORDS_STR_BUFFER_SIZE];
-  gchar s_lon[COORDS_STR_BUFFER_SIZE];
-  gchar s_alt[COORDS_STR_BUFFER_SIZE];
-  vik_coord_to_latlon ( &(tp->coord), &ll );
+  VikOutBuffer *ob = write_info->ob;
 
-  FILE *f = write_info->f;
+  vik_out_buffer_append ( ob, write_info->is_route ? "type=\"routepoint\"" : "type=\"trackpoint\"" );
+  gpspoint_write_latlon ( ob, &(tp->coord) );
 
-  a_coords_dtostr_buffer ( ll.lat, s_lat );
-  a_coords_dtostr_buffer ( ll.lon, s_lon );
-  fprintf ( f, "type=\"%spoint\" latitude=\"%s\" longitude=\"%s\"", write_info->is_route ? "route" : "track", s_lat, s_lon );
-
-  if ( tp->name ) {
-    gchar *name = slashdup(tp->name);
-    fprintf ( f, " name=\"%s\"", name );
-    g_free(name);
-  }
+  if ( tp->name )
+    gpspoint_write_string ( ob, "name", tp->name );
 
-  if ( tp->altitude != VIK_DEFAULT_ALTITUDE ) {
-    a_coords_dtostr_buffer ( tp->altitude, s_alt );
-    fprintf ( f, " altitude=\"%s\"", s_alt );
-  }
+  if ( tp->altitude != VIK_DEFAULT_ALTITUDE )
+    gpspoint_write_double ( ob, "altitude", tp->altitude );
   if ( tp->has_timestamp )
-    fprintf ( f, " unixtime=\"%ld\"", tp->timestamp );
+    gpspoint_write_int ( ob, "unixtime", tp->timestamp );
   if ( tp->newsegment )
-    fprintf ( f, " newsegment=\"yes\"" );
+    vik_out_buffer_append ( ob, " newsegment=\"yes\"" );
 
   if (!isnan(tp->speed) || !isnan(tp->course) || tp->nsats > 0) {
-    fprintf ( f, " extended=\"yes\"" );
-    if (!isnan(tp->speed)) {
-      gchar s_speed[COORDS_STR_BUFFER_SIZE];
-      a_coords_dtostr_buffer ( tp->speed, s_speed );
-      fprintf ( f, " speed=\"%s\"", s_speed );
-    }
-    if (!isnan(tp->course)) {
-      gchar s_course[COORDS_STR_BUFFER_SIZE];
-      a_coords_dtostr_buffer ( tp->course, s_course );
-      fprintf ( f, " course=\"%s\"", s_course );
-    }
+    vik_out_buffer_append ( ob, " extended=\"yes\"" );
+    if (!isnan(tp->speed))
+      gpspoint_write_double ( ob, "speed", tp->speed );
+    if (!isnan(tp->course))
+      gpspoint_write_double ( ob, "course", tp->course );
     if (tp->nsats > 0)
-      fprintf ( f, " sat=\"%d\"", tp->nsats );
+      gpspoint_write_int ( ob, "sat", tp->nsats );
     if (tp->fix_mode > 0)
-      fprintf ( f, " fix=\"%d\"", tp->fix_mode );
+      gpspoint_write_int ( ob, "fix", tp->fix_mode );
 
-    if ( tp->hdop != VIK_DEFAULT_DOP ) {
-      gchar ss[COORDS_STR_BUFFER_SIZE];
-      a_coords_dtostr_buffer ( tp->hdop, ss );
-      fprintf ( f, " hdop=\"%s\"", ss );
-    }
-    if ( tp->vdop != VIK_DEFAULT_DOP ) {
-      gchar ss[COORDS_STR_BUFFER_SIZE];
-      a_coords_dtostr_buffer ( tp->vdop, ss );
-      fprintf ( f, " vdop=\"%s\"", ss );
-    }
-    if ( tp->pdop != VIK_DEFAULT_DOP ) {
-      gchar ss[COORDS_STR_BUFFER_SIZE];
-      a_coords_dtostr_buffer ( tp->pdop, ss );
-      fprintf ( f, " pdop=\"%s\"", ss );
-    }
+    if ( tp->hdop != VIK_DEFAULT_DOP )
+      gpspoint_write_double ( ob, "hdop", tp->hdop );
+    if ( tp->vdop != VIK_DEFAULT_DOP )
+      gpspoint_write_double ( ob, "vdop", tp->vdop );
+    if ( tp->pdop != VIK_DEFAULT_DOP )
+      gpspoint_write_double ( ob, "pdop", tp->pdop );
   }
-  fprintf ( f, "\n" );
+  vik_out_buffer_append_c ( ob, '\n' );
 }
 
-
-static void a_gpspoint_write_track ( const gpointer id, const VikTrack *trk, FILE *f )
+static void a_gpspoint_write_track ( VikOutBuffer *ob, const VikTrack *trk )
 {
   // Sanity clauses
   if ( !trk )
@@ -723,63 +713,81 @@ static void a_gpspoint_write_track ( const gpointer id, const VikTrack *trk, FIL
   if ( !(trk->name) )
     return;
 
-  gchar *tmp_name = slashdup(trk->name);
-  fprintf ( f, "type=\"%s\" name=\"%s\"", trk->is_route ? "route" : "track", tmp_name );
-  g_free ( tmp_name );
+  vik_out_buffer_append ( ob, trk->is_route ? "type=\"route\"" : "type=\"track\"" );
+  gpspoint_write_string ( ob, "name", trk->name );
 
-  if ( trk->comment ) {
-    gchar *tmp = slashdup(trk->comment);
-    fprintf ( f, " comment=\"%s\"", tmp );
-    g_free ( tmp );
-  }
-
-  if ( trk->description ) {
-    gchar *tmp = slashdup(trk->description);
-    fprintf ( f, " description=\"%s\"", tmp );
-    g_free ( tmp );
-  }
-
-  if ( trk->source ) {
-    gchar *tmp = slashdup(trk->source);
-    fprintf ( f, " source=\"%s\"", tmp );
-    g_free ( tmp );
-  }
-
-  if ( trk->type ) {
-    gchar *tmp = slashdup(trk->type);
-    fprintf ( f, " xtype=\"%s\"", tmp );
-    g_free ( tmp );
-  }
+  if ( trk->comment )
+    gpspoint_write_string ( ob, "comment", trk->comment );
+  if ( trk->description )
+    gpspoint_write_string ( ob, "description", trk->description );
+  if ( trk->source )
+    gpspoint_write_string ( ob, "source", trk->source );
+  if ( trk->type )
+    gpspoint_write_string ( ob, "xtype", trk->type );
 
   if ( trk->has_color ) {
-    fprintf ( f, " color=#%.2x%.2x%.2x", (int)(trk->color.red/256),(int)(trk->color.green/256),(int)(trk->color.blue/256));
+    vik_out_buffer_append_printf ( ob, " color=#%.2x%.2x%.2x", (int)(trk->color.red/256),(int)(trk->color.green/256),(int)(trk->color.blue/256));
   }
 
   if ( trk->draw_name_mode > 0 )
-    fprintf ( f, " draw_name_mode=\"%d\"", trk->draw_name_mode );
+    gpspoint_write_int ( ob, "draw_name_mode", trk->draw_name_mode );
 
   if ( trk->max_number_dist_labels > 0 )
-    fprintf ( f, " number_dist_labels=\"%d\"", trk->max_number_dist_labels );
+    gpspoint_write_int ( ob, "number_dist_labels", trk->max_number_dist_labels );
 
   if ( ! trk->visible ) {
-    fprintf ( f, " visible=\"n\"" );
+    vik_out_buffer_append ( ob, " visible=\"n\"" );
   }
-  fprintf ( f, "\n" );
+  vik_out_buffer_append_c ( ob, '\n' );
 
-  TP_write_info_type tp_write_info = { f, trk->is_route };
+  TP_write_info_type tp_write_info = { ob, trk->is_route };
   g_list_foreach ( trk->trackpoints, (GFunc) a_gpspoint_write_trackpoint, &tp_write_info );
-  fprintf ( f, "type=\"%send\"\n", trk->is_route ? "route" : "track" );
+  vik_out_buffer_append ( ob, trk->is_route ? "type=\"routeend\"\n" : "type=\"trackend\"\n" );
+}
+
+// Below this many points the tracks are simply written one after the other
+#define GPSPOINT_PARALLEL_WRITE_MIN_POINTS 50000
+
+/*
+ * Write all the tracks of the hash table, in the table's order
+ */
+static void a_gpspoint_write_tracks ( VikOutBuffer *ob, GHashTable *tracks )
+{
+  GList *gl = NULL;
+  gulong points = 0;
+  gpointer key, value;
+  GHashTableIter ght_iter;
+  g_hash_table_iter_init ( &ght_iter, tracks );
+  while ( g_hash_table_iter_next (&ght_iter, &key, &value) ) {
+    gl = g_list_prepend ( gl, value );
+    if ( points < GPSPOINT_PARALLEL_WRITE_MIN_POINTS )
+      points += vik_track_get_tp_count ( VIK_TRACK(value) );
+  }
+  gl = g_list_reverse ( gl );
+
+  if ( points < GPSPOINT_PARALLEL_WRITE_MIN_POINTS ) {
+    GList *iter;
+    for ( iter = gl; iter; iter = iter->next )
+      a_gpspoint_write_track ( ob, VIK_TRACK(iter->data) );
+  }
+  else
+    vik_out_buffer_append_parallel ( ob, gl, (VikOutBufferWriteFunc)a_gpspoint_write_track, NULL );
+
+  g_list_free ( gl );
 }
 
-void a_gpspoint_write_file ( VikTrwLayer *trw, FILE *f )
+gboolean a_gpspoint_write_file ( VikTrwLayer *trw, FILE *f )
 {
   GHashTable *tracks = vik_trw_layer_get_tracks ( trw );
   GHashTable *routes = vik_trw_layer_get_routes ( trw );
   GHashTable *waypoints = vik_trw_layer_get_waypoints ( trw );
+  VikOutBuffer *ob = vik_out_buffer_new ( f );
+
+  vik_out_buffer_append ( ob, "type=\"waypointlist\"\n" );
+  g_hash_table_foreach ( waypoints, (GHFunc) a_gpspoint_write_waypoint, ob );
+  vik_out_buffer_append ( ob, "type=\"waypointlistend\"\n" );
+  a_gpspoint_write_tracks ( ob, tracks );
+  a_gpspoint_write_tracks ( ob, routes );
 
-  fprintf ( f, "type=\"waypointlist\"\n" );
-  g_hash_table_foreach ( waypoints, (GHFunc) a_gpspoint_write_waypoint, f );
-  fprintf ( f, "type=\"waypointlistend\"\n" );
-  g_hash_table_foreach ( tracks, (GHFunc) a_gpspoint_write_track, f );
-  g_hash_table_foreach ( routes, (GHFunc) a_gpspoint_write_track, f );
+  return vik_out_buffer_free ( ob );
 }
@@ -34,6 +34,7 @@
 
 #include "gpx.h"
 #include "viking.h"
+#include "outbuffer.h"
 #include <expat.h>
 #ifdef HAVE_STRING_H
 #include <string.h>
@@ -104,7 +105,7 @@ typedef struct tag_mapping {
 
 typedef struct {
 	GpxWritingOptions *options;
-	FILE *file;
+	VikOutBuffer *ob;
 } GpxWritingContext;
 
 /*
@@ -620,11 +621,15 @@ gboolean a_gpx_read_file( VikTrwLayer *vtl, FILE *f ) {
   unnamed_tracks = 1;
   unnamed_routes = 1;
 
+  vik_trw_layer_begin_bulk_insert ( vtl );
+
   while (!done) {
     len = fread(buf, 1, sizeof(buf)-7, f);
     done = feof(f) || !len;
     status = XML_Parse(parser, buf, len, done);
   }
+
+  vik_trw_layer_commit_bulk_insert ( vtl );
  
   XML_ParserFree (parser);
   g_string_free ( xpath, TRUE );
@@ -802,197 +807,169 @@ entitize(const char * str)
 
 /* export GPX */
 
+/*
+ * Append '<tag>entitized string</tag>\n' with the given indent
+ */
+static void gpx_write_element ( VikOutBuffer *ob, const gchar *indent, const gchar *tag, const gchar *str )
+{
+  gchar *tmp = entitize ( str );
+  vik_out_buffer_append ( ob, indent );
+  vik_out_buffer_append_c ( ob, '<' );
+  vik_out_buffer_append ( ob, tag );
+  vik_out_buffer_append_c ( ob, '>' );
+  vik_out_buffer_append ( ob, tmp );
+  vik_out_buffer_append ( ob, "</" );
+  vik_out_buffer_append ( ob, tag );
+  vik_out_buffer_append ( ob, ">\n" );
+  g_free ( tmp );
+}
+
+/*
+ * Append '<tag>number</tag>\n' with the given indent
+ */
+static void gpx_write_double ( VikOutBuffer *ob, const gchar *indent, const gchar *tag, gdouble value )
+{
+  vik_out_buffer_append ( ob, indent );
+  vik_out_buffer_append_c ( ob, '<' );
+  vik_out_buffer_append ( ob, tag );
+  vik_out_buffer_append_c ( ob, '>' );
+  vik_out_buffer_append_double ( ob, value );
+  vik_out_buffer_append ( ob, "</" );
+  vik_out_buffer_append ( ob, tag );
+  vik_out_buffer_append ( ob, ">\n" );
+}
+
+/*
+ * Append ' lat="..." lon="..."'
+ */
+static void gpx_write_latlon ( VikOutBuffer *ob, const VikCoord *coord )
+{
+  struct LatLon ll;
+  vik_coord_to_latlon ( coord, &ll );
+  vik_out_buffer_append ( ob, " lat=\"" );
+  vik_out_buffer_append_double ( ob, ll.lat );
+  vik_out_buffer_append ( ob, "\" lon=\"" );
+  vik_out_buffer_append_double ( ob, ll.lon );
+  vik_out_buffer_append_c ( ob, '"' );
+}
+
 static void gpx_write_waypoint ( VikWaypoint *wp, GpxWritingContext *context )
 {
   // Don't write invisible waypoints when specified
   if (context->options && !context->options->hidden && !wp->visible)
     return;
 
-  FILE *f = context->file;
-  struct LatLon ll;
-  gchar s_lat[COORDS_STR_BUFFER_SIZE];
-  gchar s_lon[COORDS_STR_BUFFER_SIZE];
-  gchar *tmp;
-  vik_coord_to_latlon ( &(wp->coord), &ll );
-  a_coords_dtostr_buffer ( ll.lat, s_lat );
-  a_coords_dtostr_buffer ( ll.lon, s_lon );
+  VikOutBuffer *ob = context->ob;
+  vik_out_buffer_append ( ob, "<wpt" );
+  gpx_write_latlon ( ob, &(wp->coord) );
   // NB 'hidden' is not part of any GPX standard - this appears to be a made up Viking 'extension'
   //  luckily most other GPX processing software ignores things they don't understand
-  fprintf ( f, "<wpt lat=\"%s\" lon=\"%s\"%s>\n",
-               s_lat, s_lon, wp->visible ? "" : " hidden=\"hidden\"" );
+  vik_out_buffer_append ( ob, wp->visible ? ">\n" : " hidden=\"hidden\">\n" );
 
   // Sanity clause
-  if ( wp->name )
-    tmp = entitize ( wp->name );
-  else
-    tmp = g_strdup ("waypoint");
-
-  fprintf ( f, "  <name>%s</name>\n", tmp );
-  g_free ( tmp);
+  gpx_write_element ( ob, "  ", "name", wp->name ? wp->name : "waypoint" );
 
   if ( wp->altitude != VIK_DEFAULT_ALTITUDE )
-  {
-    gchar s_alt[COORDS_STR_BUFFER_SIZE];
-    a_coords_dtostr_buffer ( wp->altitude, s_alt );
-    fprintf ( f, "  <ele>%s</ele>\n", s_alt );
-  }
+    gpx_write_double ( ob, "  ", "ele", wp->altitude );
 
-  if ( wp->has_timestamp ) {
-    GTimeVal timestamp;
-    timestamp.tv_sec = wp->timestamp;
-    timestamp.tv_usec = 0;
-
-    gchar *time_iso8601 = g_time_val_to_iso8601 ( &timestamp );
-    if ( time_iso8601 != NULL )
-      fprintf ( f, "  <time>%s</time>\n", time_iso8601 );
-    g_free ( time_iso8601 );
-  }
+  if ( wp->has_timestamp )
+    vik_out_buffer_append_iso8601 ( ob, "  <time>", wp->timestamp, "</time>\n" );
 
   if ( wp->comment )
-  {
-    tmp = entitize(wp->comment);
-    fprintf ( f, "  <cmt>%s</cmt>\n", tmp );
-    g_free ( tmp );
-  }
+    gpx_write_element ( ob, "  ", "cmt", wp->comment );
   if ( wp->description )
-  {
-    tmp = entitize(wp->description);
-    fprintf ( f, "  <desc>%s</desc>\n", tmp );
-    g_free ( tmp );
-  }
+    gpx_write_element ( ob, "  ", "desc", wp->description );
   if ( wp->source )
-  {
-    tmp = entitize(wp->source);
-    fprintf ( f, "  <src>%s</src>\n", tmp );
-    g_free ( tmp );
-  }
+    gpx_write_element ( ob, "  ", "src", wp->source );
   if ( wp->type )
-  {
-    tmp = entitize(wp->type);
-    fprintf ( f, "  <type>%s</type>\n", tmp );
-    g_free ( tmp );
-  }
+    gpx_write_element ( ob, "  ", "type", wp->type );
   if ( wp->url )
-  {
-    tmp = entitize(wp->url);
-    fprintf ( f, "  <url>%s</url>\n", tmp );
-    g_free ( tmp );
-  }
+    gpx_write_element ( ob, "  ", "url", wp->url );
   if ( wp->image )
-  {
-    tmp = entitize(wp->image);
-    fprintf ( f, "  <link>%s</link>\n", tmp );
-    g_free ( tmp );
-  }
+    gpx_write_element ( ob, "  ", "link", wp->image );
   if ( wp->symbol ) 
   {
-    tmp = entitize(wp->symbol);
+    gchar *tmp = entitize(wp->symbol);
+    vik_out_buffer_append ( ob, "  <sym>" );
     if ( a_vik_gpx_export_wpt_sym_name ( ) ) {
        // Lowercase the symbol name
        gchar *tmp2 = g_utf8_strdown ( tmp, -1 );
-       fprintf ( f, "  <sym>%s</sym>\n",  tmp2 );
+       vik_out_buffer_append ( ob, tmp2 );
        g_free ( tmp2 );
     }
     else
-      fprintf ( f, "  <sym>%s</sym>\n", tmp);
+      vik_out_buffer_append ( ob, tmp );
+    vik_out_buffer_append ( ob, "</sym>\n" );
     g_free ( tmp );
   }
 
-  fprintf ( f, "</wpt>\n" );
+  vik_out_buffer_append ( ob, "</wpt>\n" );
 }
 
-static void gpx_write_trackpoint ( VikTrackpoint *tp, GpxWritingContext *context )
+static void gpx_write_trackpoint ( VikTrackpoint *tp, GpxWritingContext *context, gboolean first )
 {
-  FILE *f = context->file;
-  struct LatLon ll;
-  gchar s_lat[COORDS_STR_BUFFER_SIZE];
-  gchar s_lon[COORDS_STR_BUFFER_SIZE];
-  gchar s_alt[COORDS_STR_BUFFER_SIZE];
-  gchar s_dop[COORDS_STR_BUFFER_SIZE];
-  gchar *time_iso8601;
-  vik_coord_to_latlon ( &(tp->coord), &ll );
+  VikOutBuffer *ob = context->ob;
+  gboolean is_route = context->options && context->options->is_route;
 
   // No such thing as a rteseg! So make sure we don't put them in
-  if ( context->options && !context->options->is_route && tp->newsegment )
-    fprintf ( f, "  </trkseg>\n  <trkseg>\n" );
+  //  and the first point is always within the <trkseg> opened by the track
+  if ( context->options && !is_route && tp->newsegment && !first )
+    vik_out_buffer_append ( ob, "  </trkseg>\n  <trkseg>\n" );
 
-  a_coords_dtostr_buffer ( ll.lat, s_lat );
-  a_coords_dtostr_buffer ( ll.lon, s_lon );
-  fprintf ( f, "  <%spt lat=\"%s\" lon=\"%s\">\n", (context->options && context->options->is_route) ? "rte" : "trk", s_lat, s_lon );
+  vik_out_buffer_append ( ob, is_route ? "  <rtept" : "  <trkpt" );
+  gpx_write_latlon ( ob, &(tp->coord) );
+  vik_out_buffer_append ( ob, ">\n" );
 
-  if (tp->name) {
-    gchar *s_name = entitize(tp->name);
-    fprintf ( f, "    <name>%s</name>\n", s_name );
-    g_free(s_name);
-  }
+  if (tp->name)
+    gpx_write_element ( ob, "    ", "name", tp->name );
 
   if ( tp->altitude != VIK_DEFAULT_ALTITUDE )
-  {
-    a_coords_dtostr_buffer ( tp->altitude, s_alt );
-    fprintf ( f, "    <ele>%s</ele>\n", s_alt );
-  }
+    gpx_write_double ( ob, "    ", "ele", tp->altitude );
   else if ( context->options != NULL && context->options->force_ele )
-  {
-    fprintf ( f, "    <ele>0</ele>\n" );
-  }
-  
-  time_iso8601 = NULL;
-  if ( tp->has_timestamp ) {
-    GTimeVal timestamp;
-    timestamp.tv_sec = tp->timestamp;
-    timestamp.tv_usec = 0;
-  
-    time_iso8601 = g_time_val_to_iso8601 ( &timestamp );
-  }
+    vik_out_buffer_append ( ob, "    <ele>0</ele>\n" );
+
+  if ( tp->has_timestamp )
+    vik_out_buffer_append_iso8601 ( ob, "    <time>", tp->timestamp, "</time>\n" );
   else if ( context->options != NULL && context->options->force_time )
   {
+    // Includes the microseconds, so left to glib
     GTimeVal current;
     g_get_current_time ( &current );
-  
-    time_iso8601 = g_time_val_to_iso8601 ( &current );
-  }
-  if ( time_iso8601 != NULL )
-    fprintf ( f, "    <time>%s</time>\n", time_iso8601 );
-  g_free(time_iso8601);
-  time_iso8601 = NULL;
-  
-  if (!isnan(tp->course)) {
-    gchar s_course[COORDS_STR_BUFFER_SIZE];
-    a_coords_dtostr_buffer ( tp->course, s_course );
-    fprintf ( f, "    <course>%s</course>\n", s_course );
-  }
-  if (!isnan(tp->speed)) {
-    gchar s_speed[COORDS_STR_BUFFER_SIZE];
-    a_coords_dtostr_buffer ( tp->speed, s_speed );
-    fprintf ( f, "    <speed>%s</speed>\n", s_speed );
+    gchar *time_iso8601 = g_time_val_to_iso8601 ( &current );
+    if ( time_iso8601 != NULL ) {
+      vik_out_buffer_append ( ob, "    <time>" );
+      vik_out_buffer_append ( ob, time_iso8601 );
+      vik_out_buffer_append ( ob, "</time>\n" );
+    }
+    g_free ( time_iso8601 );
   }
+
+  if (!isnan(tp->course))
+    gpx_write_double ( ob, "    ", "course", tp->course );
+  if (!isnan(tp->speed))
+    gpx_write_double ( ob, "    ", "speed", tp->speed );
   if (tp->fix_mode == VIK_GPS_MODE_2D)
-    fprintf ( f, "    <fix>2d</fix>\n");
+    vik_out_buffer_append ( ob, "    <fix>2d</fix>\n" );
   if (tp->fix_mode == VIK_GPS_MODE_3D)
-    fprintf ( f, "    <fix>3d</fix>\n");
+    vik_out_buffer_append ( ob, "    <fix>3d</fix>\n" );
   if (tp->fix_mode == VIK_GPS_MODE_DGPS)
-    fprintf ( f, "    <fix>dgps</fix>\n");
+    vik_out_buffer_append ( ob, "    <fix>dgps</fix>\n" );
   if (tp->fix_mode == VIK_GPS_MODE_PPS)
-    fprintf ( f, "    <fix>pps</fix>\n");
-  if (tp->nsats > 0)
-    fprintf ( f, "    <sat>%d</sat>\n", tp->nsats );
-
-  if ( tp->hdop != VIK_DEFAULT_DOP ) {
-    a_coords_dtostr_buffer ( tp->hdop, s_dop );
-    fprintf ( f, "    <hdop>%s</hdop>\n", s_dop );
+    vik_out_buffer_append ( ob, "    <fix>pps</fix>\n" );
+  if (tp->nsats > 0) {
+    vik_out_buffer_append ( ob, "    <sat>" );
+    vik_out_buffer_append_int ( ob, tp->nsats );
+    vik_out_buffer_append ( ob, "</sat>\n" );
   }
 
-  if ( tp->vdop != VIK_DEFAULT_DOP ) {
-    a_coords_dtostr_buffer ( tp->vdop, s_dop );
-    fprintf ( f, "    <vdop>%s</vdop>\n", s_dop );
-  }
-
-  if ( tp->pdop != VIK_DEFAULT_DOP ) {
-    a_coords_dtostr_buffer ( tp->pdop, s_dop );
-    fprintf ( f, "    <pdop>%s</pdop>\n", s_dop );
-  }
+  if ( tp->hdop != VIK_DEFAULT_DOP )
+    gpx_write_double ( ob, "    ", "hdop", tp->hdop );
+  if ( tp->vdop != VIK_DEFAULT_DOP )
+    gpx_write_double ( ob, "    ", "vdop", tp->vdop );
+  if ( tp->pdop != VIK_DEFAULT_DOP )
+    gpx_write_double ( ob, "    ", "pdop", tp->pdop );
 
-  fprintf ( f, "  </%spt>\n", (context->options && context->options->is_route) ? "rte" : "trk" );
+  vik_out_buffer_append ( ob, is_route ? "  </rtept>\n" : "  </trkpt>\n" );
 }
 
 
@@ -1002,82 +979,80 @@ static void gpx_write_track ( VikTrack *t, GpxWritingContext *context )
   if (context->options && !context->options->hidden && !t->visible)
     return;
 
-  FILE *f = context->file;
-  gchar *tmp;
-  gboolean first_tp_is_newsegment = FALSE; /* must temporarily make it not so, but we want to restore state. not that it matters. */
-
-  // Sanity clause
-  if ( t->name )
-    tmp = entitize ( t->name );
-  else
-    tmp = g_strdup ("track");
+  VikOutBuffer *ob = context->ob;
 
   // NB 'hidden' is not part of any GPX standard - this appears to be a made up Viking 'extension'
   //  luckily most other GPX processing software ignores things they don't understand
-  fprintf ( f, "<%s%s>\n  <name>%s</name>\n",
-	    t->is_route ? "rte" : "trk",
-	    t->visible ? "" : " hidden=\"hidden\"",
-	    tmp );
-  g_free ( tmp );
+  vik_out_buffer_append ( ob, t->is_route ? "<rte" : "<trk" );
+  vik_out_buffer_append ( ob, t->visible ? ">\n" : " hidden=\"hidden\">\n" );
 
-  if ( t->comment )
-  {
-    tmp = entitize ( t->comment );
-    fprintf ( f, "  <cmt>%s</cmt>\n", tmp );
-    g_free ( tmp );
-  }
+  // Sanity clause
+  gpx_write_element ( ob, "  ", "name", t->name ? t->name : "track" );
 
+  if ( t->comment )
+    gpx_write_element ( ob, "  ", "cmt", t->comment );
   if ( t->description )
-  {
-    tmp = entitize ( t->description );
-    fprintf ( f, "  <desc>%s</desc>\n", tmp );
-    g_free ( tmp );
-  }
-
+    gpx_write_element ( ob, "  ", "desc", t->description );
   if ( t->source )
-  {
-    tmp = entitize ( t->source );
-    fprintf ( f, "  <src>%s</src>\n", tmp );
-    g_free ( tmp );
-  }
-
+    gpx_write_element ( ob, "  ", "src", t->source );
   if ( t->type )
-  {
-    tmp = entitize ( t->type );
-    fprintf ( f, "  <type>%s</type>\n", tmp );
-    g_free ( tmp );
-  }
+    gpx_write_element ( ob, "  ", "type", t->type );
 
   /* No such thing as a rteseg! */
   if ( !t->is_route )
-    fprintf ( f, "  <trkseg>\n" );
+    vik_out_buffer_append ( ob, "  <trkseg>\n" );
 
-  if ( t->trackpoints && t->trackpoints->data ) {
-    first_tp_is_newsegment = VIK_TRACKPOINT(t->trackpoints->data)->newsegment;
-    VIK_TRACKPOINT(t->trackpoints->data)->newsegment = FALSE; /* so we won't write </trkseg><trkseg> already */
-    g_list_foreach ( t->trackpoints, (GFunc) gpx_write_trackpoint, context );
-    VIK_TRACKPOINT(t->trackpoints->data)->newsegment = first_tp_is_newsegment; /* restore state */
-  }
+  GList *iter;
+  for ( iter = t->trackpoints; iter; iter = iter->next )
+    if ( iter->data )
+      gpx_write_trackpoint ( VIK_TRACKPOINT(iter->data), context, iter == t->trackpoints );
 
   /* NB apparently no such thing as a rteseg! */
   if (!t->is_route)
-    fprintf ( f, "  </trkseg>\n");
+    vik_out_buffer_append ( ob, "  </trkseg>\n" );
+
+  vik_out_buffer_append ( ob, t->is_route ? "</rte>\n" : "</trk>\n" );
+}
+
+/*
+ * For vik_out_buffer_append_parallel(), writing each track into its own buffer
+ */
+static void gpx_write_track_buffer ( VikOutBuffer *ob, VikTrack *t, GpxWritingContext *context )
+{
+  GpxWritingContext track_context = { context->options, ob };
+  gpx_write_track ( t, &track_context );
+}
 
-  fprintf ( f, "</%s>\n", t->is_route ? "rte" : "trk" );
+// Below this many points the tracks are simply written one after the other
+#define GPX_PARALLEL_WRITE_MIN_POINTS 50000
+
+static void gpx_write_tracks ( GList *tracks, GpxWritingContext *context )
+{
+  gulong points = 0;
+  GList *iter;
+  for ( iter = tracks; iter && points < GPX_PARALLEL_WRITE_MIN_POINTS; iter = iter->next )
+    points += vik_track_get_tp_count ( VIK_TRACK(iter->data) );
+
+  if ( points < GPX_PARALLEL_WRITE_MIN_POINTS ) {
+    for ( iter = tracks; iter; iter = iter->next )
+      gpx_write_track ( VIK_TRACK(iter->data), context );
+  }
+  else
+    vik_out_buffer_append_parallel ( context->ob, tracks, (VikOutBufferWriteFunc)gpx_write_track_buffer, context );
 }
 
-static void gpx_write_header( FILE *f )
+static void gpx_write_header( VikOutBuffer *ob )
 {
-  fprintf(f, "<?xml version=\"1.0\"?>\n"
+  vik_out_buffer_append ( ob, "<?xml version=\"1.0\"?>\n"
           "<gpx version=\"1.0\" creator=\"Viking -- http://viking.sf.net/\"\n"
           "xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\"\n"
           "xmlns=\"http://www.topografix.com/GPX/1/0\"\n"
           "xsi:schemaLocation=\"http://www.topografix.com/GPX/1/0 http://www.topografix.com/GPX/1/0/gpx.xsd\">\n");
 }
 
-static void gpx_write_footer( FILE *f )
+static void gpx_write_footer( VikOutBuffer *ob )
 {
-  fprintf(f, "</gpx>\n");
+  vik_out_buffer_append ( ob, "</gpx>\n" );
 }
 
 static int gpx_waypoint_compare(const void *x, const void *y)
@@ -1094,42 +1069,32 @@ static int gpx_track_compare_name(const void *x, const void *y)
   return strcmp(a->name,b->name);
 }
 
-void a_gpx_write_file ( VikTrwLayer *vtl, FILE *f, GpxWritingOptions *options )
+/**
+ * a_gpx_write_file:
+ *
+ * Returns: FALSE if writing to the file failed
+ */
+gboolean a_gpx_write_file ( VikTrwLayer *vtl, FILE *f, GpxWritingOptions *options )
 {
-  GpxWritingContext context = { options, f };
+  VikOutBuffer *ob = vik_out_buffer_new ( f );
+  GpxWritingContext context = { options, ob };
 
-  gpx_write_header ( f );
+  gpx_write_header ( ob );
 
-  gchar *tmp;
   const gchar *name = vik_layer_get_name(VIK_LAYER(vtl));
-  if ( name ) {
-    tmp = entitize ( name );
-    fprintf ( f, "  <name>%s</name>\n", tmp );
-    g_free ( tmp );
-  }
+  if ( name )
+    gpx_write_element ( ob, "  ", "name", name );
 
   VikTRWMetadata *md = vik_trw_layer_get_metadata (vtl);
   if ( md ) {
-    if ( md->author && strlen(md->author) > 0 ) {
-      tmp = entitize ( md->author );
-      fprintf ( f, "  <author>%s</author>\n", tmp );
-      g_free ( tmp );
-    }
-    if ( md->description && strlen(md->description) > 0) {
-      tmp = entitize ( md->description );
-      fprintf ( f, "  <desc>%s</desc>\n", tmp );
-      g_free ( tmp );
-    }
-    if ( md->timestamp ) {
-      tmp = entitize ( md->timestamp );
-      fprintf ( f, "  <time>%s</time>\n", tmp );
-      g_free ( tmp );
-    }
-    if ( md->keywords && strlen(md->keywords) > 0) {
-      tmp = entitize ( md->keywords );
-      fprintf ( f, "  <keywords>%s</keywords>\n", tmp );
-      g_free ( tmp );
-    }
+    if ( md->author && strlen(md->author) > 0 )
+      gpx_write_element ( ob, "  ", "author", md->author );
+    if ( md->description && strlen(md->description) > 0)
+      gpx_write_element ( ob, "  ", "desc", md->description );
+    if ( md->timestamp )
+      gpx_write_element ( ob, "  ", "time", md->timestamp );
+    if ( md->keywords && strlen(md->keywords) > 0)
+      gpx_write_element ( ob, "  ", "keywords", md->keywords );
   }
 
   if ( vik_trw_layer_get_waypoints_visibility(vtl) || (options && options->hidden) ) {
@@ -1179,29 +1144,28 @@ void a_gpx_write_file ( VikTrwLayer *vtl, FILE *f, GpxWritingOptions *options )
     context_tmp.options = &opt_tmp;
   context_tmp.options->is_route = FALSE;
 
-  // Loop around each list and write each one
-  for (GList *iter = g_list_first (gl); iter != NULL; iter = g_list_next (iter)) {
-    gpx_write_track ( (VikTrack*)iter->data, &context_tmp );
-  }
+  // Write each list, the options are not changed while a list is being written
+  gpx_write_tracks ( gl, &context_tmp );
 
   // Routes (to get routepoints)
   context_tmp.options->is_route = TRUE;
-  for (GList *iter = g_list_first (glrte); iter != NULL; iter = g_list_next (iter)) {
-    gpx_write_track ( (VikTrack*)iter->data, &context_tmp );
-  }
+  gpx_write_tracks ( glrte, &context_tmp );
 
   g_list_free ( gl );
   g_list_free ( glrte );
 
-  gpx_write_footer ( f );
+  gpx_write_footer ( ob );
+  return vik_out_buffer_free ( ob );
 }
 
-void a_gpx_write_track_file ( VikTrack *trk, FILE *f, GpxWritingOptions *options )
+gboolean a_gpx_write_track_file ( VikTrack *trk, FILE *f, GpxWritingOptions *options )
 {
-  GpxWritingContext context = {options, f};
-  gpx_write_header ( f );
+  VikOutBuffer *ob = vik_out_buffer_new ( f );
+  GpxWritingContext context = { options, ob };
+  gpx_write_header ( ob );
   gpx_write_track ( trk, &context );
-  gpx_write_footer ( f );
+  gpx_write_footer ( ob );
+  return vik_out_buffer_free ( ob );
 }
 
 /**
@@ -1222,12 +1186,21 @@ static gchar* write_tmp_file ( VikTrwLayer *vtl, VikTrack *trk, GpxWritingOption
 
 	FILE *ff = fdopen (fd, "w");
 
+	gboolean ok;
 	if ( trk )
-		a_gpx_write_track_file ( trk, ff, options );
+		ok = a_gpx_write_track_file ( trk, ff, options );
 	else
-		a_gpx_write_file ( vtl, ff, options );
+		ok = a_gpx_write_file ( vtl, ff, options );
 
-	fclose (ff);
+	if ( fclose (ff) != 0 )
+		ok = FALSE;
+
+	if ( !ok ) {
+		g_warning ( "%s: failed to write temporary file %s", __FUNCTION__, tmp_filename );
+		(void)g_remove ( tmp_filename );
+		g_free ( tmp_filename );
+		return NULL;
+	}
 
 	return tmp_filename;
 }
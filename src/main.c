@@ -39,6 +39,9 @@
 #include "vikutils.h"
 #include "util.h"
 #include "toolbar.h"
+#include "mapseed.h"
+#include "tileindex.h"
+#include "perfstats.h"
 
 #ifdef HAVE_STDLIB_H
 #include <stdlib.h>
@@ -104,6 +107,17 @@ static gdouble longitude = 0.0;
 static gint zoom_level_osm = -1;
 static gint map_id = -1;
 
+// Map cache seeding
+static gint seed_map_id = -1;
+static gchar *seed_bbox = NULL;
+static gchar *seed_gpx = NULL;
+static gdouble seed_corridor = 1000.0;
+static gint seed_zoom_min = -1;
+static gint seed_zoom_max = -1;
+static gint seed_threads = 4;
+static gchar *seed_cache_dir = NULL;
+static gchar *seed_cache_layout = NULL;
+
 /* Options */
 static GOptionEntry entries[] = 
 {
@@ -114,9 +128,97 @@ static GOptionEntry entries[] =
   { "longitude", 0, 0, G_OPTION_ARG_DOUBLE, &longitude, N_("Longitude in decimal degrees"), NULL },
   { "zoom", 'z', 0, G_OPTION_ARG_INT, &zoom_level_osm, N_("Zoom Level (OSM). Value can be 0 - 22"), NULL },
   { "map", 'm', 0, G_OPTION_ARG_INT, &map_id, N_("Add a map layer by id value. Use 0 for the default map."), NULL },
+  { "seed-map", 0, 0, G_OPTION_ARG_INT, &seed_map_id, N_("Download the tiles of a map by id value (0 for the default map) into the maps cache, without opening a window"), NULL },
+  { "seed-bbox", 0, 0, G_OPTION_ARG_STRING, &seed_bbox, N_("Area to seed in decimal degrees"), "SOUTH,WEST,NORTH,EAST" },
+  { "seed-gpx", 0, 0, G_OPTION_ARG_FILENAME, &seed_gpx, N_("Seed a corridor along the tracks and routes of a GPX file"), "FILE" },
+  { "seed-corridor", 0, 0, G_OPTION_ARG_DOUBLE, &seed_corridor, N_("Corridor width either side of the GPX tracks in metres (default 1000)"), "METRES" },
+  { "seed-zoom-min", 0, 0, G_OPTION_ARG_INT, &seed_zoom_min, N_("Lowest zoom level (OSM) to seed"), NULL },
+  { "seed-zoom-max", 0, 0, G_OPTION_ARG_INT, &seed_zoom_max, N_("Highest zoom level (OSM) to seed"), NULL },
+  { "seed-threads", 0, 0, G_OPTION_ARG_INT, &seed_threads, N_("Number of simultaneous downloads when seeding (default 4)"), NULL },
+  { "seed-cache-dir", 0, 0, G_OPTION_ARG_FILENAME, &seed_cache_dir, N_("Maps cache directory to seed (default as for new map layers)"), "DIR" },
+  { "seed-cache-layout", 0, 0, G_OPTION_ARG_STRING, &seed_cache_layout, N_("Maps cache layout to seed: viking or osm (default as for new map layers)"), "LAYOUT" },
   { NULL }
 };
 
+/**
+ * Seeding the maps cache is performed without any windows,
+ *  (thus can run on a machine without a display)
+ */
+static gboolean seed_requested ( int argc, char *argv[] )
+{
+  for ( int jj = 1; jj < argc; jj++ ) {
+    if ( strcmp ( argv[jj], "--" ) == 0 )
+      break;
+    if ( g_str_has_prefix ( argv[jj], "--seed-map" ) )
+      return TRUE;
+  }
+  return FALSE;
+}
+
+static int seed_main ( int argc, char *argv[] )
+{
+  GError *error = NULL;
+  GOptionContext *context = g_option_context_new ( NULL );
+  g_option_context_add_main_entries ( context, entries, GETTEXT_PACKAGE );
+  gboolean parsed = g_option_context_parse ( context, &argc, &argv, &error );
+  g_option_context_free ( context );
+  if ( !parsed ) {
+    (void)g_fprintf (stderr, "Parsing command line options failed: %s\n", error->message);
+    g_error_free (error);
+    return EXIT_FAILURE;
+  }
+
+  MapSeedOptions options;
+  memset ( &options, 0, sizeof(MapSeedOptions) );
+  if ( seed_gpx )
+    options.gpx_file = seed_gpx;
+  else if ( !seed_bbox || !a_map_seed_parse_bbox ( seed_bbox, &options ) ) {
+    (void)g_fprintf (stderr, "Seeding requires either --seed-bbox=SOUTH,WEST,NORTH,EAST or --seed-gpx=FILE\n");
+    return EXIT_FAILURE;
+  }
+  if ( seed_zoom_min < 0 && seed_zoom_max < 0 ) {
+    (void)g_fprintf (stderr, "Seeding requires --seed-zoom-min and/or --seed-zoom-max\n");
+    return EXIT_FAILURE;
+  }
+  options.zoom_min = seed_zoom_min < 0 ? seed_zoom_max : seed_zoom_min;
+  options.zoom_max = seed_zoom_max < 0 ? seed_zoom_min : seed_zoom_max;
+  options.map_id = MAX(seed_map_id, 0);
+  options.cache_dir = seed_cache_dir;
+  options.corridor = MAX(seed_corridor, 0.0);
+  options.threads = MAX(seed_threads, 1);
+
+#if ! GLIB_CHECK_VERSION (2, 36, 0)
+  g_type_init ();
+#endif
+
+  // Only the non GUI parts of the first stage initialization
+  a_settings_init ();
+  a_preferences_init ();
+  a_vik_preferences_init ();
+  a_layer_defaults_init ();
+  a_download_init();
+  curl_download_init();
+  modules_init();
+  maps_layer_init ();
+  a_tile_index_init ();
+
+  if ( seed_cache_layout )
+    options.cache_layout = g_ascii_strcasecmp ( seed_cache_layout, "osm" ) == 0 ? VIK_MAPS_CACHE_LAYOUT_OSM : VIK_MAPS_CACHE_LAYOUT_VIKING;
+  else
+    options.cache_layout = maps_layer_get_cache_default ();
+
+  int ans = a_map_seed ( &options );
+
+  a_tile_index_uninit ();
+  a_layer_defaults_uninit ();
+  a_preferences_uninit ();
+  a_settings_uninit ();
+  modules_uninit();
+  curl_download_uninit();
+
+  return ans;
+}
+
 int main( int argc, char *argv[] )
 {
   VikWindow *first_window;
@@ -133,6 +235,10 @@ int main( int argc, char *argv[] )
 #if ! GLIB_CHECK_VERSION (2, 32, 0)
   g_thread_init ( NULL );
 #endif
+
+  if ( seed_requested ( argc, argv ) )
+    return seed_main ( argc, argv );
+
   gdk_threads_init ();
 
   gui_initialized = gtk_init_with_args (&argc, &argv, "files+", entries, NULL, &error);
@@ -205,7 +311,9 @@ int main( int argc, char *argv[] )
 
   vik_georef_layer_init ();
   maps_layer_init ();
+  a_perf_init ();
   a_mapcache_init ();
+  a_tile_index_init ();
   a_background_init ();
 
   a_toolbar_init();
@@ -281,7 +389,9 @@ int main( int argc, char *argv[] )
   a_toolbar_uninit ();
   a_background_uninit ();
   a_mapcache_uninit ();
+  a_tile_index_uninit ();
   a_dems_uninit ();
+  a_perf_uninit ();
   a_layer_defaults_uninit ();
   a_preferences_uninit ();
   a_settings_uninit ();
@@ -30,6 +30,8 @@
 #define MAP_ID_EXPEDIA 5
 
 #define MAP_ID_MAPNIK_RENDER 7
+// Not a map source - for the tiles of large GeoRef layer images in the map cache
+#define MAP_ID_GEOREF_PYRAMID 8
  
 // Mostly OSM related - except the Blue Marble value
 #define MAP_ID_OSM_MAPNIK 13
@@ -28,6 +28,7 @@
 #include "globals.h"
 #include "mapcache.h"
 #include "preferences.h"
+#include "perfstats.h"
 #include "vik_compat.h"
 
 #define MC_KEY_SIZE 64
@@ -54,8 +55,8 @@ typedef struct {
 
 static GMutex *mc_mutex = NULL;
 
-#define HASHKEY_FORMAT_STRING "%d-%d-%d-%d-%d-%d-%d-%.3f-%.3f"
-#define HASHKEY_FORMAT_STRING_NOSHRINK_NOR_ALPHA "%d-%d-%d-%d-%d-%d-"
+#define HASHKEY_FORMAT_STRING "%d-%d-%d-%d-%d-%d-%.3f-%.3f"
+#define HASHKEY_FORMAT_STRING_NOSHRINK "%d-%d-%d-%d-%d-%d-"
 #define HASHKEY_FORMAT_STRING_TYPE "%d-"
 
 static VikLayerParamScale params_scales[] = {
@@ -151,8 +152,10 @@ static void list_add_entry ( gchar *key )
 /**
  * Function increments reference counter of pixbuf.
  * Caller may (and should) decrease it's reference.
+ * The pixbuf should be as decoded, i.e. without any layer alpha applied,
+ *  as that is applied when drawing (see vik_viewport_draw_pixbuf_with_alpha())
  */
-void a_mapcache_add ( GdkPixbuf *pixbuf, mapcache_extra_t extra, gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar* name )
+void a_mapcache_add ( GdkPixbuf *pixbuf, mapcache_extra_t extra, gint x, gint y, gint z, guint16 type, gint zoom, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar* name )
 {
   if ( ! GDK_IS_PIXBUF(pixbuf) ) {
     g_debug ( "Not caching corrupt pixbuf for maptype %d at %d %d %d %d", type, x, y, z, zoom );
@@ -160,7 +163,7 @@ void a_mapcache_add ( GdkPixbuf *pixbuf, mapcache_extra_t extra, gint x, gint y,
   }
 
   guint nn = name ? g_str_hash ( name ) : 0;
-  gchar *key = g_strdup_printf ( HASHKEY_FORMAT_STRING, type, x, y, z, zoom, nn, alpha, xshrinkfactor, yshrinkfactor );
+  gchar *key = g_strdup_printf ( HASHKEY_FORMAT_STRING, type, x, y, z, zoom, nn, xshrinkfactor, yshrinkfactor );
 
   g_mutex_lock(mc_mutex);
   g_object_ref(pixbuf);
@@ -173,11 +176,13 @@ void a_mapcache_add ( GdkPixbuf *pixbuf, mapcache_extra_t extra, gint x, gint y,
     if ( queue_tail ) {
       gchar *oldkey = list_shift_add_entry ( key );
       cache_remove(oldkey);
+      a_perf_count ( PERF_MAPCACHE_EVICTION, 1 );
 
       while ( cache_size > max_cache_size &&
              (queue_tail->next != queue_tail) ) { /* make sure there's more than one thing to delete */
         oldkey = list_shift ();
         cache_remove(oldkey);
+        a_perf_count ( PERF_MAPCACHE_EVICTION, 1 );
       }
     }
     /* chop off 'start' etc */
@@ -195,28 +200,30 @@ void a_mapcache_add ( GdkPixbuf *pixbuf, mapcache_extra_t extra, gint x, gint y,
  * Function increases reference counter of pixels buffer in behalf of caller.
  * Caller have to decrease references counter, when buffer is no longer needed.
  */
-GdkPixbuf *a_mapcache_get ( gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar* name )
+GdkPixbuf *a_mapcache_get ( gint x, gint y, gint z, guint16 type, gint zoom, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar* name )
 {
   static char key[MC_KEY_SIZE];
   guint nn = name ? g_str_hash ( name ) : 0;
-  g_snprintf ( key, sizeof(key), HASHKEY_FORMAT_STRING, type, x, y, z, zoom, nn, alpha, xshrinkfactor, yshrinkfactor );
+  g_snprintf ( key, sizeof(key), HASHKEY_FORMAT_STRING, type, x, y, z, zoom, nn, xshrinkfactor, yshrinkfactor );
   g_mutex_lock(mc_mutex); /* prevent returning pixbuf when cache is being cleared */
   cache_item_t *ci = g_hash_table_lookup ( cache, key );
   if ( ci ) {
     g_object_ref(ci->pixbuf);
     g_mutex_unlock(mc_mutex);
+    a_perf_count ( PERF_MAPCACHE_HIT, 1 );
     return ci->pixbuf;
   } else {
     g_mutex_unlock(mc_mutex);
+    a_perf_count ( PERF_MAPCACHE_MISS, 1 );
     return NULL;
   }
 }
 
-mapcache_extra_t a_mapcache_get_extra ( gint x, gint y, gint z, guint16 type, gint zoom, guint8 alpha, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar* name )
+mapcache_extra_t a_mapcache_get_extra ( gint x, gint y, gint z, guint16 type, gint zoom, gdouble xshrinkfactor, gdouble yshrinkfactor, const gchar* name )
 {
   static char key[MC_KEY_SIZE];
   guint nn = name ? g_str_hash ( name ) : 0;
-  g_snprintf ( key, sizeof(key), HASHKEY_FORMAT_STRING, type, x, y, z, zoom, nn, alpha, xshrinkfactor, yshrinkfactor );
+  g_snprintf ( key, sizeof(key), HASHKEY_FORMAT_STRING, type, x, y, z, zoom, nn, xshrinkfactor, yshrinkfactor );
   cache_item_t *ci = g_hash_table_lookup ( cache, key );
   if ( ci )
     return ci->extra;
@@ -277,7 +284,7 @@ void a_mapcache_remove_all_shrinkfactors ( gint x, gint y, gint z, guint16 type,
 {
   char key[MC_KEY_SIZE];
   guint nn = name ? g_str_hash ( name ) : 0;
-  g_snprintf ( key, sizeof(key), HASHKEY_FORMAT_STRING_NOSHRINK_NOR_ALPHA, type, x, y, z, zoom, nn );
+  g_snprintf ( key, sizeof(key), HASHKEY_FORMAT_STRING_NOSHRINK, type, x, y, z, zoom, nn );
   flush_matching ( key );
 }
 
@@ -308,7 +315,7 @@ void a_mapcache_flush ()
  *  @type: Specified map type
  *
  * Just remove cache items for the specified map type
- *  i.e. all related xyz+zoom+alpha+etc...
+ *  i.e. all related xyz+zoom+etc...
  */
 void a_mapcache_flush_type ( guint16 type )
 {
@@ -0,0 +1,449 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 2; tab-width: 2 -*- */
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2026, The Viking developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/*
+ * Fill the map tile cache for an area without any user interface,
+ *  e.g. to prepare for going offline.
+ *
+ * The tiles are fetched by several download threads at once.
+ * Tiles already in the cache are skipped, so an interrupted run can simply be repeated to resume it
+ *  (downloads are written to a temporary file first, so a partial tile is never left in the cache).
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <string.h>
+#include <stdlib.h>
+#include <expat.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <glib/gprintf.h>
+#include <glib/gi18n.h>
+
+#include "mapseed.h"
+#include "vikmapslayer.h"
+#include "vik_compat.h"
+#include "download.h"
+#include "tileindex.h"
+#include "globals.h"
+
+// Seconds between progress reports
+#define SEED_PROGRESS_INTERVAL 5
+// Web Mercator limit
+#define SEED_LAT_LIMIT 85.0511
+
+typedef struct {
+  VikMapSource *map;
+  const gchar *cache_dir;
+  VikMapsCacheLayout cache_layout;
+  GArray *tiles;       // of MapCoord
+  GMutex *mutex;       // Protects all the following
+  guint next;
+  guint downloaded;
+  guint present;
+  guint failed;
+  guint64 bytes;
+  guint running;
+} SeedJob;
+
+/**
+ * a_map_seed_parse_bbox:
+ * @str: "south,west,north,east" in decimal degrees
+ *
+ * Returns: TRUE if the string is valid
+ */
+gboolean a_map_seed_parse_bbox ( const gchar *str, MapSeedOptions *options )
+{
+  gboolean ok = FALSE;
+  gchar **parts = g_strsplit ( str, ",", -1 );
+  if ( g_strv_length ( parts ) == 4 ) {
+    gdouble vals[4];
+    ok = TRUE;
+    for ( guint i = 0; i < 4; i++ ) {
+      gchar *end = NULL;
+      vals[i] = g_ascii_strtod ( parts[i], &end );
+      if ( end == parts[i] )
+        ok = FALSE;
+    }
+    if ( ok ) {
+      options->bbox_sw.lat = MIN(vals[0], vals[2]);
+      options->bbox_sw.lon = MIN(vals[1], vals[3]);
+      options->bbox_ne.lat = MAX(vals[0], vals[2]);
+      options->bbox_ne.lon = MAX(vals[1], vals[3]);
+    }
+  }
+  g_strfreev ( parts );
+  return ok;
+}
+
+/*** GPX corridor ***/
+
+typedef struct {
+  GList *segments; // of GArray of struct LatLon
+  GArray *current;
+} GpxPoints;
+
+static const gchar *gpx_attr ( const char **attr, const gchar *name )
+{
+  for ( guint i = 0; attr[i]; i += 2 )
+    if ( g_strcmp0 ( attr[i], name ) == 0 )
+      return attr[i+1];
+  return NULL;
+}
+
+static void gpx_start ( GpxPoints *gp, const char *el, const char **attr )
+{
+  if ( g_strcmp0 ( el, "trkseg" ) == 0 || g_strcmp0 ( el, "rte" ) == 0 ) {
+    gp->current = g_array_new ( FALSE, FALSE, sizeof(struct LatLon) );
+    gp->segments = g_list_prepend ( gp->segments, gp->current );
+  }
+  else if ( gp->current && (g_strcmp0 ( el, "trkpt" ) == 0 || g_strcmp0 ( el, "rtept" ) == 0) ) {
+    const gchar *lat = gpx_attr ( attr, "lat" );
+    const gchar *lon = gpx_attr ( attr, "lon" );
+    if ( lat && lon ) {
+      struct LatLon ll;
+      ll.lat = g_ascii_strtod ( lat, NULL );
+      ll.lon = g_ascii_strtod ( lon, NULL );
+      g_array_append_val ( gp->current, ll );
+    }
+  }
+}
+
+static void gpx_end ( GpxPoints *gp, const char *el )
+{
+  if ( g_strcmp0 ( el, "trkseg" ) == 0 || g_strcmp0 ( el, "rte" ) == 0 )
+    gp->current = NULL;
+}
+
+/**
+ * Only the positions of track and route points are wanted,
+ *  so just these are picked out, rather than loading everything into a TrackWaypoint layer
+ */
+static GList *gpx_read_points ( const gchar *filename )
+{
+  FILE *ff = g_fopen ( filename, "r" );
+  if ( !ff ) {
+    g_printerr ( _("Could not open %s\n"), filename );
+    return NULL;
+  }
+
+  GpxPoints gp = { NULL, NULL };
+  XML_Parser parser = XML_ParserCreate ( NULL );
+  XML_SetElementHandler ( parser, (XML_StartElementHandler) gpx_start, (XML_EndElementHandler) gpx_end );
+  XML_SetUserData ( parser, &gp );
+
+  gchar buf[4096];
+  gboolean ok = TRUE;
+  int done = 0;
+  while ( !done && ok ) {
+    size_t len = fread ( buf, 1, sizeof(buf), ff );
+    done = feof ( ff ) || !len;
+    ok = XML_Parse ( parser, buf, len, done ) != XML_STATUS_ERROR;
+  }
+  if ( !ok )
+    g_printerr ( _("%s: GPX parse error at line %ld: %s\n"), filename,
+                 (glong)XML_GetCurrentLineNumber(parser), XML_ErrorString(XML_GetErrorCode(parser)) );
+
+  XML_ParserFree ( parser );
+  fclose ( ff );
+  return g_list_reverse ( gp.segments );
+}
+
+/*** Tile sets ***/
+
+static gint64 *tile_key ( gint x, gint y )
+{
+  gint64 *key = g_malloc ( sizeof(gint64) );
+  *key = ((gint64)x << 32) | (guint32)y;
+  return key;
+}
+
+/**
+ * Add all the tiles covering the area between the two corners
+ */
+static void tiles_add_area ( GHashTable *set, VikMapSource *map, gdouble mpp, gdouble south, gdouble west, gdouble north, gdouble east, MapCoord *base )
+{
+  struct LatLon ll;
+  VikCoord ul, br;
+  MapCoord ulm, brm;
+
+  ll.lat = CLAMP(north, -SEED_LAT_LIMIT, SEED_LAT_LIMIT);
+  ll.lon = CLAMP(west, -180.0, 180.0);
+  vik_coord_load_from_latlon ( &ul, VIK_COORD_LATLON, &ll );
+  ll.lat = CLAMP(south, -SEED_LAT_LIMIT, SEED_LAT_LIMIT);
+  ll.lon = CLAMP(east, -180.0, 180.0);
+  vik_coord_load_from_latlon ( &br, VIK_COORD_LATLON, &ll );
+
+  if ( !vik_map_source_coord_to_mapcoord ( map, &ul, mpp, mpp, &ulm ) ||
+       !vik_map_source_coord_to_mapcoord ( map, &br, mpp, mpp, &brm ) )
+    return;
+
+  *base = ulm;
+  gint xmin = MIN(ulm.x, brm.x), xmax = MAX(ulm.x, brm.x);
+  gint ymin = MIN(ulm.y, brm.y), ymax = MAX(ulm.y, brm.y);
+  for ( gint x = xmin; x <= xmax; x++ )
+    for ( gint y = ymin; y <= ymax; y++ )
+      g_hash_table_insert ( set, tile_key ( x, y ), NULL );
+}
+
+/**
+ * Add the tiles within the corridor either side of a track segment
+ */
+static void tiles_add_corridor ( GHashTable *set, VikMapSource *map, gdouble mpp, GArray *points, gdouble corridor, MapCoord *base )
+{
+  // Sample the line often enough that the boxes around each sample overlap,
+  //  but no more than a few times per tile
+  gdouble tile_metres = mpp * vik_map_source_get_tilesize_x ( map );
+  gdouble step = MAX(corridor, tile_metres / 4);
+
+  for ( guint i = 0; i < points->len; i++ ) {
+    struct LatLon *ll1 = &g_array_index ( points, struct LatLon, i );
+    struct LatLon *ll2 = (i + 1 < points->len) ? &g_array_index ( points, struct LatLon, i+1 ) : ll1;
+    guint samples = (guint)ceil ( a_coords_latlon_diff ( ll1, ll2 ) / step );
+    samples = MAX(samples, 1);
+
+    for ( guint s = 0; s < samples; s++ ) {
+      gdouble frac = (gdouble)s / samples;
+      gdouble lat = ll1->lat + (ll2->lat - ll1->lat) * frac;
+      gdouble lon = ll1->lon + (ll2->lon - ll1->lon) * frac;
+      gdouble dlat = corridor / 111320.0;
+      gdouble dlon = corridor / (111320.0 * MAX(cos(DEG2RAD(lat)), 0.01));
+      tiles_add_area ( set, map, mpp, lat - dlat, lon - dlon, lat + dlat, lon + dlon, base );
+    }
+  }
+}
+
+/**
+ * Append the tiles of one zoom level to the list of tiles to get
+ */
+static void tiles_append ( GArray *tiles, VikMapSource *map, MapSeedOptions *options, GList *segments, gint zoom )
+{
+  GHashTable *set = g_hash_table_new_full ( g_int64_hash, g_int64_equal, g_free, NULL );
+  MapCoord base;
+  gdouble mpp = ldexp ( 1.0, 17 - zoom );
+
+  if ( segments ) {
+    for ( GList *iter = segments; iter; iter = iter->next )
+      tiles_add_corridor ( set, map, mpp, iter->data, options->corridor, &base );
+  }
+  else
+    tiles_add_area ( set, map, mpp, options->bbox_sw.lat, options->bbox_sw.lon,
+                     options->bbox_ne.lat, options->bbox_ne.lon, &base );
+
+  GHashTableIter iter;
+  gpointer key;
+  g_hash_table_iter_init ( &iter, set );
+  while ( g_hash_table_iter_next ( &iter, &key, NULL ) ) {
+    MapCoord mc = base;
+    mc.x = (gint)(*(gint64*)key >> 32);
+    mc.y = (gint32)(*(gint64*)key & 0xffffffff);
+    if ( maps_layer_tile_in_area ( map, &mc ) )
+      g_array_append_val ( tiles, mc );
+  }
+  g_hash_table_destroy ( set );
+}
+
+/*** Downloading ***/
+
+static gpointer seed_worker ( SeedJob *job )
+{
+  void *handle = vik_map_source_download_handle_init ( job->map );
+  gsize len = strlen ( job->cache_dir ) + strlen ( vik_map_source_get_name ( job->map ) ) + 64;
+  gchar *filename = g_malloc ( len );
+
+  while ( TRUE ) {
+    g_mutex_lock ( job->mutex );
+    guint ii = job->next;
+    if ( ii < job->tiles->len )
+      job->next++;
+    g_mutex_unlock ( job->mutex );
+    if ( ii >= job->tiles->len )
+      break;
+
+    MapCoord *mc = &g_array_index ( job->tiles, MapCoord, ii );
+    maps_layer_get_tile_filename ( job->cache_dir, job->cache_layout, job->map, mc, filename, len );
+
+    DownloadResult_t result = DOWNLOAD_NOT_REQUIRED;
+    GStatBuf stat_buf;
+    stat_buf.st_size = 0;
+    // Resume: anything in the cache is complete
+    if ( !a_tile_index_exists ( filename ) ) {
+      result = vik_map_source_download ( job->map, mc, filename, handle );
+      if ( result == DOWNLOAD_SUCCESS ) {
+        a_tile_index_add ( filename );
+        (void)g_stat ( filename, &stat_buf );
+      }
+      else if ( result != DOWNLOAD_NOT_REQUIRED && vik_verbose )
+        g_printerr ( _("Failed to download tile %d/%d/%d (%d)\n"), 17 - mc->scale, mc->x, mc->y, result );
+    }
+
+    g_mutex_lock ( job->mutex );
+    if ( result == DOWNLOAD_SUCCESS ) {
+      job->downloaded++;
+      job->bytes += stat_buf.st_size;
+    }
+    else if ( result == DOWNLOAD_NOT_REQUIRED )
+      job->present++;
+    else
+      job->failed++;
+    g_mutex_unlock ( job->mutex );
+  }
+
+  g_free ( filename );
+  vik_map_source_download_handle_cleanup ( job->map, handle );
+
+  g_mutex_lock ( job->mutex );
+  job->running--;
+  g_mutex_unlock ( job->mutex );
+  return NULL;
+}
+
+static void seed_report ( SeedJob *job, gdouble elapsed )
+{
+  g_mutex_lock ( job->mutex );
+  guint downloaded = job->downloaded;
+  guint present = job->present;
+  guint failed = job->failed;
+  guint64 bytes = job->bytes;
+  g_mutex_unlock ( job->mutex );
+
+  elapsed = MAX(elapsed, 0.001);
+  g_printf ( _("%u/%u tiles: %u downloaded, %u already present, %u failed - %.1f tiles/s, %.1f KiB/s\n"),
+             downloaded + present + failed, job->tiles->len, downloaded, present, failed,
+             downloaded / elapsed, bytes / 1024.0 / elapsed );
+}
+
+/**
+ * a_map_seed:
+ *
+ * Download all the tiles of the area for each zoom level into the map cache
+ *
+ * Returns: The program exit status - failure if any tile could not be obtained
+ *  (rerunning will then only try the missing tiles)
+ */
+gint a_map_seed ( MapSeedOptions *options )
+{
+  VikMapSource *map = maps_layer_get_map_source ( options->map_id );
+  if ( !map ) {
+    g_printerr ( _("Unknown map id %d\n"), options->map_id );
+    return EXIT_FAILURE;
+  }
+  if ( vik_map_source_is_direct_file_access ( map ) || vik_map_source_is_mbtiles ( map ) || vik_map_source_is_osm_meta_tiles ( map ) ) {
+    g_printerr ( _("Map %s is not downloadable\n"), vik_map_source_get_label ( map ) );
+    return EXIT_FAILURE;
+  }
+
+  gint zoom_min = MAX(options->zoom_min, vik_map_source_get_zoom_min ( map ));
+  gint zoom_max = MIN(options->zoom_max, vik_map_source_get_zoom_max ( map ));
+  if ( zoom_min > zoom_max ) {
+    g_printerr ( _("Map %s does not support zoom levels %d to %d\n"), vik_map_source_get_label ( map ), options->zoom_min, options->zoom_max );
+    return EXIT_FAILURE;
+  }
+
+  GList *segments = NULL;
+  if ( options->gpx_file ) {
+    segments = gpx_read_points ( options->gpx_file );
+    if ( !segments ) {
+      g_printerr ( _("No tracks or routes in %s\n"), options->gpx_file );
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Ensure the cache directory ends with a separator, as for maps layers
+  gchar *cache_dir;
+  const gchar *dir = options->cache_dir ? options->cache_dir : maps_layer_default_dir ();
+  if ( g_str_has_suffix ( dir, G_DIR_SEPARATOR_S ) )
+    cache_dir = g_strdup ( dir );
+  else
+    cache_dir = g_strconcat ( dir, G_DIR_SEPARATOR_S, NULL );
+
+  SeedJob job;
+  job.map = map;
+  job.cache_dir = cache_dir;
+  job.cache_layout = options->cache_layout;
+  job.tiles = g_array_new ( FALSE, FALSE, sizeof(MapCoord) );
+  job.mutex = vik_mutex_new ();
+  job.next = 0;
+  job.downloaded = 0;
+  job.present = 0;
+  job.failed = 0;
+  job.bytes = 0;
+
+  // Lower zoom levels first - as these are the more generally useful
+  for ( gint zz = zoom_min; zz <= zoom_max; zz++ )
+    tiles_append ( job.tiles, map, options, segments, zz );
+
+  g_list_foreach ( segments, (GFunc)g_array_unref, NULL );
+  g_list_free ( segments );
+
+  g_printf ( _("Seeding %u tiles of %s at zoom levels %d to %d into %s\n"),
+             job.tiles->len, vik_map_source_get_label ( map ), zoom_min, zoom_max, cache_dir );
+
+  guint threads = CLAMP(options->threads, 1, 64);
+  job.running = threads;
+  GThread **workers = g_malloc0 ( threads * sizeof(GThread*) );
+  for ( guint i = 0; i < threads; i++ ) {
+#if GLIB_CHECK_VERSION (2, 32, 0)
+    workers[i] = g_thread_try_new ( "map_seed", (GThreadFunc)seed_worker, &job, NULL );
+#else
+    workers[i] = g_thread_create ( (GThreadFunc)seed_worker, &job, TRUE, NULL );
+#endif
+    if ( !workers[i] ) {
+      g_mutex_lock ( job.mutex );
+      job.running--;
+      g_mutex_unlock ( job.mutex );
+    }
+  }
+
+  GTimer *timer = g_timer_new ();
+  gdouble last_report = 0.0;
+  while ( TRUE ) {
+    g_mutex_lock ( job.mutex );
+    guint running = job.running;
+    g_mutex_unlock ( job.mutex );
+    if ( !running )
+      break;
+    g_usleep ( G_USEC_PER_SEC / 4 );
+    if ( g_timer_elapsed ( timer, NULL ) - last_report >= SEED_PROGRESS_INTERVAL ) {
+      last_report = g_timer_elapsed ( timer, NULL );
+      seed_report ( &job, last_report );
+    }
+  }
+
+  for ( guint i = 0; i < threads; i++ )
+    if ( workers[i] )
+      g_thread_join ( workers[i] );
+  g_free ( workers );
+
+  seed_report ( &job, g_timer_elapsed ( timer, NULL ) );
+  g_timer_destroy ( timer );
+
+  // If no thread could be started, everything left is a failure
+  gboolean success = job.failed == 0 && job.downloaded + job.present == job.tiles->len;
+
+  g_array_free ( job.tiles, TRUE );
+  vik_mutex_free ( job.mutex );
+  g_free ( cache_dir );
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,52 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 2; tab-width: 2 -*- */
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2026, The Viking developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef _VIKING_MAPSEED_H
+#define _VIKING_MAPSEED_H
+
+#include <glib.h>
+
+#include "coords.h"
+#include "vikmapslayer.h"
+
+G_BEGIN_DECLS
+
+typedef struct {
+  guint map_id;                 // 0 for the default map
+  gchar *cache_dir;             // NULL for the default maps directory
+  VikMapsCacheLayout cache_layout;
+  // The area is either a bounding box or a corridor along the tracks and routes in a GPX file
+  struct LatLon bbox_sw;
+  struct LatLon bbox_ne;
+  gchar *gpx_file;
+  gdouble corridor;             // Corridor half width in metres
+  gint zoom_min;                // OSM zoom levels
+  gint zoom_max;
+  guint threads;                // Number of simultaneous downloads
+} MapSeedOptions;
+
+gboolean a_map_seed_parse_bbox ( const gchar *str, MapSeedOptions *options );
+gint a_map_seed ( MapSeedOptions *options );
+
+G_END_DECLS
+
+#endif
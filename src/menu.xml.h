@@ -104,6 +104,7 @@ static const char *menu_xml =
 	"      </menu>"
 	"      <separator/>"
 	"      <menuitem action='BGJobs'/>"
+	"      <menuitem action='Performance'/>"
 	"    </menu>"
 	"    <menu action='Layers'>"
 	"      <menuitem action='Properties'/>"
@@ -527,6 +527,7 @@ void osm_traces_upload_viktrwlayer ( VikTrwLayer *vtl, VikTrack *trk )
 
     // launch the thread
     a_background_thread( BACKGROUND_POOL_REMOTE,
+                         BACKGROUND_PRIORITY_BULK, 0,
                          VIK_GTK_WINDOW_FROM_LAYER(vtl),          /* parent window */
                          title,                                   /* description string */
                          (vik_thr_func) osm_traces_upload_thread, /* function to call within thread */
@@ -0,0 +1,350 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 2; tab-width: 2 -*- */
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2026, The Viking developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Buffered text output for the file writers.
+ *
+ * Text is formatted into a large reusable buffer which is only handed to the
+ * stdio FILE once it has grown past FLUSH_SIZE, so writing a big layer costs
+ * a few large writes rather than several formatted writes per point.
+ *
+ * Buffers created without a FILE are kept in memory; these are used to format
+ * independent items (e.g. tracks) on several threads before the results are
+ * appended in order onto the buffer for the file.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdarg.h>
+#include <string.h>
+
+#include "outbuffer.h"
+#include "coords.h"
+#include "util.h"
+#include "vik_compat.h"
+#include "misc/fpconv.h"
+
+#define FLUSH_SIZE (256*1024)
+
+struct _VikOutBuffer {
+  GString *str;
+  FILE *f;
+  gboolean failed; // Set by any failed write, so the error is not lost by later successful writes
+};
+
+/**
+ * vik_out_buffer_new:
+ * @f: The file to write to, or NULL to keep the text in memory
+ */
+VikOutBuffer *vik_out_buffer_new ( FILE *f )
+{
+  VikOutBuffer *ob = g_malloc ( sizeof(VikOutBuffer) );
+  ob->str = g_string_sized_new ( f ? FLUSH_SIZE + 4096 : 4096 );
+  ob->f = f;
+  ob->failed = FALSE;
+  return ob;
+}
+
+static void write_out ( VikOutBuffer *ob, const gchar *str, gsize len )
+{
+  if ( fwrite ( str, 1, len, ob->f ) != len )
+    ob->failed = TRUE;
+}
+
+/**
+ * vik_out_buffer_flush:
+ *
+ * Write any pending text to the file (a no-op for in-memory buffers)
+ *
+ * Returns: FALSE if this or any earlier write to the file failed
+ */
+gboolean vik_out_buffer_flush ( VikOutBuffer *ob )
+{
+  if ( ob->f && ob->str->len ) {
+    write_out ( ob, ob->str->str, ob->str->len );
+    g_string_truncate ( ob->str, 0 );
+  }
+  return !ob->failed;
+}
+
+/**
+ * vik_out_buffer_free:
+ *
+ * Flushes any pending text and then frees the buffer.
+ * The file itself is not closed.
+ *
+ * Returns: FALSE if any write to the file failed
+ */
+gboolean vik_out_buffer_free ( VikOutBuffer *ob )
+{
+  if ( !ob )
+    return TRUE;
+  gboolean ok = vik_out_buffer_flush ( ob );
+  if ( !ok )
+    g_warning ( "%s: write failed", __FUNCTION__ );
+  g_string_free ( ob->str, TRUE );
+  g_free ( ob );
+  return ok;
+}
+
+static inline void check_flush ( VikOutBuffer *ob )
+{
+  if ( ob->f && ob->str->len >= FLUSH_SIZE )
+    vik_out_buffer_flush ( ob ); // Any failure is kept for vik_out_buffer_free()
+}
+
+void vik_out_buffer_append ( VikOutBuffer *ob, const gchar *str )
+{
+  g_string_append ( ob->str, str );
+  check_flush ( ob );
+}
+
+void vik_out_buffer_append_len ( VikOutBuffer *ob, const gchar *str, gsize len )
+{
+  g_string_append_len ( ob->str, str, len );
+  check_flush ( ob );
+}
+
+void vik_out_buffer_append_c ( VikOutBuffer *ob, gchar c )
+{
+  g_string_append_c ( ob->str, c );
+  check_flush ( ob );
+}
+
+/**
+ * vik_out_buffer_append_double:
+ *
+ * Append a double WITHOUT LOCALE, giving the same text as a_coords_dtostr_buffer()
+ */
+void vik_out_buffer_append_double ( VikOutBuffer *ob, gdouble d )
+{
+  gchar buffer[COORDS_STR_BUFFER_SIZE];
+  int len = fpconv_dtoa ( d, buffer );
+  // Match the truncation of a_coords_dtostr_buffer() for the (theoretical) full length output
+  g_string_append_len ( ob->str, buffer, MIN(len, COORDS_STR_BUFFER_SIZE-1) );
+  check_flush ( ob );
+}
+
+void vik_out_buffer_append_int ( VikOutBuffer *ob, gint64 i )
+{
+  gchar buffer[24];
+  gchar *p = buffer + sizeof(buffer);
+  // Work with the unsigned magnitude so that G_MININT64 is handled too
+  guint64 u = ( i < 0 ) ? -(guint64)i : (guint64)i;
+  do {
+    *--p = '0' + (u % 10);
+    u /= 10;
+  } while ( u );
+  if ( i < 0 )
+    *--p = '-';
+  g_string_append_len ( ob->str, p, buffer + sizeof(buffer) - p );
+  check_flush ( ob );
+}
+
+static inline gchar *put_digits ( gchar *p, guint value, guint width )
+{
+  gchar *end = p + width;
+  while ( width-- ) {
+    p[width] = '0' + (value % 10);
+    value /= 10;
+  }
+  return end;
+}
+
+/**
+ * vik_out_buffer_append_iso8601:
+ * @prefix: Text to put before the timestamp (e.g. an opening tag)
+ * @suffix: Text to put after the timestamp
+ *
+ * Append a UTC timestamp in the form YYYY-MM-DDTHH:MM:SSZ,
+ *  i.e. the same as g_time_val_to_iso8601() gives for whole seconds,
+ *  but without any allocation or use of the C library time conversions.
+ *
+ * Returns: FALSE if the time could not be converted, in which case
+ *          neither the prefix nor the suffix are appended either
+ */
+gboolean vik_out_buffer_append_iso8601 ( VikOutBuffer *ob, const gchar *prefix, time_t t, const gchar *suffix )
+{
+  gint64 secs = (gint64)t;
+  gint64 days = secs / 86400;
+  gint64 rem = secs % 86400;
+  if ( rem < 0 ) {
+    rem += 86400;
+    days--;
+  }
+
+  // Civil date from days since 1970-01-01 (proleptic Gregorian calendar)
+  //  see http://howardhinnant.github.io/date_algorithms.html
+  days += 719468;
+  gint64 era = ( days >= 0 ? days : days - 146096 ) / 146097;
+  guint doe = (guint)( days - era * 146097 );
+  guint yoe = ( doe - doe/1460 + doe/36524 - doe/146096 ) / 365;
+  guint doy = doe - ( 365*yoe + yoe/4 - yoe/100 );
+  guint mp = ( 5*doy + 2 ) / 153;
+  guint day = doy - ( 153*mp + 2 ) / 5 + 1;
+  guint month = mp < 10 ? mp + 3 : mp - 9;
+  gint64 year = (gint64)yoe + era * 400 + ( month <= 2 );
+
+  if ( year < 1000 || year > 9999 ) {
+    // Not a four digit year - let glib decide what to do
+    GTimeVal timestamp;
+    timestamp.tv_sec = t;
+    timestamp.tv_usec = 0;
+    gchar *time_iso8601 = g_time_val_to_iso8601 ( &timestamp );
+    if ( !time_iso8601 )
+      return FALSE;
+    g_string_append ( ob->str, prefix );
+    g_string_append ( ob->str, time_iso8601 );
+    vik_out_buffer_append ( ob, suffix );
+    g_free ( time_iso8601 );
+    return TRUE;
+  }
+
+  gchar buffer[20];
+  gchar *p = buffer;
+  p = put_digits ( p, (guint)year, 4 );
+  *p++ = '-';
+  p = put_digits ( p, month, 2 );
+  *p++ = '-';
+  p = put_digits ( p, day, 2 );
+  *p++ = 'T';
+  p = put_digits ( p, (guint)(rem / 3600), 2 );
+  *p++ = ':';
+  p = put_digits ( p, (guint)((rem / 60) % 60), 2 );
+  *p++ = ':';
+  p = put_digits ( p, (guint)(rem % 60), 2 );
+  *p++ = 'Z';
+  g_string_append ( ob->str, prefix );
+  g_string_append_len ( ob->str, buffer, p - buffer );
+  vik_out_buffer_append ( ob, suffix );
+  return TRUE;
+}
+
+void vik_out_buffer_append_printf ( VikOutBuffer *ob, const gchar *format, ... )
+{
+  va_list args;
+  va_start ( args, format );
+  g_string_append_vprintf ( ob->str, format, args );
+  va_end ( args );
+  check_flush ( ob );
+}
+
+/**
+ * vik_out_buffer_append_buffer:
+ *
+ * Append all the text of @src (which is then emptied)
+ */
+void vik_out_buffer_append_buffer ( VikOutBuffer *ob, VikOutBuffer *src )
+{
+  vik_out_buffer_flush ( src );
+  if ( ob->f && src->str->len >= FLUSH_SIZE ) {
+    // Big enough to go straight out, without copying
+    vik_out_buffer_flush ( ob );
+    write_out ( ob, src->str->str, src->str->len );
+  }
+  else
+    vik_out_buffer_append_len ( ob, src->str->str, src->str->len );
+  g_string_truncate ( src->str, 0 );
+}
+
+typedef struct {
+  VikOutBuffer *ob;
+  gpointer item;
+  gboolean done; // Protected by the job mutex
+} ParallelSlot;
+
+typedef struct {
+  VikOutBufferWriteFunc func;
+  gpointer user_data;
+  GMutex *mutex;
+  GCond *cond;
+} ParallelJob;
+
+static void parallel_write ( ParallelSlot *slot, ParallelJob *job )
+{
+  job->func ( slot->ob, slot->item, job->user_data );
+  g_mutex_lock ( job->mutex );
+  slot->done = TRUE;
+  // Only the writer waits, but it may be waiting for a different slot
+  g_cond_broadcast ( job->cond );
+  g_mutex_unlock ( job->mutex );
+}
+
+/**
+ * vik_out_buffer_append_parallel:
+ * @items:     The items to write
+ * @func:      Writes one item to the given (in memory) buffer.
+ *             This will be called from several threads at once.
+ * @user_data: Passed to @func
+ *
+ * Format each item into its own buffer using all the available CPUs,
+ *  appending the results onto @ob in the order of @items.
+ *
+ * Only a limited number of items are formatted ahead of those already
+ *  appended, so the memory used remains proportional to the largest items
+ *  rather than to the whole output.
+ */
+void vik_out_buffer_append_parallel ( VikOutBuffer *ob, GList *items, VikOutBufferWriteFunc func, gpointer user_data )
+{
+  guint threads = util_get_number_of_cpus ();
+  guint n_items = g_list_length ( items );
+  if ( threads < 2 || n_items < 2 ) {
+    GList *iter;
+    for ( iter = items; iter; iter = iter->next )
+      func ( ob, iter->data, user_data );
+    return;
+  }
+
+  ParallelJob job = { func, user_data, vik_mutex_new (), vik_cond_new () };
+  ParallelSlot *slots = g_new0 ( ParallelSlot, n_items );
+  guint ahead = threads * 4;
+  guint pushed = 0;
+  guint ii;
+  GList *iter = items;
+  for ( ii = 0; ii < n_items; ii++, iter = iter->next ) {
+    slots[ii].ob = vik_out_buffer_new ( NULL );
+    slots[ii].item = iter->data;
+  }
+
+  GThreadPool *pool = g_thread_pool_new ( (GFunc)parallel_write, &job, threads, FALSE, NULL );
+  for ( ; pushed < n_items && pushed < ahead; pushed++ )
+    g_thread_pool_push ( pool, &slots[pushed], NULL );
+
+  for ( ii = 0; ii < n_items; ii++ ) {
+    g_mutex_lock ( job.mutex );
+    while ( !slots[ii].done )
+      g_cond_wait ( job.cond, job.mutex );
+    g_mutex_unlock ( job.mutex );
+    vik_out_buffer_append_buffer ( ob, slots[ii].ob );
+    vik_out_buffer_free ( slots[ii].ob );
+    if ( pushed < n_items ) {
+      g_thread_pool_push ( pool, &slots[pushed], NULL );
+      pushed++;
+    }
+  }
+
+  g_thread_pool_free ( pool, FALSE, TRUE );
+  vik_cond_free ( job.cond );
+  vik_mutex_free ( job.mutex );
+  g_free ( slots );
+}
@@ -0,0 +1,53 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 2; tab-width: 2 -*- */
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2026, The Viking developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef _VIKING_OUTBUFFER_H
+#define _VIKING_OUTBUFFER_H
+
+#include <stdio.h>
+#include <time.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _VikOutBuffer VikOutBuffer;
+
+VikOutBuffer *vik_out_buffer_new ( FILE *f );
+gboolean vik_out_buffer_flush ( VikOutBuffer *ob );
+gboolean vik_out_buffer_free ( VikOutBuffer *ob );
+
+void vik_out_buffer_append ( VikOutBuffer *ob, const gchar *str );
+void vik_out_buffer_append_len ( VikOutBuffer *ob, const gchar *str, gsize len );
+void vik_out_buffer_append_c ( VikOutBuffer *ob, gchar c );
+void vik_out_buffer_append_double ( VikOutBuffer *ob, gdouble d );
+void vik_out_buffer_append_int ( VikOutBuffer *ob, gint64 i );
+gboolean vik_out_buffer_append_iso8601 ( VikOutBuffer *ob, const gchar *prefix, time_t t, const gchar *suffix );
+void vik_out_buffer_append_printf ( VikOutBuffer *ob, const gchar *format, ... ) G_GNUC_PRINTF (2, 3);
+void vik_out_buffer_append_buffer ( VikOutBuffer *ob, VikOutBuffer *src );
+
+typedef void (*VikOutBufferWriteFunc) ( VikOutBuffer *ob, gpointer item, gpointer user_data );
+
+void vik_out_buffer_append_parallel ( VikOutBuffer *ob, GList *items, VikOutBufferWriteFunc func, gpointer user_data );
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,506 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 2; tab-width: 2 -*- */
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2026, The Viking developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+/*
+ * Lightweight instrumentation, to help find out where the time goes when Viking is slow.
+ *
+ * Timings are recorded as a start time and a name for what was done
+ *  (e.g. drawing a layer type, decoding a tile), and are both summed per name
+ *  and kept in a fixed size ring of the most recent events, which can be exported
+ *  in the Chrome trace event format (viewable in chrome://tracing or Perfetto).
+ *
+ * Counters (such as map cache hits) are simple atomic integers, which are sampled
+ *  each second so their history is also available in the trace.
+ *
+ * Names (and categories) are expected to be static strings as only the pointers are kept.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <errno.h>
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+#include "perfstats.h"
+#include "dialog.h"
+#include "vik_compat.h"
+
+#define PERF_TRACE_EVENTS 65536
+#define PERF_SAMPLES 3600
+
+typedef struct {
+  const gchar *category;
+  const gchar *name;
+  guint count;
+  gint64 total; // Microseconds
+  gint64 max;
+} PerfStat;
+
+typedef struct {
+  const gchar *category;
+  const gchar *name;
+  gint64 start;
+  gint64 duration;
+  guint tid;
+} PerfEvent;
+
+typedef struct {
+  gint64 time;
+  gint values[PERF_NUM_COUNTERS];
+} PerfSample;
+
+// Names shown in the dialog, and the (untranslated) ones used in the trace
+static const gchar *counter_labels[PERF_NUM_COUNTERS] = {
+  N_("Map cache hits"),
+  N_("Map cache misses"),
+  N_("Map cache evictions"),
+  N_("Layer cache hits"),
+  N_("Layer cache misses"),
+  N_("Background items queued"),
+  N_("Background items completed"),
+};
+static const gchar *counter_keys[PERF_NUM_COUNTERS] = {
+  "mapcache_hits",
+  "mapcache_misses",
+  "mapcache_evictions",
+  "layercache_hits",
+  "layercache_misses",
+  "background_queue",
+  "background_completed",
+};
+
+static GMutex *perf_mutex = NULL;
+static gint64 epoch = 0;
+
+static GHashTable *stats = NULL;     // Name -> PerfStat
+static GPtrArray *stats_order = NULL; // In order of first use, for a stable display
+static PerfEvent *events = NULL;
+static guint64 events_total = 0;
+static GHashTable *threads = NULL;   // GThread -> trace thread id
+
+static volatile gint counters[PERF_NUM_COUNTERS];
+static PerfSample *samples = NULL;
+static guint64 samples_total = 0;
+static guint sample_id = 0;
+
+static GtkWidget *perf_window = NULL;
+static GtkListStore *timing_store = NULL;
+static GtkListStore *counter_store = NULL;
+static guint refresh_id = 0;
+
+static gboolean perf_sample ( gpointer data )
+{
+  g_mutex_lock ( perf_mutex );
+  PerfSample *sample = &samples[samples_total++ % PERF_SAMPLES];
+  sample->time = g_get_monotonic_time ();
+  guint ii;
+  for ( ii = 0; ii < PERF_NUM_COUNTERS; ii++ )
+    sample->values[ii] = g_atomic_int_get ( &counters[ii] );
+  g_mutex_unlock ( perf_mutex );
+  return TRUE;
+}
+
+/**
+ * Small thread ids are easier to read in the trace than the addresses
+ *  NB call with the mutex held
+ */
+static guint thread_id ( void )
+{
+  guint tid = GPOINTER_TO_UINT ( g_hash_table_lookup ( threads, g_thread_self() ) );
+  if ( !tid ) {
+    tid = g_hash_table_size ( threads ) + 1;
+    g_hash_table_insert ( threads, g_thread_self(), GUINT_TO_POINTER(tid) );
+  }
+  return tid;
+}
+
+/**
+ * a_perf_init:
+ *
+ * Call from the main thread, so it is thread 1 in the trace
+ */
+void a_perf_init ()
+{
+  perf_mutex = vik_mutex_new ();
+  epoch = g_get_monotonic_time ();
+  stats = g_hash_table_new_full ( g_str_hash, g_str_equal, NULL, g_free );
+  stats_order = g_ptr_array_new ();
+  events = g_malloc0 ( PERF_TRACE_EVENTS * sizeof(PerfEvent) );
+  threads = g_hash_table_new ( g_direct_hash, g_direct_equal );
+  thread_id ();
+  samples = g_malloc0 ( PERF_SAMPLES * sizeof(PerfSample) );
+  sample_id = g_timeout_add_seconds ( 1, perf_sample, NULL );
+}
+
+void a_perf_uninit ()
+{
+  if ( !perf_mutex )
+    return;
+  if ( perf_window ) {
+    gtk_widget_destroy ( perf_window );
+    g_object_unref ( timing_store );
+    g_object_unref ( counter_store );
+    perf_window = NULL;
+    timing_store = counter_store = NULL;
+  }
+  if ( refresh_id )
+    g_source_remove ( refresh_id );
+  g_source_remove ( sample_id );
+
+  g_mutex_lock ( perf_mutex );
+  g_hash_table_destroy ( stats );
+  g_ptr_array_free ( stats_order, TRUE );
+  g_free ( events );
+  g_hash_table_destroy ( threads );
+  g_free ( samples );
+  g_mutex_unlock ( perf_mutex );
+  vik_mutex_free ( perf_mutex );
+  perf_mutex = NULL;
+}
+
+/**
+ * a_perf_now:
+ *
+ * Returns: The start time to pass to a_perf_record()
+ */
+gint64 a_perf_now ()
+{
+  return g_get_monotonic_time ();
+}
+
+/**
+ * a_perf_record:
+ * @category: The general area, e.g. "draw"
+ * @name:     What has been timed
+ * @start:    From a_perf_now()
+ *
+ * Record something has been done, which can be from any thread
+ */
+void a_perf_record ( const gchar *category, const gchar *name, gint64 start )
+{
+  if ( !perf_mutex )
+    return;
+  gint64 duration = g_get_monotonic_time () - start;
+
+  g_mutex_lock ( perf_mutex );
+  PerfStat *stat = g_hash_table_lookup ( stats, name );
+  if ( !stat ) {
+    stat = g_malloc0 ( sizeof(PerfStat) );
+    stat->category = category;
+    stat->name = name;
+    g_hash_table_insert ( stats, (gpointer)name, stat );
+    g_ptr_array_add ( stats_order, stat );
+  }
+  stat->count++;
+  stat->total += duration;
+  if ( duration > stat->max )
+    stat->max = duration;
+
+  PerfEvent *event = &events[events_total++ % PERF_TRACE_EVENTS];
+  event->category = category;
+  event->name = name;
+  event->start = start;
+  event->duration = duration;
+  event->tid = thread_id ();
+  g_mutex_unlock ( perf_mutex );
+}
+
+void a_perf_count ( PerfCounter counter, gint delta )
+{
+  g_atomic_int_add ( &counters[counter], delta );
+}
+
+/**
+ * a_perf_set:
+ *
+ * For counters that are a current level rather than a running total
+ */
+void a_perf_set ( PerfCounter counter, gint value )
+{
+  g_atomic_int_set ( &counters[counter], value );
+}
+
+void a_perf_reset ()
+{
+  if ( !perf_mutex )
+    return;
+  g_mutex_lock ( perf_mutex );
+  g_hash_table_remove_all ( stats );
+  g_ptr_array_set_size ( stats_order, 0 );
+  events_total = 0;
+  samples_total = 0;
+  g_mutex_unlock ( perf_mutex );
+
+  guint ii;
+  for ( ii = 0; ii < PERF_NUM_COUNTERS; ii++ )
+    if ( ii != PERF_BACKGROUND_QUEUE )
+      g_atomic_int_set ( &counters[ii], 0 );
+
+  if ( timing_store )
+    gtk_list_store_clear ( timing_store );
+}
+
+/**
+ * a_perf_export_trace:
+ *
+ * Write the recent events and counter history in the Chrome trace event format
+ */
+gboolean a_perf_export_trace ( const gchar *filename, GError **error )
+{
+  g_return_val_if_fail ( perf_mutex != NULL, FALSE );
+
+  FILE *f = g_fopen ( filename, "w" );
+  if ( !f ) {
+    g_set_error ( error, G_FILE_ERROR, g_file_error_from_errno(errno), "%s", g_strerror(errno) );
+    return FALSE;
+  }
+
+  fprintf ( f, "{\"traceEvents\":[\n" );
+
+  g_mutex_lock ( perf_mutex );
+  guint tid;
+  for ( tid = 1; tid <= g_hash_table_size(threads); tid++ )
+    fprintf ( f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s %u\"}},\n",
+              tid, tid == 1 ? "Main" : "Thread", tid );
+
+  guint64 ii;
+  for ( ii = events_total > PERF_TRACE_EVENTS ? events_total - PERF_TRACE_EVENTS : 0; ii < events_total; ii++ ) {
+    PerfEvent *event = &events[ii % PERF_TRACE_EVENTS];
+    fprintf ( f, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%" G_GINT64_FORMAT ",\"dur\":%" G_GINT64_FORMAT ",\"pid\":1,\"tid\":%u},\n",
+              event->name, event->category, event->start - epoch, event->duration, event->tid );
+  }
+
+  for ( ii = samples_total > PERF_SAMPLES ? samples_total - PERF_SAMPLES : 0; ii < samples_total; ii++ ) {
+    PerfSample *sample = &samples[ii % PERF_SAMPLES];
+    guint cc;
+    for ( cc = 0; cc < PERF_NUM_COUNTERS; cc++ )
+      fprintf ( f, "{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%" G_GINT64_FORMAT ",\"pid\":1,\"args\":{\"value\":%d}},\n",
+                counter_keys[cc], sample->time - epoch, sample->values[cc] );
+  }
+  g_mutex_unlock ( perf_mutex );
+
+  // The final entry, so there is no trailing comma
+  fprintf ( f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"%s\"}}\n", PACKAGE_NAME );
+  fprintf ( f, "],\"displayTimeUnit\":\"ms\"}\n" );
+
+  gboolean ok = !ferror ( f );
+  if ( fclose ( f ) != 0 )
+    ok = FALSE;
+  if ( !ok )
+    g_set_error ( error, G_FILE_ERROR, g_file_error_from_errno(errno), "%s", g_strerror(errno) );
+  return ok;
+}
+
+enum {
+  TIMING_CATEGORY_COLUMN = 0,
+  TIMING_NAME_COLUMN,
+  TIMING_COUNT_COLUMN,
+  TIMING_MEAN_COLUMN,
+  TIMING_MAX_COLUMN,
+  TIMING_TOTAL_COLUMN,
+  TIMING_N_COLUMNS,
+};
+
+enum {
+  COUNTER_NAME_COLUMN = 0,
+  COUNTER_VALUE_COLUMN,
+  COUNTER_RATE_COLUMN,
+  COUNTER_N_COLUMNS,
+};
+
+static void set_timing_row ( GtkTreeIter *iter, PerfStat *stat )
+{
+  gchar *mean = g_strdup_printf ( "%.2f", stat->count ? stat->total / 1000.0 / stat->count : 0.0 );
+  gchar *max = g_strdup_printf ( "%.2f", stat->max / 1000.0 );
+  gchar *total = g_strdup_printf ( "%.2f", stat->total / 1000000.0 );
+  gtk_list_store_set ( timing_store, iter,
+                       TIMING_CATEGORY_COLUMN, stat->category,
+                       TIMING_NAME_COLUMN, stat->name,
+                       TIMING_COUNT_COLUMN, stat->count,
+                       TIMING_MEAN_COLUMN, mean,
+                       TIMING_MAX_COLUMN, max,
+                       TIMING_TOTAL_COLUMN, total,
+                       -1 );
+  g_free ( mean );
+  g_free ( max );
+  g_free ( total );
+}
+
+/**
+ * Update the rows in place, so the selection and scroll position are kept
+ */
+static gboolean perf_window_refresh ( gpointer data )
+{
+  g_mutex_lock ( perf_mutex );
+  guint count = stats_order->len;
+  PerfStat *snapshot = g_malloc ( MAX(count,1) * sizeof(PerfStat) );
+  guint ii;
+  for ( ii = 0; ii < count; ii++ )
+    snapshot[ii] = *(PerfStat*)g_ptr_array_index ( stats_order, ii );
+  // The rate over the last sampling interval
+  gdouble rates[PERF_NUM_COUNTERS] = { 0.0 };
+  if ( samples_total > 1 ) {
+    PerfSample *last = &samples[(samples_total-1) % PERF_SAMPLES];
+    PerfSample *prev = &samples[(samples_total-2) % PERF_SAMPLES];
+    gdouble secs = (last->time - prev->time) / 1000000.0;
+    for ( ii = 0; ii < PERF_NUM_COUNTERS; ii++ )
+      if ( secs > 0 )
+        rates[ii] = (last->values[ii] - prev->values[ii]) / secs;
+  }
+  g_mutex_unlock ( perf_mutex );
+
+  GtkTreeIter iter;
+  gboolean valid = gtk_tree_model_get_iter_first ( GTK_TREE_MODEL(timing_store), &iter );
+  for ( ii = 0; ii < count; ii++ ) {
+    if ( !valid )
+      gtk_list_store_append ( timing_store, &iter );
+    set_timing_row ( &iter, &snapshot[ii] );
+    if ( valid )
+      valid = gtk_tree_model_iter_next ( GTK_TREE_MODEL(timing_store), &iter );
+  }
+  g_free ( snapshot );
+
+  valid = gtk_tree_model_get_iter_first ( GTK_TREE_MODEL(counter_store), &iter );
+  for ( ii = 0; ii < PERF_NUM_COUNTERS && valid; ii++ ) {
+    gchar *rate = g_strdup_printf ( "%.1f", rates[ii] );
+    gtk_list_store_set ( counter_store, &iter,
+                         COUNTER_VALUE_COLUMN, g_atomic_int_get ( &counters[ii] ),
+                         COUNTER_RATE_COLUMN, rate,
+                         -1 );
+    g_free ( rate );
+    valid = gtk_tree_model_iter_next ( GTK_TREE_MODEL(counter_store), &iter );
+  }
+  return TRUE;
+}
+
+static void perf_window_export ( GtkWindow *parent )
+{
+  GtkWidget *dialog = gtk_file_chooser_dialog_new ( _("Export Trace"),
+                                                    parent,
+                                                    GTK_FILE_CHOOSER_ACTION_SAVE,
+                                                    GTK_STOCK_CANCEL, GTK_RESPONSE_CANCEL,
+                                                    GTK_STOCK_SAVE, GTK_RESPONSE_ACCEPT,
+                                                    NULL );
+  gtk_file_chooser_set_do_overwrite_confirmation ( GTK_FILE_CHOOSER(dialog), TRUE );
+  gtk_file_chooser_set_current_name ( GTK_FILE_CHOOSER(dialog), "viking-trace.json" );
+  if ( gtk_dialog_run ( GTK_DIALOG(dialog) ) == GTK_RESPONSE_ACCEPT ) {
+    gchar *filename = gtk_file_chooser_get_filename ( GTK_FILE_CHOOSER(dialog) );
+    GError *error = NULL;
+    if ( !a_perf_export_trace ( filename, &error ) ) {
+      a_dialog_error_msg_extra ( parent, _("Unable to export trace: %s"), error->message );
+      g_error_free ( error );
+    }
+    g_free ( filename );
+  }
+  gtk_widget_destroy ( dialog );
+}
+
+static void perf_window_response ( GtkDialog *dialog, gint response )
+{
+  if ( response == 1 ) {
+    a_perf_reset ();
+    perf_window_refresh ( NULL );
+  }
+  else if ( response == 2 )
+    perf_window_export ( GTK_WINDOW(dialog) );
+  else
+    gtk_widget_hide ( perf_window );
+}
+
+static void perf_window_hide ( GtkWidget *widget, gpointer data )
+{
+  if ( refresh_id ) {
+    g_source_remove ( refresh_id );
+    refresh_id = 0;
+  }
+}
+
+static GtkWidget *add_tree_view ( GtkWidget *box, GtkListStore *store, const gchar **titles, guint n_columns )
+{
+  GtkWidget *view = gtk_tree_view_new_with_model ( GTK_TREE_MODEL(store) );
+  gtk_tree_view_set_rules_hint ( GTK_TREE_VIEW(view), TRUE );
+  guint ii;
+  for ( ii = 0; ii < n_columns; ii++ ) {
+    GtkCellRenderer *renderer = gtk_cell_renderer_text_new ();
+    // Right align the numbers
+    if ( ii > 0 && store == counter_store )
+      g_object_set ( G_OBJECT(renderer), "xalign", 1.0, NULL );
+    if ( ii > TIMING_NAME_COLUMN && store == timing_store )
+      g_object_set ( G_OBJECT(renderer), "xalign", 1.0, NULL );
+    GtkTreeViewColumn *column = gtk_tree_view_column_new_with_attributes ( _(titles[ii]), renderer, "text", ii, NULL );
+    gtk_tree_view_append_column ( GTK_TREE_VIEW(view), column );
+  }
+  GtkWidget *scrolled_window = gtk_scrolled_window_new ( NULL, NULL );
+  gtk_scrolled_window_set_policy ( GTK_SCROLLED_WINDOW(scrolled_window), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC );
+  gtk_container_add ( GTK_CONTAINER(scrolled_window), view );
+  gtk_box_pack_start ( GTK_BOX(box), scrolled_window, store == timing_store, TRUE, 0 );
+  return view;
+}
+
+static void perf_window_create ( GtkWindow *parent )
+{
+  timing_store = gtk_list_store_new ( TIMING_N_COLUMNS, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_UINT, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING );
+  counter_store = gtk_list_store_new ( COUNTER_N_COLUMNS, G_TYPE_STRING, G_TYPE_INT, G_TYPE_STRING );
+  guint ii;
+  for ( ii = 0; ii < PERF_NUM_COUNTERS; ii++ ) {
+    GtkTreeIter iter;
+    gtk_list_store_append ( counter_store, &iter );
+    gtk_list_store_set ( counter_store, &iter, COUNTER_NAME_COLUMN, _(counter_labels[ii]), -1 );
+  }
+
+  perf_window = gtk_dialog_new_with_buttons ( _("Viking Performance"), parent, 0,
+                                              _("_Reset"), 1,
+                                              _("_Export Trace..."), 2,
+                                              GTK_STOCK_CLOSE, GTK_RESPONSE_CLOSE,
+                                              NULL );
+  GtkWidget *content = gtk_dialog_get_content_area ( GTK_DIALOG(perf_window) );
+
+  const gchar *timing_titles[TIMING_N_COLUMNS] = { N_("Category"), N_("Name"), N_("Count"), N_("Mean (ms)"), N_("Max (ms)"), N_("Total (s)") };
+  add_tree_view ( content, timing_store, timing_titles, TIMING_N_COLUMNS );
+  const gchar *counter_titles[COUNTER_N_COLUMNS] = { N_("Counter"), N_("Value"), N_("Per second") };
+  add_tree_view ( content, counter_store, counter_titles, COUNTER_N_COLUMNS );
+
+  gtk_window_set_default_size ( GTK_WINDOW(perf_window), 500, 500 );
+  g_signal_connect ( G_OBJECT(perf_window), "delete-event", G_CALLBACK(gtk_widget_hide_on_delete), NULL );
+  g_signal_connect ( G_OBJECT(perf_window), "response", G_CALLBACK(perf_window_response), NULL );
+  g_signal_connect ( G_OBJECT(perf_window), "hide", G_CALLBACK(perf_window_hide), NULL );
+}
+
+/**
+ * a_perf_show_window:
+ *
+ * Display the live performance statistics
+ */
+void a_perf_show_window ( GtkWindow *parent )
+{
+  g_return_if_fail ( perf_mutex != NULL );
+
+  if ( !perf_window )
+    perf_window_create ( parent );
+  perf_window_refresh ( NULL );
+  if ( !refresh_id )
+    refresh_id = g_timeout_add_seconds ( 1, perf_window_refresh, NULL );
+  gtk_widget_show_all ( perf_window );
+  gtk_window_present ( GTK_WINDOW(perf_window) );
+}
@@ -0,0 +1,58 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 2; tab-width: 2 -*- */
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2026, The Viking developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+
+#ifndef _VIKING_PERFSTATS_H
+#define _VIKING_PERFSTATS_H
+
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+typedef enum {
+  PERF_MAPCACHE_HIT = 0,
+  PERF_MAPCACHE_MISS,
+  PERF_MAPCACHE_EVICTION,
+  PERF_LAYERCACHE_HIT,
+  PERF_LAYERCACHE_MISS,
+  PERF_BACKGROUND_QUEUE,      // Items currently waiting or in progress
+  PERF_BACKGROUND_COMPLETED,
+  PERF_NUM_COUNTERS
+} PerfCounter;
+
+void a_perf_init ();
+void a_perf_uninit ();
+
+gint64 a_perf_now ();
+void a_perf_record ( const gchar *category, const gchar *name, gint64 start );
+
+void a_perf_count ( PerfCounter counter, gint delta );
+void a_perf_set ( PerfCounter counter, gint value );
+
+void a_perf_reset ();
+gboolean a_perf_export_trace ( const gchar *filename, GError **error );
+
+void a_perf_show_window ( GtkWindow *parent );
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,248 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 2; tab-width: 2 -*- */
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2026, The Viking developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Write a PNG file a few rows at a time,
+ *  so that an image much larger than could be held in memory can be generated in bands.
+ *
+ * Only 8 bit RGB or RGBA images are supported (i.e. as GdkPixbufs).
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <glib/gstdio.h>
+#include <glib/gi18n.h>
+
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+
+#include "pngwriter.h"
+
+#define PNG_WRITER_BUFFER_SIZE 65536
+
+struct _PngWriter {
+  FILE *ff;
+  gchar *filename;
+  guint width;
+  guint height;
+  guint channels;
+  guint rows_written;
+  gboolean failed;
+  guchar *row;       // Filter type byte + filtered row
+  guchar *prev;      // Previous row unfiltered (for the Paeth filter)
+  guchar *out;
+#ifdef HAVE_LIBZ
+  z_stream zs;
+#endif
+};
+
+#ifdef HAVE_LIBZ
+static void put_uint32 ( guchar *buf, guint32 val )
+{
+  buf[0] = (val >> 24) & 0xff;
+  buf[1] = (val >> 16) & 0xff;
+  buf[2] = (val >> 8) & 0xff;
+  buf[3] = val & 0xff;
+}
+
+static void write_chunk ( PngWriter *pw, const gchar *type, const guchar *data, guint32 len )
+{
+  guchar buf[4];
+  put_uint32 ( buf, len );
+  uLong crc = crc32 ( 0L, (const Bytef*)type, 4 );
+  if ( len )
+    crc = crc32 ( crc, data, len );
+
+  if ( fwrite ( buf, 1, 4, pw->ff ) != 4 ||
+       fwrite ( type, 1, 4, pw->ff ) != 4 ||
+       (len && fwrite ( data, 1, len, pw->ff ) != len) )
+    pw->failed = TRUE;
+  put_uint32 ( buf, crc );
+  if ( fwrite ( buf, 1, 4, pw->ff ) != 4 )
+    pw->failed = TRUE;
+}
+
+/**
+ * Compress the available input, writing out an IDAT chunk whenever the output buffer fills
+ */
+static void deflate_to_file ( PngWriter *pw, int flush )
+{
+  int ret;
+  do {
+    ret = deflate ( &pw->zs, flush );
+    if ( ret == Z_STREAM_ERROR ) {
+      pw->failed = TRUE;
+      return;
+    }
+    if ( pw->zs.avail_out == 0 || (flush == Z_FINISH && pw->zs.avail_out < PNG_WRITER_BUFFER_SIZE) ) {
+      write_chunk ( pw, "IDAT", pw->out, PNG_WRITER_BUFFER_SIZE - pw->zs.avail_out );
+      pw->zs.next_out = pw->out;
+      pw->zs.avail_out = PNG_WRITER_BUFFER_SIZE;
+    }
+  } while ( pw->zs.avail_in > 0 || (flush == Z_FINISH && ret != Z_STREAM_END) );
+}
+
+static inline guchar paeth ( guchar a, guchar b, guchar c )
+{
+  gint p = a + b - c;
+  gint pa = abs ( p - a );
+  gint pb = abs ( p - b );
+  gint pc = abs ( p - c );
+  if ( pa <= pb && pa <= pc )
+    return a;
+  if ( pb <= pc )
+    return b;
+  return c;
+}
+#endif
+
+/**
+ * png_writer_new:
+ * @width:  Of the whole image
+ * @height: Of the whole image
+ *
+ * Returns: A writer to pass the image rows to in order, or NULL on error
+ *  (which includes when support is not available)
+ */
+PngWriter *png_writer_new ( const gchar *filename, guint width, guint height, gboolean has_alpha, GError **error )
+{
+#ifndef HAVE_LIBZ
+  g_set_error ( error, G_FILE_ERROR, G_FILE_ERROR_NOSYS, "PNG writing not supported" );
+  return NULL;
+#else
+  FILE *ff = g_fopen ( filename, "wb" );
+  if ( !ff ) {
+    g_set_error ( error, G_FILE_ERROR, g_file_error_from_errno(errno), _("Could not open %s"), filename );
+    return NULL;
+  }
+
+  PngWriter *pw = g_malloc0 ( sizeof(PngWriter) );
+  pw->ff = ff;
+  pw->filename = g_strdup ( filename );
+  pw->width = width;
+  pw->height = height;
+  pw->channels = has_alpha ? 4 : 3;
+  pw->row = g_malloc ( 1 + width * pw->channels );
+  pw->prev = g_malloc0 ( width * pw->channels );
+  pw->out = g_malloc ( PNG_WRITER_BUFFER_SIZE );
+
+  static const guchar signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+  if ( fwrite ( signature, 1, sizeof(signature), ff ) != sizeof(signature) )
+    pw->failed = TRUE;
+
+  guchar ihdr[13];
+  put_uint32 ( ihdr, width );
+  put_uint32 ( ihdr+4, height );
+  ihdr[8] = 8;                 // Bit depth
+  ihdr[9] = has_alpha ? 6 : 2; // Colour type: RGBA or RGB
+  ihdr[10] = 0;                // Deflate
+  ihdr[11] = 0;                // Adaptive filtering
+  ihdr[12] = 0;                // Not interlaced
+  write_chunk ( pw, "IHDR", ihdr, sizeof(ihdr) );
+
+  memset ( &pw->zs, 0, sizeof(z_stream) );
+  if ( deflateInit ( &pw->zs, Z_DEFAULT_COMPRESSION ) != Z_OK )
+    pw->failed = TRUE;
+  pw->zs.next_out = pw->out;
+  pw->zs.avail_out = PNG_WRITER_BUFFER_SIZE;
+
+  return pw;
+#endif
+}
+
+/**
+ * png_writer_write_rows:
+ * @pixels:    The first row to write, in the format given when created
+ * @rowstride: Bytes from one row to the next
+ * @rows:      Number of rows to write
+ *
+ * Returns: FALSE on error
+ */
+gboolean png_writer_write_rows ( PngWriter *pw, const guchar *pixels, gint rowstride, guint rows )
+{
+#ifdef HAVE_LIBZ
+  guint bpp = pw->channels;
+  guint len = pw->width * bpp;
+
+  for ( guint rr = 0; rr < rows && !pw->failed && pw->rows_written < pw->height; rr++ ) {
+    const guchar *cur = pixels + (gsize)rr * rowstride;
+    // Paeth generally compresses map images well, and is cheap enough
+    pw->row[0] = 4;
+    for ( guint i = 0; i < len; i++ ) {
+      guchar a = i >= bpp ? cur[i-bpp] : 0;
+      guchar c = i >= bpp ? pw->prev[i-bpp] : 0;
+      pw->row[i+1] = cur[i] - paeth ( a, pw->prev[i], c );
+    }
+    memcpy ( pw->prev, cur, len );
+
+    pw->zs.next_in = pw->row;
+    pw->zs.avail_in = len + 1;
+    deflate_to_file ( pw, Z_NO_FLUSH );
+    pw->rows_written++;
+  }
+#endif
+  return !pw->failed;
+}
+
+/**
+ * png_writer_close:
+ *
+ * Finish the file and free the writer.
+ * If not all the rows were written, the (invalid) file is removed.
+ *
+ * Returns: FALSE on error
+ */
+gboolean png_writer_close ( PngWriter *pw, GError **error )
+{
+#ifdef HAVE_LIBZ
+  if ( pw->rows_written == pw->height ) {
+    deflate_to_file ( pw, Z_FINISH );
+    write_chunk ( pw, "IEND", NULL, 0 );
+  }
+  else
+    pw->failed = TRUE;
+  deflateEnd ( &pw->zs );
+  if ( fclose ( pw->ff ) != 0 )
+    pw->failed = TRUE;
+
+  gboolean ok = !pw->failed;
+  if ( !ok ) {
+    g_set_error ( error, G_FILE_ERROR, G_FILE_ERROR_IO, _("Failed writing %s"), pw->filename );
+    (void)g_remove ( pw->filename );
+  }
+
+  g_free ( pw->filename );
+  g_free ( pw->row );
+  g_free ( pw->prev );
+  g_free ( pw->out );
+  g_free ( pw );
+  return ok;
+#else
+  return FALSE;
+#endif
+}
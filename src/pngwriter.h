@@ -0,0 +1,38 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 2; tab-width: 2 -*- */
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2026, The Viking developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef _VIKING_PNGWRITER_H
+#define _VIKING_PNGWRITER_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _PngWriter PngWriter;
+
+PngWriter *png_writer_new ( const gchar *filename, guint width, guint height, gboolean has_alpha, GError **error );
+gboolean png_writer_write_rows ( PngWriter *pw, const guchar *pixels, gint rowstride, guint rows );
+gboolean png_writer_close ( PngWriter *pw, GError **error );
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,314 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 2; tab-width: 2 -*- */
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2026, The Viking developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * An in memory index of which map tiles are in the cache on disk.
+ *
+ * Tiles are stored as <level directory>/<x>/<y><extension> for all the cache layouts,
+ *  so the index is kept per level directory, which is read in one go when first needed.
+ * Thereafter answering whether a tile exists doesn't touch the disk at all;
+ *  the index is updated as tiles are downloaded or removed.
+ *
+ * Since other programs (or other instances of Viking) may also change the cache,
+ *  a level is read again once it is older than a configurable lifetime.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "tileindex.h"
+#include "settings.h"
+#include "vik_compat.h"
+
+// Seconds
+#define TILE_INDEX_LIFETIME 600
+#define VIK_SETTINGS_TILE_INDEX_LIFETIME "maps_tile_index_lifetime"
+
+typedef struct {
+  gint64 key;   // x,y - NB must be first for g_int64_hash()
+  time_t mtime; // 0 if not known yet
+} TileIndexEntry;
+
+typedef struct {
+  GHashTable *tiles;
+  time_t read_time;
+} TileIndexLevel;
+
+static GHashTable *levels = NULL;
+static GMutex *index_mutex = NULL;
+static gint lifetime = TILE_INDEX_LIFETIME;
+
+static gint64 tile_key ( gint x, gint y )
+{
+  return ((gint64)x << 32) | (guint32)y;
+}
+
+static void level_free ( TileIndexLevel *level )
+{
+  g_hash_table_destroy ( level->tiles );
+  g_free ( level );
+}
+
+void a_tile_index_init ()
+{
+  levels = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, (GDestroyNotify)level_free );
+  index_mutex = vik_mutex_new ();
+  gint tmp;
+  if ( a_settings_get_integer ( VIK_SETTINGS_TILE_INDEX_LIFETIME, &tmp ) )
+    lifetime = tmp;
+}
+
+void a_tile_index_uninit ()
+{
+  g_hash_table_destroy ( levels );
+  levels = NULL;
+  vik_mutex_free ( index_mutex );
+}
+
+/**
+ * Parse a name that is a number followed by the given extension
+ */
+static gboolean parse_number ( const gchar *name, gsize len, const gchar *ext, gint *val )
+{
+  gsize ii = 0;
+  gint64 num = 0;
+  while ( ii < len && g_ascii_isdigit ( name[ii] ) ) {
+    num = num * 10 + (name[ii] - '0');
+    if ( num > G_MAXINT )
+      return FALSE;
+    ii++;
+  }
+  if ( ii == 0 )
+    return FALSE;
+  if ( ext && strncmp ( name + ii, ext, len - ii ) != 0 )
+    return FALSE;
+  if ( ext && strlen ( ext ) != len - ii )
+    return FALSE;
+  *val = (gint)num;
+  return TRUE;
+}
+
+/**
+ * Split a tile filename into the level (directory plus extension) and tile position
+ *
+ * Returns: The level key, or NULL if the filename is not of a tile
+ */
+static gchar *split_filename ( const gchar *filename, gint *x, gint *y )
+{
+  const gchar *ysep = strrchr ( filename, G_DIR_SEPARATOR );
+  if ( !ysep || ysep == filename )
+    return NULL;
+  const gchar *xsep = g_strrstr_len ( filename, ysep - filename, G_DIR_SEPARATOR_S );
+  if ( !xsep )
+    return NULL;
+  if ( !parse_number ( xsep + 1, ysep - xsep - 1, "", x ) )
+    return NULL;
+
+  const gchar *yname = ysep + 1;
+  const gchar *ext = yname;
+  while ( g_ascii_isdigit ( *ext ) )
+    ext++;
+  if ( !parse_number ( yname, strlen(yname), ext, y ) )
+    return NULL;
+
+  // NB '|' can not be in the extension
+  gchar *dir = g_strndup ( filename, xsep - filename );
+  gchar *key = g_strconcat ( dir, "|", ext, NULL );
+  g_free ( dir );
+  return key;
+}
+
+static void level_add ( TileIndexLevel *level, gint x, gint y, time_t mtime )
+{
+  TileIndexEntry *entry = g_malloc ( sizeof(TileIndexEntry) );
+  entry->key = tile_key ( x, y );
+  entry->mtime = mtime;
+  g_hash_table_replace ( level->tiles, entry, entry );
+}
+
+/**
+ * Read all the tiles of a level from disk - just the directory entries, no stat()ing of files
+ */
+static TileIndexLevel *level_read ( const gchar *key )
+{
+  TileIndexLevel *level = g_malloc ( sizeof(TileIndexLevel) );
+  level->tiles = g_hash_table_new_full ( g_int64_hash, g_int64_equal, g_free, NULL );
+  level->read_time = time ( NULL );
+
+  const gchar *bar = strrchr ( key, '|' );
+  gchar *dir = g_strndup ( key, bar - key );
+  const gchar *ext = bar + 1;
+
+  GDir *xdir = g_dir_open ( dir, 0, NULL );
+  if ( xdir ) {
+    const gchar *xname;
+    while ( (xname = g_dir_read_name ( xdir )) ) {
+      gint x;
+      if ( !parse_number ( xname, strlen(xname), "", &x ) )
+        continue;
+      gchar *ydirname = g_build_filename ( dir, xname, NULL );
+      GDir *ydir = g_dir_open ( ydirname, 0, NULL );
+      if ( ydir ) {
+        const gchar *yname;
+        gint y;
+        while ( (yname = g_dir_read_name ( ydir )) )
+          // Partially downloaded tiles are in a .tmp file, so are ignored
+          if ( parse_number ( yname, strlen(yname), ext, &y ) )
+            level_add ( level, x, y, 0 );
+        g_dir_close ( ydir );
+      }
+      g_free ( ydirname );
+    }
+    g_dir_close ( xdir );
+  }
+  g_free ( dir );
+  return level;
+}
+
+/**
+ * Get the index entry for a tile, reading the level if necessary
+ * NB call with the mutex held
+ *
+ * Returns: FALSE if the filename is not a tile
+ */
+static gboolean lookup ( const gchar *filename, TileIndexLevel **level, TileIndexEntry **entry, gint *x, gint *y )
+{
+  gchar *key = split_filename ( filename, x, y );
+  if ( !key )
+    return FALSE;
+
+  *level = g_hash_table_lookup ( levels, key );
+  if ( !*level || (lifetime > 0 && time(NULL) - (*level)->read_time > lifetime) ) {
+    *level = level_read ( key );
+    g_hash_table_replace ( levels, key, *level );
+  }
+  else
+    g_free ( key );
+
+  gint64 tk = tile_key ( *x, *y );
+  *entry = g_hash_table_lookup ( (*level)->tiles, &tk );
+  return TRUE;
+}
+
+/**
+ * a_tile_index_exists:
+ * @filename: The tile file in the cache
+ *
+ * Returns: Whether the tile is in the cache
+ */
+gboolean a_tile_index_exists ( const gchar *filename )
+{
+  TileIndexLevel *level;
+  TileIndexEntry *entry;
+  gint x, y;
+  gboolean exists;
+
+  g_mutex_lock ( index_mutex );
+  if ( lookup ( filename, &level, &entry, &x, &y ) )
+    exists = (entry != NULL);
+  else
+    exists = g_file_test ( filename, G_FILE_TEST_EXISTS );
+  g_mutex_unlock ( index_mutex );
+
+  return exists;
+}
+
+/**
+ * a_tile_index_get_mtime:
+ * @filename: The tile file in the cache
+ *
+ * Returns: The modification time of the tile, or 0 if it is not in the cache
+ */
+time_t a_tile_index_get_mtime ( const gchar *filename )
+{
+  TileIndexLevel *level;
+  TileIndexEntry *entry;
+  gint x, y;
+  time_t mtime = 0;
+  GStatBuf stat_buf;
+
+  g_mutex_lock ( index_mutex );
+  if ( lookup ( filename, &level, &entry, &x, &y ) ) {
+    if ( entry ) {
+      // Times are only found out when they are wanted
+      if ( !entry->mtime && g_stat ( filename, &stat_buf ) == 0 )
+        entry->mtime = stat_buf.st_mtime;
+      mtime = entry->mtime;
+    }
+  }
+  else if ( g_stat ( filename, &stat_buf ) == 0 )
+    mtime = stat_buf.st_mtime;
+  g_mutex_unlock ( index_mutex );
+
+  return mtime;
+}
+
+/**
+ * a_tile_index_add:
+ * @filename: The tile file that has just been written into the cache
+ */
+void a_tile_index_add ( const gchar *filename )
+{
+  TileIndexLevel *level;
+  TileIndexEntry *entry;
+  gint x, y;
+
+  g_mutex_lock ( index_mutex );
+  if ( lookup ( filename, &level, &entry, &x, &y ) ) {
+    if ( entry )
+      entry->mtime = time ( NULL );
+    else
+      level_add ( level, x, y, time ( NULL ) );
+  }
+  g_mutex_unlock ( index_mutex );
+}
+
+/**
+ * a_tile_index_remove:
+ * @filename: The tile file that has just been removed from the cache
+ */
+void a_tile_index_remove ( const gchar *filename )
+{
+  TileIndexLevel *level;
+  TileIndexEntry *entry;
+  gint x, y;
+
+  g_mutex_lock ( index_mutex );
+  if ( lookup ( filename, &level, &entry, &x, &y ) && entry )
+    g_hash_table_remove ( level->tiles, entry );
+  g_mutex_unlock ( index_mutex );
+}
+
+/**
+ * a_tile_index_flush:
+ *
+ * Forget everything, so the cache is read again when next needed
+ */
+void a_tile_index_flush ()
+{
+  g_mutex_lock ( index_mutex );
+  g_hash_table_remove_all ( levels );
+  g_mutex_unlock ( index_mutex );
+}
@@ -0,0 +1,41 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 2; tab-width: 2 -*- */
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2026, The Viking developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef _VIKING_TILEINDEX_H
+#define _VIKING_TILEINDEX_H
+
+#include <glib.h>
+#include <time.h>
+
+G_BEGIN_DECLS
+
+void a_tile_index_init ();
+gboolean a_tile_index_exists ( const gchar *filename );
+time_t a_tile_index_get_mtime ( const gchar *filename );
+void a_tile_index_add ( const gchar *filename );
+void a_tile_index_remove ( const gchar *filename );
+void a_tile_index_flush ();
+void a_tile_index_uninit ();
+
+G_END_DECLS
+
+#endif
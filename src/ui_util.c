@@ -205,7 +205,7 @@ GtkWidget* ui_label_new_selectable ( const gchar* text )
 GdkPixbuf *ui_pixbuf_set_alpha ( GdkPixbuf *pixbuf, guint8 alpha )
 {
   guchar *pixels;
-  gint width, height, iii, jjj;
+  gint width, height, rowstride, iii, jjj;
 
   if ( ! gdk_pixbuf_get_has_alpha ( pixbuf ) )
   {
@@ -219,26 +219,86 @@ GdkPixbuf *ui_pixbuf_set_alpha ( GdkPixbuf *pixbuf, guint8 alpha )
   pixels = gdk_pixbuf_get_pixels(pixbuf);
   width = gdk_pixbuf_get_width(pixbuf);
   height = gdk_pixbuf_get_height(pixbuf);
+  rowstride = gdk_pixbuf_get_rowstride(pixbuf);
 
-  /* r,g,b,a,r,g,b,a.... */
-  for (iii = 0; iii < width; iii++) for (jjj = 0; jjj < height; jjj++)
+  /* r,g,b,a,r,g,b,a.... - row by row, as rows may be padded */
+  for (jjj = 0; jjj < height; jjj++, pixels += rowstride)
   {
-    pixels += 3;
-    if ( *pixels != 0 )
-      *pixels = alpha;
-    pixels++;
+    guchar *px = pixels + 3;
+    for (iii = 0; iii < width; iii++, px += 4)
+      if ( *px != 0 )
+        *px = alpha;
   }
   return pixbuf;
 }
 
 
+/**
+ * ui_pixbuf_half_size:
+ *
+ * Halve the size of the pixbuf by averaging each 2x2 block of pixels (i.e. a box filter),
+ *  as used to make each level of a mipmap from the previous one.
+ * The last row and column of odd sized pixbufs are averaged with themselves.
+ * Colours of pixbufs with an alpha channel are weighted by their alpha,
+ *  so transparent pixels don't darken the edges of what's visible.
+ *
+ * Returns: A new pixbuf
+ */
+GdkPixbuf *ui_pixbuf_half_size ( GdkPixbuf *pixbuf )
+{
+  gint width = gdk_pixbuf_get_width ( pixbuf );
+  gint height = gdk_pixbuf_get_height ( pixbuf );
+  gint new_width = MAX ( 1, (width + 1) / 2 );
+  gint new_height = MAX ( 1, (height + 1) / 2 );
+  gboolean has_alpha = gdk_pixbuf_get_has_alpha ( pixbuf );
+  gint n_channels = gdk_pixbuf_get_n_channels ( pixbuf );
+
+  if ( gdk_pixbuf_get_bits_per_sample ( pixbuf ) != 8 || n_channels != (has_alpha ? 4 : 3) )
+    return gdk_pixbuf_scale_simple ( pixbuf, new_width, new_height, GDK_INTERP_BILINEAR );
+
+  GdkPixbuf *half = gdk_pixbuf_new ( GDK_COLORSPACE_RGB, has_alpha, 8, new_width, new_height );
+  if ( !half )
+    return NULL;
+
+  const guchar *src = gdk_pixbuf_get_pixels ( pixbuf );
+  guchar *dst = gdk_pixbuf_get_pixels ( half );
+  gint src_stride = gdk_pixbuf_get_rowstride ( pixbuf );
+  gint dst_stride = gdk_pixbuf_get_rowstride ( half );
+  gint x, y, c;
+
+  for ( y = 0; y < new_height; y++ ) {
+    const guchar *row0 = src + (2 * y) * src_stride;
+    const guchar *row1 = ( 2 * y + 1 < height ) ? row0 + src_stride : row0;
+    guchar *out = dst + y * dst_stride;
+    for ( x = 0; x < new_width; x++ ) {
+      // Offset of the right hand pixels of the block
+      gint right = ( 2 * x + 1 < width ) ? n_channels : 0;
+      const guchar *p0 = row0 + 2 * x * n_channels;
+      const guchar *p1 = row1 + 2 * x * n_channels;
+      if ( has_alpha ) {
+        guint a0 = p0[3], a1 = p0[right+3], a2 = p1[3], a3 = p1[right+3];
+        guint asum = a0 + a1 + a2 + a3;
+        for ( c = 0; c < 3; c++ )
+          out[c] = asum ? ( p0[c]*a0 + p0[right+c]*a1 + p1[c]*a2 + p1[right+c]*a3 + asum/2 ) / asum : 0;
+        out[3] = ( asum + 2 ) >> 2;
+      }
+      else {
+        for ( c = 0; c < 3; c++ )
+          out[c] = ( p0[c] + p0[right+c] + p1[c] + p1[right+c] + 2 ) >> 2;
+      }
+      out += n_channels;
+    }
+  }
+  return half;
+}
+
 /**
  * Reduce the alpha value of the specified pixbuf by alpha / 255
  */
 GdkPixbuf *ui_pixbuf_scale_alpha ( GdkPixbuf *pixbuf, guint8 alpha )
 {
   guchar *pixels;
-  gint width, height, iii, jjj;
+  gint width, height, rowstride, iii, jjj;
 
   if ( ! gdk_pixbuf_get_has_alpha ( pixbuf ) )
   {
@@ -252,14 +312,15 @@ GdkPixbuf *ui_pixbuf_scale_alpha ( GdkPixbuf *pixbuf, guint8 alpha )
   pixels = gdk_pixbuf_get_pixels(pixbuf);
   width = gdk_pixbuf_get_width(pixbuf);
   height = gdk_pixbuf_get_height(pixbuf);
+  rowstride = gdk_pixbuf_get_rowstride(pixbuf);
 
-  /* r,g,b,a,r,g,b,a.... */
-  for (iii = 0; iii < width; iii++) for (jjj = 0; jjj < height; jjj++)
+  /* r,g,b,a,r,g,b,a.... - row by row, as rows may be padded */
+  for (jjj = 0; jjj < height; jjj++, pixels += rowstride)
   {
-    pixels += 3;
-    if ( *pixels != 0 )
-      *pixels = (guint8)(((guint16)*pixels * (guint16)alpha) / 255);
-    pixels++;
+    guchar *px = pixels + 3;
+    for (iii = 0; iii < width; iii++, px += 4)
+      if ( *px != 0 )
+        *px = (guint8)(((guint16)*px * (guint16)alpha) / 255);
   }
   return pixbuf;
 }
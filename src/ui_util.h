@@ -43,6 +43,7 @@ GtkWidget *ui_spin_button_new ( GtkAdjustment *adjustment,
 
 GdkPixbuf *ui_pixbuf_set_alpha ( GdkPixbuf *pixbuf, guint8 alpha );
 GdkPixbuf *ui_pixbuf_scale_alpha ( GdkPixbuf *pixbuf, guint8 alpha );
+GdkPixbuf *ui_pixbuf_half_size ( GdkPixbuf *pixbuf );
 void ui_add_recent_file ( const gchar *filename );
 
 G_END_DECLS
@@ -42,3 +42,24 @@ void vik_mutex_free (GMutex *mutex)
   g_mutex_free (mutex);
 #endif
 }
+
+GCond * vik_cond_new ()
+{
+#if GLIB_CHECK_VERSION (2, 32, 0)
+	GCond *cond = g_new (GCond, 1);
+	g_cond_init(cond);
+#else
+	GCond *cond = g_cond_new();
+#endif
+	return cond;
+}
+
+void vik_cond_free (GCond *cond)
+{
+#if GLIB_CHECK_VERSION (2, 32, 0)
+  g_cond_clear (cond);
+  g_free (cond);
+#else
+  g_cond_free (cond);
+#endif
+}
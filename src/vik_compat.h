@@ -36,6 +36,9 @@ typedef struct stat GStatBuf;
 GMutex * vik_mutex_new ();
 void vik_mutex_free (GMutex *mutex);
 
+GCond * vik_cond_new ();
+void vik_cond_free (GCond *cond);
+
 /*
  * Since combo boxes are used in various places
  * keep the code reasonably tidy and only have one ifdef to cater for the naming variances
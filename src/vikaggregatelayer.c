@@ -24,6 +24,7 @@
 #include "viktrwlayer_analysis.h"
 #include "viktrwlayer_tracklist.h"
 #include "viktrwlayer_waypointlist.h"
+#include "perfstats.h"
 #include "icons/icons.h"
 
 #include <string.h>
@@ -323,34 +324,65 @@ void vik_aggregate_layer_move_layer ( VikAggregateLayer *val, GtkTreeIter *child
     val->children = second;
 }
 
-/* Draw the aggregate layer. If vik viewport is in half_drawn mode, this means we are only
- * to draw the layers above and including the trigger layer.
- * To do this we don't draw any layers if in half drawn mode, unless we find the
- * trigger layer, in which case we pull up the saved pixmap, turn off half drawn mode and
- * start drawing layers.
- * Also, if we were never in half drawn mode, we save a snapshot
- * of the pixmap before drawing the trigger layer so we can use it again
- * later.
+/*
+ * Combine what identifies the drawing of a layer into the key of everything drawn before it
+ */
+static guint64 aggregate_layer_key_add ( guint64 key, VikLayer *vl )
+{
+  // FNV-1a style mixing
+  const guint64 prime = G_GUINT64_CONSTANT(1099511628211);
+  key = (key ^ (guint64)GPOINTER_TO_SIZE(vl)) * prime;
+  key = (key ^ (guint64)(guint)g_atomic_int_get(&vl->version)) * prime;
+  key = (key ^ (guint64)vl->visible) * prime;
+  return key;
+}
+
+/* Draw the aggregate layer.
+ * The viewport keeps snapshots of the drawing part way through the layers,
+ *  each keyed by the layers (and their versions) drawn up to that point.
+ * So when the highest snapshot still valid can be restored, only the layers above it
+ *  (i.e. from the lowest changed layer upwards) need to be drawn again.
+ * Keys start from what has been drawn before this layer, so this also works for nested aggregate layers.
  */
 void vik_aggregate_layer_draw ( VikAggregateLayer *val, VikViewport *vp )
 {
-  GList *iter = val->children;
-  VikLayer *vl;
-  VikLayer *trigger = VIK_LAYER(vik_viewport_get_trigger( vp ));
-  while ( iter ) {
-    vl = VIK_LAYER(iter->data);
-    if ( vl == trigger ) {
-      if ( vik_viewport_get_half_drawn ( vp ) ) {
-        vik_viewport_set_half_drawn ( vp, FALSE );
-        vik_viewport_snapshot_load( vp );
-      } else {
-        vik_viewport_snapshot_save( vp );
-      }
+  guint nn = g_list_length ( val->children );
+  if ( !nn )
+    return;
+
+  guint64 base = vik_viewport_layer_cache_get_base ( vp );
+  guint64 *keys = g_new ( guint64, nn );
+  guint64 key = base;
+  GList *iter;
+  guint ii;
+  for ( iter = val->children, ii = 0; iter; iter = iter->next, ii++ ) {
+    keys[ii] = key;
+    key = aggregate_layer_key_add ( key, VIK_LAYER(iter->data) );
+  }
+
+  guint start = 0;
+  for ( ii = nn - 1; ii > 0; ii-- ) {
+    if ( vik_viewport_layer_cache_load ( vp, keys[ii] ) ) {
+      start = ii;
+      break;
     }
-    if ( vl->type == VIK_LAYER_AGGREGATE || vl->type == VIK_LAYER_GPS || ! vik_viewport_get_half_drawn( vp ) )
-      vik_layer_draw ( vl, vp );
-    iter = iter->next;
   }
+  // Count each draw once, rather than every snapshot looked for
+  if ( nn > 1 && vik_viewport_layer_cache_get_usable ( vp ) )
+    a_perf_count ( start ? PERF_LAYERCACHE_HIT : PERF_LAYERCACHE_MISS, 1 );
+
+  for ( iter = g_list_nth ( val->children, start ), ii = start; iter; iter = iter->next, ii++ ) {
+    VikLayer *vl = VIK_LAYER(iter->data);
+    if ( !vl->visible )
+      continue;
+    if ( ii > start )
+      vik_viewport_layer_cache_save ( vp, keys[ii] );
+    vik_viewport_layer_cache_set_base ( vp, keys[ii] );
+    vik_layer_draw ( vl, vp );
+  }
+
+  vik_viewport_layer_cache_set_base ( vp, base );
+  g_free ( keys );
 }
 
 static void aggregate_layer_change_coord_mode ( VikAggregateLayer *val, VikCoordMode mode )
@@ -438,6 +438,7 @@ gboolean dem_layer_set_param ( VikDEMLayer *vdl, guint16 id, VikLayerParamData d
         dltd->vdl->files = data.sl;
 
         a_background_thread ( BACKGROUND_POOL_LOCAL,
+                              BACKGROUND_PRIORITY_INTERACTIVE, 0,
                               VIK_GTK_WINDOW_FROM_WIDGET(vp),
                               _("DEM Loading"),
                               (vik_thr_func) dem_layer_load_list_thread,
@@ -942,16 +943,39 @@ typedef struct {
  *  SOURCE: SRTM                                  *
  **************************************************/
 
+/**
+ * srtm_download:
+ *
+ * Returns: The result of the download, or DOWNLOAD_PARAMETERS_ERROR if there is no SRTM data for the location
+ */
+static DownloadResult_t srtm_download ( gint intlat, gint intlon, const gchar *dest )
+{
+  const gchar *continent_dir = srtm_continent_dir(intlat, intlon);
+  if (!continent_dir)
+    return DOWNLOAD_PARAMETERS_ERROR;
+
+  gchar *src_url = g_strdup_printf("%s/%s/%c%02d%c%03d.hgt.zip",
+                base_url,
+                continent_dir,
+		(intlat >= 0) ? 'N' : 'S',
+		ABS(intlat),
+		(intlon >= 0) ? 'E' : 'W',
+		ABS(intlon) );
+
+  static DownloadFileOptions options = { FALSE, FALSE, NULL, 5, a_check_map_file, NULL, NULL };
+  DownloadResult_t result = a_http_download_get_url ( src_url, NULL, dest, &options, NULL );
+  g_free ( src_url );
+  return result;
+}
+
 static void srtm_dem_download_thread ( DEMDownloadParams *p, gpointer threaddata )
 {
   gint intlat, intlon;
-  const gchar *continent_dir;
 
   intlat = (int)floor(p->lat);
   intlon = (int)floor(p->lon);
-  continent_dir = srtm_continent_dir(intlat, intlon);
 
-  if (!continent_dir) {
+  if (!srtm_continent_dir(intlat, intlon)) {
     if ( p->vdl ) {
       gchar *msg = g_strdup_printf ( _("No SRTM data available for %f, %f"), p->lat, p->lon );
       vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(p->vdl), msg, VIK_STATUSBAR_INFO );
@@ -960,16 +984,7 @@ static void srtm_dem_download_thread ( DEMDownloadParams *p, gpointer threaddata
     return;
   }
 
-  gchar *src_url = g_strdup_printf("%s/%s/%c%02d%c%03d.hgt.zip",
-                base_url,
-                continent_dir,
-		(intlat >= 0) ? 'N' : 'S',
-		ABS(intlat),
-		(intlon >= 0) ? 'E' : 'W',
-		ABS(intlon) );
-
-  static DownloadFileOptions options = { FALSE, FALSE, NULL, 5, a_check_map_file, NULL, NULL };
-  DownloadResult_t result = a_http_download_get_url ( src_url, NULL, p->dest, &options, NULL );
+  DownloadResult_t result = srtm_download ( intlat, intlon, p->dest );
   switch ( result ) {
     case DOWNLOAD_PARAMETERS_ERROR:
     case DOWNLOAD_CONTENT_ERROR:
@@ -990,7 +1005,6 @@ static void srtm_dem_download_thread ( DEMDownloadParams *p, gpointer threaddata
     default:
       break;
   }
-  g_free ( src_url );
 }
 
 static gchar *srtm_lat_lon_to_dest_fn ( gdouble lat, gdouble lon )
@@ -1170,6 +1184,66 @@ static gboolean dem_layer_add_file ( VikDEMLayer *vdl, const gchar *filename )
     return FALSE;
 }
 
+/**
+ * vik_dem_layer_is_srtm:
+ *
+ * Returns: TRUE if this layer's download source is SRTM
+ */
+gboolean vik_dem_layer_is_srtm ( VikDEMLayer *vdl )
+{
+  return vdl->source == DEM_SOURCE_SRTM;
+}
+
+/**
+ * vik_dem_layer_download_srtm_tile:
+ * @intlat: The south edge of the 1 degree tile
+ * @intlon: The west edge of the 1 degree tile
+ *
+ * Ensure the SRTM tile is in the cache (downloading it if necessary) and loaded.
+ * This blocks, so is intended to be called from a background thread.
+ *
+ * Returns: The filename of the tile if it is now loaded, or NULL.
+ *          The caller holds a reference on the DEM, to be released with a_dems_unref(),
+ *          and should free the string.
+ *          To show the DEM in a layer, pass the filename to vik_dem_layer_add_file() from the main thread.
+ */
+gchar *vik_dem_layer_download_srtm_tile ( gint intlat, gint intlon )
+{
+  if ( !srtm_continent_dir(intlat, intlon) )
+    return NULL;
+
+  gchar *dem_file = srtm_lat_lon_to_dest_fn ( intlat + 0.5, intlon + 0.5 );
+  gchar *full_path = g_strdup_printf ( "%s%s", MAPS_CACHE_DIR, dem_file );
+  g_free ( dem_file );
+
+  if ( !g_file_test ( full_path, G_FILE_TEST_EXISTS ) ) {
+    DownloadResult_t result = srtm_download ( intlat, intlon, full_path );
+    if ( result != DOWNLOAD_SUCCESS && result != DOWNLOAD_NOT_REQUIRED )
+      g_warning ( "%s: Failed to download %s", __FUNCTION__, full_path );
+  }
+
+  if ( !a_dems_load ( full_path ) ) {
+    g_free ( full_path );
+    return NULL;
+  }
+  return full_path;
+}
+
+/**
+ * vik_dem_layer_add_file:
+ *
+ * Add the DEM file to the layer, unless it is already in it.
+ * Only for use from the main thread.
+ *
+ * Returns: TRUE if the file was added
+ */
+gboolean vik_dem_layer_add_file ( VikDEMLayer *vdl, const gchar *filename )
+{
+  if ( g_list_find_custom ( vdl->files, filename, (GCompareFunc)g_strcmp0 ) )
+    return FALSE;
+  return dem_layer_add_file ( vdl, filename );
+}
+
 static void dem_download_thread ( DEMDownloadParams *p, gpointer threaddata )
 {
   if ( p->source == DEM_SOURCE_SRTM )
@@ -1303,6 +1377,7 @@ static gboolean dem_layer_download_release ( VikDEMLayer *vdl, GdkEventButton *e
       g_object_weak_ref(G_OBJECT(p->vdl), weak_ref_cb, p );
 
       a_background_thread ( BACKGROUND_POOL_REMOTE,
+                            BACKGROUND_PRIORITY_BULK, 0,
                             VIK_GTK_WINDOW_FROM_LAYER(vdl), tmp,
                             (vik_thr_func) dem_download_thread, p,
                             (vik_thr_free_func) free_dem_download_params, NULL, 1 );
@@ -42,6 +42,10 @@ GType vik_dem_layer_get_type ();
 
 typedef struct _VikDEMLayer VikDEMLayer;
 
+gboolean vik_dem_layer_is_srtm ( VikDEMLayer *vdl );
+gchar *vik_dem_layer_download_srtm_tile ( gint intlat, gint intlon );
+gboolean vik_dem_layer_add_file ( VikDEMLayer *vdl, const gchar *filename );
+
 G_END_DECLS
 
 #endif
@@ -38,6 +38,8 @@
 #include "preferences.h"
 #include "icons/icons.h"
 #include "vikmapslayer.h"
+#include "georefpyramid.h"
+#include "background.h"
 
 /*
 static VikLayerParamData image_default ( void )
@@ -189,6 +191,10 @@ typedef struct {
   GtkWidget *imageentry;
 } changeable_widgets;
 
+#define VIK_SETTINGS_GEOREF_PYRAMID_MIN_SIZE "georef_pyramid_min_size"
+#define GEOREF_PYRAMID_MIN_SIZE 4096
+#define GEOREF_PREVIEW_SIZE 1024
+
 struct _VikGeorefLayer {
   VikLayer vl;
   gchar *image;
@@ -203,6 +209,12 @@ struct _VikGeorefLayer {
   GdkPixbuf *scaled;
   guint32 scaled_width, scaled_height;
 
+  // For large images - see georef_layer_load_large_image()
+  VikGeorefPyramid *pyramid;
+  GdkPixbuf *preview; // Reduced size image to draw until the pyramid is available
+  gint pyramid_built;
+  gint image_generation; // Changes with the image, so builds for previous images are ignored
+
   gint click_x, click_y;
   changeable_widgets cw;
 };
@@ -354,6 +366,10 @@ static VikGeorefLayer *georef_layer_new ( VikViewport *vvp )
   vgl->scaled = NULL;
   vgl->scaled_width = 0;
   vgl->scaled_height = 0;
+  vgl->pyramid = NULL;
+  vgl->preview = NULL;
+  vgl->pyramid_built = 0;
+  vgl->image_generation = 0;
   vgl->ll_br.lat = 0.0;
   vgl->ll_br.lon = 0.0;
   vgl->alpha = 255;
@@ -395,7 +411,16 @@ static void georef_layer_mpp_from_coords ( VikCoordMode mode, struct LatLon ll_t
 
 static void georef_layer_draw ( VikGeorefLayer *vgl, VikViewport *vp )
 {
-  if ( vgl->pixbuf )
+  // Pyramid been built in the background since the last draw?
+  if ( !vgl->pyramid && g_atomic_int_get ( &vgl->pyramid_built ) && vgl->image ) {
+    vgl->pyramid = vik_georef_pyramid_open ( vgl->image );
+    if ( vgl->pyramid && vgl->preview ) {
+      g_object_unref ( vgl->preview );
+      vgl->preview = NULL;
+    }
+  }
+
+  if ( vgl->pixbuf || vgl->pyramid || vgl->preview )
   {
     gdouble xmpp = vik_viewport_get_xmpp(vp), ympp = vik_viewport_get_ympp(vp);
     GdkPixbuf *pixbuf = vgl->pixbuf;
@@ -420,6 +445,27 @@ static void georef_layer_draw ( VikGeorefLayer *vgl, VikViewport *vp )
     // If image not in viewport bounds - no need to draw it (or bother with any scaling)
     if ( (x < 0 || x < width) && (y < 0 || y < height) && x+layer_width > 0 && y+layer_height > 0 ) {
 
+      if ( vgl->pyramid ) {
+        vik_georef_pyramid_draw ( vgl->pyramid, vp, x, y,
+                                  (gdouble)layer_width / vgl->width, (gdouble)layer_height / vgl->height, vgl->alpha );
+        return;
+      }
+
+      if ( !pixbuf ) {
+        // Pyramid still being built
+        vik_viewport_draw_pixbuf_scaled ( vp, vgl->preview, vgl->alpha,
+                                          0, 0, gdk_pixbuf_get_width(vgl->preview), gdk_pixbuf_get_height(vgl->preview),
+                                          x, y, layer_width, layer_height );
+        return;
+      }
+
+      if ( scale && (layer_width > vgl->width || layer_height > vgl->height) ) {
+        // Enlarge only the visible part as it is drawn, rather than making an even bigger image
+        vik_viewport_draw_pixbuf_scaled ( vp, pixbuf, vgl->alpha, 0, 0, vgl->width, vgl->height,
+                                          x, y, layer_width, layer_height );
+        return;
+      }
+
       if ( scale )
       {
         /* rescale if necessary */
@@ -442,7 +488,7 @@ static void georef_layer_draw ( VikGeorefLayer *vgl, VikViewport *vp )
           vgl->scaled_height = layer_height;
         }
       }
-      vik_viewport_draw_pixbuf ( vp, pixbuf, 0, 0, x, y, layer_width, layer_height ); /* todo: draw only what we need to. */
+      vik_viewport_draw_pixbuf_with_alpha ( vp, pixbuf, vgl->alpha, 0, 0, x, y, layer_width, layer_height ); /* todo: draw only what we need to. */
     }
   }
 }
@@ -453,6 +499,9 @@ static void georef_layer_free ( VikGeorefLayer *vgl )
     g_free ( vgl->image );
   if ( vgl->scaled != NULL )
     g_object_unref ( vgl->scaled );
+  if ( vgl->preview != NULL )
+    g_object_unref ( vgl->preview );
+  vik_georef_pyramid_free ( vgl->pyramid );
 }
 
 static VikGeorefLayer *georef_layer_create ( VikViewport *vp )
@@ -465,6 +514,124 @@ static gboolean georef_layer_properties ( VikGeorefLayer *vgl, gpointer vp )
   return georef_layer_dialog ( vgl, vp, VIK_GTK_WINDOW_FROM_WIDGET(vp) );
 }
 
+typedef struct {
+  VikGeorefLayer *vgl;
+  gchar *image;
+  gint image_generation;
+  GMutex *mutex;
+} PyramidBuildParams;
+
+static void pyramid_weak_ref_cb ( gpointer ptr, GObject *dead_vgl )
+{
+  PyramidBuildParams *p = ptr;
+  g_mutex_lock ( p->mutex );
+  p->vgl = NULL;
+  g_mutex_unlock ( p->mutex );
+}
+
+static void pyramid_build_thread ( PyramidBuildParams *p, gpointer threaddata )
+{
+  gboolean built = vik_georef_pyramid_build ( p->image, threaddata );
+
+  g_mutex_lock ( p->mutex );
+  if ( p->vgl ) {
+    g_object_weak_unref ( G_OBJECT(p->vgl), pyramid_weak_ref_cb, p );
+    if ( built && g_atomic_int_get ( &p->vgl->image_generation ) == p->image_generation ) {
+      // The pyramid is then opened on the next draw
+      g_atomic_int_set ( &p->vgl->pyramid_built, 1 );
+      vik_layer_emit_update ( VIK_LAYER(p->vgl) ); // NB update from background thread
+    }
+    p->vgl = NULL;
+  }
+  g_mutex_unlock ( p->mutex );
+}
+
+static void pyramid_build_free ( PyramidBuildParams *p )
+{
+  // When cancelled the layer may still be around
+  g_mutex_lock ( p->mutex );
+  if ( p->vgl )
+    g_object_weak_unref ( G_OBJECT(p->vgl), pyramid_weak_ref_cb, p );
+  g_mutex_unlock ( p->mutex );
+  vik_mutex_free ( p->mutex );
+  g_free ( p->image );
+  g_free ( p );
+}
+
+/**
+ * Images bigger than this (in either dimension) are drawn via a tiled pyramid, rather than being held in memory
+ */
+static gint georef_pyramid_min_size ( void )
+{
+  gint size = GEOREF_PYRAMID_MIN_SIZE;
+  gint tmp;
+  if ( a_settings_get_integer ( VIK_SETTINGS_GEOREF_PYRAMID_MIN_SIZE, &tmp ) )
+    size = tmp;
+  return size;
+}
+
+/**
+ * Large images are not loaded as such, instead they are drawn from a tiled
+ *  pyramid stored on disk (which is created in the background on first use).
+ *
+ * Returns: TRUE if the image is large
+ */
+static gboolean georef_layer_load_large_image ( VikGeorefLayer *vgl )
+{
+  gint width, height;
+  if ( !gdk_pixbuf_get_file_info ( vgl->image, &width, &height ) )
+    return FALSE;
+  gint min_size = georef_pyramid_min_size ();
+  if ( min_size <= 0 || (width <= min_size && height <= min_size) )
+    return FALSE;
+
+  vgl->width = width;
+  vgl->height = height;
+  vgl->pyramid = vik_georef_pyramid_open ( vgl->image );
+  if ( vgl->pyramid )
+    return TRUE;
+
+  // Show something while the pyramid is built
+  //  (for JPEGs at least, this is decoded directly at the reduced size)
+  vgl->preview = gdk_pixbuf_new_from_file_at_size ( vgl->image, GEOREF_PREVIEW_SIZE, GEOREF_PREVIEW_SIZE, NULL );
+
+  PyramidBuildParams *p = g_malloc ( sizeof(PyramidBuildParams) );
+  p->vgl = vgl;
+  p->image = g_strdup ( vgl->image );
+  p->image_generation = g_atomic_int_get ( &vgl->image_generation );
+  p->mutex = vik_mutex_new ();
+  g_object_weak_ref ( G_OBJECT(vgl), pyramid_weak_ref_cb, p );
+
+  gchar *msg = g_strdup_printf ( _("Preparing image %s"), a_file_basename ( vgl->image ) );
+  a_background_thread ( BACKGROUND_POOL_LOCAL, BACKGROUND_PRIORITY_INTERACTIVE, 0,
+                        VIK_GTK_WINDOW_FROM_LAYER(vgl), msg,
+                        (vik_thr_func) pyramid_build_thread, p,
+                        (vik_thr_free_func) pyramid_build_free, NULL, 1 );
+  g_free ( msg );
+  return TRUE;
+}
+
+/**
+ * Drop everything derived from the image
+ */
+static void georef_layer_clear_image ( VikGeorefLayer *vgl )
+{
+  if ( vgl->scaled )
+  {
+    g_object_unref ( G_OBJECT(vgl->scaled) );
+    vgl->scaled = NULL;
+  }
+  if ( vgl->preview )
+  {
+    g_object_unref ( G_OBJECT(vgl->preview) );
+    vgl->preview = NULL;
+  }
+  vik_georef_pyramid_free ( vgl->pyramid );
+  vgl->pyramid = NULL;
+  g_atomic_int_set ( &vgl->pyramid_built, 0 );
+  g_atomic_int_inc ( &vgl->image_generation );
+}
+
 static void georef_layer_load_image ( VikGeorefLayer *vgl, VikViewport *vp, gboolean from_file )
 {
   GError *gx = NULL;
@@ -472,12 +639,14 @@ static void georef_layer_load_image ( VikGeorefLayer *vgl, VikViewport *vp, gboo
     return;
 
   if ( vgl->pixbuf )
-    g_object_unref ( G_OBJECT(vgl->pixbuf) );
-  if ( vgl->scaled )
   {
-    g_object_unref ( G_OBJECT(vgl->scaled) );
-    vgl->scaled = NULL;
+    g_object_unref ( G_OBJECT(vgl->pixbuf) );
+    vgl->pixbuf = NULL;
   }
+  georef_layer_clear_image ( vgl );
+
+  if ( georef_layer_load_large_image ( vgl ) )
+    return;
 
   vgl->pixbuf = gdk_pixbuf_new_from_file ( vgl->image, &gx );
 
@@ -491,9 +660,6 @@ static void georef_layer_load_image ( VikGeorefLayer *vgl, VikViewport *vp, gboo
   {
     vgl->width = gdk_pixbuf_get_width ( vgl->pixbuf );
     vgl->height = gdk_pixbuf_get_height ( vgl->pixbuf );
-
-    if ( vgl->pixbuf && vgl->alpha <= 255 )
-      vgl->pixbuf = ui_pixbuf_set_alpha ( vgl->pixbuf, vgl->alpha );
   }
   /* should find length and width here too */
 }
@@ -502,11 +668,7 @@ static void georef_layer_set_image ( VikGeorefLayer *vgl, const gchar *image )
 {
   if ( vgl->image )
     g_free ( vgl->image );
-  if ( vgl->scaled )
-  {
-    g_object_unref ( vgl->scaled );
-    vgl->scaled = NULL;
-  }
+  georef_layer_clear_image ( vgl );
   if ( image == NULL )
     vgl->image = NULL;
 
@@ -977,11 +1139,8 @@ static gboolean georef_layer_dialog ( VikGeorefLayer *vgl, gpointer vp, GtkWindo
       }
     }
 
+    // NB applied when drawing
     vgl->alpha = (guint8) gtk_range_get_value ( GTK_RANGE(alpha_scale) );
-    if ( vgl->pixbuf && vgl->alpha <= 255 )
-      vgl->pixbuf = ui_pixbuf_set_alpha ( vgl->pixbuf, vgl->alpha );
-    if ( vgl->scaled && vgl->alpha <= 255 )
-      vgl->scaled = ui_pixbuf_set_alpha ( vgl->scaled, vgl->alpha );
 
     a_settings_set_integer ( VIK_SETTINGS_GEOREF_TAB, gtk_notebook_get_current_page(GTK_NOTEBOOK(cw.tabs)) );
 
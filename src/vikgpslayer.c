@@ -196,6 +196,10 @@ static VikLayerParamData gpsd_retry_interval_default ( void )
   return data;
 }
 
+static VikLayerParamScale params_redraw_interval[] = { {0, 600, 1, 0} };
+
+static VikLayerParamData realtime_redraw_interval_default ( void ) { return VIK_LPD_UINT ( 5 ); }
+
 #endif
 
 static VikLayerParam gps_layer_params[] = {
@@ -215,6 +219,8 @@ static VikLayerParam gps_layer_params[] = {
   { VIK_LAYER_GPS, "center_start_tracking", VIK_LAYER_PARAM_BOOLEAN, GROUP_REALTIME_MODE, N_("Jump to current position on start"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL, NULL, vik_lpd_false_default, NULL, NULL },
   { VIK_LAYER_GPS, "moving_map_method", VIK_LAYER_PARAM_UINT, GROUP_REALTIME_MODE, N_("Moving Map Method:"), VIK_LAYER_WIDGET_RADIOGROUP_STATIC, params_vehicle_position, NULL, NULL, moving_map_method_default, NULL, NULL },
   { VIK_LAYER_GPS, "realtime_update_statusbar", VIK_LAYER_PARAM_BOOLEAN, GROUP_REALTIME_MODE, N_("Update Statusbar:"), VIK_LAYER_WIDGET_CHECKBUTTON, NULL, NULL, N_("Display information in the statusbar on GPS updates"), vik_lpd_true_default, NULL, NULL },
+  { VIK_LAYER_GPS, "realtime_redraw_interval", VIK_LAYER_PARAM_UINT, GROUP_REALTIME_MODE, N_("Full Redraw Interval (seconds):"), VIK_LAYER_WIDGET_SPINBUTTON, params_redraw_interval, NULL,
+    N_("In between full redraws only the newest part of the track and the position are drawn. 0 redraws on every GPS update"), realtime_redraw_interval_default, NULL, NULL },
   { VIK_LAYER_GPS, "gpsd_host", VIK_LAYER_PARAM_STRING, GROUP_REALTIME_MODE, N_("Gpsd Host:"), VIK_LAYER_WIDGET_ENTRY, NULL, NULL, NULL, gpsd_host_default, NULL, NULL },
   { VIK_LAYER_GPS, "gpsd_port", VIK_LAYER_PARAM_STRING, GROUP_REALTIME_MODE, N_("Gpsd Port:"), VIK_LAYER_WIDGET_ENTRY, NULL, NULL, NULL, gpsd_port_default, NULL, NULL },
   { VIK_LAYER_GPS, "gpsd_retry_interval", VIK_LAYER_PARAM_STRING, GROUP_REALTIME_MODE, N_("Gpsd Retry Interval (seconds):"), VIK_LAYER_WIDGET_ENTRY, NULL, NULL, NULL, gpsd_retry_interval_default, NULL, NULL },
@@ -230,6 +236,7 @@ enum {
   PARAM_REALTIME_CENTER_START,
   PARAM_VEHICLE_POSITION,
   PARAM_REALTIME_UPDATE_STATUSBAR,
+  PARAM_REALTIME_REDRAW_INTERVAL,
   PARAM_GPSD_HOST,
   PARAM_GPSD_PORT,
   PARAM_GPSD_RETRY_INTERVAL,
@@ -337,6 +344,8 @@ struct _VikGpsLayer {
   GpsFix last_fix;
 
   VikTrack *realtime_track;
+  GList *realtime_track_tail; /* last link of the realtime track, NULL when not known */
+  guint realtime_track_version; /* of the realtime track when the tail was known */
 
   GIOChannel *realtime_io_channel;
   guint realtime_io_watch_id;
@@ -346,6 +355,13 @@ struct _VikGpsLayer {
   GdkGC *realtime_track_pt_gc;
   GdkGC *realtime_track_pt1_gc;
   GdkGC *realtime_track_pt2_gc;
+  GdkGC *realtime_segment_gc;      /* for drawing onto the viewport in between full redraws */
+  GdkPixmap *realtime_under_marker;
+  gint realtime_marker_x;
+  gint realtime_marker_y;
+  gboolean realtime_marker_drawn;  /* realtime_under_marker holds what is under the position marker */
+  gboolean realtime_redraw_needed;
+  gint64 realtime_last_redraw;
 
   /* params */
   gchar *gpsd_host;
@@ -355,6 +371,7 @@ struct _VikGpsLayer {
   gboolean realtime_jump_to_start;
   guint vehicle_position;
   gboolean realtime_update_statusbar;
+  guint realtime_redraw_interval;
   VikTrackpoint *trkpt;
   VikTrackpoint *trkpt_prev;
 #endif /* VIK_CONFIG_REALTIME_GPS_TRACKING */
@@ -585,6 +602,9 @@ static gboolean gps_layer_set_param ( VikGpsLayer *vgl, guint16 id, VikLayerPara
     case PARAM_REALTIME_UPDATE_STATUSBAR:
       vgl->realtime_update_statusbar = data.b;
       break;
+    case PARAM_REALTIME_REDRAW_INTERVAL:
+      vgl->realtime_redraw_interval = data.u;
+      break;
 #endif /* VIK_CONFIG_REALTIME_GPS_TRACKING */
     default:
       g_warning("gps_layer_set_param(): unknown parameter");
@@ -646,6 +666,9 @@ static VikLayerParamData gps_layer_get_param ( VikGpsLayer *vgl, guint16 id, gbo
     case PARAM_REALTIME_UPDATE_STATUSBAR:
       rv.u = vgl->realtime_update_statusbar;
       break;
+    case PARAM_REALTIME_REDRAW_INTERVAL:
+      rv.u = vgl->realtime_redraw_interval;
+      break;
 #endif /* VIK_CONFIG_REALTIME_GPS_TRACKING */
     default:
       g_warning(_("%s: unknown parameter"), __FUNCTION__);
@@ -681,6 +704,12 @@ VikGpsLayer *vik_gps_layer_new (VikViewport *vp)
     vgl->realtime_track_pt_gc = vgl->realtime_track_pt1_gc;
   }
   vgl->realtime_track = NULL;
+  vgl->realtime_track_tail = NULL;
+  vgl->realtime_segment_gc = NULL;
+  vgl->realtime_under_marker = NULL;
+  vgl->realtime_marker_drawn = FALSE;
+  vgl->realtime_redraw_needed = FALSE;
+  vgl->realtime_last_redraw = 0;
 #endif // VIK_CONFIG_REALTIME_GPS_TRACKING
 
   vik_layer_set_defaults ( VIK_LAYER(vgl), vp );
@@ -691,35 +720,12 @@ VikGpsLayer *vik_gps_layer_new (VikViewport *vp)
 static void vik_gps_layer_draw ( VikGpsLayer *vgl, VikViewport *vp )
 {
   gint i;
-  VikLayer *vl;
-  VikLayer *trigger = VIK_LAYER(vik_viewport_get_trigger( vp ));
 
-  for (i = 0; i < NUM_TRW; i++) {
-    vl = VIK_LAYER(vgl->trw_children[i]);
-    if (vl == trigger) {
-      if ( vik_viewport_get_half_drawn ( vp ) ) {
-        vik_viewport_set_half_drawn ( vp, FALSE );
-        vik_viewport_snapshot_load( vp );
-      } else {
-        vik_viewport_snapshot_save( vp );
-      }
-    }
-    if (!vik_viewport_get_half_drawn(vp))
-      vik_layer_draw ( vl, vp );
-  }
+  for (i = 0; i < NUM_TRW; i++)
+    vik_layer_draw ( VIK_LAYER(vgl->trw_children[i]), vp );
 #if defined (VIK_CONFIG_REALTIME_GPS_TRACKING) && defined (GPSD_API_MAJOR_VERSION)
-  if (vgl->realtime_tracking) {
-    if (VIK_LAYER(vgl) == trigger) {
-      if ( vik_viewport_get_half_drawn ( vp ) ) {
-        vik_viewport_set_half_drawn ( vp, FALSE );
-        vik_viewport_snapshot_load( vp );
-      } else {
-        vik_viewport_snapshot_save( vp );
-      }
-    }
-    if (!vik_viewport_get_half_drawn(vp))
-      realtime_tracking_draw(vgl, vp);
-  }
+  if (vgl->realtime_tracking)
+    realtime_tracking_draw(vgl, vp);
 #endif /* VIK_CONFIG_REALTIME_GPS_TRACKING */
 }
 
@@ -823,6 +829,10 @@ static void vik_gps_layer_free ( VikGpsLayer *vgl )
     g_object_unref(vgl->realtime_track_pt1_gc);
   if (vgl->realtime_track_pt2_gc != NULL)
     g_object_unref(vgl->realtime_track_pt2_gc);
+  if (vgl->realtime_segment_gc != NULL)
+    g_object_unref(vgl->realtime_segment_gc);
+  if (vgl->realtime_under_marker != NULL)
+    g_object_unref(vgl->realtime_under_marker);
 #endif /* VIK_CONFIG_REALTIME_GPS_TRACKING */
 }
 
@@ -1458,6 +1468,35 @@ static void gps_empty_all_cb( gpointer layer_and_vlp[2] )
 }
 
 #if defined (VIK_CONFIG_REALTIME_GPS_TRACKING) && defined (GPSD_API_MAJOR_VERSION)
+// Big enough to contain the position marker
+#define MARKER_HALF_SIZE 32
+
+/**
+ * Remember what is drawn where the position marker is about to go,
+ *  so that the marker can be moved without redrawing everything else
+ */
+static void realtime_save_under_marker ( VikGpsLayer *vgl, VikViewport *vp, gint x, gint y )
+{
+  GdkPixmap *buffer = vik_viewport_get_pixmap ( vp );
+  if ( !vgl->realtime_under_marker )
+    vgl->realtime_under_marker = gdk_pixmap_new ( buffer, 2*MARKER_HALF_SIZE, 2*MARKER_HALF_SIZE, -1 );
+  gdk_draw_drawable ( vgl->realtime_under_marker, vgl->realtime_track_gc, buffer,
+                      x-MARKER_HALF_SIZE, y-MARKER_HALF_SIZE, 0, 0, 2*MARKER_HALF_SIZE, 2*MARKER_HALF_SIZE );
+  vgl->realtime_marker_x = x;
+  vgl->realtime_marker_y = y;
+  vgl->realtime_marker_drawn = TRUE;
+}
+
+static void realtime_restore_under_marker ( VikGpsLayer *vgl, VikViewport *vp )
+{
+  if ( !vgl->realtime_marker_drawn )
+    return;
+  gdk_draw_drawable ( vik_viewport_get_pixmap(vp), vgl->realtime_track_gc, vgl->realtime_under_marker,
+                      0, 0, vgl->realtime_marker_x-MARKER_HALF_SIZE, vgl->realtime_marker_y-MARKER_HALF_SIZE,
+                      2*MARKER_HALF_SIZE, 2*MARKER_HALF_SIZE );
+  vgl->realtime_marker_drawn = FALSE;
+}
+
 static void realtime_tracking_draw(VikGpsLayer *vgl, VikViewport *vp)
 {
   struct LatLon ll;
@@ -1467,6 +1506,7 @@ static void realtime_tracking_draw(VikGpsLayer *vgl, VikViewport *vp)
   vik_viewport_screen_to_coord ( vp, vik_viewport_get_width(vp)+20, vik_viewport_get_width(vp)+20, &se );
   vik_coord_to_latlon ( &nw, &lnw );
   vik_coord_to_latlon ( &se, &lse );
+  vgl->realtime_marker_drawn = FALSE;
   if ( vgl->realtime_fix.fix.latitude > lse.lat &&
        vgl->realtime_fix.fix.latitude < lnw.lat &&
        vgl->realtime_fix.fix.longitude > lnw.lon &&
@@ -1486,6 +1526,8 @@ static void realtime_tracking_draw(VikGpsLayer *vgl, VikViewport *vp)
     vik_coord_load_from_latlon ( &gps, vik_viewport_get_coord_mode(vp), &ll);
     vik_viewport_coord_to_screen ( vp, &gps, &x, &y );
 
+    realtime_save_under_marker ( vgl, vp, x, y );
+
     gdouble heading_cos = cos(DEG2RAD(vgl->realtime_fix.fix.track));
     gdouble heading_sin = sin(DEG2RAD(vgl->realtime_fix.fix.track));
 
@@ -1521,6 +1563,26 @@ static void realtime_tracking_draw(VikGpsLayer *vgl, VikViewport *vp)
   }
 }
 
+/**
+ * The last link of the realtime track.
+ * Any other changes to the track (such as the user editing it) change its version,
+ *  so then the end of the track can no longer be assumed.
+ */
+static GList *realtime_track_get_tail ( VikGpsLayer *vgl )
+{
+  if ( !vgl->realtime_track_tail || vgl->realtime_track->version != vgl->realtime_track_version ) {
+    vgl->realtime_track_tail = g_list_last ( vgl->realtime_track->trackpoints );
+    vgl->realtime_track_version = vgl->realtime_track->version;
+  }
+  return vgl->realtime_track_tail;
+}
+
+static void realtime_track_set_tail ( VikGpsLayer *vgl, GList *tail )
+{
+  vgl->realtime_track_tail = tail;
+  vgl->realtime_track_version = vgl->realtime_track->version;
+}
+
 static VikTrackpoint* create_realtime_trackpoint(VikGpsLayer *vgl, gboolean forced)
 {
     struct LatLon ll;
@@ -1541,12 +1603,19 @@ static VikTrackpoint* create_realtime_trackpoint(VikGpsLayer *vgl, gboolean forc
       int last_heading = isnan(vgl->last_fix.fix.track) ? 0 : (int)floor(vgl->last_fix.fix.track);
       int alt = isnan(vgl->realtime_fix.fix.altitude) ? VIK_DEFAULT_ALTITUDE : floor(vgl->realtime_fix.fix.altitude);
       int last_alt = isnan(vgl->last_fix.fix.altitude) ? VIK_DEFAULT_ALTITUDE : floor(vgl->last_fix.fix.altitude);
-      if (((last_tp = g_list_last(vgl->realtime_track->trackpoints)) != NULL) &&
+      if (((last_tp = realtime_track_get_tail ( vgl )) != NULL) &&
           (vgl->realtime_fix.fix.mode > MODE_2D) &&
           (vgl->last_fix.fix.mode <= MODE_2D) &&
           ((cur_timestamp - last_timestamp) < 2)) {
-        g_free(last_tp->data);
+        if ( vgl->trkpt_prev == last_tp->data )
+          vgl->trkpt_prev = last_tp->prev ? last_tp->prev->data : NULL;
+        vik_trackpoint_free ( last_tp->data );
+        GList *tail = last_tp->prev;
         vgl->realtime_track->trackpoints = g_list_delete_link(vgl->realtime_track->trackpoints, last_tp);
+        vik_track_invalidate_index ( vgl->realtime_track );
+        realtime_track_set_tail ( vgl, tail );
+        // The replaced part of the track is only removed from the display by a full redraw
+        vgl->realtime_redraw_needed = TRUE;
         replace = TRUE;
       }
       if (replace ||
@@ -1572,7 +1641,8 @@ static VikTrackpoint* create_realtime_trackpoint(VikGpsLayer *vgl, gboolean forc
         vik_coord_load_from_latlon(&tp->coord,
              vik_trw_layer_get_coord_mode(vgl->trw_children[TRW_REALTIME]), &ll);
 
-        vik_track_add_trackpoint ( vgl->realtime_track, tp, TRUE ); // Ensure bounds is recalculated
+        // Ensure bounds is recalculated
+        realtime_track_set_tail ( vgl, vik_track_add_trackpoint_after_tail ( vgl->realtime_track, realtime_track_get_tail ( vgl ), tp, TRUE ) );
         vgl->realtime_fix.dirty = FALSE;
         vgl->realtime_fix.satellites_used = 0;
         vgl->last_fix = vgl->realtime_fix;
@@ -1603,6 +1673,50 @@ static void update_statusbar ( VikGpsLayer *vgl, VikWindow *vw )
 
 }
 
+/**
+ * Draw just the latest part of the track and move the position marker,
+ *  directly onto the existing viewport image
+ */
+static void realtime_draw_increment ( VikGpsLayer *vgl, VikViewport *vvp, VikTrackpoint *tp_prev, VikTrackpoint *tp )
+{
+  realtime_restore_under_marker ( vgl, vvp );
+
+  VikTrwLayer *vtl = vgl->trw_children[TRW_REALTIME];
+  if ( tp && tp_prev && VIK_LAYER(vtl)->visible && vgl->realtime_track->visible ) {
+    if ( !vgl->realtime_segment_gc ) {
+      gint thickness = vik_trw_layer_get_property_tracks_line_thickness ( vtl );
+      if ( vgl->realtime_track->has_color )
+        vgl->realtime_segment_gc = vik_viewport_new_gc_from_color ( vvp, &vgl->realtime_track->color, thickness );
+      else
+        vgl->realtime_segment_gc = vik_viewport_new_gc ( vvp, "#203070", thickness );
+    }
+    VikCoord c1, c2;
+    gint x1, y1, x2, y2;
+    vik_coord_copy_convert ( &tp_prev->coord, vik_viewport_get_coord_mode(vvp), &c1 );
+    vik_coord_copy_convert ( &tp->coord, vik_viewport_get_coord_mode(vvp), &c2 );
+    vik_viewport_coord_to_screen ( vvp, &c1, &x1, &y1 );
+    vik_viewport_coord_to_screen ( vvp, &c2, &x2, &y2 );
+    vik_viewport_draw_line ( vvp, vgl->realtime_segment_gc, x1, y1, x2, y2 );
+  }
+
+  realtime_tracking_draw ( vgl, vvp );
+  vik_viewport_sync ( vvp );
+}
+
+/**
+ * Full redraws are throttled according to the redraw interval,
+ *  unless the view has moved or the track is otherwise out of date
+ */
+static gboolean realtime_full_redraw_due ( VikGpsLayer *vgl )
+{
+  if ( vgl->realtime_redraw_needed || vgl->realtime_redraw_interval == 0 )
+    return TRUE;
+  // Nothing to draw on to (yet)
+  if ( vgl->realtime_last_redraw == 0 || !VIK_LAYER(vgl)->visible )
+    return TRUE;
+  return ( g_get_monotonic_time () - vgl->realtime_last_redraw ) >= (gint64)vgl->realtime_redraw_interval * G_USEC_PER_SEC;
+}
+
 static void gpsd_raw_hook(VglGpsd *vgpsd, gchar *data)
 {
   gboolean update_all = FALSE;
@@ -1660,6 +1774,7 @@ static void gpsd_raw_hook(VglGpsd *vgpsd, gchar *data)
 
     vgl->first_realtime_trackpoint = FALSE;
 
+    VikTrackpoint *tp_prev = vgl->trkpt_prev;
     vgl->trkpt = create_realtime_trackpoint ( vgl, FALSE );
 
     if ( vgl->trkpt ) {
@@ -1668,7 +1783,18 @@ static void gpsd_raw_hook(VglGpsd *vgpsd, gchar *data)
       vgl->trkpt_prev = vgl->trkpt;
     }
 
-    vik_layer_emit_update ( update_all ? VIK_LAYER(vgl) : VIK_LAYER(vgl->trw_children[TRW_REALTIME]) ); // NB update from background thread
+    if ( update_all || realtime_full_redraw_due ( vgl ) ) {
+      vgl->realtime_last_redraw = g_get_monotonic_time ();
+      vgl->realtime_redraw_needed = FALSE;
+      // Pick up any changes to the track's drawing style
+      if ( vgl->realtime_segment_gc ) {
+        g_object_unref ( vgl->realtime_segment_gc );
+        vgl->realtime_segment_gc = NULL;
+      }
+      vik_layer_emit_update ( VIK_LAYER(vgl) );
+    }
+    else
+      realtime_draw_increment ( vgl, vvp, tp_prev, vgl->trkpt );
   }
 }
 
@@ -1759,6 +1885,9 @@ static gboolean rt_gpsd_try_connect(gpointer *data)
     vik_trw_layer_add_track(vtl, name, vgl->realtime_track);
     g_free(name);
   }
+  vgl->realtime_track_tail = NULL;
+  vgl->trkpt_prev = NULL;
+  vgl->realtime_last_redraw = 0;
 
 #if GPSD_API_MAJOR_VERSION == 3 || GPSD_API_MAJOR_VERSION == 4
   gps_set_raw_hook(&vgl->vgpsd->gpsd, gpsd_raw_hook);
@@ -1846,6 +1975,7 @@ static void rt_gpsd_disconnect(VikGpsLayer *vgl)
       vik_trw_layer_delete_track(vgl->trw_children[TRW_REALTIME], vgl->realtime_track);
     vgl->realtime_track = NULL;
   }
+  vgl->realtime_track_tail = NULL;
 }
 
 static void gps_start_stop_tracking_cb( gpointer layer_and_vlp[2])
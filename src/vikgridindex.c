@@ -0,0 +1,191 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 2; tab-width: 2 -*- */
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2026, The Viking developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+/*
+ * Cells at level N are 360/2^N degrees square, numbered from longitude -180 and latitude -90.
+ * Each level is a hash table of only the cells that have something in them,
+ *  so the memory used is bounded by the number of items rather than the area covered.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+
+#include "vikgridindex.h"
+
+// Beyond this cells are only a few metres across
+#define GRID_INDEX_MAX_LEVEL 24
+// Stop adding levels once cells hold fewer than this many items on average
+#define GRID_INDEX_MIN_AVERAGE 4
+
+typedef struct {
+  gint64 key;
+  VikGridCluster cluster;
+} GridCell;
+
+struct _VikGridIndex {
+  GHashTable *levels[GRID_INDEX_MAX_LEVEL+1];
+  gint max_level; // -1 when empty
+};
+
+static inline gdouble cell_size ( gint level )
+{
+  return 360.0 / (1 << level);
+}
+
+static inline gint64 cell_key ( guint32 gx, guint32 gy )
+{
+  return ((gint64)gx << 32) | gy;
+}
+
+static guint32 cell_coord ( gdouble degrees, gdouble origin, gint level )
+{
+  gdouble cc = floor ( (degrees - origin) / cell_size(level) );
+  if ( cc < 0 )
+    return 0;
+  if ( cc >= (1 << level) )
+    return (1 << level) - 1;
+  return (guint32)cc;
+}
+
+/**
+ * vik_grid_index_new:
+ * @positions: Latitude and longitude pairs for each item
+ * @items:     The items themselves, which are not otherwise used
+ * @count:     The number of items
+ */
+VikGridIndex *vik_grid_index_new ( const gdouble *positions, gpointer *items, guint count )
+{
+  VikGridIndex *gi = g_malloc0 ( sizeof(VikGridIndex) );
+  gi->max_level = -1;
+  if ( !count )
+    return gi;
+
+  gint level;
+  for ( level = 0; level <= GRID_INDEX_MAX_LEVEL; level++ ) {
+    GHashTable *cells = g_hash_table_new_full ( g_int64_hash, g_int64_equal, NULL, g_free );
+    guint ii;
+    for ( ii = 0; ii < count; ii++ ) {
+      gdouble lat = positions[2*ii];
+      gdouble lon = positions[2*ii+1];
+      gint64 key = cell_key ( cell_coord(lon, -180.0, level), cell_coord(lat, -90.0, level) );
+      GridCell *cell = g_hash_table_lookup ( cells, &key );
+      if ( !cell ) {
+        cell = g_malloc0 ( sizeof(GridCell) );
+        cell->key = key;
+        cell->cluster.item = items[ii];
+        g_hash_table_insert ( cells, &cell->key, cell );
+      }
+      else
+        cell->cluster.item = NULL;
+      // Sum for now, averaged below
+      cell->cluster.lat += lat;
+      cell->cluster.lon += lon;
+      cell->cluster.count++;
+    }
+
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init ( &iter, cells );
+    while ( g_hash_table_iter_next ( &iter, NULL, &value ) ) {
+      VikGridCluster *cluster = &((GridCell*)value)->cluster;
+      cluster->lat /= cluster->count;
+      cluster->lon /= cluster->count;
+    }
+
+    gi->levels[level] = cells;
+    gi->max_level = level;
+    if ( g_hash_table_size ( cells ) * GRID_INDEX_MIN_AVERAGE > count )
+      break;
+  }
+  return gi;
+}
+
+void vik_grid_index_free ( VikGridIndex *gi )
+{
+  gint level;
+  for ( level = 0; level <= gi->max_level; level++ )
+    g_hash_table_destroy ( gi->levels[level] );
+  g_free ( gi );
+}
+
+/**
+ * vik_grid_index_get_level:
+ * @degrees: The smallest size of cell wanted
+ *
+ * Returns: The finest level with cells at least this size,
+ *  or -1 if that is finer than the index goes (i.e. the items are sparse enough at that size)
+ */
+gint vik_grid_index_get_level ( VikGridIndex *gi, gdouble degrees )
+{
+  if ( gi->max_level < 0 || degrees <= 0.0 )
+    return -1;
+  gint level = (gint)floor ( log2 ( 360.0 / degrees ) );
+  if ( level < 0 )
+    level = 0;
+  return level > gi->max_level ? -1 : level;
+}
+
+/**
+ * vik_grid_index_foreach:
+ *
+ * Call the function for each non empty cell of the level that overlaps the area.
+ * The work done is bounded by the smaller of the number of cells in the area
+ *  and the number of cells in the level.
+ */
+void vik_grid_index_foreach ( VikGridIndex *gi, gint level, const LatLonBBox *bbox, VikGridClusterFunc func, gpointer user_data )
+{
+  if ( level < 0 || level > gi->max_level )
+    return;
+
+  GHashTable *cells = gi->levels[level];
+  guint32 gx1 = cell_coord ( bbox->west, -180.0, level );
+  guint32 gx2 = cell_coord ( bbox->east, -180.0, level );
+  guint32 gy1 = cell_coord ( bbox->south, -90.0, level );
+  guint32 gy2 = cell_coord ( bbox->north, -90.0, level );
+  if ( gx2 < gx1 || gy2 < gy1 )
+    return;
+
+  if ( (guint64)(gx2 - gx1 + 1) * (gy2 - gy1 + 1) > g_hash_table_size(cells) ) {
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init ( &iter, cells );
+    while ( g_hash_table_iter_next ( &iter, NULL, &value ) ) {
+      GridCell *cell = value;
+      guint32 gx = cell->key >> 32;
+      guint32 gy = cell->key & 0xffffffff;
+      if ( gx >= gx1 && gx <= gx2 && gy >= gy1 && gy <= gy2 )
+        func ( &cell->cluster, user_data );
+    }
+  }
+  else {
+    guint32 gx, gy;
+    for ( gy = gy1; gy <= gy2; gy++ )
+      for ( gx = gx1; gx <= gx2; gx++ ) {
+        gint64 key = cell_key ( gx, gy );
+        GridCell *cell = g_hash_table_lookup ( cells, &key );
+        if ( cell )
+          func ( &cell->cluster, user_data );
+      }
+  }
+}
@@ -0,0 +1,64 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 2; tab-width: 2 -*- */
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2026, The Viking developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifndef __VIKING_GRID_INDEX_H
+#define __VIKING_GRID_INDEX_H
+
+#include <glib.h>
+
+#include "bbox.h"
+
+G_BEGIN_DECLS
+
+/**
+ * VikGridIndex:
+ *
+ * A hierarchy of grids over latitude and longitude, each level having cells
+ *  half the size of the one above, recording how many items fall in each cell.
+ * Levels are only built down to where cells hold a few items on average,
+ *  so finer detail than that is left to the items themselves.
+ */
+typedef struct _VikGridIndex VikGridIndex;
+
+/**
+ * VikGridCluster:
+ * @lat: Latitude of the centre of the items in the cell
+ * @lon: Longitude of the centre of the items in the cell
+ * @count: Number of items in the cell
+ * @item: The item, only when there is exactly one in the cell
+ */
+typedef struct {
+  gdouble lat, lon;
+  guint count;
+  gpointer item;
+} VikGridCluster;
+
+typedef void (*VikGridClusterFunc) ( const VikGridCluster *cluster, gpointer user_data );
+
+VikGridIndex *vik_grid_index_new ( const gdouble *positions, gpointer *items, guint count );
+void vik_grid_index_free ( VikGridIndex *gi );
+
+gint vik_grid_index_get_level ( VikGridIndex *gi, gdouble degrees );
+void vik_grid_index_foreach ( VikGridIndex *gi, gint level, const LatLonBBox *bbox, VikGridClusterFunc func, gpointer user_data );
+
+G_END_DECLS
+
+#endif
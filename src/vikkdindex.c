@@ -0,0 +1,398 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*- */
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2026, The Viking developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/*
+ * The tree is laid out implicitly: for any subtree covering the array range [lo,hi)
+ *  the node is at the middle element, the left subtree is [lo,mid) and the right is [mid+1,hi).
+ * Hence no child pointers are needed and the array can be written straight to disk.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "vikkdindex.h"
+
+#define KD_INDEX_MAGIC "VKDI"
+#define KD_INDEX_VERSION 1
+
+typedef struct {
+	gchar magic[4];
+	guint32 version;     // Also serves as a byte order check
+	guint32 count;
+	guint32 names_size;
+	guint64 stamp;       // Identifies the source data the snapshot was built from
+} KdIndexHeader;
+
+typedef struct {
+	gdouble pos[2];
+	guint32 name;        // Offset into the names pool
+	guint32 dim;         // The dimension this node splits on
+} KdIndexNode;
+
+struct _VikKdIndex {
+	GMappedFile *mf;     // Only when loaded from a snapshot
+	KdIndexNode *nodes;
+	gchar *names;
+	guint count;
+	guint32 names_size;
+};
+
+static inline gdouble dist_sq ( const gdouble *a, const gdouble *b )
+{
+	gdouble dx = a[0] - b[0];
+	gdouble dy = a[1] - b[1];
+	return dx*dx + dy*dy;
+}
+
+static inline void swap_nodes ( KdIndexNode *nodes, guint aa, guint bb )
+{
+	KdIndexNode tmp = nodes[aa];
+	nodes[aa] = nodes[bb];
+	nodes[bb] = tmp;
+}
+
+/**
+ * select_nth:
+ *
+ * Partially sort [lo,hi) such that the nth element is where it would be if fully sorted on dimension 'dim'
+ *  (i.e. quickselect)
+ */
+static void select_nth ( KdIndexNode *nodes, guint lo, guint hi, guint nth, guint dim )
+{
+	while ( hi - lo > 1 ) {
+		// Median of three pivot, moved to the end
+		guint mid = lo + (hi - lo) / 2;
+		guint last = hi - 1;
+		if ( nodes[mid].pos[dim] < nodes[lo].pos[dim] )
+			swap_nodes ( nodes, mid, lo );
+		if ( nodes[last].pos[dim] < nodes[lo].pos[dim] )
+			swap_nodes ( nodes, last, lo );
+		if ( nodes[mid].pos[dim] < nodes[last].pos[dim] )
+			swap_nodes ( nodes, mid, last );
+		gdouble pivot = nodes[last].pos[dim];
+
+		guint store = lo;
+		guint ii;
+		for ( ii = lo; ii < last; ii++ ) {
+			if ( nodes[ii].pos[dim] < pivot ) {
+				swap_nodes ( nodes, ii, store );
+				store++;
+			}
+		}
+		swap_nodes ( nodes, store, last );
+
+		if ( store == nth )
+			return;
+		if ( nth < store )
+			hi = store;
+		else
+			lo = store + 1;
+	}
+}
+
+static void build ( KdIndexNode *nodes, guint lo, guint hi )
+{
+	while ( hi > lo ) {
+		// Split on the dimension with the widest spread
+		gdouble min[2] = { G_MAXDOUBLE, G_MAXDOUBLE };
+		gdouble max[2] = { -G_MAXDOUBLE, -G_MAXDOUBLE };
+		guint ii, dd;
+		for ( ii = lo; ii < hi; ii++ ) {
+			for ( dd = 0; dd < 2; dd++ ) {
+				if ( nodes[ii].pos[dd] < min[dd] ) min[dd] = nodes[ii].pos[dd];
+				if ( nodes[ii].pos[dd] > max[dd] ) max[dd] = nodes[ii].pos[dd];
+			}
+		}
+		guint dim = (max[1] - min[1]) > (max[0] - min[0]) ? 1 : 0;
+
+		guint mid = lo + (hi - lo) / 2;
+		select_nth ( nodes, lo, hi, mid, dim );
+		nodes[mid].dim = dim;
+
+		build ( nodes, lo, mid );
+		lo = mid + 1;
+	}
+}
+
+/**
+ * vik_kd_index_new:
+ * @positions: Array of 2 * @count values
+ * @names:     Array of @count strings (which may be NULL)
+ * @count:     The number of entries
+ *
+ * Bulk construct a tree of the given positions.
+ * The names are copied.
+ *
+ * Returns: A new index, free with vik_kd_index_free()
+ */
+VikKdIndex *vik_kd_index_new ( const gdouble *positions, const gchar * const *names, guint count )
+{
+	VikKdIndex *kdi = g_new0 ( VikKdIndex, 1 );
+	kdi->count = count;
+	kdi->nodes = g_new ( KdIndexNode, count );
+
+	// Pool all the names together, with the empty string first for any NULL ones
+	GString *pool = g_string_sized_new ( count * 16 );
+	g_string_append_c ( pool, '\0' );
+	guint ii;
+	for ( ii = 0; ii < count; ii++ ) {
+		kdi->nodes[ii].pos[0] = positions[2*ii];
+		kdi->nodes[ii].pos[1] = positions[2*ii+1];
+		kdi->nodes[ii].dim = 0;
+		if ( names && names[ii] ) {
+			kdi->nodes[ii].name = pool->len;
+			g_string_append_len ( pool, names[ii], strlen(names[ii])+1 );
+		}
+		else
+			kdi->nodes[ii].name = 0;
+	}
+	kdi->names_size = pool->len;
+	kdi->names = g_string_free ( pool, FALSE );
+
+	build ( kdi->nodes, 0, count );
+
+	return kdi;
+}
+
+/**
+ * vik_kd_index_new_from_file:
+ * @filename: A snapshot previously written by vik_kd_index_save()
+ * @stamp:    The value the snapshot must have been saved with
+ *
+ * The file is memory mapped, so loading is effectively instant.
+ *
+ * Returns: A new index or NULL if the file is missing, invalid or has a different stamp
+ */
+VikKdIndex *vik_kd_index_new_from_file ( const gchar *filename, guint64 stamp )
+{
+	GError *error = NULL;
+	GMappedFile *mf = g_mapped_file_new ( filename, FALSE, &error );
+	if ( !mf ) {
+		g_debug ( "%s: %s", __FUNCTION__, error->message );
+		g_error_free ( error );
+		return NULL;
+	}
+
+	gsize len = g_mapped_file_get_length ( mf );
+	gchar *contents = g_mapped_file_get_contents ( mf );
+	KdIndexHeader header;
+	if ( len < sizeof(header) )
+		goto invalid;
+	memcpy ( &header, contents, sizeof(header) );
+
+	if ( strncmp ( header.magic, KD_INDEX_MAGIC, 4 ) || header.version != KD_INDEX_VERSION )
+		goto invalid;
+	if ( header.stamp != stamp ) {
+		g_debug ( "%s: %s is out of date", __FUNCTION__, filename );
+		goto invalid;
+	}
+	if ( header.names_size == 0 ||
+	     len != sizeof(header) + (gsize)header.count * sizeof(KdIndexNode) + header.names_size )
+		goto invalid;
+
+	KdIndexNode *nodes = (KdIndexNode*)(contents + sizeof(header));
+	gchar *names = contents + sizeof(header) + (gsize)header.count * sizeof(KdIndexNode);
+	if ( names[header.names_size-1] != '\0' )
+		goto invalid;
+	guint ii;
+	for ( ii = 0; ii < header.count; ii++ )
+		if ( nodes[ii].name >= header.names_size || nodes[ii].dim > 1 )
+			goto invalid;
+
+	VikKdIndex *kdi = g_new0 ( VikKdIndex, 1 );
+	kdi->mf = mf;
+	kdi->nodes = nodes;
+	kdi->names = names;
+	kdi->count = header.count;
+	kdi->names_size = header.names_size;
+	return kdi;
+
+ invalid:
+	g_debug ( "%s: Ignoring %s", __FUNCTION__, filename );
+	g_mapped_file_unref ( mf );
+	return NULL;
+}
+
+/**
+ * vik_kd_index_save:
+ * @stamp: A value identifying the source of the data (e.g. from the source files' sizes and times)
+ *
+ * Write the index such that it can be mapped back in via vik_kd_index_new_from_file()
+ * Note the snapshot uses the native byte order and so is not intended to be portable between machines.
+ */
+gboolean vik_kd_index_save ( VikKdIndex *kdi, const gchar *filename, guint64 stamp )
+{
+	KdIndexHeader header;
+	memset ( &header, 0, sizeof(header) );
+	memcpy ( header.magic, KD_INDEX_MAGIC, 4 );
+	header.version = KD_INDEX_VERSION;
+	header.count = kdi->count;
+	header.names_size = kdi->names_size;
+	header.stamp = stamp;
+
+	gsize nodes_size = (gsize)kdi->count * sizeof(KdIndexNode);
+	gsize len = sizeof(header) + nodes_size + kdi->names_size;
+	gchar *buffer = g_malloc ( len );
+	memcpy ( buffer, &header, sizeof(header) );
+	memcpy ( buffer + sizeof(header), kdi->nodes, nodes_size );
+	memcpy ( buffer + sizeof(header) + nodes_size, kdi->names, kdi->names_size );
+
+	GError *error = NULL;
+	gboolean ans = g_file_set_contents ( filename, buffer, len, &error );
+	if ( !ans ) {
+		g_warning ( "%s: %s", __FUNCTION__, error->message );
+		g_error_free ( error );
+	}
+	g_free ( buffer );
+	return ans;
+}
+
+void vik_kd_index_free ( VikKdIndex *kdi )
+{
+	if ( !kdi )
+		return;
+	if ( kdi->mf )
+		g_mapped_file_unref ( kdi->mf );
+	else {
+		g_free ( kdi->nodes );
+		g_free ( kdi->names );
+	}
+	g_free ( kdi );
+}
+
+guint vik_kd_index_get_count ( VikKdIndex *kdi )
+{
+	return kdi->count;
+}
+
+/**
+ * vik_kd_index_get_name:
+ *
+ * Returns: The name of the entry. This is owned by the index and is valid for as long as it exists.
+ */
+const gchar *vik_kd_index_get_name ( VikKdIndex *kdi, guint index )
+{
+	g_return_val_if_fail ( index < kdi->count, NULL );
+	return kdi->names + kdi->nodes[index].name;
+}
+
+void vik_kd_index_get_position ( VikKdIndex *kdi, guint index, gdouble pos[2] )
+{
+	g_return_if_fail ( index < kdi->count );
+	pos[0] = kdi->nodes[index].pos[0];
+	pos[1] = kdi->nodes[index].pos[1];
+}
+
+static void nearest ( const KdIndexNode *nodes, guint lo, guint hi, const gdouble *pos, gint *best, gdouble *best_dsq )
+{
+	while ( hi > lo ) {
+		guint mid = lo + (hi - lo) / 2;
+		const KdIndexNode *node = &nodes[mid];
+
+		gdouble dsq = dist_sq ( node->pos, pos );
+		if ( dsq < *best_dsq ) {
+			*best_dsq = dsq;
+			*best = mid;
+		}
+
+		gdouble diff = pos[node->dim] - node->pos[node->dim];
+		if ( diff < 0 ) {
+			nearest ( nodes, lo, mid, pos, best, best_dsq );
+			// Only search the other side if it could possibly have something closer
+			if ( diff*diff >= *best_dsq )
+				return;
+			lo = mid + 1;
+		}
+		else {
+			nearest ( nodes, mid + 1, hi, pos, best, best_dsq );
+			if ( diff*diff >= *best_dsq )
+				return;
+			hi = mid;
+		}
+	}
+}
+
+/**
+ * vik_kd_index_nearest:
+ * @pos:      The position to search from
+ * @range:    Only consider entries closer than this
+ * @distance: Optionally return the distance to the found entry
+ *
+ * Returns: The index of the closest entry, or -1 if there is nothing within the range
+ */
+gint vik_kd_index_nearest ( VikKdIndex *kdi, const gdouble pos[2], gdouble range, gdouble *distance )
+{
+	gint best = -1;
+	gdouble best_dsq = range * range;
+	nearest ( kdi->nodes, 0, kdi->count, pos, &best, &best_dsq );
+	if ( distance && best >= 0 )
+		*distance = sqrt ( best_dsq );
+	return best;
+}
+
+static void nearest_range ( const KdIndexNode *nodes, guint lo, guint hi, const gdouble *pos, gdouble range_sq,
+                            guint *results, guint max_results, guint *found )
+{
+	while ( hi > lo && *found < max_results ) {
+		guint mid = lo + (hi - lo) / 2;
+		const KdIndexNode *node = &nodes[mid];
+
+		if ( dist_sq ( node->pos, pos ) <= range_sq )
+			results[(*found)++] = mid;
+
+		gdouble diff = pos[node->dim] - node->pos[node->dim];
+		gboolean both = (diff*diff <= range_sq);
+		if ( diff < 0 ) {
+			if ( both )
+				nearest_range ( nodes, mid + 1, hi, pos, range_sq, results, max_results, found );
+			hi = mid;
+		}
+		else {
+			if ( both )
+				nearest_range ( nodes, lo, mid, pos, range_sq, results, max_results, found );
+			lo = mid + 1;
+		}
+	}
+}
+
+/**
+ * vik_kd_index_nearest_range:
+ * @pos:         The position to search from
+ * @range:       The search radius
+ * @results:     Caller supplied storage for the indices of the entries found
+ * @max_results: Size of @results
+ *
+ * Find entries within the range, in no particular order.
+ * The search stops once @results is full.
+ *
+ * Returns: The number of entries put in @results
+ */
+guint vik_kd_index_nearest_range ( VikKdIndex *kdi, const gdouble pos[2], gdouble range, guint *results, guint max_results )
+{
+	guint found = 0;
+	nearest_range ( kdi->nodes, 0, kdi->count, pos, range * range, results, max_results, &found );
+	return found;
+}
@@ -0,0 +1,53 @@
+/* -*- Mode: C; indent-tabs-mode: t; c-basic-offset: 4; tab-width: 4 -*- */
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2026, The Viking developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#ifndef __VIKING_KD_INDEX_H
+#define __VIKING_KD_INDEX_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * VikKdIndex:
+ *
+ * A static two dimensional k-d tree of named positions.
+ * The tree is built in one go and then stored implicitly in a single array,
+ *  so queries never allocate and the whole thing can be saved to
+ *  (and memory mapped back from) a file.
+ */
+typedef struct _VikKdIndex VikKdIndex;
+
+VikKdIndex *vik_kd_index_new ( const gdouble *positions, const gchar * const *names, guint count );
+VikKdIndex *vik_kd_index_new_from_file ( const gchar *filename, guint64 stamp );
+gboolean vik_kd_index_save ( VikKdIndex *kdi, const gchar *filename, guint64 stamp );
+void vik_kd_index_free ( VikKdIndex *kdi );
+
+guint vik_kd_index_get_count ( VikKdIndex *kdi );
+const gchar *vik_kd_index_get_name ( VikKdIndex *kdi, guint index );
+void vik_kd_index_get_position ( VikKdIndex *kdi, guint index, gdouble pos[2] );
+
+gint vik_kd_index_nearest ( VikKdIndex *kdi, const gdouble pos[2], gdouble range, gdouble *distance );
+guint vik_kd_index_nearest_range ( VikKdIndex *kdi, const gdouble pos[2], gdouble range, guint *results, guint max_results );
+
+G_END_DECLS
+
+#endif
@@ -31,6 +31,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include "viklayer_defaults.h"
+#include "perfstats.h"
 
 /* functions common to all layers. */
 /* TODO longone: rename interface free -> finalize */
@@ -81,20 +82,43 @@ static void vik_layer_class_init (VikLayerClass *klass)
     layer_defaults_register ( layer );
 }
 
+// About one frame at 25 frames per second
+#define LAYER_UPDATE_INTERVAL 40
+
 /**
  * Invoke the actual drawing via signal method
  */
 static gboolean idle_draw ( VikLayer *vl )
 {
+  g_atomic_int_set ( &vl->update_pending, 0 );
   g_signal_emit ( G_OBJECT(vl), layer_signals[VL_UPDATE_SIGNAL], 0 );
   return FALSE; // Nothing else to do
 }
 
+/**
+ * Arrange for the update signal to be emitted, unless it is already going to be.
+ * Requests from background threads are held back for a frame,
+ *  so that many of them (e.g. one per map tile downloaded) are combined into a single redraw.
+ */
+static void layer_queue_update ( VikLayer *vl, gboolean background )
+{
+  if ( !g_atomic_int_compare_and_exchange ( &vl->update_pending, 0, 1 ) )
+    return;
+
+  if ( background )
+    // Drawing requested from another (background) thread, so handle via the gdk thread method
+    gdk_threads_add_timeout ( LAYER_UPDATE_INTERVAL, (GSourceFunc) idle_draw, vl );
+  else
+    g_idle_add ( (GSourceFunc) idle_draw, vl );
+}
+
 /**
  * Draw specified layer
  */
 void vik_layer_emit_update ( VikLayer *vl )
 {
+  // May be called from a background thread
+  g_atomic_int_inc ( &vl->version );
   if ( vl->visible && vl->realized ) {
     GThread *thread = vik_window_get_thread ( VIK_WINDOW(VIK_GTK_WINDOW_FROM_LAYER(vl)) );
     if ( !thread )
@@ -104,11 +128,7 @@ void vik_layer_emit_update ( VikLayer *vl )
     vik_window_set_redraw_trigger(vl);
 
     // Only ever draw when there is time to do so
-    if ( g_thread_self() != thread )
-      // Drawing requested from another (background) thread, so handle via the gdk thread method
-      gdk_threads_add_idle ( (GSourceFunc) idle_draw, vl );
-    else
-      g_idle_add ( (GSourceFunc) idle_draw, vl );
+    layer_queue_update ( vl, g_thread_self() != thread );
   }
 }
 
@@ -118,17 +138,19 @@ void vik_layer_emit_update ( VikLayer *vl )
  */
 void vik_layer_emit_update_although_invisible ( VikLayer *vl )
 {
+  g_atomic_int_inc ( &vl->version );
   vik_window_set_redraw_trigger(vl);
-  g_idle_add ( (GSourceFunc) idle_draw, vl );
+  layer_queue_update ( vl, FALSE );
 }
 
 /* doesn't set the trigger. should be done by aggregate layer when child emits update. */
 void vik_layer_emit_update_secondary ( VikLayer *vl )
 {
+  g_atomic_int_inc ( &vl->version );
   if ( vl->visible )
     // TODO: this can used from the background - eg in acquire
     //       so will need to flow background update status through too
-    g_idle_add ( (GSourceFunc) idle_draw, vl );
+    layer_queue_update ( vl, FALSE );
 }
 
 static VikLayerInterface *vik_layer_interfaces[VIK_LAYER_NUM_TYPES] = {
@@ -256,8 +278,11 @@ gboolean vik_layer_properties ( VikLayer *layer, VikViewport *vp )
 void vik_layer_draw ( VikLayer *l, VikViewport *vp )
 {
   if ( l->visible )
-    if ( vik_layer_interfaces[l->type]->draw )
+    if ( vik_layer_interfaces[l->type]->draw ) {
+      gint64 start = a_perf_now ();
       vik_layer_interfaces[l->type]->draw ( l, vp );
+      a_perf_record ( "draw", vik_layer_interfaces[l->type]->fixed_layer_name, start );
+    }
 }
 
 void vik_layer_change_coord_mode ( VikLayer *l, VikCoordMode mode )
@@ -62,6 +62,11 @@ struct _VikLayer {
 
   /* for explicit "polymorphism" (function type switching) */
   VikLayerTypeEnum type;
+
+  // Changed whenever an update is signalled, so cached drawing of the layer can be recognised as out of date
+  gint version;
+  // Whether an update signal is already waiting to be emitted
+  gint update_pending;
 };
 
 /* I think most of these are ignored,
@@ -160,7 +165,7 @@ typedef VikLayerParamData
 typedef void          (*VikLayerFuncChangeParam)           (GtkWidget *, ui_change_values );
 
 typedef gboolean      (*VikLayerFuncReadFileData)          (VikLayer *, FILE *, const gchar *); // gchar* is the directory path. Function should report success or failure
-typedef void          (*VikLayerFuncWriteFileData)         (VikLayer *, FILE *);
+typedef gboolean      (*VikLayerFuncWriteFileData)         (VikLayer *, FILE *); // Function should report success or failure
 
 /* item manipulation */
 typedef void          (*VikLayerFuncDeleteItem)            (VikLayer *, gint, gpointer);
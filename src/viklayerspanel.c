@@ -49,6 +49,10 @@ struct _VikLayersPanel {
 
   VikTreeview *vt;
   VikViewport *vvp; /* reference */
+
+  gint update_pending;
+  gint64 last_update; // Microseconds
+  gint update_interval; // Milliseconds, redraws happen at most once per interval
 };
 
 static GtkActionEntry entries[] = {
@@ -160,6 +164,8 @@ static GtkWidget* layers_panel_create_popup ( VikLayersPanel *vlp, gboolean full
   return menu;
 }
 
+#define VIK_SETTINGS_LAYERS_PANEL_UPDATE_INTERVAL "layers_panel_update_interval"
+
 static void vik_layers_panel_init ( VikLayersPanel *vlp )
 {
   GtkWidget *hbox;
@@ -174,6 +180,11 @@ static void vik_layers_panel_init ( VikLayersPanel *vlp )
 
   vlp->vvp = NULL;
 
+  vlp->update_interval = 40;
+  gint tmp;
+  if ( a_settings_get_integer ( VIK_SETTINGS_LAYERS_PANEL_UPDATE_INTERVAL, &tmp ) )
+    vlp->update_interval = tmp;
+
   hbox = gtk_hbox_new ( TRUE, 2 );
   vlp->vt = vik_treeview_new ( );
 
@@ -253,10 +264,21 @@ static void vik_layers_panel_init ( VikLayersPanel *vlp )
  */
 static gboolean idle_draw_panel ( VikLayersPanel *vlp )
 {
+  g_atomic_int_set ( &vlp->update_pending, 0 );
+  vlp->last_update = g_get_monotonic_time ();
   g_signal_emit ( G_OBJECT(vlp), layers_panel_signals[VLP_UPDATE_SIGNAL], 0 );
   return FALSE; // Nothing else to do
 }
 
+/*
+ * Milliseconds to wait before redrawing, so redraws happen at most once per interval
+ */
+static guint layers_panel_update_delay ( VikLayersPanel *vlp )
+{
+  gint64 since = (g_get_monotonic_time () - vlp->last_update) / 1000;
+  return since < vlp->update_interval ? vlp->update_interval - since : 0;
+}
+
 void vik_layers_panel_emit_update ( VikLayersPanel *vlp )
 {
   GThread *thread = vik_window_get_thread (VIK_WINDOW(VIK_GTK_WINDOW_FROM_WIDGET(vlp)));
@@ -264,12 +286,25 @@ void vik_layers_panel_emit_update ( VikLayersPanel *vlp )
     // Do nothing
     return;
 
+  // Any number of requests before the redraw happens are satisfied by that one redraw
+  if ( !g_atomic_int_compare_and_exchange ( &vlp->update_pending, 0, 1 ) )
+    return;
+
   // Only ever draw when there is time to do so
-  if ( g_thread_self() != thread )
+  guint delay = layers_panel_update_delay ( vlp );
+  if ( g_thread_self() != thread ) {
     // Drawing requested from another (background) thread, so handle via the gdk thread method
-    gdk_threads_add_idle ( (GSourceFunc) idle_draw_panel, vlp );
-  else
-    g_idle_add ( (GSourceFunc) idle_draw_panel, vlp );
+    if ( delay )
+      gdk_threads_add_timeout ( delay, (GSourceFunc) idle_draw_panel, vlp );
+    else
+      gdk_threads_add_idle ( (GSourceFunc) idle_draw_panel, vlp );
+  }
+  else {
+    if ( delay )
+      g_timeout_add ( delay, (GSourceFunc) idle_draw_panel, vlp );
+    else
+      g_idle_add ( (GSourceFunc) idle_draw_panel, vlp );
+  }
 }
 
 static void layers_item_toggled (VikLayersPanel *vlp, GtkTreeIter *iter)
@@ -286,7 +321,7 @@ static void layers_item_toggled (VikLayersPanel *vlp, GtkTreeIter *iter)
   {
     case VIK_TREEVIEW_TYPE_LAYER:
       visible = (VIK_LAYER(p)->visible ^= 1);
-      vik_layer_emit_update_although_invisible ( VIK_LAYER(p) ); /* set trigger for half-drawn */
+      vik_layer_emit_update_although_invisible ( VIK_LAYER(p) ); /* set trigger for redraw */
       break;
     case VIK_TREEVIEW_TYPE_SUBLAYER:
       visible = vik_layer_sublayer_toggle_visible ( VIK_LAYER(vik_treeview_item_get_parent(vlp->vt, iter)),
@@ -564,12 +599,6 @@ gboolean vik_layers_panel_properties ( VikLayersPanel *vlp )
     return FALSE;
 }
 
-void vik_layers_panel_draw_all ( VikLayersPanel *vlp )
-{
-  if ( vlp->vvp && VIK_LAYER(vlp->toplayer)->visible )
-    vik_aggregate_layer_draw ( vlp->toplayer, vlp->vvp );
-}
-
 void vik_layers_panel_cut_selected ( VikLayersPanel *vlp )
 {
   gint type;
@@ -586,10 +615,6 @@ void vik_layers_panel_cut_selected ( VikLayersPanel *vlp )
     VikAggregateLayer *parent = vik_treeview_item_get_parent ( vlp->vt, &iter );
     if ( parent )
     {
-      /* reset trigger if trigger deleted */
-      if ( vik_layers_panel_get_selected ( vlp ) == vik_viewport_get_trigger ( vlp->vvp ) )
-        vik_viewport_set_trigger ( vlp->vvp, NULL );
-
       a_clipboard_copy_selected ( vlp );
 
       if (IS_VIK_AGGREGATE_LAYER(parent)) {
@@ -653,10 +678,6 @@ void vik_layers_panel_delete_selected ( VikLayersPanel *vlp )
     VikAggregateLayer *parent = vik_treeview_item_get_parent ( vlp->vt, &iter );
     if ( parent )
     {
-      /* reset trigger if trigger deleted */
-      if ( vik_layers_panel_get_selected ( vlp ) == vik_viewport_get_trigger ( vlp->vvp ) )
-        vik_viewport_set_trigger ( vlp->vvp, NULL );
-
       if (IS_VIK_AGGREGATE_LAYER(parent)) {
 
         g_signal_emit ( G_OBJECT(vlp), layers_panel_signals[VLP_DELETE_LAYER_SIGNAL], 0 );
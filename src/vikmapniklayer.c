@@ -44,6 +44,7 @@
 #include "icons/icons.h"
 #include "mapnik_interface.h"
 #include "background.h"
+#include "perfstats.h"
 
 #include "vikmapslayer.h"
 
@@ -665,7 +666,9 @@ typedef struct
 static void render ( VikMapnikLayer *vml, VikCoord *ul, VikCoord *br, MapCoord *ulm )
 {
 	gint64 tt1 = g_get_real_time ();
+	gint64 start = a_perf_now ();
 	GdkPixbuf *pixbuf = mapnik_interface_render ( vml->mi, ul->north_south, ul->east_west, br->north_south, br->east_west );
+	a_perf_record ( "render", "Mapnik render", start );
 	gint64 tt2 = g_get_real_time ();
 	gdouble tt = (gdouble)(tt2-tt1)/1000000;
 	g_debug ( "Mapnik rendering completed in %.3f seconds", tt );
@@ -675,10 +678,8 @@ static void render ( VikMapnikLayer *vml, VikCoord *ul, VikCoord *br, MapCoord *
 	}
 	possibly_save_pixbuf ( vml, pixbuf, ulm );
 
-	// NB Mapnik can apply alpha, but use our own function for now
-	if ( vml->alpha < 255 )
-		pixbuf = ui_pixbuf_scale_alpha ( pixbuf, vml->alpha );
-	a_mapcache_add ( pixbuf, (mapcache_extra_t){ tt }, ulm->x, ulm->y, ulm->z, MAP_ID_MAPNIK_RENDER, ulm->scale, vml->alpha, 0.0, 0.0, vml->filename_xml );
+	// NB Mapnik can apply alpha, but it is applied when drawing so the cached tiles are independent of it
+	a_mapcache_add ( pixbuf, (mapcache_extra_t){ tt }, ulm->x, ulm->y, ulm->z, MAP_ID_MAPNIK_RENDER, ulm->scale, 0.0, 0.0, vml->filename_xml );
 	g_object_unref(pixbuf);
 }
 
@@ -748,6 +749,7 @@ static void thread_add (VikMapnikLayer *vml, MapCoord *mul, VikCoord *ul, VikCoo
 	gchar *description = g_strdup_printf ( _("Mapnik Render %d:%d:%d %s"), zoom, x, y, basename );
 	g_free ( basename );
 	a_background_thread ( BACKGROUND_POOL_LOCAL_MAPNIK,
+	                      BACKGROUND_PRIORITY_INTERACTIVE, 0,
 	                      VIK_GTK_WINDOW_FROM_LAYER(vml),
 	                      description,
 	                      (vik_thr_func) background,
@@ -780,9 +782,7 @@ static GdkPixbuf *load_pixbuf ( VikMapnikLayer *vml, MapCoord *ulm, MapCoord *br
 			g_error_free ( error );
 		}
 		else {
-			if ( vml->alpha < 255 )
-				pixbuf = ui_pixbuf_set_alpha ( pixbuf, vml->alpha );
-			a_mapcache_add ( pixbuf, (mapcache_extra_t) { -42.0 }, ulm->x, ulm->y, ulm->z, MAP_ID_MAPNIK_RENDER, ulm->scale, vml->alpha, 0.0, 0.0, vml->filename_xml );
+			a_mapcache_add ( pixbuf, (mapcache_extra_t) { -42.0 }, ulm->x, ulm->y, ulm->z, MAP_ID_MAPNIK_RENDER, ulm->scale, 0.0, 0.0, vml->filename_xml );
 		}
 		// If file is too old mark for rerendering
 		if ( planet_import_time < gsb.st_mtime ) {
@@ -806,7 +806,7 @@ static GdkPixbuf *get_pixbuf ( VikMapnikLayer *vml, MapCoord *ulm, MapCoord *brm
 	map_utils_iTMS_to_vikcoord (ulm, &ul);
 	map_utils_iTMS_to_vikcoord (brm, &br);
 
-	pixbuf = a_mapcache_get ( ulm->x, ulm->y, ulm->z, MAP_ID_MAPNIK_RENDER, ulm->scale, vml->alpha, 0.0, 0.0, vml->filename_xml );
+	pixbuf = a_mapcache_get ( ulm->x, ulm->y, ulm->z, MAP_ID_MAPNIK_RENDER, ulm->scale, 0.0, 0.0, vml->filename_xml );
 
 	if ( ! pixbuf ) {
 		gboolean rerender = FALSE;
@@ -882,7 +882,7 @@ static void mapnik_layer_draw ( VikMapnikLayer *vml, VikViewport *vvp )
 				if ( pixbuf ) {
 					map_utils_iTMS_to_vikcoord ( &ulm, &coord );
 					vik_viewport_coord_to_screen ( vvp, &coord, &xx, &yy );
-					vik_viewport_draw_pixbuf ( vvp, pixbuf, 0, 0, xx, yy, vml->tile_size_x, vml->tile_size_x );
+					vik_viewport_draw_pixbuf_with_alpha ( vvp, pixbuf, vml->alpha, 0, 0, xx, yy, vml->tile_size_x, vml->tile_size_x );
 					g_object_unref(pixbuf);
 				}
 			}
@@ -1085,7 +1085,7 @@ static void mapnik_layer_tile_info ( VikMapnikLayer *vml )
 	// Requested position to map coord
 	map_utils_vikcoord_to_iTMS ( &vml->rerender_ul, vml->rerender_zoom, vml->rerender_zoom, &ulm );
 
-	mapcache_extra_t extra = a_mapcache_get_extra ( ulm.x, ulm.y, ulm.z, MAP_ID_MAPNIK_RENDER, ulm.scale, vml->alpha, 0.0, 0.0, vml->filename_xml );
+	mapcache_extra_t extra = a_mapcache_get_extra ( ulm.x, ulm.y, ulm.z, MAP_ID_MAPNIK_RENDER, ulm.scale, 0.0, 0.0, vml->filename_xml );
 
 	gchar *filename = get_filename ( vml->file_cache_dir, ulm.x, ulm.y, ulm.scale );
 	gchar *filemsg = NULL;
@@ -49,6 +49,8 @@
 #include "vikutils.h"
 #include "maputils.h"
 #include "mapcache.h"
+#include "tileindex.h"
+#include "perfstats.h"
 #include "background.h"
 #include "preferences.h"
 #include "vikmapslayer.h"
@@ -77,8 +79,13 @@ static gdouble REAL_MIN_SHRINKFACTOR = 0.0039062499; /* if shrinkfactor is betwe
 static guint SCALE_INC_UP = 2;
 #define VIK_SETTINGS_MAP_SCALE_INC_DOWN "maps_scale_inc_down"
 static guint SCALE_INC_DOWN = 4;
+// Tiles are reduced in size by up to 2^MAX_MIP_LEVEL (i.e. to REAL_MIN_SHRINKFACTOR)
+#define MAX_MIP_LEVEL 8
 #define VIK_SETTINGS_MAP_SCALE_SMALLER_ZOOM_FIRST "maps_scale_smaller_zoom_first"
 static gboolean SCALE_SMALLER_ZOOM_FIRST = TRUE;
+// Bulk downloads (e.g. of many zoom levels) only run this many jobs at once,
+//  leaving the rest of the pool for other downloads
+#define BULK_DOWNLOAD_MAX_CONCURRENT 2
 
 /****** MAP TYPES ******/
 
@@ -117,7 +124,7 @@ static gboolean maps_layer_download_release ( VikMapsLayer *vml, GdkEventButton
 static gboolean maps_layer_download_click ( VikMapsLayer *vml, GdkEventButton *event, VikViewport *vvp );
 static gpointer maps_layer_download_create ( VikWindow *vw, VikViewport *vvp );
 static void maps_layer_set_cache_dir ( VikMapsLayer *vml, const gchar *dir );
-static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const VikCoord *ul, const VikCoord *br, gint redownload );
+static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const VikCoord *ul, const VikCoord *br, gint redownload, Background_Priority priority );
 static void maps_layer_add_menu_items ( VikMapsLayer *vml, GtkMenu *menu, VikLayersPanel *vlp );
 static guint map_uniq_id_to_index ( guint uniq_id );
 
@@ -293,6 +300,11 @@ struct _VikMapsLayer {
 #ifdef HAVE_SQLITE3_H
   sqlite3 *mbtiles;
 #endif
+
+  // Range of tiles in the last drawing, when it is a single range
+  //  so downloads of tiles elsewhere need not cause a redraw
+  gboolean drawn_known;
+  MapCoord drawn_min, drawn_max;
 };
 
 enum { REDOWNLOAD_NONE = 0,    /* download only missing maps */
@@ -450,6 +462,33 @@ guint vik_maps_layer_get_default_map_type ()
   return vlpd.u;
 }
 
+/**
+ * maps_layer_get_map_source:
+ * @uniq_id: The map id, or 0 for the default map
+ *
+ * Returns: The registered map source for the id, or NULL if there is no such map
+ */
+VikMapSource *maps_layer_get_map_source ( guint uniq_id )
+{
+  if ( uniq_id == 0 )
+    uniq_id = vik_maps_layer_get_default_map_type ();
+  guint index = map_uniq_id_to_index ( uniq_id );
+  if ( index == NUM_MAP_TYPES )
+    return NULL;
+  return MAPS_LAYER_NTH_TYPE(index);
+}
+
+/**
+ * maps_layer_get_cache_default:
+ *
+ * Returns: The cache layout for new maps layers
+ */
+VikMapsCacheLayout maps_layer_get_cache_default ( void )
+{
+  VikLayerInterface *vli = vik_layer_get_interface ( VIK_LAYER_MAPS );
+  return a_layer_defaults_get ( vli->fixed_layer_name, "cache_type", VIK_LAYER_PARAM_UINT ).u;
+}
+
 gchar *vik_maps_layer_get_map_label(VikMapsLayer *vml)
 {
   return(g_strdup(MAPS_LAYER_NTH_LABEL(vml->maptype)));
@@ -884,15 +923,6 @@ static VikMapsLayer *maps_layer_unmarshall( guint8 *data, gint len, VikViewport
 /****** DRAWING ******/
 /*********************/
 
-static GdkPixbuf *pixbuf_shrink ( GdkPixbuf *pixbuf, gdouble xshrinkfactor, gdouble yshrinkfactor )
-{
-  GdkPixbuf *tmp;
-  guint16 width = gdk_pixbuf_get_width(pixbuf), height = gdk_pixbuf_get_height(pixbuf);
-  tmp = gdk_pixbuf_scale_simple(pixbuf, ceil(width * xshrinkfactor), ceil(height * yshrinkfactor), GDK_INTERP_BILINEAR);
-  g_object_unref ( G_OBJECT(pixbuf) );
-  return tmp;
-}
-
 #ifdef HAVE_SQLITE3_H
 /*
 static int sql_select_tile_dump_cb (void *data, int cols, char **fields, char **col_names )
@@ -1052,19 +1082,14 @@ static GdkPixbuf *get_pixbuf_from_metatile ( VikMapsLayer *vml, gint xx, gint yy
  * Caller has to decrease reference counter of returned
  * GdkPixbuf, when buffer is no longer needed.
  */
-static GdkPixbuf *pixbuf_apply_settings ( GdkPixbuf *pixbuf, VikMapsLayer *vml, MapCoord *mapcoord, gdouble xshrinkfactor, gdouble yshrinkfactor )
+static GdkPixbuf *pixbuf_apply_settings ( GdkPixbuf *pixbuf, VikMapsLayer *vml, MapCoord *mapcoord )
 {
-  // Apply alpha setting
-  if ( pixbuf && vml->alpha < 255 )
-    pixbuf = ui_pixbuf_set_alpha ( pixbuf, vml->alpha );
-
-  if ( pixbuf && ( xshrinkfactor != 1.0 || yshrinkfactor != 1.0 ) )
-    pixbuf = pixbuf_shrink ( pixbuf, xshrinkfactor, yshrinkfactor );
-
+  // NB The alpha setting and any resizing are applied when drawing,
+  //  so the cached tiles are independent of them
   if ( pixbuf )
     a_mapcache_add ( pixbuf, (mapcache_extra_t) {0.0}, mapcoord->x, mapcoord->y,
                      mapcoord->z, vik_map_source_get_uniq_id(MAPS_LAYER_NTH_TYPE(vml->maptype)),
-                     mapcoord->scale, vml->alpha, xshrinkfactor, yshrinkfactor, vml->filename );
+                     mapcoord->scale, 1.0, 1.0, vml->filename );
 
   return pixbuf;
 }
@@ -1101,16 +1126,18 @@ static void get_filename ( const gchar *cache_dir,
 }
 
 /**
+ * Get the tile at its actual size
+ *
  * Caller has to decrease reference counter of returned
  * GdkPixbuf, when buffer is no longer needed.
  */
-static GdkPixbuf *get_pixbuf( VikMapsLayer *vml, guint16 id, const gchar* mapname, MapCoord *mapcoord, gchar *filename_buf, gint buf_len, gdouble xshrinkfactor, gdouble yshrinkfactor )
+static GdkPixbuf *get_pixbuf( VikMapsLayer *vml, guint16 id, const gchar* mapname, MapCoord *mapcoord, gchar *filename_buf, gint buf_len )
 {
   GdkPixbuf *pixbuf;
 
   /* get the thing */
   pixbuf = a_mapcache_get ( mapcoord->x, mapcoord->y, mapcoord->z,
-                            id, mapcoord->scale, vml->alpha, xshrinkfactor, yshrinkfactor, vml->filename );
+                            id, mapcoord->scale, 1.0, 1.0, vml->filename );
 
   if ( ! pixbuf ) {
     VikMapSource *map = MAPS_LAYER_NTH_TYPE(vml->maptype);
@@ -1118,13 +1145,13 @@ static GdkPixbuf *get_pixbuf( VikMapsLayer *vml, guint16 id, const gchar* mapnam
       // ATM MBTiles must be 'a direct access type'
       if ( vik_map_source_is_mbtiles(map) ) {
         pixbuf = get_mbtiles_pixbuf ( vml, mapcoord->x, mapcoord->y, (17 - mapcoord->scale) );
-        pixbuf = pixbuf_apply_settings ( pixbuf, vml, mapcoord, xshrinkfactor, yshrinkfactor );
+        pixbuf = pixbuf_apply_settings ( pixbuf, vml, mapcoord );
         // return now to avoid file tests that aren't appropriate for this map type
         return pixbuf;
       }
       else if ( vik_map_source_is_osm_meta_tiles(map) ) {
         pixbuf = get_pixbuf_from_metatile ( vml, mapcoord->x, mapcoord->y, (17 - mapcoord->scale) );
-        pixbuf = pixbuf_apply_settings ( pixbuf, vml, mapcoord, xshrinkfactor, yshrinkfactor );
+        pixbuf = pixbuf_apply_settings ( pixbuf, vml, mapcoord );
         return pixbuf;
       }
       else
@@ -1140,7 +1167,9 @@ static GdkPixbuf *get_pixbuf( VikMapsLayer *vml, guint16 id, const gchar* mapnam
     if ( g_file_test ( filename_buf, G_FILE_TEST_EXISTS ) == TRUE)
     {
       GError *gx = NULL;
+      gint64 start = a_perf_now ();
       pixbuf = gdk_pixbuf_new_from_file ( filename_buf, &gx );
+      a_perf_record ( "decode", "Tile decode", start );
 
       /* free the pixbuf on error */
       if (gx)
@@ -1159,13 +1188,84 @@ static GdkPixbuf *get_pixbuf( VikMapsLayer *vml, guint16 id, const gchar* mapnam
           g_object_unref ( G_OBJECT(pixbuf) );
         pixbuf = NULL;
       } else {
-        pixbuf = pixbuf_apply_settings ( pixbuf, vml, mapcoord, xshrinkfactor, yshrinkfactor );
+        pixbuf = pixbuf_apply_settings ( pixbuf, vml, mapcoord );
       }
     }
   }
   return pixbuf;
 }
 
+/**
+ * The tile mipmap level for drawing at the given shrink factors:
+ *  the smallest reduction by a power of two that is still no smaller than needed.
+ * Level 0 is the tile itself.
+ */
+static guint mip_level ( gdouble xshrinkfactor, gdouble yshrinkfactor )
+{
+  gdouble shrink = MAX ( xshrinkfactor, yshrinkfactor );
+  guint level = 0;
+  while ( level < MAX_MIP_LEVEL && shrink <= 0.5 ) {
+    shrink *= 2.0;
+    level++;
+  }
+  return level;
+}
+
+/**
+ * Get the tile reduced in size by 2^level.
+ * Each level is made by halving the size of the level above it, and then cached,
+ *  so drawing at any shrink factor only ever uses these few sizes of each tile.
+ *
+ * Caller has to decrease reference counter of returned
+ * GdkPixbuf, when buffer is no longer needed.
+ */
+static GdkPixbuf *get_pixbuf_level ( VikMapsLayer *vml, guint16 id, const gchar* mapname, MapCoord *mapcoord, gchar *filename_buf, gint buf_len, guint level )
+{
+  if ( level == 0 )
+    return get_pixbuf ( vml, id, mapname, mapcoord, filename_buf, buf_len );
+
+  gdouble factor = 1.0 / (1 << level);
+  GdkPixbuf *pixbuf = a_mapcache_get ( mapcoord->x, mapcoord->y, mapcoord->z,
+                                       id, mapcoord->scale, factor, factor, vml->filename );
+  if ( pixbuf )
+    return pixbuf;
+
+  GdkPixbuf *above = get_pixbuf_level ( vml, id, mapname, mapcoord, filename_buf, buf_len, level - 1 );
+  if ( !above )
+    return NULL;
+  pixbuf = ui_pixbuf_half_size ( above );
+  g_object_unref ( above );
+
+  if ( pixbuf )
+    a_mapcache_add ( pixbuf, (mapcache_extra_t) {0.0}, mapcoord->x, mapcoord->y, mapcoord->z,
+                     id, mapcoord->scale, factor, factor, vml->filename );
+  return pixbuf;
+}
+
+/**
+ * Draw part of a tile, which is resized to fit as it is drawn
+ * @frac_x, @frac_y: Position of the part of the tile to draw, as a fraction of the tile size
+ * @frac_size:      Size of the part of the tile to draw, as a fraction of the tile size
+ *
+ * Returns: FALSE if the tile is not available
+ */
+static gboolean draw_tile ( VikMapsLayer *vml, VikViewport *vvp, guint16 id, const gchar *mapname, MapCoord *mapcoord, gchar *path_buf, gint buf_len,
+                            gdouble xshrinkfactor, gdouble yshrinkfactor, gdouble frac_x, gdouble frac_y, gdouble frac_size,
+                            gint dest_x, gint dest_y, gint dest_w, gint dest_h )
+{
+  GdkPixbuf *pixbuf = get_pixbuf_level ( vml, id, mapname, mapcoord, path_buf, buf_len, mip_level ( xshrinkfactor, yshrinkfactor ) );
+  if ( !pixbuf )
+    return FALSE;
+
+  gdouble width = gdk_pixbuf_get_width ( pixbuf );
+  gdouble height = gdk_pixbuf_get_height ( pixbuf );
+  vik_viewport_draw_pixbuf_scaled ( vvp, pixbuf, vml->alpha,
+                                    frac_x * width, frac_y * height, frac_size * width, frac_size * height,
+                                    dest_x, dest_y, dest_w, dest_h );
+  g_object_unref ( pixbuf );
+  return TRUE;
+}
+
 static gboolean should_start_autodownload(VikMapsLayer *vml, VikViewport *vvp)
 {
   const VikCoord *center = vik_viewport_get_center ( vvp );
@@ -1208,7 +1308,6 @@ static gboolean should_start_autodownload(VikMapsLayer *vml, VikViewport *vvp)
 gboolean try_draw_scale_down (VikMapsLayer *vml, VikViewport *vvp, MapCoord ulm, gint xx, gint yy, gint tilesize_x_ceil, gint tilesize_y_ceil,
                               gdouble xshrinkfactor, gdouble yshrinkfactor, guint id, const gchar *mapname, gchar *path_buf, guint max_path_len)
 {
-  GdkPixbuf *pixbuf;
   int scale_inc;
   for (scale_inc = 1; scale_inc <= SCALE_INC_DOWN; scale_inc++) {
     // Try with smaller zooms
@@ -1217,14 +1316,12 @@ gboolean try_draw_scale_down (VikMapsLayer *vml, VikViewport *vvp, MapCoord ulm,
     ulm2.x = ulm.x / scale_factor;
     ulm2.y = ulm.y / scale_factor;
     ulm2.scale = ulm.scale + scale_inc;
-    pixbuf = get_pixbuf ( vml, id, mapname, &ulm2, path_buf, max_path_len, xshrinkfactor * scale_factor, yshrinkfactor * scale_factor );
-    if ( pixbuf ) {
-      gint src_x = (ulm.x % scale_factor) * tilesize_x_ceil;
-      gint src_y = (ulm.y % scale_factor) * tilesize_y_ceil;
-      vik_viewport_draw_pixbuf ( vvp, pixbuf, src_x, src_y, xx, yy, tilesize_x_ceil, tilesize_y_ceil );
-      g_object_unref(pixbuf);
+    // Draw the corresponding part of the larger area tile, enlarged as it is drawn
+    if ( draw_tile ( vml, vvp, id, mapname, &ulm2, path_buf, max_path_len,
+                     xshrinkfactor * scale_factor, yshrinkfactor * scale_factor,
+                     (gdouble)(ulm.x % scale_factor) / scale_factor, (gdouble)(ulm.y % scale_factor) / scale_factor, 1.0 / scale_factor,
+                     xx, yy, tilesize_x_ceil, tilesize_y_ceil ) )
       return TRUE;
-    }
   }
   return FALSE;
 }
@@ -1235,11 +1332,11 @@ gboolean try_draw_scale_down (VikMapsLayer *vml, VikViewport *vvp, MapCoord ulm,
 gboolean try_draw_scale_up (VikMapsLayer *vml, VikViewport *vvp, MapCoord ulm, gint xx, gint yy, gint tilesize_x_ceil, gint tilesize_y_ceil,
                             gdouble xshrinkfactor, gdouble yshrinkfactor, guint id, const gchar *mapname, gchar *path_buf, guint max_path_len)
 {
-  GdkPixbuf *pixbuf;
   // Try with bigger zooms
   int scale_dec;
   for (scale_dec = 1; scale_dec <= SCALE_INC_UP; scale_dec++) {
     int pict_x, pict_y;
+    gboolean drawn = FALSE;
     int scale_factor = 1 << scale_dec;  /*  2^scale_dec */
     MapCoord ulm2 = ulm;
     ulm2.x = ulm.x * scale_factor;
@@ -1250,18 +1347,17 @@ gboolean try_draw_scale_up (VikMapsLayer *vml, VikViewport *vvp, MapCoord ulm, g
         MapCoord ulm3 = ulm2;
         ulm3.x += pict_x;
         ulm3.y += pict_y;
-        pixbuf = get_pixbuf ( vml, id, mapname, &ulm3, path_buf, max_path_len, xshrinkfactor / scale_factor, yshrinkfactor / scale_factor );
-        if ( pixbuf ) {
-          gint src_x = 0;
-          gint src_y = 0;
-          gint dest_x = xx + pict_x * (tilesize_x_ceil / scale_factor);
-          gint dest_y = yy + pict_y * (tilesize_y_ceil / scale_factor);
-          vik_viewport_draw_pixbuf ( vvp, pixbuf, src_x, src_y, dest_x, dest_y, tilesize_x_ceil / scale_factor, tilesize_y_ceil / scale_factor );
-          g_object_unref(pixbuf);
-          return TRUE;
-        }
+        gint dest_x = xx + pict_x * (tilesize_x_ceil / scale_factor);
+        gint dest_y = yy + pict_y * (tilesize_y_ceil / scale_factor);
+        // Compose the area from the smaller area tiles, using reduced size versions of them
+        if ( draw_tile ( vml, vvp, id, mapname, &ulm3, path_buf, max_path_len,
+                         xshrinkfactor / scale_factor, yshrinkfactor / scale_factor, 0.0, 0.0, 1.0,
+                         dest_x, dest_y, tilesize_x_ceil / scale_factor, tilesize_y_ceil / scale_factor ) )
+          drawn = TRUE;
       }
     }
+    if ( drawn )
+      return TRUE;
   }
   return FALSE;
 }
@@ -1309,6 +1405,14 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
     guint16 id = vik_map_source_get_uniq_id(map);
     const gchar *mapname = vik_map_source_get_name(map);
 
+    vml->drawn_min = ulm;
+    vml->drawn_min.x = xmin;
+    vml->drawn_min.y = ymin;
+    vml->drawn_max = vml->drawn_min;
+    vml->drawn_max.x = xmax;
+    vml->drawn_max.y = ymax;
+    vml->drawn_known = TRUE;
+
     VikCoord coord;
     gint xx, yy, width, height;
     GdkPixbuf *pixbuf;
@@ -1329,10 +1433,10 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
       g_debug("%s: Starting autodownload", __FUNCTION__);
       if ( !vml->adl_only_missing && vik_map_source_supports_download_only_new (map) )
         // Try to download newer tiles
-        start_download_thread ( vml, vvp, ul, br, REDOWNLOAD_NEW );
+        start_download_thread ( vml, vvp, ul, br, REDOWNLOAD_NEW, BACKGROUND_PRIORITY_INTERACTIVE );
       else
         // Download only missing tiles
-        start_download_thread ( vml, vvp, ul, br, REDOWNLOAD_NONE );
+        start_download_thread ( vml, vvp, ul, br, REDOWNLOAD_NONE, BACKGROUND_PRIORITY_INTERACTIVE );
     }
 
     if ( vik_map_source_get_tilesize_x(map) == 0 && !existence_only ) {
@@ -1340,17 +1444,22 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
         for ( y = ymin; y <= ymax; y++ ) {
           ulm.x = x;
           ulm.y = y;
-          pixbuf = get_pixbuf ( vml, id, mapname, &ulm, path_buf, max_path_len, xshrinkfactor, yshrinkfactor );
+          guint level = mip_level ( xshrinkfactor, yshrinkfactor );
+          pixbuf = get_pixbuf_level ( vml, id, mapname, &ulm, path_buf, max_path_len, level );
           if ( pixbuf ) {
-            width = gdk_pixbuf_get_width ( pixbuf );
-            height = gdk_pixbuf_get_height ( pixbuf );
+            // Size to draw at, relative to the size of the mipmap level
+            gdouble xscale = xshrinkfactor * (1 << level);
+            gdouble yscale = yshrinkfactor * (1 << level);
+            width = ceil ( gdk_pixbuf_get_width ( pixbuf ) * xscale );
+            height = ceil ( gdk_pixbuf_get_height ( pixbuf ) * yscale );
 
             vik_map_source_mapcoord_to_center_coord ( map, &ulm, &coord );
             vik_viewport_coord_to_screen ( vvp, &coord, &xx, &yy );
             xx -= (width/2);
             yy -= (height/2);
 
-            vik_viewport_draw_pixbuf ( vvp, pixbuf, 0, 0, xx, yy, width, height );
+            vik_viewport_draw_pixbuf_scaled ( vvp, pixbuf, vml->alpha, 0, 0, gdk_pixbuf_get_width ( pixbuf ), gdk_pixbuf_get_height ( pixbuf ),
+                                              xx, yy, width, height );
             g_object_unref(pixbuf);
           }
         }
@@ -1391,21 +1500,14 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
               get_filename ( vml->cache_dir, vml->cache_layout, id, vik_map_source_get_name(map),
                              ulm.scale, ulm.z, ulm.x, ulm.y, path_buf, max_path_len, vik_map_source_get_file_extension(map) );
 
-            if ( g_file_test ( path_buf, G_FILE_TEST_EXISTS ) == TRUE ) {
+            if ( a_tile_index_exists ( path_buf ) ) {
 	      GdkGC *black_gc = gtk_widget_get_style(GTK_WIDGET(vvp))->black_gc;
               vik_viewport_draw_line ( vvp, black_gc, xx+tilesize_x_ceil, yy, xx, yy+tilesize_y_ceil );
             }
           } else {
             // Try correct scale first
-            int scale_factor = 1;
-            pixbuf = get_pixbuf ( vml, id, mapname, &ulm, path_buf, max_path_len, xshrinkfactor * scale_factor, yshrinkfactor * scale_factor );
-            if ( pixbuf ) {
-              gint src_x = (ulm.x % scale_factor) * tilesize_x_ceil;
-              gint src_y = (ulm.y % scale_factor) * tilesize_y_ceil;
-              vik_viewport_draw_pixbuf ( vvp, pixbuf, src_x, src_y, xx, yy, tilesize_x_ceil, tilesize_y_ceil );
-              g_object_unref(pixbuf);
-            }
-            else {
+            if ( !draw_tile ( vml, vvp, id, mapname, &ulm, path_buf, max_path_len, xshrinkfactor, yshrinkfactor,
+                              0.0, 0.0, 1.0, xx, yy, tilesize_x_ceil, tilesize_y_ceil ) ) {
               // Otherwise try different scales
               if ( SCALE_SMALLER_ZOOM_FIRST ) {
                 if ( !try_draw_scale_down(vml,vvp,ulm,xx,yy,tilesize_x_ceil,tilesize_y_ceil,xshrinkfactor,yshrinkfactor,id,mapname,path_buf,max_path_len) ) {
@@ -1458,6 +1560,7 @@ static void maps_layer_draw_section ( VikMapsLayer *vml, VikViewport *vvp, VikCo
 
 static void maps_layer_draw ( VikMapsLayer *vml, VikViewport *vvp )
 {
+  vml->drawn_known = FALSE;
   if ( vik_map_source_get_drawmode(MAPS_LAYER_NTH_TYPE(vml->maptype)) == vik_viewport_get_drawmode ( vvp ) )
   {
     VikCoord ul, br;
@@ -1482,6 +1585,8 @@ static void maps_layer_draw ( VikMapsLayer *vml, VikViewport *vvp )
         vik_viewport_corners_for_zonen ( vvp, i, &ul, &br );
         maps_layer_draw_section ( vml, vvp, &ul, &br );
       }
+      // Tile numbers from different zones can not be compared
+      vml->drawn_known = FALSE;
     }
     else {
       vik_viewport_screen_to_coord ( vvp, 0, 0, &ul );
@@ -1551,6 +1656,44 @@ static gboolean is_in_area (VikMapSource *map, MapCoord mc)
   return vik_coord_inside ( &vc, &vctl, &vcbr );
 }
 
+/**
+ * maps_layer_tile_in_area:
+ *
+ * Returns: TRUE if the tile is within the area the map covers
+ */
+gboolean maps_layer_tile_in_area ( VikMapSource *map, MapCoord *mc )
+{
+  return is_in_area ( map, *mc );
+}
+
+/**
+ * maps_layer_get_tile_filename:
+ * @cache_dir: The maps cache directory (ending with a separator)
+ *
+ * Get the filename that the tile is stored as in the cache
+ */
+void maps_layer_get_tile_filename ( const gchar *cache_dir, VikMapsCacheLayout layout, VikMapSource *map, MapCoord *mc, gchar *filename_buf, gint buf_len )
+{
+  get_filename ( cache_dir, layout,
+                 vik_map_source_get_uniq_id(map),
+                 vik_map_source_get_name(map),
+                 mc->scale, mc->z, mc->x, mc->y, filename_buf, buf_len,
+                 vik_map_source_get_file_extension(map) );
+}
+
+/**
+ * Whether the tile could be on display, so a redraw is needed once it has been downloaded
+ * NB Called from the download threads, so this is only a hint
+ */
+static gboolean maps_layer_tile_drawn ( VikMapsLayer *vml, MapCoord *mc )
+{
+  if ( !vml->drawn_known )
+    return TRUE;
+  return mc->z == vml->drawn_min.z && mc->scale == vml->drawn_min.scale &&
+         mc->x >= vml->drawn_min.x && mc->x <= vml->drawn_max.x &&
+         mc->y >= vml->drawn_min.y && mc->y <= vml->drawn_max.y;
+}
+
 static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
 {
   void *handle = vik_map_source_download_handle_init(MAPS_LAYER_NTH_TYPE(mdi->maptype));
@@ -1582,7 +1725,7 @@ static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
           return -1;
         }
 
-        if ( g_file_test ( mdi->filename_buf, G_FILE_TEST_EXISTS ) == FALSE ) {
+        if ( !a_tile_index_exists ( mdi->filename_buf ) ) {
           need_download = TRUE;
           remove_mem_cache = TRUE;
 
@@ -1599,6 +1742,7 @@ static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
               if (gx || (!pixbuf)) {
                 if ( g_remove ( mdi->filename_buf ) )
                   g_warning ( "REDOWNLOAD failed to remove: %s", mdi->filename_buf );
+                a_tile_index_remove ( mdi->filename_buf );
                 need_download = TRUE;
                 remove_mem_cache = TRUE;
                 g_error_free ( gx );
@@ -1610,6 +1754,9 @@ static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
             }
 
             case REDOWNLOAD_NEW:
+              // Tiles younger than the tile age are never refreshed, so don't even try
+              if ( time(NULL) - a_tile_index_get_mtime ( mdi->filename_buf ) < a_preferences_get(VIKING_PREFERENCES_NAMESPACE "download_tile_age")->u )
+                continue;
               need_download = TRUE;
               remove_mem_cache = TRUE;
               break;
@@ -1618,6 +1765,7 @@ static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
               /* FIXME: need a better way than to erase file in case of server/network problem */
               if ( g_remove ( mdi->filename_buf ) )
                 g_warning ( "REDOWNLOAD failed to remove: %s", mdi->filename_buf );
+              a_tile_index_remove ( mdi->filename_buf );
               need_download = TRUE;
               remove_mem_cache = TRUE;
               break;
@@ -1652,6 +1800,8 @@ static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
               break;
             }
             case DOWNLOAD_SUCCESS:
+              a_tile_index_add ( mdi->filename_buf );
+              break;
             case DOWNLOAD_NOT_REQUIRED:
             default:
               break;
@@ -1661,8 +1811,7 @@ static int map_download_thread ( MapDownloadInfo *mdi, gpointer threaddata )
         g_mutex_lock(mdi->mutex);
         if (remove_mem_cache)
             a_mapcache_remove_all_shrinkfactors ( x, y, mdi->mapcoord.z, vik_map_source_get_uniq_id(MAPS_LAYER_NTH_TYPE(mdi->maptype)), mdi->mapcoord.scale, mdi->vml->filename );
-        if (mdi->refresh_display && mdi->map_layer_alive) {
-          /* TODO: check if it's on visible area */
+        if (mdi->refresh_display && mdi->map_layer_alive && maps_layer_tile_drawn ( mdi->vml, &mcoord )) {
           vik_layer_emit_update ( VIK_LAYER(mdi->vml) ); // NB update display from background
         }
         g_mutex_unlock(mdi->mutex);
@@ -1691,11 +1840,12 @@ static void mdi_cancel_cleanup ( MapDownloadInfo *mdi )
     {
       if ( g_remove ( mdi->filename_buf ) )
         g_warning ( "Cleanup failed to remove: %s", mdi->filename_buf );
+      a_tile_index_remove ( mdi->filename_buf );
     }
   }
 }
 
-static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const VikCoord *ul, const VikCoord *br, gint redownload )
+static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const VikCoord *ul, const VikCoord *br, gint redownload, Background_Priority priority )
 {
   gdouble xzoom = vml->xmapzoom ? vml->xmapzoom : vik_viewport_get_xmpp ( vvp );
   gdouble yzoom = vml->ymapzoom ? vml->ymapzoom : vik_viewport_get_ympp ( vvp );
@@ -1755,7 +1905,7 @@ static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const V
                            vik_map_source_get_name(map),
                            ulm.scale, ulm.z, a, b, mdi->filename_buf, mdi->maxlen,
                            vik_map_source_get_file_extension(map) );
-            if ( g_file_test ( mdi->filename_buf, G_FILE_TEST_EXISTS ) == FALSE )
+            if ( !a_tile_index_exists ( mdi->filename_buf ) )
               mdi->mapstoget++;
           }
         }
@@ -1785,6 +1935,8 @@ static void start_download_thread ( VikMapsLayer *vml, VikViewport *vvp, const V
       g_object_weak_ref(G_OBJECT(mdi->vml), weak_ref_cb, mdi);
       /* launch the thread */
       a_background_thread ( BACKGROUND_POOL_REMOTE,
+                            priority,
+                            priority == BACKGROUND_PRIORITY_INTERACTIVE ? 0 : BULK_DOWNLOAD_MAX_CONCURRENT,
                             VIK_GTK_WINDOW_FROM_LAYER(vml), /* parent window */
                             tmp,                                              /* description string */
                             (vik_thr_func) map_download_thread,               /* function to call within thread */
@@ -1852,7 +2004,7 @@ static void maps_layer_download_section ( VikMapsLayer *vml, VikViewport *vvp, V
                        vik_map_source_get_name(map),
                        ulm.scale, ulm.z, i, j, mdi->filename_buf, mdi->maxlen,
                        vik_map_source_get_file_extension(map) );
-        if ( g_file_test ( mdi->filename_buf, G_FILE_TEST_EXISTS ) == FALSE )
+        if ( !a_tile_index_exists ( mdi->filename_buf ) )
               mdi->mapstoget++;
       }
     }
@@ -1872,6 +2024,8 @@ static void maps_layer_download_section ( VikMapsLayer *vml, VikViewport *vvp, V
 
     // launch the thread
     a_background_thread ( BACKGROUND_POOL_REMOTE,
+                          BACKGROUND_PRIORITY_BULK,
+                          BULK_DOWNLOAD_MAX_CONCURRENT,
                           VIK_GTK_WINDOW_FROM_LAYER(vml), /* parent window */
                           tmp,                                /* description string */
                           (vik_thr_func) map_download_thread, /* function to call within thread */
@@ -1902,17 +2056,17 @@ void vik_maps_layer_download_section ( VikMapsLayer *vml, VikViewport *vvp, VikC
 
 static void maps_layer_redownload_bad ( VikMapsLayer *vml )
 {
-  start_download_thread ( vml, vml->redownload_vvp, &(vml->redownload_ul), &(vml->redownload_br), REDOWNLOAD_BAD );
+  start_download_thread ( vml, vml->redownload_vvp, &(vml->redownload_ul), &(vml->redownload_br), REDOWNLOAD_BAD, BACKGROUND_PRIORITY_BULK );
 }
 
 static void maps_layer_redownload_all ( VikMapsLayer *vml )
 {
-  start_download_thread ( vml, vml->redownload_vvp, &(vml->redownload_ul), &(vml->redownload_br), REDOWNLOAD_ALL );
+  start_download_thread ( vml, vml->redownload_vvp, &(vml->redownload_ul), &(vml->redownload_br), REDOWNLOAD_ALL, BACKGROUND_PRIORITY_BULK );
 }
 
 static void maps_layer_redownload_new ( VikMapsLayer *vml )
 {
-  start_download_thread ( vml, vml->redownload_vvp, &(vml->redownload_ul), &(vml->redownload_br), REDOWNLOAD_NEW );
+  start_download_thread ( vml, vml->redownload_vvp, &(vml->redownload_ul), &(vml->redownload_br), REDOWNLOAD_NEW, BACKGROUND_PRIORITY_BULK );
 }
 
 /**
@@ -2035,7 +2189,7 @@ static gboolean maps_layer_download_release ( VikMapsLayer *vml, GdkEventButton
       VikCoord ul, br;
       vik_viewport_screen_to_coord ( vvp, MAX(0, MIN(event->x, vml->dl_tool_x)), MAX(0, MIN(event->y, vml->dl_tool_y)), &ul );
       vik_viewport_screen_to_coord ( vvp, MIN(vik_viewport_get_width(vvp), MAX(event->x, vml->dl_tool_x)), MIN(vik_viewport_get_height(vvp), MAX ( event->y, vml->dl_tool_y ) ), &br );
-      start_download_thread ( vml, vvp, &ul, &br, DOWNLOAD_OR_REFRESH );
+      start_download_thread ( vml, vvp, &ul, &br, DOWNLOAD_OR_REFRESH, BACKGROUND_PRIORITY_BULK );
       vml->dl_tool_x = vml->dl_tool_y = -1;
       return TRUE;
     }
@@ -2128,7 +2282,7 @@ static void download_onscreen_maps ( menu_array_values values, gint redownload )
   if ( vik_map_source_get_drawmode(map) == vp_drawmode &&
        vik_map_source_coord_to_mapcoord ( map, &ul, xzoom, yzoom, &ulm ) &&
        vik_map_source_coord_to_mapcoord ( map, &br, xzoom, yzoom, &brm ) )
-    start_download_thread ( vml, vvp, &ul, &br, redownload );
+    start_download_thread ( vml, vvp, &ul, &br, redownload, BACKGROUND_PRIORITY_BULK );
   else if (vik_map_source_get_drawmode(map) != vp_drawmode) {
     const gchar *drawmode_name = vik_viewport_get_drawmode_name (vvp, vik_map_source_get_drawmode(map));
     gchar *err = g_strdup_printf(_("Wrong drawmode for this map.\nSelect \"%s\" from View menu and try again."), _(drawmode_name));
@@ -2233,7 +2387,7 @@ static gint maps_layer_how_many_maps ( VikMapsLayer *vml, VikViewport *vvp, VikC
             mdi->mapstoget++;
           }
           else {
-            if ( g_file_test ( mdi->filename_buf, G_FILE_TEST_EXISTS ) == FALSE ) {
+            if ( !a_tile_index_exists ( mdi->filename_buf ) ) {
               // Missing
               mdi->mapstoget++;
             }
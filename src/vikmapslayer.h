@@ -69,6 +69,10 @@ void vik_maps_layer_set_map_type(VikMapsLayer *vml, guint map_type);
 gchar *vik_maps_layer_get_map_label(VikMapsLayer *vml);
 gchar *maps_layer_default_dir ();
 void vik_maps_layer_download ( VikMapsLayer *vml, VikViewport *vvp, gboolean only_new );
+VikMapSource *maps_layer_get_map_source ( guint uniq_id );
+VikMapsCacheLayout maps_layer_get_cache_default ( void );
+void maps_layer_get_tile_filename ( const gchar *cache_dir, VikMapsCacheLayout layout, VikMapSource *map, MapCoord *mc, gchar *filename_buf, gint buf_len );
+gboolean maps_layer_tile_in_area ( VikMapSource *map, MapCoord *mc );
 
 G_END_DECLS
 
@@ -36,6 +36,7 @@
 #include "coords.h"
 #include "vikcoord.h"
 #include "viktrack.h"
+#include "viktrackprofile.h"
 #include "globals.h"
 #include "dems.h"
 #include "settings.h"
@@ -160,6 +161,7 @@ void vik_track_free(VikTrack *tr)
     g_free ( tr->type );
   g_list_foreach ( tr->trackpoints, (GFunc) vik_trackpoint_free, NULL );
   g_list_free( tr->trackpoints );
+  vik_track_invalidate_index ( tr );
   if (tr->property_dialog)
     if ( GTK_IS_WIDGET(tr->property_dialog) )
       gtk_widget_destroy ( GTK_WIDGET(tr->property_dialog) );
@@ -248,6 +250,27 @@ VikTrackpoint *vik_trackpoint_copy(VikTrackpoint *tp)
   return new_tp;
 }
 
+/**
+ * track_extend_bounds:
+ * @trk:   The track to consider the recalculation on
+ * @tp:    A trackpoint of the track
+ *
+ * See if this trackpoint increases the track bounds and update if so
+ */
+static void track_extend_bounds ( VikTrack *trk, VikTrackpoint *tp )
+{
+  struct LatLon ll;
+  vik_coord_to_latlon ( &(tp->coord), &ll );
+  if ( ll.lat > trk->bbox.north )
+    trk->bbox.north = ll.lat;
+  if ( ll.lon < trk->bbox.west )
+    trk->bbox.west = ll.lon;
+  if ( ll.lat < trk->bbox.south )
+    trk->bbox.south = ll.lat;
+  if ( ll.lon > trk->bbox.east )
+    trk->bbox.east = ll.lon;
+}
+
 /**
  * track_recalculate_bounds_last_tp:
  * @trk:   The track to consider the recalculation on
@@ -258,19 +281,8 @@ static void track_recalculate_bounds_last_tp ( VikTrack *trk )
 {
   GList *tpl = g_list_last ( trk->trackpoints );
 
-  if ( tpl ) {
-    struct LatLon ll;
-    // See if this trackpoint increases the track bounds and update if so
-    vik_coord_to_latlon ( &(VIK_TRACKPOINT(tpl->data)->coord), &ll );
-    if ( ll.lat > trk->bbox.north )
-      trk->bbox.north = ll.lat;
-    if ( ll.lon < trk->bbox.west )
-      trk->bbox.west = ll.lon;
-    if ( ll.lat < trk->bbox.south )
-      trk->bbox.south = ll.lat;
-    if ( ll.lon > trk->bbox.east )
-      trk->bbox.east = ll.lon;
-  }
+  if ( tpl )
+    track_extend_bounds ( trk, VIK_TRACKPOINT(tpl->data) );
 }
 
 /**
@@ -288,12 +300,41 @@ void vik_track_add_trackpoint ( VikTrack *tr, VikTrackpoint *tp, gboolean recalc
   // When it's the first trackpoint need to ensure the bounding box is initialized correctly
   gboolean adding_first_point = tr->trackpoints ? FALSE : TRUE;
   tr->trackpoints = g_list_append ( tr->trackpoints, tp );
+  vik_track_invalidate_index ( tr );
   if ( adding_first_point )
     vik_track_calculate_bounds ( tr );
   else if ( recalculate )
     track_recalculate_bounds_last_tp ( tr );
 }
 
+/**
+ * vik_track_add_trackpoint_after_tail:
+ * @tr:          The track to which the trackpoint will be added
+ * @tail:        The last link of the track's trackpoint list, or NULL if not known
+ * @tp:          The trackpoint to add
+ * @recalculate: Whether to update the bounds for the new trackpoint
+ *
+ * As vik_track_add_trackpoint() but in constant time, for callers
+ *  that keep hold of the end of the list (e.g. when continually recording)
+ * The caller must know the tail is still part of the list,
+ *  e.g. by checking the track's version has not changed since it was obtained.
+ *
+ * Returns: The new last link of the trackpoint list
+ */
+GList *vik_track_add_trackpoint_after_tail ( VikTrack *tr, GList *tail, VikTrackpoint *tp, gboolean recalculate )
+{
+  if ( !tail || tail->next ) {
+    vik_track_add_trackpoint ( tr, tp, recalculate );
+    return g_list_last ( tr->trackpoints );
+  }
+  // NB g_list_append() on the last link does not need to walk the list
+  tail = g_list_append ( tail, tp )->next;
+  vik_track_invalidate_index ( tr );
+  if ( recalculate )
+    track_extend_bounds ( tr, tp );
+  return tail;
+}
+
 /**
  * vik_track_get_length_to_trackpoint:
  *
@@ -484,6 +525,7 @@ void vik_track_to_routepoints ( VikTrack *tr )
 
     iter = iter->next;
   }
+  vik_track_invalidate_index ( tr );
 }
 
 guint vik_track_get_segment_count(const VikTrack *tr)
@@ -568,6 +610,7 @@ void vik_track_reverse ( VikTrack *tr )
     return;
 
   tr->trackpoints = g_list_reverse(tr->trackpoints);
+  vik_track_invalidate_index ( tr );
 
   /* fix 'newsegment' */
   GList *iter = g_list_last ( tr->trackpoints );
@@ -717,6 +760,7 @@ void vik_track_convert ( VikTrack *tr, VikCoordMode dest_mode )
     vik_coord_convert ( &(VIK_TRACKPOINT(iter->data)->coord), dest_mode );
     iter = iter->next;
   }
+  vik_track_invalidate_index ( tr );
 }
 
 /* I understood this when I wrote it ... maybe ... Basically it eats up the
@@ -1226,6 +1270,128 @@ gdouble *vik_track_make_speed_dist_map ( const VikTrack *tr, guint16 num_chunks
   return v;
 }
 
+/*
+ * The cumulative distance (including gaps) at each trackpoint,
+ *  so finding a trackpoint by distance or time is a binary search rather than a walk along the track.
+ * Built when first needed and dropped whenever the trackpoints are changed.
+ * The profile series for the graphs are built on the same arrays and so are dropped with it.
+ */
+struct _VikTrackIndex {
+  guint n;
+  VikTrackpoint **tps;
+  gdouble *dist;
+  gboolean time_ordered; // Timestamps never decrease
+  VikTrackProfile *profile; // Built on demand by vik_track_get_profile()
+};
+
+/**
+ * vik_track_invalidate_index:
+ *
+ * Trackpoints changed other than by vik_track_* functions (which take care of this),
+ *  i.e. added, removed, reordered or their positions, times or elevations edited,
+ *  need either this or vik_track_calculate_bounds() to be called.
+ * This drops the index along with the profile built on it (see vik_track_get_profile()),
+ *  and changes the track's version so anything else derived from the trackpoints
+ *  can tell it is out of date.
+ */
+void vik_track_invalidate_index ( VikTrack *tr )
+{
+  tr->version++;
+  if ( tr->index ) {
+    vik_track_profile_free ( tr->index->profile );
+    g_free ( tr->index->tps );
+    g_free ( tr->index->dist );
+    g_free ( tr->index );
+    tr->index = NULL;
+  }
+}
+
+static struct _VikTrackIndex *track_get_index ( VikTrack *tr )
+{
+  // As a safety net, detect the list having been replaced
+  if ( tr->index && tr->index->tps[0] == tr->trackpoints->data )
+    return tr->index;
+  vik_track_invalidate_index ( tr );
+
+  struct _VikTrackIndex *index = g_malloc ( sizeof(struct _VikTrackIndex) );
+  index->n = g_list_length ( tr->trackpoints );
+  index->tps = g_malloc ( index->n * sizeof(VikTrackpoint*) );
+  index->dist = g_malloc ( index->n * sizeof(gdouble) );
+  index->time_ordered = TRUE;
+  index->profile = NULL;
+
+  gdouble dist = 0.0;
+  guint i = 0;
+  GList *iter;
+  for ( iter = tr->trackpoints; iter; iter = iter->next, i++ ) {
+    VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+    if ( i ) {
+      dist += vik_coord_diff ( &(tp->coord), &(index->tps[i-1]->coord) );
+      if ( tp->timestamp < index->tps[i-1]->timestamp )
+        index->time_ordered = FALSE;
+    }
+    index->tps[i] = tp;
+    index->dist[i] = dist;
+  }
+  tr->index = index;
+  return index;
+}
+
+/**
+ * vik_track_get_profile:
+ *
+ * The series for drawing graphs of the track, built from its index.
+ * Owned by the track and only valid until the trackpoints are next changed
+ *  (i.e. until vik_track_invalidate_index() is called).
+ *
+ * Returns: The profile or NULL if the track has no trackpoints
+ */
+const VikTrackProfile *vik_track_get_profile ( VikTrack *tr )
+{
+  if ( !tr->trackpoints )
+    return NULL;
+
+  struct _VikTrackIndex *index = track_get_index ( tr );
+  if ( !index->profile )
+    index->profile = vik_track_profile_new ( index->n, index->tps, index->dist );
+  return index->profile;
+}
+
+/**
+ * Returns: The first position from @i onwards at least the distance along the track,
+ *          or the number of trackpoints if there is no such position
+ */
+static guint index_search_dist ( const struct _VikTrackIndex *index, guint i, gdouble dist )
+{
+  guint end = index->n;
+  while ( i < end ) {
+    guint mid = i + (end - i) / 2;
+    if ( index->dist[mid] < dist )
+      i = mid + 1;
+    else
+      end = mid;
+  }
+  return i;
+}
+
+/**
+ * Returns: The first position at or after the time,
+ *          or the number of trackpoints if there is no such position
+ */
+static guint index_search_time ( const struct _VikTrackIndex *index, time_t t )
+{
+  guint i = 0;
+  guint end = index->n;
+  while ( i < end ) {
+    guint mid = i + (end - i) / 2;
+    if ( index->tps[mid]->timestamp < t )
+      i = mid + 1;
+    else
+      end = mid;
+  }
+  return i;
+}
+
 /**
  * vik_track_get_tp_by_dist:
  * @trk:                  The Track on which to find a Trackpoint
@@ -1239,102 +1405,56 @@ gdouble *vik_track_make_speed_dist_map ( const VikTrack *tr, guint16 num_chunks
  */
 VikTrackpoint *vik_track_get_tp_by_dist ( VikTrack *trk, gdouble meters_from_start, gboolean get_next_point, gdouble *tp_metres_from_start )
 {
-  gdouble current_dist = 0.0;
-  gdouble current_inc = 0.0;
   if ( tp_metres_from_start )
     *tp_metres_from_start = 0.0;
 
-  if ( trk->trackpoints ) {
-    GList *iter = g_list_next ( g_list_first ( trk->trackpoints ) );
-    while (iter) {
-      current_inc = vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-                                     &(VIK_TRACKPOINT(iter->prev->data)->coord) );
-      current_dist += current_inc;
-      if ( current_dist >= meters_from_start )
-        break;
-      iter = g_list_next ( iter );
-    }
-    // passed the end of the track
-    if ( !iter )
-      return NULL;
-
-    if ( tp_metres_from_start )
-      *tp_metres_from_start = current_dist;
+  if ( !trk->trackpoints )
+    return NULL;
 
-    // we've gone past the distance already, is the previous trackpoint wanted?
-    if ( !get_next_point ) {
-      if ( iter->prev ) {
-        if ( tp_metres_from_start )
-          *tp_metres_from_start = current_dist-current_inc;
-        return VIK_TRACKPOINT(iter->prev->data);
-      }
-    }
-    return VIK_TRACKPOINT(iter->data);
-  }
+  struct _VikTrackIndex *index = track_get_index ( trk );
+  guint i = index_search_dist ( index, 1, meters_from_start );
+  // passed the end of the track
+  if ( i >= index->n )
+    return NULL;
 
-  return NULL;
+  // we've gone past the distance already, is the previous trackpoint wanted?
+  if ( !get_next_point )
+    i--;
+  if ( tp_metres_from_start )
+    *tp_metres_from_start = index->dist[i];
+  return index->tps[i];
 }
 
 /* by Alex Foobarian */
 VikTrackpoint *vik_track_get_closest_tp_by_percentage_dist ( VikTrack *tr, gdouble reldist, gdouble *meters_from_start )
-{
-  gdouble dist = vik_track_get_length_including_gaps(tr) * reldist;
-  gdouble current_dist = 0.0;
-  gdouble current_inc = 0.0;
-  if ( tr->trackpoints )
-  {
-    GList *iter = tr->trackpoints->next;
-    GList *last_iter = NULL;
-    gdouble last_dist = 0.0;
-    while (iter)
-    {
-      current_inc = vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-                                     &(VIK_TRACKPOINT(iter->prev->data)->coord) );
-      last_dist = current_dist;
-      current_dist += current_inc;
-      if ( current_dist >= dist )
-        break;
-      last_iter = iter;
-      iter = iter->next;
-    }
-    if (!iter) { /* passing the end the track */
-      if (last_iter) {
-        if (meters_from_start)
-          *meters_from_start = last_dist;
-        return(VIK_TRACKPOINT(last_iter->data));
-      }
-      else
-        return NULL;
-    }
-    /* we've gone past the dist already, was prev trackpoint closer? */
-    /* should do a vik_coord_average_weighted() thingy. */
-    if ( iter->prev && fabs(current_dist-current_inc-dist) < fabs(current_dist-dist) ) {
-      if (meters_from_start)
-        *meters_from_start = last_dist;
-      iter = iter->prev;
-    }
-    else
-      if (meters_from_start)
-        *meters_from_start = current_dist;
-
-    return VIK_TRACKPOINT(iter->data);
-
-  }
-  return NULL;
-}
-
-VikTrackpoint *vik_track_get_closest_tp_by_percentage_time ( VikTrack *tr, gdouble reltime, time_t *seconds_from_start )
 {
   if ( !tr->trackpoints )
     return NULL;
 
-  time_t t_pos, t_start, t_end, t_total;
-  t_start = VIK_TRACKPOINT(tr->trackpoints->data)->timestamp;
-  t_end = VIK_TRACKPOINT(g_list_last(tr->trackpoints)->data)->timestamp;
-  t_total = t_end - t_start;
+  struct _VikTrackIndex *index = track_get_index ( tr );
+  if ( index->n < 2 )
+    return NULL;
 
-  t_pos = t_start + t_total * reltime;
+  gdouble dist = index->dist[index->n-1] * reldist;
+  guint i = index_search_dist ( index, 1, dist );
+  if ( i >= index->n ) /* passing the end the track */
+    i = index->n - 1;
+  /* we've gone past the dist already, was prev trackpoint closer? */
+  /* should do a vik_coord_average_weighted() thingy. */
+  else if ( fabs(index->dist[i-1]-dist) < fabs(index->dist[i]-dist) )
+    i--;
+
+  if (meters_from_start)
+    *meters_from_start = index->dist[i];
+  return index->tps[i];
+}
 
+/**
+ * The nearest trackpoint in time, by walking the track;
+ *  for when the timestamps are out of order
+ */
+static GList *closest_tpl_by_time ( VikTrack *tr, time_t t_pos )
+{
   GList *iter = tr->trackpoints;
 
   while (iter) {
@@ -1353,12 +1473,51 @@ VikTrackpoint *vik_track_get_closest_tp_by_percentage_time ( VikTrack *tr, gdoub
       break;
     iter = iter->next;
   }
+  return iter;
+}
+
+VikTrackpoint *vik_track_get_closest_tp_by_percentage_time ( VikTrack *tr, gdouble reltime, time_t *seconds_from_start )
+{
+  if ( !tr->trackpoints )
+    return NULL;
+
+  struct _VikTrackIndex *index = track_get_index ( tr );
+  time_t t_pos, t_start, t_end, t_total;
+  t_start = index->tps[0]->timestamp;
+  t_end = index->tps[index->n-1]->timestamp;
+  t_total = t_end - t_start;
+
+  t_pos = t_start + t_total * reltime;
+
+  VikTrackpoint *tp = NULL;
+  if ( index->time_ordered ) {
+    guint i = index_search_time ( index, t_pos );
+    if ( i >= index->n ) {
+      /* last trackpoint: accommodate for round-off */
+      if ( t_pos < (index->tps[index->n-1]->timestamp + 3) )
+        tp = index->tps[index->n-1];
+    }
+    else {
+      if ( index->tps[i]->timestamp > t_pos && i > 0 ) {
+        time_t t_before = t_pos - index->tps[i-1]->timestamp;
+        time_t t_after = index->tps[i]->timestamp - t_pos;
+        if (t_before <= t_after)
+          i--;
+      }
+      tp = index->tps[i];
+    }
+  }
+  else {
+    GList *iter = closest_tpl_by_time ( tr, t_pos );
+    if ( iter )
+      tp = VIK_TRACKPOINT(iter->data);
+  }
 
-  if (!iter)
+  if (!tp)
     return NULL;
   if (seconds_from_start)
-    *seconds_from_start = VIK_TRACKPOINT(iter->data)->timestamp - VIK_TRACKPOINT(tr->trackpoints->data)->timestamp;
-  return VIK_TRACKPOINT(iter->data);
+    *seconds_from_start = tp->timestamp - t_start;
+  return tp;
 }
 
 VikTrackpoint* vik_track_get_tp_by_max_speed ( const VikTrack *tr )
@@ -1531,6 +1690,7 @@ void vik_track_marshall ( VikTrack *tr, guint8 **data, guint *datalen)
   vtm_append(tr->comment);
   vtm_append(tr->description);
   vtm_append(tr->source);
+  vtm_append(tr->type);
 
   *data = b->data;
   *datalen = b->len;
@@ -1586,6 +1746,7 @@ VikTrack *vik_track_unmarshall (guint8 *data, guint datalen)
   vtu_get(new_tr->comment);
   vtu_get(new_tr->description);
   vtu_get(new_tr->source);
+  vtu_get(new_tr->type);
 
   return new_tr;
 }
@@ -1623,6 +1784,9 @@ void vik_track_calculate_bounds ( VikTrack *trk )
  
   g_debug ( "Bounds of track: '%s' is: %f,%f to: %f,%f", trk->name, topleft.lat, topleft.lon, bottomright.lat, bottomright.lon );
 
+  // Anything derived from the trackpoints is out of date too
+  vik_track_invalidate_index ( trk );
+
   trk->bbox.north = topleft.lat;
   trk->bbox.east = bottomright.lon;
   trk->bbox.south = bottomright.lat;
@@ -1661,6 +1825,7 @@ void vik_track_anonymize_times ( VikTrack *tr )
     }
     tp_iter = tp_iter->next;
   }
+  vik_track_invalidate_index ( tr );
 }
 
 /**
@@ -1713,36 +1878,6 @@ void vik_track_interpolate_times ( VikTrack *tr )
   }
 }
 
-/**
- * vik_track_apply_dem_data:
- * @skip_existing: When TRUE, don't change the elevation if the trackpoint already has a value
- *
- * Set elevation data for a track using any available DEM information
- */
-gulong vik_track_apply_dem_data ( VikTrack *tr, gboolean skip_existing )
-{
-  gulong num = 0;
-  GList *tp_iter;
-  gint16 elev;
-  tp_iter = tr->trackpoints;
-  while ( tp_iter ) {
-    // Don't apply if the point already has a value and the overwrite is off
-    if ( !(skip_existing && VIK_TRACKPOINT(tp_iter->data)->altitude != VIK_DEFAULT_ALTITUDE) ) {
-      /* TODO: of the 4 possible choices we have for choosing an elevation
-       * (trackpoint in between samples), choose the one with the least elevation change
-       * as the last */
-      elev = a_dems_get_elev_by_coord ( &(VIK_TRACKPOINT(tp_iter->data)->coord), VIK_DEM_INTERPOL_BEST );
-
-      if ( elev != VIK_DEM_INVALID_ELEVATION ) {
-        VIK_TRACKPOINT(tp_iter->data)->altitude = elev;
-	num++;
-      }
-    }
-    tp_iter = tp_iter->next;
-  }
-  return num;
-}
-
 /**
  * vik_track_apply_dem_data_last_trackpoint:
  * Apply DEM data (if available) - to only the last trackpoint
@@ -1751,10 +1886,12 @@ void vik_track_apply_dem_data_last_trackpoint ( VikTrack *tr )
 {
   gint16 elev;
   if ( tr->trackpoints ) {
-    /* As in vik_track_apply_dem_data above - use 'best' interpolation method */
+    /* As in vik_trw_layer_dem_apply() - use 'best' interpolation method */
     elev = a_dems_get_elev_by_coord ( &(VIK_TRACKPOINT(g_list_last(tr->trackpoints)->data)->coord), VIK_DEM_INTERPOL_BEST );
-    if ( elev != VIK_DEM_INVALID_ELEVATION )
+    if ( elev != VIK_DEM_INVALID_ELEVATION ) {
       VIK_TRACKPOINT(g_list_last(tr->trackpoints)->data)->altitude = elev;
+      vik_track_invalidate_index ( tr );
+    }
   }
 }
 
@@ -1850,6 +1987,8 @@ gulong vik_track_smooth_missing_elevation_data ( VikTrack *tr, gboolean flat )
     tp_iter = tp_iter->next;
   }
 
+  if ( num )
+    vik_track_invalidate_index ( tr );
   return num;
 }
 
@@ -1865,11 +2004,104 @@ void vik_track_steal_and_append_trackpoints ( VikTrack *t1, VikTrack *t2 )
   } else
     t1->trackpoints = t2->trackpoints;
   t2->trackpoints = NULL;
+  vik_track_invalidate_index ( t2 );
 
   // Trackpoints updated - so update the bounds
   vik_track_calculate_bounds ( t1 );
 }
 
+static gint trackpoint_time_compare ( gconstpointer a, gconstpointer b )
+{
+  time_t t1 = VIK_TRACKPOINT(a)->timestamp, t2 = VIK_TRACKPOINT(b)->timestamp;
+  if ( t1 < t2 ) return -1;
+  if ( t1 > t2 ) return 1;
+  return 0;
+}
+
+/*
+ * Sort trackpoints by time, but only when they are not already in order
+ *  (which is the norm for recorded tracks)
+ */
+static GList *trackpoints_sort_by_time ( GList *tps )
+{
+  GList *iter;
+  for ( iter = tps; iter && iter->next; iter = iter->next )
+    if ( VIK_TRACKPOINT(iter->next->data)->timestamp < VIK_TRACKPOINT(iter->data)->timestamp )
+      return g_list_sort ( tps, trackpoint_time_compare );
+  return tps;
+}
+
+/*
+ * Merge two lists of trackpoints already in time order.
+ * For equal times those from the first list come first.
+ */
+static GList *trackpoints_merge_by_time ( GList *aa, GList *bb )
+{
+  GList head = { NULL, NULL, NULL };
+  GList *tail = &head;
+  while ( aa && bb ) {
+    if ( VIK_TRACKPOINT(bb->data)->timestamp < VIK_TRACKPOINT(aa->data)->timestamp ) {
+      tail->next = bb;
+      bb->prev = tail;
+      tail = bb;
+      bb = bb->next;
+    }
+    else {
+      tail->next = aa;
+      aa->prev = tail;
+      tail = aa;
+      aa = aa->next;
+    }
+  }
+  tail->next = aa ? aa : bb;
+  if ( tail->next )
+    tail->next->prev = tail;
+  if ( head.next )
+    head.next->prev = NULL;
+  return head.next;
+}
+
+/**
+ * vik_track_merge_by_time:
+ * @tr:     The track to receive the trackpoints
+ * @others: A list of #VikTrack, which are left with no trackpoints
+ *
+ * Moves the trackpoints of all the other tracks into @tr, in time order.
+ * This gives the same result as appending them all to @tr and then (stable) sorting,
+ *  but each track is only sorted on its own (if needed) and the sorted runs are then merged.
+ */
+void vik_track_merge_by_time ( VikTrack *tr, GList *others )
+{
+  guint nn = g_list_length ( others ) + 1;
+  GList **runs = g_new ( GList*, nn );
+  guint ii = 0, jj;
+  GList *iter;
+
+  runs[ii++] = trackpoints_sort_by_time ( tr->trackpoints );
+  for ( iter = others; iter; iter = iter->next ) {
+    VikTrack *trk = VIK_TRACK(iter->data);
+    runs[ii++] = trackpoints_sort_by_time ( trk->trackpoints );
+    trk->trackpoints = NULL;
+    vik_track_invalidate_index ( trk );
+  }
+
+  // Merge neighbouring runs pairwise so each trackpoint only takes part in log(nn) merges
+  while ( nn > 1 ) {
+    jj = 0;
+    for ( ii = 0; ii + 1 < nn; ii += 2 )
+      runs[jj++] = trackpoints_merge_by_time ( runs[ii], runs[ii+1] );
+    if ( ii < nn )
+      runs[jj++] = runs[ii];
+    nn = jj;
+  }
+
+  tr->trackpoints = runs[0];
+  g_free ( runs );
+
+  vik_track_invalidate_index ( tr );
+  vik_track_calculate_bounds ( tr );
+}
+
 /**
  * vik_track_cut_back_to_double_point:
  * 
@@ -1885,6 +2117,7 @@ VikCoord *vik_track_cut_back_to_double_point ( VikTrack *tr )
 
   if ( !iter )
     return NULL;
+  vik_track_invalidate_index ( tr );
   while ( iter->next )
     iter = iter->next;
 
@@ -92,6 +92,8 @@ struct _VikTrack {
   gboolean has_color;
   GdkColor color;
   LatLonBBox bbox;
+  struct _VikTrackIndex *index; // Built on demand for lookups by distance or time
+  guint version; // Changed whenever the trackpoints are, see vik_track_invalidate_index()
 };
 
 VikTrack *vik_track_new();
@@ -111,6 +113,7 @@ VikTrackpoint *vik_trackpoint_copy(VikTrackpoint *tp);
 void vik_trackpoint_set_name(VikTrackpoint *tp, const gchar *name);
 
 void vik_track_add_trackpoint(VikTrack *tr, VikTrackpoint *tp, gboolean recalculate);
+GList *vik_track_add_trackpoint_after_tail(VikTrack *tr, GList *tail, VikTrackpoint *tp, gboolean recalculate);
 gdouble vik_track_get_length_to_trackpoint (const VikTrack *tr, const VikTrackpoint *tp);
 gdouble vik_track_get_length(const VikTrack *tr);
 gdouble vik_track_get_length_including_gaps(const VikTrack *tr);
@@ -154,14 +157,15 @@ void vik_track_marshall ( VikTrack *tr, guint8 **data, guint *len);
 VikTrack *vik_track_unmarshall (guint8 *data, guint datalen);
 
 void vik_track_calculate_bounds ( VikTrack *trk );
+void vik_track_invalidate_index ( VikTrack *tr );
 
 void vik_track_anonymize_times ( VikTrack *tr );
 void vik_track_interpolate_times ( VikTrack *tr );
-gulong vik_track_apply_dem_data ( VikTrack *tr, gboolean skip_existing );
 void vik_track_apply_dem_data_last_trackpoint ( VikTrack *tr );
 gulong vik_track_smooth_missing_elevation_data ( VikTrack *tr, gboolean flat );
 
 void vik_track_steal_and_append_trackpoints ( VikTrack *t1, VikTrack *t2 );
+void vik_track_merge_by_time ( VikTrack *tr, GList *others );
 
 VikCoord *vik_track_cut_back_to_double_point ( VikTrack *tr );
 
@@ -0,0 +1,488 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 2; tab-width: 2 -*- */
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2026, The Viking developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/*
+ * Track profile series for drawing graphs of a track at any width.
+ *
+ * These are built on the track's index (which already has the cumulative distance),
+ *  so they are owned by the track and dropped along with the index whenever it changes.
+ * The cumulative time and elevation integrals are built in one pass over the trackpoints.
+ * Thereafter the average value for each pixel column is found from the difference of the
+ *  cumulative values at the column boundaries, and the extremes within a column from a
+ *  min/max pyramid (each level holding the min/max of pairs from the level below).
+ * Thus making a map costs O(width * log(points)) rather than walking the whole track.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include "viktrackprofile.h"
+#include "globals.h"
+
+typedef struct {
+  guint levels;
+  guint *sizes;
+  gfloat **mins; // mins[0] and maxs[0] are the same array of the original values
+  gfloat **maxs;
+} MinMaxPyramid;
+
+struct _VikTrackProfile {
+  guint n;
+  VikTrackpoint **tps; // Borrowed from the track's index
+  const gdouble *dist; // Cumulative distance, including gaps (also from the index)
+  gdouble *time;      // Seconds since the first trackpoint
+  gdouble *area_dist; // Integral of the elevation over the distance
+  gdouble *area_time; // Integral of the elevation over the time
+  gboolean has_elevation;
+  gboolean has_time;  // Timestamps are set and in order
+  MinMaxPyramid elevation;
+  MinMaxPyramid speed; // Speed of the segment ending at each trackpoint
+  MinMaxPyramid gps_speed;
+};
+
+/**
+ * pyramid_init:
+ * @values: Takes ownership of this array
+ */
+static void pyramid_init ( MinMaxPyramid *pyr, gfloat *values, guint n )
+{
+  guint levels = 1;
+  guint size = n;
+  while ( size > 1 ) {
+    size = (size + 1) / 2;
+    levels++;
+  }
+
+  pyr->levels = levels;
+  pyr->sizes = g_new ( guint, levels );
+  pyr->mins = g_new ( gfloat*, levels );
+  pyr->maxs = g_new ( gfloat*, levels );
+  pyr->sizes[0] = n;
+  pyr->mins[0] = values;
+  pyr->maxs[0] = values;
+
+  guint lvl, ii;
+  for ( lvl = 1; lvl < levels; lvl++ ) {
+    guint below = pyr->sizes[lvl-1];
+    size = (below + 1) / 2;
+    pyr->sizes[lvl] = size;
+    pyr->mins[lvl] = g_new ( gfloat, size );
+    pyr->maxs[lvl] = g_new ( gfloat, size );
+    for ( ii = 0; ii < size; ii++ ) {
+      guint jj = 2 * ii;
+      // NB fminf/fmaxf ignore NANs
+      if ( jj + 1 < below ) {
+        pyr->mins[lvl][ii] = fminf ( pyr->mins[lvl-1][jj], pyr->mins[lvl-1][jj+1] );
+        pyr->maxs[lvl][ii] = fmaxf ( pyr->maxs[lvl-1][jj], pyr->maxs[lvl-1][jj+1] );
+      }
+      else {
+        pyr->mins[lvl][ii] = pyr->mins[lvl-1][jj];
+        pyr->maxs[lvl][ii] = pyr->maxs[lvl-1][jj];
+      }
+    }
+  }
+}
+
+static void pyramid_clear ( MinMaxPyramid *pyr )
+{
+  guint lvl;
+  for ( lvl = 1; lvl < pyr->levels; lvl++ ) {
+    g_free ( pyr->mins[lvl] );
+    g_free ( pyr->maxs[lvl] );
+  }
+  if ( pyr->levels )
+    g_free ( pyr->mins[0] );
+  g_free ( pyr->mins );
+  g_free ( pyr->maxs );
+  g_free ( pyr->sizes );
+}
+
+/**
+ * pyramid_query:
+ *
+ * Get the min and max values of the inclusive range [lo, hi] in O(log n).
+ * Both are NAN if there are no valid values in the range.
+ */
+static void pyramid_query ( const MinMaxPyramid *pyr, guint lo, guint hi, gdouble *min, gdouble *max )
+{
+  gfloat mn = NAN;
+  gfloat mx = NAN;
+  guint lvl = 0;
+  while ( lo <= hi ) {
+    // A right hand child on the left edge can't be covered by its parent
+    if ( lo & 1 ) {
+      mn = fminf ( mn, pyr->mins[lvl][lo] );
+      mx = fmaxf ( mx, pyr->maxs[lvl][lo] );
+      lo++;
+    }
+    // Similarly a left hand child on the right edge
+    if ( lo <= hi && !(hi & 1) ) {
+      mn = fminf ( mn, pyr->mins[lvl][hi] );
+      mx = fmaxf ( mx, pyr->maxs[lvl][hi] );
+      if ( hi == 0 )
+        break;
+      hi--;
+    }
+    if ( lo > hi )
+      break;
+    lo >>= 1;
+    hi >>= 1;
+    lvl++;
+  }
+  *min = mn;
+  *max = mx;
+}
+
+/**
+ * find_segment:
+ *
+ * Returns: The index of the segment [k, k+1] containing x, for a non decreasing axis
+ */
+static guint find_segment ( const gdouble *axis, guint n, gdouble x )
+{
+  guint lo = 0;
+  guint hi = n - 1;
+  if ( x <= axis[0] )
+    return 0;
+  while ( hi - lo > 1 ) {
+    guint mid = (lo + hi) / 2;
+    if ( axis[mid] <= x )
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/**
+ * lower_bound:
+ *
+ * Returns: The first index with an axis value of at least x (or n if none)
+ */
+static guint lower_bound ( const gdouble *axis, guint n, gdouble x )
+{
+  guint lo = 0;
+  guint hi = n;
+  while ( lo < hi ) {
+    guint mid = (lo + hi) / 2;
+    if ( axis[mid] < x )
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+static gdouble fraction_along ( const gdouble *axis, guint k, gdouble x )
+{
+  gdouble span = axis[k+1] - axis[k];
+  if ( span <= 0 )
+    return 1.0;
+  return CLAMP ( (x - axis[k]) / span, 0.0, 1.0 );
+}
+
+/**
+ * interpolate:
+ *
+ * The value of a series at x on the given axis, linearly interpolated between trackpoints
+ */
+static gdouble interpolate ( const VikTrackProfile *profile, const gdouble *axis, const gdouble *values, gdouble x )
+{
+  guint k = find_segment ( axis, profile->n, x );
+  gdouble f = fraction_along ( axis, k, x );
+  return values[k] + f * (values[k+1] - values[k]);
+}
+
+/**
+ * elevation_area:
+ *
+ * The integral of the elevation up to x on the given axis,
+ *  treating the elevation as varying linearly between trackpoints
+ */
+static gdouble elevation_area ( const VikTrackProfile *profile, const gdouble *axis, const gdouble *area, gdouble x )
+{
+  guint k = find_segment ( axis, profile->n, x );
+  gdouble f = fraction_along ( axis, k, x );
+  gdouble alt1 = profile->tps[k]->altitude;
+  gdouble alt_x = alt1 + f * (profile->tps[k+1]->altitude - alt1);
+  return area[k] + f * (axis[k+1] - axis[k]) * (alt1 + alt_x) * 0.5;
+}
+
+/**
+ * vik_track_profile_new:
+ * @n:    The number of trackpoints (at least one)
+ * @tps:  The trackpoints in order
+ * @dist: The cumulative distance at each trackpoint
+ *
+ * Build the profile series on the arrays of a track's index, which must outlive the profile.
+ * Use vik_track_get_profile() rather than calling this directly.
+ */
+VikTrackProfile *vik_track_profile_new ( guint n, VikTrackpoint **tps, const gdouble *dist )
+{
+  VikTrackProfile *profile = g_malloc0 ( sizeof(VikTrackProfile) );
+  profile->n = n;
+  profile->tps = tps;
+  profile->dist = dist;
+
+  profile->time = g_new ( gdouble, n );
+  profile->area_dist = g_new ( gdouble, n );
+  profile->area_time = g_new ( gdouble, n );
+  gfloat *elevations = g_new ( gfloat, n );
+  gfloat *speeds = g_new ( gfloat, n );
+  gfloat *gps_speeds = g_new ( gfloat, n );
+
+  time_t t0 = tps[0]->timestamp;
+  profile->has_time = TRUE;
+
+  guint ii;
+  for ( ii = 0; ii < n; ii++ ) {
+    VikTrackpoint *tp = tps[ii];
+    // Some protection against crazily massive numbers, see vik_track_make_elevation_map()
+    if ( tp->altitude != VIK_DEFAULT_ALTITUDE && tp->altitude < 1E9 )
+      profile->has_elevation = TRUE;
+    elevations[ii] = tp->altitude;
+    gps_speeds[ii] = tp->speed;
+    profile->time[ii] = (gdouble)(tp->timestamp - t0);
+
+    if ( ii == 0 ) {
+      profile->area_dist[0] = 0.0;
+      profile->area_time[0] = 0.0;
+      speeds[0] = NAN;
+      continue;
+    }
+
+    VikTrackpoint *prev = tps[ii-1];
+    gdouble seg_length = dist[ii] - dist[ii-1];
+    gdouble seg_time = profile->time[ii] - profile->time[ii-1];
+    gdouble seg_alt = (prev->altitude + tp->altitude) * 0.5;
+    if ( seg_time < 0 )
+      profile->has_time = FALSE;
+    profile->area_dist[ii] = profile->area_dist[ii-1] + seg_length * seg_alt;
+    profile->area_time[ii] = profile->area_time[ii-1] + seg_time * seg_alt;
+    speeds[ii] = seg_time > 0 ? seg_length / seg_time : NAN;
+  }
+
+  if ( !t0 || !tps[n-1]->timestamp || profile->time[n-1] <= 0 )
+    profile->has_time = FALSE;
+
+  pyramid_init ( &profile->elevation, elevations, n );
+  pyramid_init ( &profile->speed, speeds, n );
+  pyramid_init ( &profile->gps_speed, gps_speeds, n );
+
+  return profile;
+}
+
+void vik_track_profile_free ( VikTrackProfile *profile )
+{
+  if ( !profile )
+    return;
+  pyramid_clear ( &profile->elevation );
+  pyramid_clear ( &profile->speed );
+  pyramid_clear ( &profile->gps_speed );
+  g_free ( profile->time );
+  g_free ( profile->area_dist );
+  g_free ( profile->area_time );
+  g_free ( profile );
+}
+
+/**
+ * vik_track_profile_make_map:
+ * @width: The number of values (i.e. pixel columns) to generate
+ * @mins:  Optional array of @width values to receive the smallest value within each column
+ * @maxs:  Optional array of @width values to receive the largest value within each column
+ *
+ * Values are in metres, seconds and metres per second as appropriate.
+ * Min/max values are NAN where there are no values within a column.
+ *
+ * Returns: A newly allocated array of the average value for each column,
+ *          or NULL if the track doesn't have the data for this kind of map.
+ */
+gdouble *vik_track_profile_make_map ( const VikTrackProfile *profile, VikTrackProfileMap map, guint width, gdouble *mins, gdouble *maxs )
+{
+  if ( !profile || profile->n < 2 || !width )
+    return NULL;
+
+  guint n = profile->n;
+  gdouble length = profile->dist[n-1];
+  gdouble duration = profile->time[n-1];
+  const gdouble *axis;
+  gdouble extent;
+
+  switch ( map ) {
+  case VIK_TRACK_PROFILE_ELEVATION_DISTANCE:
+  case VIK_TRACK_PROFILE_GRADIENT_DISTANCE:
+    if ( !profile->has_elevation || length <= 0 )
+      return NULL;
+    axis = profile->dist;
+    extent = length;
+    break;
+  case VIK_TRACK_PROFILE_SPEED_DISTANCE:
+    if ( !profile->has_time || length <= 0 )
+      return NULL;
+    axis = profile->dist;
+    extent = length;
+    break;
+  case VIK_TRACK_PROFILE_GPS_SPEED_DISTANCE:
+    if ( length <= 0 )
+      return NULL;
+    axis = profile->dist;
+    extent = length;
+    break;
+  case VIK_TRACK_PROFILE_ELEVATION_TIME:
+    if ( !profile->has_elevation || !profile->has_time )
+      return NULL;
+    axis = profile->time;
+    extent = duration;
+    break;
+  default:
+    // Remaining maps are by time
+    if ( !profile->has_time )
+      return NULL;
+    axis = profile->time;
+    extent = duration;
+    break;
+  }
+
+  gdouble *pts = g_malloc ( sizeof(gdouble) * width );
+  gdouble x1 = 0.0;
+  guint cc;
+  for ( cc = 0; cc < width; cc++ ) {
+    gdouble x0 = x1;
+    x1 = extent * (cc + 1) / width;
+
+    switch ( map ) {
+    case VIK_TRACK_PROFILE_ELEVATION_DISTANCE:
+    case VIK_TRACK_PROFILE_GRADIENT_DISTANCE:
+      pts[cc] = (elevation_area ( profile, axis, profile->area_dist, x1 ) - elevation_area ( profile, axis, profile->area_dist, x0 )) / (x1 - x0);
+      break;
+    case VIK_TRACK_PROFILE_ELEVATION_TIME:
+      pts[cc] = (elevation_area ( profile, axis, profile->area_time, x1 ) - elevation_area ( profile, axis, profile->area_time, x0 )) / (x1 - x0);
+      break;
+    case VIK_TRACK_PROFILE_SPEED_TIME:
+      pts[cc] = (interpolate ( profile, axis, profile->dist, x1 ) - interpolate ( profile, axis, profile->dist, x0 )) / (x1 - x0);
+      break;
+    case VIK_TRACK_PROFILE_DISTANCE_TIME:
+      pts[cc] = interpolate ( profile, axis, profile->dist, x1 );
+      break;
+    case VIK_TRACK_PROFILE_SPEED_DISTANCE: {
+      gdouble dt = interpolate ( profile, axis, profile->time, x1 ) - interpolate ( profile, axis, profile->time, x0 );
+      pts[cc] = dt > 0 ? (x1 - x0) / dt : 0.0;
+      break;
+    }
+    default:
+      pts[cc] = NAN;
+      break;
+    }
+
+    if ( !mins && !maxs && map != VIK_TRACK_PROFILE_GPS_SPEED_DISTANCE && map != VIK_TRACK_PROFILE_GPS_SPEED_TIME )
+      continue;
+
+    // The trackpoints within this column
+    guint lo = lower_bound ( axis, n, x0 );
+    guint hi = lower_bound ( axis, n, x1 );
+    if ( hi == n || axis[hi] > x1 )
+      hi--;
+
+    gdouble mn = pts[cc];
+    gdouble mx = pts[cc];
+    switch ( map ) {
+    case VIK_TRACK_PROFILE_ELEVATION_DISTANCE:
+    case VIK_TRACK_PROFILE_ELEVATION_TIME:
+      if ( lo <= hi && hi < n ) {
+        pyramid_query ( &profile->elevation, lo, hi, &mn, &mx );
+        mn = MIN ( mn, pts[cc] );
+        mx = MAX ( mx, pts[cc] );
+      }
+      break;
+    case VIK_TRACK_PROFILE_SPEED_TIME:
+    case VIK_TRACK_PROFILE_SPEED_DISTANCE:
+      // Any segment overlapping this column
+      pyramid_query ( &profile->speed, MAX(lo, 1), MIN(hi+1, n-1), &mn, &mx );
+      break;
+    case VIK_TRACK_PROFILE_GPS_SPEED_DISTANCE:
+    case VIK_TRACK_PROFILE_GPS_SPEED_TIME:
+      if ( lo <= hi && hi < n )
+        pyramid_query ( &profile->gps_speed, lo, hi, &mn, &mx );
+      else
+        mn = mx = NAN;
+      pts[cc] = (mn + mx) * 0.5;
+      break;
+    case VIK_TRACK_PROFILE_DISTANCE_TIME:
+      mn = cc ? pts[cc-1] : 0.0;
+      break;
+    default:
+      break;
+    }
+    if ( mins )
+      mins[cc] = mn;
+    if ( maxs )
+      maxs[cc] = mx;
+  }
+
+  // Gradients are derived from the average elevations, as per vik_track_make_gradient_map()
+  if ( map == VIK_TRACK_PROFILE_GRADIENT_DISTANCE ) {
+    gdouble chunk_length = length / width;
+    gdouble gradient = 0.0;
+    for ( cc = 0; cc + 1 < width; cc++ ) {
+      gradient = 100.0 * (pts[cc+1] - pts[cc]) / chunk_length;
+      pts[cc] = gradient;
+    }
+    pts[width-1] = gradient;
+    for ( cc = 0; cc < width; cc++ ) {
+      if ( mins )
+        mins[cc] = pts[cc];
+      if ( maxs )
+        maxs[cc] = pts[cc];
+    }
+  }
+
+  return pts;
+}
+
+/**
+ * vik_track_profile_get_tp_at_distance:
+ *
+ * Returns: The trackpoint nearest to the distance along the track
+ */
+VikTrackpoint *vik_track_profile_get_tp_at_distance ( const VikTrackProfile *profile, gdouble distance )
+{
+  if ( !profile )
+    return NULL;
+  if ( profile->n == 1 )
+    return profile->tps[0];
+  guint k = find_segment ( profile->dist, profile->n, distance );
+  return fraction_along ( profile->dist, k, distance ) < 0.5 ? profile->tps[k] : profile->tps[k+1];
+}
+
+/**
+ * vik_track_profile_get_tp_at_time:
+ *
+ * Returns: The trackpoint nearest to the time from the start of the track,
+ *          or NULL if the track doesn't have usable timestamps
+ */
+VikTrackpoint *vik_track_profile_get_tp_at_time ( const VikTrackProfile *profile, gdouble seconds )
+{
+  if ( !profile || profile->n < 2 || !profile->has_time )
+    return NULL;
+  guint k = find_segment ( profile->time, profile->n, seconds );
+  return fraction_along ( profile->time, k, seconds ) < 0.5 ? profile->tps[k] : profile->tps[k+1];
+}
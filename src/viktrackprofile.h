@@ -0,0 +1,55 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 2; tab-width: 2 -*- */
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2026, The Viking developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#ifndef _VIKING_TRACKPROFILE_H
+#define _VIKING_TRACKPROFILE_H
+
+#include "viktrack.h"
+
+G_BEGIN_DECLS
+
+typedef enum {
+  VIK_TRACK_PROFILE_ELEVATION_DISTANCE, // Average elevation along the track
+  VIK_TRACK_PROFILE_GRADIENT_DISTANCE,  // Gradient (%) along the track
+  VIK_TRACK_PROFILE_SPEED_TIME,         // Average speed over time
+  VIK_TRACK_PROFILE_DISTANCE_TIME,      // Distance travelled over time
+  VIK_TRACK_PROFILE_ELEVATION_TIME,     // Average elevation over time
+  VIK_TRACK_PROFILE_SPEED_DISTANCE,     // Average speed along the track
+  VIK_TRACK_PROFILE_GPS_SPEED_DISTANCE, // Recorded GPS speeds along the track (only the min/max are meaningful)
+  VIK_TRACK_PROFILE_GPS_SPEED_TIME,     // Recorded GPS speeds over time (only the min/max are meaningful)
+} VikTrackProfileMap;
+
+typedef struct _VikTrackProfile VikTrackProfile;
+
+const VikTrackProfile *vik_track_get_profile ( VikTrack *tr );
+
+VikTrackProfile *vik_track_profile_new ( guint n, VikTrackpoint **tps, const gdouble *dist );
+void vik_track_profile_free ( VikTrackProfile *profile );
+
+gdouble *vik_track_profile_make_map ( const VikTrackProfile *profile, VikTrackProfileMap map, guint width, gdouble *mins, gdouble *maxs );
+
+VikTrackpoint *vik_track_profile_get_tp_at_distance ( const VikTrackProfile *profile, gdouble distance );
+VikTrackpoint *vik_track_profile_get_tp_at_time ( const VikTrackProfile *profile, gdouble seconds );
+
+G_END_DECLS
+
+#endif
@@ -52,6 +52,7 @@
 #include "babel.h"
 #include "dem.h"
 #include "dems.h"
+#include "viktrwlayer_dem.h"
 #include "geonamessearch.h"
 #ifdef VIK_CONFIG_OPENSTREETMAP
 #include "osm-traces.h"
@@ -63,6 +64,7 @@
 #include "vikexttool_datasources.h"
 #include "ui_util.h"
 #include "vikutils.h"
+#include "vikgridindex.h"
 
 #include "vikrouting.h"
 
@@ -126,6 +128,31 @@ typedef enum {
   FS_NUM_SIZES
 } font_size_t;
 
+// Buffers for drawing a track, so each kind of primitive can be sent in as few requests as possible
+typedef struct {
+  GArray *segs; // GdkSegment
+  GArray *gcs;  // GdkGC* for each segment
+} DrawSegments;
+
+typedef enum {
+  DRAW_MARKER_START = 0,
+  DRAW_MARKER_POINT,
+  DRAW_MARKER_STOP,
+  DRAW_MARKER_END,
+} DrawMarkerType;
+
+typedef struct {
+  GdkGC *gc;
+  gint x, y;
+  guint8 size;
+  DrawMarkerType type;
+} DrawMarker;
+
+typedef struct {
+  GdkGC *gc;
+  GdkPoint points[4];
+} DrawElevation;
+
 struct _VikTrwLayer {
   VikLayer vl;
   GHashTable *tracks;
@@ -153,6 +180,12 @@ struct _VikTrwLayer {
   guint8 bg_line_thickness;
   vik_layer_sort_order_t track_sort_order;
 
+  // Reused for each track drawn
+  DrawSegments draw_lines;  // The track itself (also drawn as the outline)
+  DrawSegments draw_extras; // Elevation lines and direction arrows
+  GArray *draw_elevations;  // DrawElevation
+  GArray *draw_markers;     // DrawMarker
+
   // Metadata
   VikTRWMetadata *metadata;
 
@@ -217,6 +250,11 @@ struct _VikTrwLayer {
 
   /* for waypoint text */
   PangoLayout *wplabellayout;
+  GHashTable *wp_label_cache; // Laid out labels by waypoint name, for the current font size
+  guint8 *wp_label_grid;      // Screen cells already covered by a label in the current draw
+  guint wp_label_grid_cols, wp_label_grid_rows;
+  VikGridIndex *wp_grid;      // For drawing clusters of waypoints, created when first needed
+  PangoLayout *wp_cluster_layout;
 
   gboolean has_verified_thumbnails;
 
@@ -230,6 +268,17 @@ struct _VikTrwLayer {
 
   // One per layer
   GtkWidget *tracks_analysis_dialog;
+
+  // Large sublayers only get a placeholder row until they are first expanded
+  //  (apart from rows created individually for items selected from the map)
+  gboolean tracks_deferred, routes_deferred, waypoints_deferred;
+  GtkTreeIter tracks_placeholder, routes_placeholder, waypoints_placeholder;
+  gulong test_expand_handler;
+  gboolean selecting_item; // So showing a single item row doesn't create all the others
+
+  // Bulk insertion: sorting of each sublayer is deferred until the outermost commit
+  guint bulk_insert_depth;
+  gboolean bulk_sort_waypoints, bulk_sort_tracks, bulk_sort_routes;
 };
 
 /* A caached waypoint image. */
@@ -251,6 +300,7 @@ struct DrawingParams {
   gdouble ce1, ce2, cn1, cn2;
   LatLonBBox bbox;
   gboolean highlight;
+  gboolean declutter_labels;
 };
 
 static gboolean trw_layer_delete_waypoint ( VikTrwLayer *vtl, VikWaypoint *wp );
@@ -410,6 +460,11 @@ static void highest_wp_number_reset(VikTrwLayer *vtl);
 static void highest_wp_number_add_wp(VikTrwLayer *vtl, const gchar *new_wp_name);
 static void highest_wp_number_remove_wp(VikTrwLayer *vtl, const gchar *old_wp_name);
 
+static void trw_layer_set_track_icon ( VikTrwLayer *vtl, VikTrack *trk, GtkTreeIter *iter );
+static void trw_layer_realize_deferred ( VikTrwLayer *vtl, gint subtype );
+static GtkTreeIter *trw_layer_get_item_iter ( VikTrwLayer *vtl, gint subtype, gpointer id );
+static void trw_layer_select_item ( VikTrwLayer *vtl, gint subtype, gpointer id );
+
 // Note for the following tool GtkRadioActionEntry texts:
 //  the very first text value is an internal name not displayed anywhere
 //  the first N_ text value is the name used for menu entries - hence has an underscore for the keyboard accelerator
@@ -976,11 +1031,11 @@ gboolean vik_trw_layer_find_date ( VikTrwLayer *vtl, const gchar *date_str, VikC
       struct LatLon maxmin[2] = { {0,0}, {0,0} };
       trw_layer_find_maxmin_tracks ( NULL, df.trk, maxmin );
       trw_layer_zoom_to_show_latlons ( vtl, vvp, maxmin );
-      vik_treeview_select_iter ( VIK_LAYER(vtl)->vt, g_hash_table_lookup (vtl->tracks_iters, df.trk_id), TRUE );
+      trw_layer_select_item ( vtl, VIK_TRW_LAYER_SUBLAYER_TRACK, df.trk_id );
     }
     else if ( df.wpt ) {
       vik_viewport_set_center_coord ( vvp, &(df.wpt->coord), TRUE );
-      vik_treeview_select_iter ( VIK_LAYER(vtl)->vt, g_hash_table_lookup (vtl->waypoints_iters, df.wpt_id), TRUE );
+      trw_layer_select_item ( vtl, VIK_TRW_LAYER_SUBLAYER_WAYPOINT, df.wpt_id );
     }
     vik_layer_emit_update ( VIK_LAYER(vtl) );
   }
@@ -1179,6 +1234,17 @@ static void image_cache_free ( VikTrwLayer *vtl )
   g_queue_free ( vtl->image_cache );
 }
 
+/*
+ * To be called whenever waypoints are added, removed, moved or change visibility
+ */
+static void trw_layer_waypoints_grid_invalidate ( VikTrwLayer *vtl )
+{
+  if ( vtl->wp_grid ) {
+    vik_grid_index_free ( vtl->wp_grid );
+    vtl->wp_grid = NULL;
+  }
+}
+
 static gboolean trw_layer_set_param ( VikTrwLayer *vtl, guint16 id, VikLayerParamData data, VikViewport *vp, gboolean is_file_operation )
 {
   switch ( id )
@@ -1292,6 +1358,7 @@ static gboolean trw_layer_set_param ( VikTrwLayer *vtl, guint16 id, VikLayerPara
       if ( data.u < FS_NUM_SIZES ) {
         vtl->wp_font_size = data.u;
         g_free ( vtl->wp_fsize_str );
+        g_hash_table_remove_all ( vtl->wp_label_cache );
         switch ( vtl->wp_font_size ) {
           case FS_XX_SMALL: vtl->wp_fsize_str = g_strdup ( "xx-small" ); break;
           case FS_X_SMALL: vtl->wp_fsize_str = g_strdup ( "x-small" ); break;
@@ -1623,6 +1690,14 @@ static VikTrwLayer* trw_layer_new1 ( VikViewport *vvp )
   rv->routes_iters = g_hash_table_new_full ( g_direct_hash, g_direct_equal, NULL, g_free );
 
   rv->image_cache = g_queue_new(); // Must be performed before set_params via set_defaults
+  rv->wp_label_cache = g_hash_table_new_full ( g_str_hash, g_str_equal, g_free, g_object_unref );
+
+  rv->draw_lines.segs = g_array_new ( FALSE, FALSE, sizeof(GdkSegment) );
+  rv->draw_lines.gcs = g_array_new ( FALSE, FALSE, sizeof(GdkGC*) );
+  rv->draw_extras.segs = g_array_new ( FALSE, FALSE, sizeof(GdkSegment) );
+  rv->draw_extras.gcs = g_array_new ( FALSE, FALSE, sizeof(GdkGC*) );
+  rv->draw_elevations = g_array_new ( FALSE, FALSE, sizeof(DrawElevation) );
+  rv->draw_markers = g_array_new ( FALSE, FALSE, sizeof(DrawMarker) );
 
   vik_layer_set_defaults ( VIK_LAYER(rv), vvp );
 
@@ -1652,6 +1727,13 @@ static void trw_layer_free ( VikTrwLayer *trwlayer )
   /* ODC: replace with GArray */
   trw_layer_free_track_gcs ( trwlayer );
 
+  g_array_free ( trwlayer->draw_lines.segs, TRUE );
+  g_array_free ( trwlayer->draw_lines.gcs, TRUE );
+  g_array_free ( trwlayer->draw_extras.segs, TRUE );
+  g_array_free ( trwlayer->draw_extras.gcs, TRUE );
+  g_array_free ( trwlayer->draw_elevations, TRUE );
+  g_array_free ( trwlayer->draw_markers, TRUE );
+
   if ( trwlayer->wp_right_click_menu )
     g_object_ref_sink ( G_OBJECT(trwlayer->wp_right_click_menu) );
 
@@ -1664,6 +1746,12 @@ static void trw_layer_free ( VikTrwLayer *trwlayer )
   if ( trwlayer->wplabellayout != NULL)
     g_object_unref ( G_OBJECT ( trwlayer->wplabellayout ) );
 
+  g_hash_table_destroy ( trwlayer->wp_label_cache );
+  g_free ( trwlayer->wp_label_grid );
+  trw_layer_waypoints_grid_invalidate ( trwlayer );
+  if ( trwlayer->wp_cluster_layout != NULL )
+    g_object_unref ( G_OBJECT ( trwlayer->wp_cluster_layout ) );
+
   if ( trwlayer->waypoint_gc != NULL )
     g_object_unref ( G_OBJECT ( trwlayer->waypoint_gc ) );
 
@@ -1690,6 +1778,7 @@ static void init_drawing_params ( struct DrawingParams *dp, VikTrwLayer *vtl, Vi
   dp->vtl = vtl;
   dp->vp = vp;
   dp->highlight = highlight;
+  dp->declutter_labels = FALSE;
   dp->vw = (VikWindow *)VIK_GTK_WINDOW_FROM_LAYER(dp->vtl);
   dp->xmpp = vik_viewport_get_xmpp ( vp );
   dp->ympp = vik_viewport_get_ympp ( vp );
@@ -2064,47 +2153,135 @@ static void trw_layer_draw_point_names ( struct DrawingParams *dp, VikTrack *trk
   g_free ( bgcolour );
 }
 
-static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct DrawingParams *dp, gboolean draw_track_outline )
+/*
+ * Add a line to be drawn later, skipping it if it is wholly off one side of the screen
+ *  (as vik_viewport_draw_line() does)
+ */
+static void draw_segments_add ( DrawSegments *ds, struct DrawingParams *dp, GdkGC *gc, gint x1, gint y1, gint x2, gint y2 )
+{
+  if ( ( x1 < 0 && x2 < 0 ) || ( y1 < 0 && y2 < 0 ) ||
+       ( x1 > dp->width && x2 > dp->width ) || ( y1 > dp->height && y2 > dp->height ) )
+    return;
+
+  a_viewport_clip_line ( &x1, &y1, &x2, &y2 );
+  GdkSegment seg = { x1, y1, x2, y2 };
+  g_array_append_val ( ds->segs, seg );
+  g_array_append_val ( ds->gcs, gc );
+}
+
+/*
+ * Draw the lines with one call per GC, in order of the first use of each GC,
+ *  and then empty the list ready for the next track
+ */
+static void draw_segments_flush ( DrawSegments *ds, VikViewport *vp )
+{
+  GdkSegment *segs = (GdkSegment*)ds->segs->data;
+  GdkGC **gcs = (GdkGC**)ds->gcs->data;
+  guint len = ds->segs->len;
+  GArray *group = NULL;
+  guint start, ii;
+
+  for ( start = 0; start < len; start++ ) {
+    GdkGC *gc = gcs[start];
+    if ( !gc )
+      continue; // Already drawn with an earlier group
+
+    // Normally all the rest use the same GC, so can be drawn directly
+    for ( ii = start + 1; ii < len && gcs[ii] == gc; ii++ );
+    if ( ii == len ) {
+      vik_viewport_draw_segments ( vp, gc, segs + start, len - start );
+      break;
+    }
+
+    if ( !group )
+      group = g_array_new ( FALSE, FALSE, sizeof(GdkSegment) );
+    g_array_set_size ( group, 0 );
+    for ( ii = start; ii < len; ii++ ) {
+      if ( gcs[ii] == gc ) {
+        g_array_append_val ( group, segs[ii] );
+        gcs[ii] = NULL;
+      }
+    }
+    vik_viewport_draw_segments ( vp, gc, (GdkSegment*)group->data, group->len );
+  }
+
+  if ( group )
+    g_array_free ( group, TRUE );
+  g_array_set_size ( ds->segs, 0 );
+  g_array_set_size ( ds->gcs, 0 );
+}
+
+static void draw_marker_add ( GArray *markers, GdkGC *gc, DrawMarkerType type, gint x, gint y, guint8 size )
+{
+  DrawMarker mk = { gc, x, y, size, type };
+  g_array_append_val ( markers, mk );
+}
+
+static void draw_markers_flush ( GArray *markers, VikViewport *vp )
+{
+  guint ii;
+  for ( ii = 0; ii < markers->len; ii++ ) {
+    DrawMarker *mk = &g_array_index ( markers, DrawMarker, ii );
+    gint x = mk->x, y = mk->y, tp_size = mk->size;
+    switch ( mk->type ) {
+    case DRAW_MARKER_START:
+      {
+        GdkPoint trian[3] = { { x, y-(3*tp_size) }, { x-(2*tp_size), y+(2*tp_size) }, {x+(2*tp_size), y+(2*tp_size)} };
+        vik_viewport_draw_polygon ( vp, mk->gc, TRUE, trian, 3 );
+      }
+      break;
+    case DRAW_MARKER_POINT:
+      vik_viewport_draw_rectangle ( vp, mk->gc, TRUE, x-tp_size, y-tp_size, 2*tp_size, 2*tp_size );
+      break;
+    case DRAW_MARKER_STOP:
+      vik_viewport_draw_arc ( vp, mk->gc, TRUE, x-(3*tp_size), y-(3*tp_size), 6*tp_size, 6*tp_size, 0, 360*64 );
+      break;
+    default: // DRAW_MARKER_END
+      vik_viewport_draw_arc ( vp, mk->gc, TRUE, x-(2*tp_size), y-(2*tp_size), 4*tp_size, 4*tp_size, 0, 360*64 );
+      break;
+    }
+  }
+  g_array_set_size ( markers, 0 );
+}
+
+/**
+ * trw_layer_draw_track:
+ *
+ * The screen positions of the track are worked out once into the layer's drawing buffers,
+ *  which are then drawn in order: the outline (if any), elevation shading, the track lines,
+ *  elevation lines and direction arrows, then the trackpoints and finally the labels.
+ * Lines are drawn with a single request per GC.
+ */
+static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct DrawingParams *dp )
 {
   if ( ! track->visible )
     return;
 
-  /* TODO: this function is a mess, get rid of any redundancy */
+  VikTrwLayer *vtl = dp->vtl;
   GList *list = track->trackpoints;
   GdkGC *main_gc;
   gboolean useoldvals = TRUE;
 
-  gboolean drawpoints;
-  gboolean drawstops;
+  gboolean drawpoints = vtl->drawpoints;
+  gboolean drawstops = vtl->drawstops;
   gboolean drawelevation;
   gdouble min_alt, max_alt, alt_diff = 0;
 
-  const guint8 tp_size_reg = dp->vtl->drawpoints_size;
-  const guint8 tp_size_cur = dp->vtl->drawpoints_size*2;
+  const guint8 tp_size_reg = vtl->drawpoints_size;
+  const guint8 tp_size_cur = vtl->drawpoints_size*2;
   guint8 tp_size;
 
-  if ( dp->vtl->drawelevation )
+  if ( vtl->drawelevation )
   {
     /* assume if it has elevation at the beginning, it has it throughout. not ness a true good assumption */
     if ( ( drawelevation = vik_track_get_minmax_alt ( track, &min_alt, &max_alt ) ) )
       alt_diff = max_alt - min_alt;
   }
 
-  /* admittedly this is not an efficient way to do it because we go through the whole GC thing all over... */
-  if ( dp->vtl->bg_line_thickness && !draw_track_outline )
-    trw_layer_draw_track ( id, track, dp, TRUE );
-
-  if ( draw_track_outline )
-    drawpoints = drawstops = FALSE;
-  else {
-    drawpoints = dp->vtl->drawpoints;
-    drawstops = dp->vtl->drawstops;
-  }
-
   gboolean drawing_highlight = FALSE;
   /* Current track - used for creation */
-  if ( track == dp->vtl->current_track )
-    main_gc = dp->vtl->current_track_gc;
+  if ( track == vtl->current_track )
+    main_gc = vtl->current_track_gc;
   else {
     if ( dp->highlight ) {
       /* Draw all tracks of the layer in special colour
@@ -2114,36 +2291,36 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
     }
     if ( !drawing_highlight ) {
       // Still need to figure out the gc according to the drawing mode:
-      switch ( dp->vtl->drawmode ) {
+      switch ( vtl->drawmode ) {
       case DRAWMODE_BY_TRACK:
-        if ( dp->vtl->track_1color_gc )
-          g_object_unref ( dp->vtl->track_1color_gc );
-        dp->vtl->track_1color_gc = vik_viewport_new_gc_from_color ( dp->vp, &track->color, dp->vtl->line_thickness );
-        main_gc = dp->vtl->track_1color_gc;
+        if ( vtl->track_1color_gc )
+          g_object_unref ( vtl->track_1color_gc );
+        vtl->track_1color_gc = vik_viewport_new_gc_from_color ( dp->vp, &track->color, vtl->line_thickness );
+        main_gc = vtl->track_1color_gc;
 	break;
       default:
         // Mostly for DRAWMODE_ALL_SAME_COLOR
         // but includes DRAWMODE_BY_SPEED, main_gc is set later on as necessary
-        main_gc = g_array_index(dp->vtl->track_gc, GdkGC *, VIK_TRW_LAYER_TRACK_GC_SINGLE);
+        main_gc = g_array_index(vtl->track_gc, GdkGC *, VIK_TRW_LAYER_TRACK_GC_SINGLE);
         break;
       }
     }
   }
 
+  GdkGC *stop_gc = g_array_index(vtl->track_gc, GdkGC *, VIK_TRW_LAYER_TRACK_GC_STOP);
+
   if (list) {
     int x, y, oldx, oldy;
     VikTrackpoint *tp = VIK_TRACKPOINT(list->data);
   
-    tp_size = (list == dp->vtl->current_tpl) ? tp_size_cur : tp_size_reg;
+    tp_size = (list == vtl->current_tpl) ? tp_size_cur : tp_size_reg;
 
     vik_viewport_coord_to_screen ( dp->vp, &(tp->coord), &x, &y );
 
     // Draw the first point as something a bit different from the normal points
     // ATM it's slightly bigger and a triangle
-    if ( drawpoints ) {
-      GdkPoint trian[3] = { { x, y-(3*tp_size) }, { x-(2*tp_size), y+(2*tp_size) }, {x+(2*tp_size), y+(2*tp_size)} };
-      vik_viewport_draw_polygon ( dp->vp, main_gc, TRUE, trian, 3 );
-    }
+    if ( drawpoints )
+      draw_marker_add ( vtl->draw_markers, main_gc, DRAW_MARKER_START, x, y, tp_size );
 
     oldx = x;
     oldy = y;
@@ -2152,17 +2329,17 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
     gdouble low_speed = 0.0;
     gdouble high_speed = 0.0;
     // If necessary calculate these values - which is done only once per track redraw
-    if ( dp->vtl->drawmode == DRAWMODE_BY_SPEED ) {
+    if ( vtl->drawmode == DRAWMODE_BY_SPEED ) {
       // the percentage factor away from the average speed determines transistions between the levels
-      average_speed = vik_track_get_average_speed_moving(track, dp->vtl->stop_length);
-      low_speed = average_speed - (average_speed*(dp->vtl->track_draw_speed_factor/100.0));
-      high_speed = average_speed + (average_speed*(dp->vtl->track_draw_speed_factor/100.0));
+      average_speed = vik_track_get_average_speed_moving(track, vtl->stop_length);
+      low_speed = average_speed - (average_speed*(vtl->track_draw_speed_factor/100.0));
+      high_speed = average_speed + (average_speed*(vtl->track_draw_speed_factor/100.0));
     }
 
     while ((list = g_list_next(list)))
     {
       tp = VIK_TRACKPOINT(list->data);
-      tp_size = (list == dp->vtl->current_tpl) ? tp_size_cur : tp_size_reg;
+      tp_size = (list == vtl->current_tpl) ? tp_size_cur : tp_size_reg;
 
       VikTrackpoint *tp2 = VIK_TRACKPOINT(list->prev->data);
       // See if in a different lat/lon 'quadrant' so don't draw massively long lines (presumably wrong way around the Earth)
@@ -2188,21 +2365,21 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
 	if ( useoldvals && x == oldx && y == oldy )
 	{
 	  // Still need to process points to ensure 'stops' are drawn if required
-	  if ( drawstops && drawpoints && ! draw_track_outline && list->next &&
-	       (VIK_TRACKPOINT(list->next->data)->timestamp - VIK_TRACKPOINT(list->data)->timestamp > dp->vtl->stop_length) )
-	    vik_viewport_draw_arc ( dp->vp, g_array_index(dp->vtl->track_gc, GdkGC *, VIK_TRW_LAYER_TRACK_GC_STOP), TRUE, x-(3*tp_size), y-(3*tp_size), 6*tp_size, 6*tp_size, 0, 360*64 );
+	  if ( drawstops && drawpoints && list->next &&
+	       (VIK_TRACKPOINT(list->next->data)->timestamp - VIK_TRACKPOINT(list->data)->timestamp > vtl->stop_length) )
+	    draw_marker_add ( vtl->draw_markers, stop_gc, DRAW_MARKER_STOP, x, y, tp_size );
 
 	  goto skip;
 	}
 
-        if ( drawpoints || dp->vtl->drawlines ) {
+        if ( drawpoints || vtl->drawlines ) {
           // setup main_gc for both point and line drawing
-          if ( !drawing_highlight && (dp->vtl->drawmode == DRAWMODE_BY_SPEED) ) {
-            main_gc = g_array_index(dp->vtl->track_gc, GdkGC *, track_section_colour_by_speed ( dp->vtl, tp, tp2, average_speed, low_speed, high_speed ) );
+          if ( !drawing_highlight && (vtl->drawmode == DRAWMODE_BY_SPEED) ) {
+            main_gc = g_array_index(vtl->track_gc, GdkGC *, track_section_colour_by_speed ( vtl, tp, tp2, average_speed, low_speed, high_speed ) );
           }
         }
 
-        if ( drawpoints && ! draw_track_outline )
+        if ( drawpoints )
         {
 
           if ( list->next ) {
@@ -2214,61 +2391,54 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
 	     * This is drawn first so the trackpoint will be drawn on top
 	     */
             /* stops */
-            if ( drawstops && VIK_TRACKPOINT(list->next->data)->timestamp - VIK_TRACKPOINT(list->data)->timestamp > dp->vtl->stop_length )
+            if ( drawstops && VIK_TRACKPOINT(list->next->data)->timestamp - VIK_TRACKPOINT(list->data)->timestamp > vtl->stop_length )
 	      /* Stop point.  Draw 6x circle. Always in redish colour */
-              vik_viewport_draw_arc ( dp->vp, g_array_index(dp->vtl->track_gc, GdkGC *, VIK_TRW_LAYER_TRACK_GC_STOP), TRUE, x-(3*tp_size), y-(3*tp_size), 6*tp_size, 6*tp_size, 0, 360*64 );
+              draw_marker_add ( vtl->draw_markers, stop_gc, DRAW_MARKER_STOP, x, y, tp_size );
 
 	    /* Regular point - draw 2x square. */
-	    vik_viewport_draw_rectangle ( dp->vp, main_gc, TRUE, x-tp_size, y-tp_size, 2*tp_size, 2*tp_size );
+	    draw_marker_add ( vtl->draw_markers, main_gc, DRAW_MARKER_POINT, x, y, tp_size );
           }
           else
 	    /* Final point - draw 4x circle. */
-            vik_viewport_draw_arc ( dp->vp, main_gc, TRUE, x-(2*tp_size), y-(2*tp_size), 4*tp_size, 4*tp_size, 0, 360*64 );
+            draw_marker_add ( vtl->draw_markers, main_gc, DRAW_MARKER_END, x, y, tp_size );
         }
 
-        if ((!tp->newsegment) && (dp->vtl->drawlines))
+        if ((!tp->newsegment) && (vtl->drawlines))
         {
 
           /* UTM only: zone check */
-          if ( drawpoints && dp->vtl->coord_mode == VIK_COORD_UTM && tp->coord.utm_zone != dp->center->utm_zone )
+          if ( drawpoints && vtl->coord_mode == VIK_COORD_UTM && tp->coord.utm_zone != dp->center->utm_zone )
             draw_utm_skip_insignia (  dp->vp, main_gc, x, y);
 
           if (!useoldvals)
             vik_viewport_coord_to_screen ( dp->vp, &(tp2->coord), &oldx, &oldy );
 
-          if ( draw_track_outline ) {
-            vik_viewport_draw_line ( dp->vp, dp->vtl->track_bg_gc, oldx, oldy, x, y);
-          }
-          else {
+          draw_segments_add ( &vtl->draw_lines, dp, main_gc, oldx, oldy, x, y );
+
+          if ( vtl->drawelevation && list->next && VIK_TRACKPOINT(list->next->data)->altitude != VIK_DEFAULT_ALTITUDE ) {
+            DrawElevation de;
+            #define FIXALTITUDE(what) ((VIK_TRACKPOINT((what))->altitude-min_alt)/alt_diff*DRAW_ELEVATION_FACTOR*vtl->elevation_factor/dp->xmpp)
+
+            de.points[0].x = oldx;
+            de.points[0].y = oldy;
+            de.points[1].x = oldx;
+            de.points[1].y = oldy-FIXALTITUDE(list->data);
+            de.points[2].x = x;
+            de.points[2].y = y-FIXALTITUDE(list->next->data);
+            de.points[3].x = x;
+            de.points[3].y = y;
+
+            if ( ((oldx - x) > 0 && (oldy - y) > 0) || ((oldx - x) < 0 && (oldy - y) < 0))
+              de.gc = gtk_widget_get_style(GTK_WIDGET(dp->vp))->light_gc[3];
+            else
+              de.gc = gtk_widget_get_style(GTK_WIDGET(dp->vp))->dark_gc[0];
+            g_array_append_val ( vtl->draw_elevations, de );
 
-            vik_viewport_draw_line ( dp->vp, main_gc, oldx, oldy, x, y);
-
-            if ( dp->vtl->drawelevation && list->next && VIK_TRACKPOINT(list->next->data)->altitude != VIK_DEFAULT_ALTITUDE ) {
-              GdkPoint tmp[4];
-              #define FIXALTITUDE(what) ((VIK_TRACKPOINT((what))->altitude-min_alt)/alt_diff*DRAW_ELEVATION_FACTOR*dp->vtl->elevation_factor/dp->xmpp)
-
-	      tmp[0].x = oldx;
-	      tmp[0].y = oldy;
-	      tmp[1].x = oldx;
-	      tmp[1].y = oldy-FIXALTITUDE(list->data);
-	      tmp[2].x = x;
-	      tmp[2].y = y-FIXALTITUDE(list->next->data);
-	      tmp[3].x = x;
-	      tmp[3].y = y;
-
-	      GdkGC *tmp_gc;
-	      if ( ((oldx - x) > 0 && (oldy - y) > 0) || ((oldx - x) < 0 && (oldy - y) < 0))
-		tmp_gc = gtk_widget_get_style(GTK_WIDGET(dp->vp))->light_gc[3];
-	      else
-		tmp_gc = gtk_widget_get_style(GTK_WIDGET(dp->vp))->dark_gc[0];
-	      vik_viewport_draw_polygon ( dp->vp, tmp_gc, TRUE, tmp, 4);
-
-              vik_viewport_draw_line ( dp->vp, main_gc, oldx, oldy-FIXALTITUDE(list->data), x, y-FIXALTITUDE(list->next->data));
-            }
+            draw_segments_add ( &vtl->draw_extras, dp, main_gc, oldx, oldy-FIXALTITUDE(list->data), x, y-FIXALTITUDE(list->next->data) );
           }
         }
 
-        if ( (!tp->newsegment) && dp->vtl->drawdirections ) {
+        if ( (!tp->newsegment) && vtl->drawdirections ) {
           // Draw an arrow at the mid point to show the direction of the track
           // Code is a rework from vikwindow::draw_ruler()
           gint midx = (oldx + x) / 2;
@@ -2279,8 +2449,8 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
           if ( len > 1 ) {
             gdouble dx = (oldx - midx) / len;
             gdouble dy = (oldy - midy) / len;
-            vik_viewport_draw_line ( dp->vp, main_gc, midx, midy, midx + (dx * dp->cc + dy * dp->ss), midy + (dy * dp->cc - dx * dp->ss) );
-            vik_viewport_draw_line ( dp->vp, main_gc, midx, midy, midx + (dx * dp->cc - dy * dp->ss), midy + (dy * dp->cc + dx * dp->ss) );
+            draw_segments_add ( &vtl->draw_extras, dp, main_gc, midx, midy, midx + (dx * dp->cc + dy * dp->ss), midy + (dy * dp->cc - dx * dp->ss) );
+            draw_segments_add ( &vtl->draw_extras, dp, main_gc, midx, midy, midx + (dx * dp->cc - dy * dp->ss), midy + (dy * dp->cc + dx * dp->ss) );
           }
         }
 
@@ -2290,26 +2460,21 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
         useoldvals = TRUE;
       }
       else {
-        if (useoldvals && dp->vtl->drawlines && (!tp->newsegment))
+        if (useoldvals && vtl->drawlines && (!tp->newsegment))
         {
-          if ( dp->vtl->coord_mode != VIK_COORD_UTM || tp->coord.utm_zone == dp->center->utm_zone )
+          if ( vtl->coord_mode != VIK_COORD_UTM || tp->coord.utm_zone == dp->center->utm_zone )
           {
             vik_viewport_coord_to_screen ( dp->vp, &(tp->coord), &x, &y );
 
-            if ( !drawing_highlight && (dp->vtl->drawmode == DRAWMODE_BY_SPEED) ) {
-              main_gc = g_array_index(dp->vtl->track_gc, GdkGC *, track_section_colour_by_speed ( dp->vtl, tp, tp2, average_speed, low_speed, high_speed ));
+            if ( !drawing_highlight && (vtl->drawmode == DRAWMODE_BY_SPEED) ) {
+              main_gc = g_array_index(vtl->track_gc, GdkGC *, track_section_colour_by_speed ( vtl, tp, tp2, average_speed, low_speed, high_speed ));
 	    }
 
 	    /*
 	     * If points are the same in display coordinates, don't draw.
 	     */
 	    if ( x != oldx || y != oldy )
-	      {
-		if ( draw_track_outline )
-		  vik_viewport_draw_line ( dp->vp, dp->vtl->track_bg_gc, oldx, oldy, x, y);
-		else
-		  vik_viewport_draw_line ( dp->vp, main_gc, oldx, oldy, x, y);
-	      }
+	      draw_segments_add ( &vtl->draw_lines, dp, main_gc, oldx, oldy, x, y );
           }
           else 
           {
@@ -2327,8 +2492,23 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
       }
     }
 
+    // The outline reuses the same screen positions as the track lines themselves
+    if ( vtl->bg_line_thickness && vtl->draw_lines.segs->len )
+      vik_viewport_draw_segments ( dp->vp, vtl->track_bg_gc, (GdkSegment*)vtl->draw_lines.segs->data, vtl->draw_lines.segs->len );
+
+    guint ii;
+    for ( ii = 0; ii < vtl->draw_elevations->len; ii++ ) {
+      DrawElevation *de = &g_array_index ( vtl->draw_elevations, DrawElevation, ii );
+      vik_viewport_draw_polygon ( dp->vp, de->gc, TRUE, de->points, 4 );
+    }
+    g_array_set_size ( vtl->draw_elevations, 0 );
+
+    draw_segments_flush ( &vtl->draw_lines, dp->vp );
+    draw_segments_flush ( &vtl->draw_extras, dp->vp );
+    draw_markers_flush ( vtl->draw_markers, dp->vp );
+
     // Labels drawn after the trackpoints, so the labels are on top
-    if ( dp->vtl->track_draw_labels ) {
+    if ( vtl->track_draw_labels ) {
       if ( track->max_number_dist_labels > 0 ) {
         trw_layer_draw_dist_labels ( dp, track, drawing_highlight );
       }
@@ -2344,7 +2524,7 @@ static void trw_layer_draw_track ( const gpointer id, VikTrack *track, struct Dr
 static void trw_layer_draw_track_cb ( const gpointer id, VikTrack *track, struct DrawingParams *dp )
 {
   if ( BBOX_INTERSECT ( track->bbox, dp->bbox ) ) {
-    trw_layer_draw_track ( id, track, dp, FALSE );
+    trw_layer_draw_track ( id, track, dp );
   }
 }
 
@@ -2359,6 +2539,100 @@ static gint cached_pixbuf_cmp ( CachedPixbuf *cp, const gchar *name )
   return strcmp ( cp->image, name );
 }
 
+#define VIK_SETTINGS_TRW_LABEL_CACHE_SIZE "trackwaypoint_label_cache_size"
+#define VIK_SETTINGS_TRW_LABEL_DECLUTTER "trackwaypoint_label_declutter"
+
+// Size in pixels of the cells used to track where labels have been drawn
+#define WP_LABEL_GRID_CELL 4
+
+/*
+ * Get the laid out label for a waypoint name, only parsing the markup on first use.
+ * The cache is emptied when the font size changes.
+ */
+static PangoLayout *trw_layer_get_wp_label ( VikTrwLayer *vtl, const gchar *name )
+{
+  if ( !name )
+    name = "";
+
+  PangoLayout *layout = g_hash_table_lookup ( vtl->wp_label_cache, name );
+  if ( layout )
+    return layout;
+
+  // Read only once, as this is called for every label on the first draw
+  static gint max_size = 0;
+  if ( !max_size ) {
+    gint tmp;
+    max_size = 10000;
+    if ( a_settings_get_integer ( VIK_SETTINGS_TRW_LABEL_CACHE_SIZE, &tmp ) )
+      max_size = MAX ( tmp, 1 );
+  }
+  if ( (gint)g_hash_table_size ( vtl->wp_label_cache ) >= max_size )
+    g_hash_table_remove_all ( vtl->wp_label_cache );
+
+  // Hopefully name won't break the markup (may need to sanitize - g_markup_escape_text())
+  gchar *wp_label_markup = g_strdup_printf ( "<span size=\"%s\">%s</span>", vtl->wp_fsize_str, name );
+
+  // Copying keeps the font description of the layer's layout
+  layout = pango_layout_copy ( vtl->wplabellayout );
+  if ( pango_parse_markup ( wp_label_markup, -1, 0, NULL, NULL, NULL, NULL ) )
+    pango_layout_set_markup ( layout, wp_label_markup, -1 );
+  else
+    // Fallback if parse failure
+    pango_layout_set_text ( layout, name, -1 );
+
+  g_free ( wp_label_markup );
+
+  g_hash_table_insert ( vtl->wp_label_cache, g_strdup(name), layout );
+  return layout;
+}
+
+/*
+ * Prepare the grid of screen cells for decluttering labels in this draw
+ */
+static void trw_layer_wp_label_grid_reset ( VikTrwLayer *vtl, struct DrawingParams *dp )
+{
+  guint cols = dp->width / WP_LABEL_GRID_CELL + 1;
+  guint rows = dp->height / WP_LABEL_GRID_CELL + 1;
+  if ( cols != vtl->wp_label_grid_cols || rows != vtl->wp_label_grid_rows ) {
+    g_free ( vtl->wp_label_grid );
+    vtl->wp_label_grid = g_malloc ( cols * rows );
+    vtl->wp_label_grid_cols = cols;
+    vtl->wp_label_grid_rows = rows;
+  }
+  memset ( vtl->wp_label_grid, 0, cols * rows );
+}
+
+/*
+ * Returns whether a label can be drawn in the given screen area
+ *  (i.e. it doesn't overlap one already drawn), and if so marks the area as used.
+ * Labels not on the screen are not tracked.
+ */
+static gboolean trw_layer_wp_label_place ( struct DrawingParams *dp, gint x, gint y, gint width, gint height, gboolean force )
+{
+  VikTrwLayer *vtl = dp->vtl;
+  gint x1 = MAX ( x, 0 );
+  gint y1 = MAX ( y, 0 );
+  gint x2 = MIN ( x + width, dp->width ) - 1;
+  gint y2 = MIN ( y + height, dp->height ) - 1;
+  if ( x2 < x1 || y2 < y1 )
+    return TRUE;
+
+  guint c1 = x1 / WP_LABEL_GRID_CELL, c2 = x2 / WP_LABEL_GRID_CELL;
+  guint r1 = y1 / WP_LABEL_GRID_CELL, r2 = y2 / WP_LABEL_GRID_CELL;
+  guint cc, rr;
+
+  if ( !force )
+    for ( rr = r1; rr <= r2; rr++ )
+      for ( cc = c1; cc <= c2; cc++ )
+        if ( vtl->wp_label_grid[rr * vtl->wp_label_grid_cols + cc] )
+          return FALSE;
+
+  for ( rr = r1; rr <= r2; rr++ )
+    memset ( vtl->wp_label_grid + rr * vtl->wp_label_grid_cols + c1, 1, c2 - c1 + 1 );
+
+  return TRUE;
+}
+
 static void trw_layer_draw_waypoint ( const gpointer id, VikWaypoint *wp, struct DrawingParams *dp )
 {
   if ( wp->visible )
@@ -2478,32 +2752,26 @@ static void trw_layer_draw_waypoint ( const gpointer id, VikWaypoint *wp, struct
       /* thanks to the GPSDrive people (Fritz Ganter et al.) for hints on this part ... yah, I'm too lazy to study documentation */
       gint label_x, label_y;
       gint width, height;
-      // Hopefully name won't break the markup (may need to sanitize - g_markup_escape_text())
-
-      // Could this stored in the waypoint rather than recreating each pass?
-      gchar *wp_label_markup = g_strdup_printf ( "<span size=\"%s\">%s</span>", dp->vtl->wp_fsize_str, wp->name );
-
-      if ( pango_parse_markup ( wp_label_markup, -1, 0, NULL, NULL, NULL, NULL ) )
-        pango_layout_set_markup ( dp->vtl->wplabellayout, wp_label_markup, -1 );
-      else
-        // Fallback if parse failure
-        pango_layout_set_text ( dp->vtl->wplabellayout, wp->name, -1 );
-
-      g_free ( wp_label_markup );
+      PangoLayout *layout = trw_layer_get_wp_label ( dp->vtl, wp->name );
 
-      pango_layout_get_pixel_size ( dp->vtl->wplabellayout, &width, &height );
+      pango_layout_get_pixel_size ( layout, &width, &height );
       label_x = x - width/2;
       if ( wp->symbol_pixbuf )
         label_y = y - height - 2 - gdk_pixbuf_get_height(wp->symbol_pixbuf)/2;
       else
         label_y = y - dp->vtl->wp_size - height - 2;
 
+      // The selected waypoint always gets its label
+      if ( dp->declutter_labels &&
+           !trw_layer_wp_label_place ( dp, label_x - 1, label_y - 1, width + 2, height + 2, wp == dp->vtl->current_wp ) )
+        return;
+
       /* if highlight mode on, then draw background text in highlight colour */
       if ( dp->highlight )
         vik_viewport_draw_rectangle ( dp->vp, vik_viewport_get_gc_highlight (dp->vp), TRUE, label_x - 1, label_y-1,width+2,height+2);
       else
         vik_viewport_draw_rectangle ( dp->vp, dp->vtl->waypoint_bg_gc, TRUE, label_x - 1, label_y-1,width+2,height+2);
-      vik_viewport_draw_layout ( dp->vp, dp->vtl->waypoint_text_gc, label_x, label_y, dp->vtl->wplabellayout );
+      vik_viewport_draw_layout ( dp->vp, dp->vtl->waypoint_text_gc, label_x, label_y, layout );
     }
   }
 }
@@ -2515,6 +2783,104 @@ static void trw_layer_draw_waypoint_cb ( gpointer id, VikWaypoint *wp, struct Dr
   }
 }
 
+#define VIK_SETTINGS_TRW_CLUSTER_PIXELS "trackwaypoint_cluster_size"
+#define VIK_SETTINGS_TRW_CLUSTER_ITEMS "trackwaypoint_cluster_items_above"
+
+static void trw_layer_draw_waypoint_cluster ( const VikGridCluster *cluster, struct DrawingParams *dp )
+{
+  VikTrwLayer *vtl = dp->vtl;
+  if ( cluster->item ) {
+    // The selected waypoint is drawn (on top) afterwards
+    if ( cluster->item != vtl->current_wp )
+      trw_layer_draw_waypoint ( NULL, VIK_WAYPOINT(cluster->item), dp );
+    return;
+  }
+
+  struct LatLon ll = { cluster->lat, cluster->lon };
+  VikCoord coord;
+  gint x, y;
+  vik_coord_load_from_latlon ( &coord, vik_viewport_get_coord_mode(dp->vp), &ll );
+  vik_viewport_coord_to_screen ( dp->vp, &coord, &x, &y );
+
+  // Grows slowly with the number of waypoints represented
+  gint radius = vtl->wp_size + 2 * (gint)log10 ( cluster->count ) + 4;
+  GdkGC *gc = dp->highlight ? vik_viewport_get_gc_highlight ( dp->vp ) : vtl->waypoint_gc;
+  vik_viewport_draw_arc ( dp->vp, gc, TRUE, x - radius, y - radius, 2*radius, 2*radius, 0, 360*64 );
+
+  if ( vtl->wplabellayout ) {
+    if ( !vtl->wp_cluster_layout )
+      vtl->wp_cluster_layout = pango_layout_copy ( vtl->wplabellayout );
+    gchar count[16];
+    gint width, height;
+    g_snprintf ( count, sizeof(count), "%u", cluster->count );
+    pango_layout_set_text ( vtl->wp_cluster_layout, count, -1 );
+    pango_layout_get_pixel_size ( vtl->wp_cluster_layout, &width, &height );
+    vik_viewport_draw_layout ( dp->vp, vtl->waypoint_text_gc, x - width/2, y - height/2, vtl->wp_cluster_layout );
+  }
+}
+
+/*
+ * When zoomed out so far that there would be more waypoints than can be distinguished,
+ *  draw a marker with the number of waypoints for each area of the screen
+ *  (at least as big as the configured cluster size in pixels) instead of every waypoint.
+ * Thus the work done depends on the size of the screen rather than the number of waypoints.
+ *
+ * Returns: FALSE if the waypoints should be drawn individually
+ */
+static gboolean trw_layer_draw_waypoint_clusters ( VikTrwLayer *vtl, struct DrawingParams *dp )
+{
+  gint pixels = 48;
+  gint min_items = 1000;
+  gint tmp;
+  if ( a_settings_get_integer ( VIK_SETTINGS_TRW_CLUSTER_PIXELS, &tmp ) )
+    pixels = tmp;
+  if ( a_settings_get_integer ( VIK_SETTINGS_TRW_CLUSTER_ITEMS, &tmp ) )
+    min_items = tmp;
+
+  if ( pixels <= 0 || (gint)g_hash_table_size ( vtl->waypoints ) < min_items )
+    return FALSE;
+
+  // Crossing the 180 degree longitude line isn't handled
+  if ( dp->bbox.west >= dp->bbox.east || dp->width == 0 )
+    return FALSE;
+
+  if ( !vtl->wp_grid ) {
+    guint count = g_hash_table_size ( vtl->waypoints );
+    gdouble *positions = g_malloc ( 2 * count * sizeof(gdouble) );
+    gpointer *items = g_malloc ( count * sizeof(gpointer) );
+    guint nn = 0;
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init ( &iter, vtl->waypoints );
+    while ( g_hash_table_iter_next ( &iter, NULL, &value ) ) {
+      VikWaypoint *wp = VIK_WAYPOINT(value);
+      if ( !wp->visible )
+        continue;
+      struct LatLon ll;
+      vik_coord_to_latlon ( &wp->coord, &ll );
+      positions[2*nn] = ll.lat;
+      positions[2*nn+1] = ll.lon;
+      items[nn++] = wp;
+    }
+    vtl->wp_grid = vik_grid_index_new ( positions, items, nn );
+    g_free ( positions );
+    g_free ( items );
+  }
+
+  gdouble degrees = pixels * (dp->bbox.east - dp->bbox.west) / dp->width;
+  gint level = vik_grid_index_get_level ( vtl->wp_grid, degrees );
+  if ( level < 0 )
+    return FALSE;
+
+  vik_grid_index_foreach ( vtl->wp_grid, level, &dp->bbox, (VikGridClusterFunc)trw_layer_draw_waypoint_cluster, dp );
+
+  // Always show the selected waypoint
+  if ( vtl->current_wp )
+    trw_layer_draw_waypoint ( NULL, vtl->current_wp, dp );
+
+  return TRUE;
+}
+
 static void trw_layer_draw_with_highlight ( VikTrwLayer *l, gpointer data, gboolean highlight )
 {
   static struct DrawingParams dp;
@@ -2528,8 +2894,20 @@ static void trw_layer_draw_with_highlight ( VikTrwLayer *l, gpointer data, gbool
   if ( l->routes_visible )
     g_hash_table_foreach ( l->routes, (GHFunc) trw_layer_draw_track_cb, &dp );
 
-  if (l->waypoints_visible)
-    g_hash_table_foreach ( l->waypoints, (GHFunc) trw_layer_draw_waypoint_cb, &dp );
+  if (l->waypoints_visible) {
+    // Skip labels that would overlap those already drawn.
+    // Not when drawing off screen, e.g. image exports drawn in several parts,
+    //  as then a label crossing two parts could be kept in one but dropped from the other.
+    dp.declutter_labels = !vik_viewport_is_offscreen ( VIK_VIEWPORT(data) );
+    if ( dp.declutter_labels )
+      a_settings_get_boolean ( VIK_SETTINGS_TRW_LABEL_DECLUTTER, &dp.declutter_labels );
+    if ( dp.declutter_labels && l->drawlabels )
+      trw_layer_wp_label_grid_reset ( l, &dp );
+    if ( !BBOX_INTERSECT ( l->waypoints_bbox, dp.bbox ) )
+      return;
+    if ( !trw_layer_draw_waypoint_clusters ( l, &dp ) )
+      g_hash_table_foreach ( l->waypoints, (GHFunc) trw_layer_draw_waypoint_cb, &dp );
+  }
 }
 
 static void trw_layer_draw ( VikTrwLayer *l, gpointer data )
@@ -2790,15 +3168,184 @@ static void trw_layer_add_sublayer_routes ( VikTrwLayer *vtl, VikTreeview *vt, G
   vik_treeview_add_sublayer ( (VikTreeview *) vt, layer_iter, &(vtl->routes_iter), _("Routes"), vtl, NULL, VIK_TRW_LAYER_SUBLAYER_ROUTES, NULL, FALSE, 0 );
 }
 
+#define VIK_SETTINGS_TRW_DEFER_ROWS "trackwaypoint_treeview_defer_items_above"
+
+/*
+ * Sublayers with more items than this only create their item rows when first needed
+ *  (zero to always create them straight away)
+ */
+static guint trw_layer_defer_rows_threshold ( void )
+{
+  gint threshold = 5000;
+  gint tmp;
+  if ( a_settings_get_integer ( VIK_SETTINGS_TRW_DEFER_ROWS, &tmp ) )
+    threshold = tmp;
+  return threshold > 0 ? threshold : 0;
+}
+
+static void trw_layer_realize_deferred_track ( gpointer id, VikTrack *track, gpointer pass_along[5] )
+{
+  VikTrwLayer *vtl = VIK_TRW_LAYER(pass_along[2]);
+  // Skip any already created by trw_layer_get_item_iter()
+  if ( !g_hash_table_lookup ( track->is_route ? vtl->routes_iters : vtl->tracks_iters, id ) )
+    trw_layer_realize_track ( id, track, pass_along );
+}
+
+static void trw_layer_realize_deferred_waypoint ( gpointer id, VikWaypoint *wp, gpointer pass_along[5] )
+{
+  if ( !g_hash_table_lookup ( VIK_TRW_LAYER(pass_along[2])->waypoints_iters, id ) )
+    trw_layer_realize_waypoint ( id, wp, pass_along );
+}
+
+/*
+ * Create the rows of the items in a sublayer that was realized with only a placeholder.
+ * The subtype can be either the sublayer or one of its items.
+ */
+static void trw_layer_realize_deferred ( VikTrwLayer *vtl, gint subtype )
+{
+  VikTreeview *vt = VIK_LAYER(vtl)->vt;
+  GtkTreeIter iter2;
+  gpointer pass_along[5] = { NULL, &iter2, vtl, vt, NULL };
+
+  switch ( subtype ) {
+  case VIK_TRW_LAYER_SUBLAYER_TRACKS:
+  case VIK_TRW_LAYER_SUBLAYER_TRACK:
+    if ( !vtl->tracks_deferred )
+      return;
+    vtl->tracks_deferred = FALSE;
+    vik_treeview_item_delete ( vt, &(vtl->tracks_placeholder) );
+    pass_along[0] = &(vtl->tracks_iter);
+    pass_along[4] = GINT_TO_POINTER(VIK_TRW_LAYER_SUBLAYER_TRACK);
+    g_hash_table_foreach ( vtl->tracks, (GHFunc) trw_layer_realize_deferred_track, pass_along );
+    vik_treeview_sort_children ( vt, &(vtl->tracks_iter), vtl->track_sort_order );
+    break;
+  case VIK_TRW_LAYER_SUBLAYER_ROUTES:
+  case VIK_TRW_LAYER_SUBLAYER_ROUTE:
+    if ( !vtl->routes_deferred )
+      return;
+    vtl->routes_deferred = FALSE;
+    vik_treeview_item_delete ( vt, &(vtl->routes_placeholder) );
+    pass_along[0] = &(vtl->routes_iter);
+    pass_along[4] = GINT_TO_POINTER(VIK_TRW_LAYER_SUBLAYER_ROUTE);
+    g_hash_table_foreach ( vtl->routes, (GHFunc) trw_layer_realize_deferred_track, pass_along );
+    vik_treeview_sort_children ( vt, &(vtl->routes_iter), vtl->track_sort_order );
+    break;
+  case VIK_TRW_LAYER_SUBLAYER_WAYPOINTS:
+  case VIK_TRW_LAYER_SUBLAYER_WAYPOINT:
+    if ( !vtl->waypoints_deferred )
+      return;
+    vtl->waypoints_deferred = FALSE;
+    vik_treeview_item_delete ( vt, &(vtl->waypoints_placeholder) );
+    pass_along[0] = &(vtl->waypoints_iter);
+    pass_along[4] = GINT_TO_POINTER(VIK_TRW_LAYER_SUBLAYER_WAYPOINT);
+    g_hash_table_foreach ( vtl->waypoints, (GHFunc) trw_layer_realize_deferred_waypoint, pass_along );
+    vik_treeview_sort_children ( vt, &(vtl->waypoints_iter), vtl->wp_sort_order );
+    break;
+  default:
+    break;
+  }
+}
+
+/*
+ * The row of an item, creating just that row if its sublayer is deferred
+ *  (the others are created when the sublayer is expanded)
+ */
+static GtkTreeIter *trw_layer_get_item_iter ( VikTrwLayer *vtl, gint subtype, gpointer id )
+{
+  GtkTreeIter iter2;
+  gpointer pass_along[5] = { NULL, &iter2, vtl, VIK_LAYER(vtl)->vt, GINT_TO_POINTER(subtype) };
+  GtkTreeIter *it;
+  gpointer item;
+
+  switch ( subtype ) {
+  case VIK_TRW_LAYER_SUBLAYER_WAYPOINT:
+    it = g_hash_table_lookup ( vtl->waypoints_iters, id );
+    if ( !it && vtl->waypoints_deferred && (item = g_hash_table_lookup ( vtl->waypoints, id )) ) {
+      pass_along[0] = &(vtl->waypoints_iter);
+      trw_layer_realize_waypoint ( id, item, pass_along );
+      it = g_hash_table_lookup ( vtl->waypoints_iters, id );
+    }
+    return it;
+  case VIK_TRW_LAYER_SUBLAYER_ROUTE:
+    it = g_hash_table_lookup ( vtl->routes_iters, id );
+    if ( !it && vtl->routes_deferred && (item = g_hash_table_lookup ( vtl->routes, id )) ) {
+      pass_along[0] = &(vtl->routes_iter);
+      trw_layer_realize_track ( id, item, pass_along );
+      it = g_hash_table_lookup ( vtl->routes_iters, id );
+    }
+    return it;
+  default:
+    it = g_hash_table_lookup ( vtl->tracks_iters, id );
+    if ( !it && vtl->tracks_deferred && (item = g_hash_table_lookup ( vtl->tracks, id )) ) {
+      pass_along[0] = &(vtl->tracks_iter);
+      trw_layer_realize_track ( id, item, pass_along );
+      it = g_hash_table_lookup ( vtl->tracks_iters, id );
+    }
+    return it;
+  }
+}
+
+/*
+ * Select an item in the treeview (showing its row), e.g. when it has been clicked on in the viewport
+ */
+static void trw_layer_select_item ( VikTrwLayer *vtl, gint subtype, gpointer id )
+{
+  GtkTreeIter *it = trw_layer_get_item_iter ( vtl, subtype, id );
+  if ( !it )
+    return;
+  // Expanding a deferred sublayer to show the row would otherwise create all its rows
+  vtl->selecting_item = TRUE;
+  vik_treeview_select_iter ( VIK_LAYER(vtl)->vt, it, TRUE );
+  vtl->selecting_item = FALSE;
+}
+
+/*
+ * Just so the sublayer shows an expander; it is replaced by the item rows on expansion
+ */
+static void trw_layer_add_placeholder ( VikTrwLayer *vtl, VikTreeview *vt, GtkTreeIter *sublayer_iter, GtkTreeIter *placeholder, gint subtype )
+{
+  // Shown (e.g. above the single row of a selected item) until the sublayer is expanded by the user
+  vik_treeview_add_sublayer ( vt, sublayer_iter, placeholder, "...", vtl, NULL, subtype, NULL, FALSE, 0 );
+}
+
+static gboolean trw_layer_test_expand_row ( VikTrwLayer *vtl, GtkTreeIter *iter, GtkTreePath *path, VikTreeview *vt )
+{
+  if ( !vtl->selecting_item &&
+       vik_treeview_item_get_type ( vt, iter ) == VIK_TREEVIEW_TYPE_SUBLAYER &&
+       vik_treeview_item_get_parent ( vt, iter ) == vtl &&
+       !vik_treeview_item_get_pointer ( vt, iter ) )
+    trw_layer_realize_deferred ( vtl, vik_treeview_item_get_data ( vt, iter ) );
+
+  // Always allow the expansion
+  return FALSE;
+}
+
 static void trw_layer_realize ( VikTrwLayer *vtl, VikTreeview *vt, GtkTreeIter *layer_iter )
 {
   GtkTreeIter iter2;
   gpointer pass_along[5] = { &(vtl->tracks_iter), &iter2, vtl, vt, GINT_TO_POINTER(VIK_TRW_LAYER_SUBLAYER_TRACK) };
+  guint defer = trw_layer_defer_rows_threshold ();
+
+  // Rows of any earlier realization are not reused
+  g_hash_table_remove_all ( vtl->tracks_iters );
+  g_hash_table_remove_all ( vtl->routes_iters );
+  g_hash_table_remove_all ( vtl->waypoints_iters );
+  vtl->tracks_deferred = FALSE;
+  vtl->routes_deferred = FALSE;
+  vtl->waypoints_deferred = FALSE;
+
+  if ( !vtl->test_expand_handler )
+    vtl->test_expand_handler = g_signal_connect_object ( vt, "test-expand-row", G_CALLBACK(trw_layer_test_expand_row), vtl, G_CONNECT_SWAPPED );
 
   if ( g_hash_table_size (vtl->tracks) > 0 ) {
     trw_layer_add_sublayer_tracks ( vtl, vt , layer_iter );
 
-    g_hash_table_foreach ( vtl->tracks, (GHFunc) trw_layer_realize_track, pass_along );
+    if ( defer && g_hash_table_size (vtl->tracks) > defer ) {
+      trw_layer_add_placeholder ( vtl, vt, &(vtl->tracks_iter), &(vtl->tracks_placeholder), VIK_TRW_LAYER_SUBLAYER_TRACKS );
+      vtl->tracks_deferred = TRUE;
+    }
+    else
+      g_hash_table_foreach ( vtl->tracks, (GHFunc) trw_layer_realize_track, pass_along );
 
     vik_treeview_item_set_visible ( vt, &(vtl->tracks_iter), vtl->tracks_visible );
   }
@@ -2809,7 +3356,12 @@ static void trw_layer_realize ( VikTrwLayer *vtl, VikTreeview *vt, GtkTreeIter *
     pass_along[0] = &(vtl->routes_iter);
     pass_along[4] = GINT_TO_POINTER(VIK_TRW_LAYER_SUBLAYER_ROUTE);
 
-    g_hash_table_foreach ( vtl->routes, (GHFunc) trw_layer_realize_track, pass_along );
+    if ( defer && g_hash_table_size (vtl->routes) > defer ) {
+      trw_layer_add_placeholder ( vtl, vt, &(vtl->routes_iter), &(vtl->routes_placeholder), VIK_TRW_LAYER_SUBLAYER_ROUTES );
+      vtl->routes_deferred = TRUE;
+    }
+    else
+      g_hash_table_foreach ( vtl->routes, (GHFunc) trw_layer_realize_track, pass_along );
 
     vik_treeview_item_set_visible ( (VikTreeview *) vt, &(vtl->routes_iter), vtl->routes_visible );
   }
@@ -2820,7 +3372,12 @@ static void trw_layer_realize ( VikTrwLayer *vtl, VikTreeview *vt, GtkTreeIter *
     pass_along[0] = &(vtl->waypoints_iter);
     pass_along[4] = GINT_TO_POINTER(VIK_TRW_LAYER_SUBLAYER_WAYPOINT);
 
-    g_hash_table_foreach ( vtl->waypoints, (GHFunc) trw_layer_realize_waypoint, pass_along );
+    if ( defer && g_hash_table_size (vtl->waypoints) > defer ) {
+      trw_layer_add_placeholder ( vtl, vt, &(vtl->waypoints_iter), &(vtl->waypoints_placeholder), VIK_TRW_LAYER_SUBLAYER_WAYPOINTS );
+      vtl->waypoints_deferred = TRUE;
+    }
+    else
+      g_hash_table_foreach ( vtl->waypoints, (GHFunc) trw_layer_realize_waypoint, pass_along );
 
     vik_treeview_item_set_visible ( (VikTreeview *) vt, &(vtl->waypoints_iter), vtl->waypoints_visible );
   }
@@ -2848,8 +3405,10 @@ static gboolean trw_layer_sublayer_toggle_visible ( VikTrwLayer *l, gint subtype
     case VIK_TRW_LAYER_SUBLAYER_WAYPOINT:
     {
       VikWaypoint *t = g_hash_table_lookup ( l->waypoints, sublayer );
-      if (t)
+      if (t) {
+        trw_layer_waypoints_grid_invalidate ( l );
         return (t->visible ^= 1);
+      }
       else
         return TRUE;
     }
@@ -3313,16 +3872,19 @@ GHashTable *vik_trw_layer_get_waypoints ( VikTrwLayer *l )
 
 GHashTable *vik_trw_layer_get_tracks_iters ( VikTrwLayer *vtl )
 {
+  trw_layer_realize_deferred ( vtl, VIK_TRW_LAYER_SUBLAYER_TRACKS );
   return vtl->tracks_iters;
 }
 
 GHashTable *vik_trw_layer_get_routes_iters ( VikTrwLayer *vtl )
 {
+  trw_layer_realize_deferred ( vtl, VIK_TRW_LAYER_SUBLAYER_ROUTES );
   return vtl->routes_iters;
 }
 
 GHashTable *vik_trw_layer_get_waypoints_iters ( VikTrwLayer *vtl )
 {
+  trw_layer_realize_deferred ( vtl, VIK_TRW_LAYER_SUBLAYER_WAYPOINTS );
   return vtl->waypoints_iters;
 }
 
@@ -3618,8 +4180,7 @@ static void trw_layer_goto_wp ( menu_array_layer values )
       gpointer wpf = g_hash_table_find ( vtl->waypoints, (GHRFunc) trw_layer_waypoint_find_uuid, (gpointer) &udata );
 
       if ( wpf && udata.uuid ) {
-        GtkTreeIter *it = g_hash_table_lookup ( vtl->waypoints_iters, udata.uuid );
-        vik_treeview_select_iter ( VIK_LAYER(vtl)->vt, it, TRUE );
+        trw_layer_select_item ( vtl, VIK_TRW_LAYER_SUBLAYER_WAYPOINT, udata.uuid );
       }
 
       break;
@@ -4438,7 +4999,8 @@ void vik_trw_layer_add_waypoint ( VikTrwLayer *vtl, gchar *name, VikWaypoint *wp
 
   vik_waypoint_set_name (wp, name);
 
-  if ( VIK_LAYER(vtl)->realized )
+  // A deferred sublayer creates the row when it is expanded
+  if ( VIK_LAYER(vtl)->realized && !vtl->waypoints_deferred )
   {
     // Do we need to create the sublayer:
     if ( g_hash_table_size (vtl->waypoints) == 0 ) {
@@ -4460,11 +5022,15 @@ void vik_trw_layer_add_waypoint ( VikTrwLayer *vtl, gchar *name, VikWaypoint *wp
     g_hash_table_insert ( vtl->waypoints_iters, GUINT_TO_POINTER(wp_uuid), iter );
 
     // Sort now as post_read is not called on a realized waypoint
-    vik_treeview_sort_children ( VIK_LAYER(vtl)->vt, &(vtl->waypoints_iter), vtl->wp_sort_order );
+    if ( vtl->bulk_insert_depth )
+      vtl->bulk_sort_waypoints = TRUE;
+    else
+      vik_treeview_sort_children ( VIK_LAYER(vtl)->vt, &(vtl->waypoints_iter), vtl->wp_sort_order );
   }
 
   highest_wp_number_add_wp(vtl, name);
   g_hash_table_insert ( vtl->waypoints, GUINT_TO_POINTER(wp_uuid), wp );
+  trw_layer_waypoints_grid_invalidate ( vtl );
  
 }
 
@@ -4477,7 +5043,8 @@ void vik_trw_layer_add_track ( VikTrwLayer *vtl, gchar *name, VikTrack *t )
 
   vik_track_set_name (t, name);
 
-  if ( VIK_LAYER(vtl)->realized )
+  // A deferred sublayer creates the row when it is expanded
+  if ( VIK_LAYER(vtl)->realized && !vtl->tracks_deferred )
   {
     // Do we need to create the sublayer:
     if ( g_hash_table_size (vtl->tracks) == 0 ) {
@@ -4499,13 +5066,16 @@ void vik_trw_layer_add_track ( VikTrwLayer *vtl, gchar *name, VikTrack *t )
 
     g_hash_table_insert ( vtl->tracks_iters, GUINT_TO_POINTER(tr_uuid), iter );
 
+    trw_layer_set_track_icon ( vtl, t, iter );
+
     // Sort now as post_read is not called on a realized track
-    vik_treeview_sort_children ( VIK_LAYER(vtl)->vt, &(vtl->tracks_iter), vtl->track_sort_order );
+    if ( vtl->bulk_insert_depth )
+      vtl->bulk_sort_tracks = TRUE;
+    else
+      vik_treeview_sort_children ( VIK_LAYER(vtl)->vt, &(vtl->tracks_iter), vtl->track_sort_order );
   }
 
   g_hash_table_insert ( vtl->tracks, GUINT_TO_POINTER(tr_uuid), t );
-
-  trw_layer_update_treeview ( vtl, t );
 }
 
 // Fake Route UUIDs vi simple increasing integer
@@ -4517,7 +5087,8 @@ void vik_trw_layer_add_route ( VikTrwLayer *vtl, gchar *name, VikTrack *t )
 
   vik_track_set_name (t, name);
 
-  if ( VIK_LAYER(vtl)->realized )
+  // A deferred sublayer creates the row when it is expanded
+  if ( VIK_LAYER(vtl)->realized && !vtl->routes_deferred )
   {
     // Do we need to create the sublayer:
     if ( g_hash_table_size (vtl->routes) == 0 ) {
@@ -4532,13 +5103,62 @@ void vik_trw_layer_add_route ( VikTrwLayer *vtl, gchar *name, VikTrack *t )
 
     g_hash_table_insert ( vtl->routes_iters, GUINT_TO_POINTER(rt_uuid), iter );
 
+    trw_layer_set_track_icon ( vtl, t, iter );
+
     // Sort now as post_read is not called on a realized route
-    vik_treeview_sort_children ( VIK_LAYER(vtl)->vt, &(vtl->routes_iter), vtl->track_sort_order );
+    if ( vtl->bulk_insert_depth )
+      vtl->bulk_sort_routes = TRUE;
+    else
+      vik_treeview_sort_children ( VIK_LAYER(vtl)->vt, &(vtl->routes_iter), vtl->track_sort_order );
   }
 
   g_hash_table_insert ( vtl->routes, GUINT_TO_POINTER(rt_uuid), t );
+}
 
-  trw_layer_update_treeview ( vtl, t );
+/**
+ * vik_trw_layer_begin_bulk_insert:
+ *
+ * Start adding many items to the layer.
+ * Until the matching vik_trw_layer_commit_bulk_insert() the treeview rows
+ *  are still attached as each item is added, but the per item sorting is skipped.
+ * Calls may be nested; only the outermost commit does the work.
+ */
+void vik_trw_layer_begin_bulk_insert ( VikTrwLayer *vtl )
+{
+  vtl->bulk_insert_depth++;
+}
+
+/**
+ * vik_trw_layer_commit_bulk_insert:
+ *
+ * Finish adding many items: each sublayer that gained items is sorted once
+ *  and then a single update is emitted for the layer.
+ */
+void vik_trw_layer_commit_bulk_insert ( VikTrwLayer *vtl )
+{
+  g_return_if_fail ( vtl->bulk_insert_depth > 0 );
+
+  if ( --vtl->bulk_insert_depth )
+    return;
+
+  gboolean added = vtl->bulk_sort_waypoints || vtl->bulk_sort_tracks || vtl->bulk_sort_routes;
+
+  // The sublayer may have been removed again if all its items were deleted within the batch
+  if ( VIK_LAYER(vtl)->realized ) {
+    if ( vtl->bulk_sort_waypoints && g_hash_table_size (vtl->waypoints) )
+      vik_treeview_sort_children ( VIK_LAYER(vtl)->vt, &(vtl->waypoints_iter), vtl->wp_sort_order );
+    if ( vtl->bulk_sort_tracks && g_hash_table_size (vtl->tracks) )
+      vik_treeview_sort_children ( VIK_LAYER(vtl)->vt, &(vtl->tracks_iter), vtl->track_sort_order );
+    if ( vtl->bulk_sort_routes && g_hash_table_size (vtl->routes) )
+      vik_treeview_sort_children ( VIK_LAYER(vtl)->vt, &(vtl->routes_iter), vtl->track_sort_order );
+  }
+
+  vtl->bulk_sort_waypoints = FALSE;
+  vtl->bulk_sort_tracks = FALSE;
+  vtl->bulk_sort_routes = FALSE;
+
+  if ( added )
+    vik_layer_emit_update ( VIK_LAYER(vtl) );
 }
 
 /* to be called whenever a track has been deleted or may have been changed. */
@@ -4738,6 +5358,7 @@ static void trw_layer_drag_drop_request ( VikTrwLayer *vtl_src, VikTrwLayer *vtl
       g_hash_table_foreach ( vtl_src->routes, (GHFunc)trw_layer_enum_item, &items);
     }
 
+    vik_trw_layer_begin_bulk_insert ( vtl_dest );
     iter = items;
     while (iter) {
       if (type==VIK_TRW_LAYER_SUBLAYER_TRACKS) {
@@ -4749,6 +5370,7 @@ static void trw_layer_drag_drop_request ( VikTrwLayer *vtl_src, VikTrwLayer *vtl
       }
       iter = iter->next;
     }
+    vik_trw_layer_commit_bulk_insert ( vtl_dest );
     if (items) 
       g_list_free(items);
   } else {
@@ -4801,11 +5423,15 @@ gboolean vik_trw_layer_delete_track ( VikTrwLayer *vtl, VikTrack *trk )
       if ( it ) {
         vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, it );
         g_hash_table_remove ( vtl->tracks_iters, udata.uuid );
+      }
+      // Tracks in a deferred sublayer have no row of their own
+      if ( it || vtl->tracks_deferred ) {
         g_hash_table_remove ( vtl->tracks, udata.uuid );
 
 	// If last sublayer, then remove sublayer container
 	if ( g_hash_table_size (vtl->tracks) == 0 ) {
           vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, &(vtl->tracks_iter) );
+          vtl->tracks_deferred = FALSE;
 	}
       }
       // Incase it was selected (no item delete signal ATM)
@@ -4849,11 +5475,15 @@ gboolean vik_trw_layer_delete_route ( VikTrwLayer *vtl, VikTrack *trk )
       if ( it ) {
         vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, it );
         g_hash_table_remove ( vtl->routes_iters, udata.uuid );
+      }
+      // Routes in a deferred sublayer have no row of their own
+      if ( it || vtl->routes_deferred ) {
         g_hash_table_remove ( vtl->routes, udata.uuid );
 
         // If last sublayer, then remove sublayer container
         if ( g_hash_table_size (vtl->routes) == 0 ) {
           vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, &(vtl->routes_iter) );
+          vtl->routes_deferred = FALSE;
         }
       }
       // Incase it was selected (no item delete signal ATM)
@@ -4890,13 +5520,17 @@ static gboolean trw_layer_delete_waypoint ( VikTrwLayer *vtl, VikWaypoint *wp )
       if ( it ) {
         vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, it );
         g_hash_table_remove ( vtl->waypoints_iters, udata.uuid );
-
+      }
+      // Waypoints in a deferred sublayer have no row of their own
+      if ( it || vtl->waypoints_deferred ) {
         highest_wp_number_remove_wp(vtl, wp->name);
         g_hash_table_remove ( vtl->waypoints, udata.uuid ); // last because this frees the name
+        trw_layer_waypoints_grid_invalidate ( vtl );
 
 	// If last sublayer, then remove sublayer container
 	if ( g_hash_table_size (vtl->waypoints) == 0 ) {
           vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, &(vtl->waypoints_iter) );
+          vtl->waypoints_deferred = FALSE;
 	}
       }
       // Incase it was selected (no item delete signal ATM)
@@ -4908,6 +5542,16 @@ static gboolean trw_layer_delete_waypoint ( VikTrwLayer *vtl, VikWaypoint *wp )
   return was_visible;
 }
 
+/**
+ * vik_trw_layer_delete_waypoint:
+ *
+ * Remove the waypoint from the layer (and free it)
+ */
+gboolean vik_trw_layer_delete_waypoint ( VikTrwLayer *vtl, VikWaypoint *wp )
+{
+  return trw_layer_delete_waypoint ( vtl, wp );
+}
+
 // Only for temporary use by trw_layer_delete_waypoint_by_name
 static gboolean trw_layer_waypoint_find_uuid_by_name ( const gpointer id, const VikWaypoint *wp, gpointer udata )
 {
@@ -5009,6 +5653,7 @@ void vik_trw_layer_delete_all_routes ( VikTrwLayer *vtl )
   g_hash_table_remove_all(vtl->routes);
 
   vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, &(vtl->routes_iter) );
+  vtl->routes_deferred = FALSE;
 
   vik_layer_emit_update ( VIK_LAYER(vtl) );
 }
@@ -5026,6 +5671,7 @@ void vik_trw_layer_delete_all_tracks ( VikTrwLayer *vtl )
   g_hash_table_remove_all(vtl->tracks);
 
   vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, &(vtl->tracks_iter) );
+  vtl->tracks_deferred = FALSE;
 
   vik_layer_emit_update ( VIK_LAYER(vtl) );
 }
@@ -5041,8 +5687,10 @@ void vik_trw_layer_delete_all_waypoints ( VikTrwLayer *vtl )
   g_hash_table_foreach(vtl->waypoints_iters, (GHFunc) remove_item_from_treeview, VIK_LAYER(vtl)->vt);
   g_hash_table_remove_all(vtl->waypoints_iters);
   g_hash_table_remove_all(vtl->waypoints);
+  trw_layer_waypoints_grid_invalidate ( vtl );
 
   vik_treeview_item_delete ( VIK_LAYER(vtl)->vt, &(vtl->waypoints_iter) );
+  vtl->waypoints_deferred = FALSE;
 
   vik_layer_emit_update ( VIK_LAYER(vtl) );
 }
@@ -5244,6 +5892,20 @@ static void trw_layer_track_statistics ( menu_array_sublayer values )
   }
 }
 
+/*
+ * Show the track colour as the icon of its treeview row
+ */
+static void trw_layer_set_track_icon ( VikTrwLayer *vtl, VikTrack *trk, GtkTreeIter *iter )
+{
+  GdkPixbuf *pixbuf = gdk_pixbuf_new ( GDK_COLORSPACE_RGB, FALSE, 8, 18, 18);
+  guint32 pixel = ((trk->color.red & 0xff00) << 16) |
+    ((trk->color.green & 0xff00) << 8) |
+    (trk->color.blue & 0xff00);
+  gdk_pixbuf_fill ( pixbuf, pixel );
+  vik_treeview_item_set_icon ( VIK_LAYER(vtl)->vt, iter, pixbuf );
+  g_object_unref (pixbuf);
+}
+
 /*
  * Update the treeview of the track id - primarily to update the icon
  */
@@ -5267,17 +5929,8 @@ void trw_layer_update_treeview ( VikTrwLayer *vtl, VikTrack *trk )
     else
       iter = g_hash_table_lookup ( vtl->tracks_iters, udata.uuid );
 
-    if ( iter ) {
-      // TODO: Make this a function
-      GdkPixbuf *pixbuf = gdk_pixbuf_new ( GDK_COLORSPACE_RGB, FALSE, 8, 18, 18);
-      guint32 pixel = ((trk->color.red & 0xff00) << 16) |
-	((trk->color.green & 0xff00) << 8) |
-	(trk->color.blue & 0xff00);
-      gdk_pixbuf_fill ( pixbuf, pixel );
-      vik_treeview_item_set_icon ( VIK_LAYER(vtl)->vt, iter, pixbuf );
-      g_object_unref (pixbuf);
-    }
-
+    if ( iter )
+      trw_layer_set_track_icon ( vtl, trk, iter );
   }
 }
 
@@ -5466,22 +6119,34 @@ static gboolean trw_layer_dem_test ( VikTrwLayer *vtl, VikLayersPanel *vlp )
   return TRUE;
 }
 
+#define VIK_SETTINGS_DEM_APPLY_DOWNLOAD_MISSING "dem_apply_download_missing"
+
 /**
  * apply_dem_data_common:
  *
- * A common function for applying the DEM values and reporting the results.
+ * A common function for applying the DEM values.
+ * This runs as a background job and the results are reported via the statusbar.
  */
-static void apply_dem_data_common ( VikTrwLayer *vtl, VikLayersPanel *vlp, VikTrack *track, gboolean skip_existing_elevations )
+static void apply_dem_data_common ( VikTrwLayer *vtl, VikLayersPanel *vlp, GList *tracks, gboolean skip_existing_elevations )
 {
   if ( !trw_layer_dem_test ( vtl, vlp ) )
     return;
 
-  gulong changed = vik_track_apply_dem_data ( track, skip_existing_elevations );
-  // Inform user how much was changed
-  gchar str[64];
-  const gchar *tmp_str = ngettext("%ld point adjusted", "%ld points adjusted", changed);
-  g_snprintf(str, 64, tmp_str, changed);
-  a_dialog_info_msg (VIK_GTK_WINDOW_FROM_LAYER(vtl), str);
+  // Any missing SRTM tiles can be downloaded into the first suitable DEM layer
+  VikDEMLayer *vdl = NULL;
+  gboolean download = TRUE;
+  if ( ! a_settings_get_boolean ( VIK_SETTINGS_DEM_APPLY_DOWNLOAD_MISSING, &download ) )
+    download = TRUE;
+  if ( vlp && download ) {
+    GList *dems = vik_layers_panel_get_all_layers_of_type ( vlp, VIK_LAYER_DEM, TRUE );
+    GList *iter;
+    for ( iter = dems; iter && !vdl; iter = iter->next )
+      if ( vik_dem_layer_is_srtm ( VIK_DEM_LAYER(iter->data) ) )
+        vdl = VIK_DEM_LAYER(iter->data);
+    g_list_free ( dems );
+  }
+
+  vik_trw_layer_dem_apply ( vtl, tracks, vdl, skip_existing_elevations );
 }
 
 static void trw_layer_apply_dem_data_all ( menu_array_sublayer values )
@@ -5493,8 +6158,11 @@ static void trw_layer_apply_dem_data_all ( menu_array_sublayer values )
   else
     track = (VikTrack *) g_hash_table_lookup ( vtl->tracks, values[MA_SUBLAYER_ID] );
 
-  if ( track )
-    apply_dem_data_common ( vtl, values[MA_VLP], track, FALSE );
+  if ( track ) {
+    GList *tracks = g_list_prepend ( NULL, track );
+    apply_dem_data_common ( vtl, values[MA_VLP], tracks, FALSE );
+    g_list_free ( tracks );
+  }
 }
 
 static void trw_layer_apply_dem_data_only_missing ( menu_array_sublayer values )
@@ -5506,8 +6174,36 @@ static void trw_layer_apply_dem_data_only_missing ( menu_array_sublayer values )
   else
     track = (VikTrack *) g_hash_table_lookup ( vtl->tracks, values[MA_SUBLAYER_ID] );
 
-  if ( track )
-    apply_dem_data_common ( vtl, values[MA_VLP], track, TRUE );
+  if ( track ) {
+    GList *tracks = g_list_prepend ( NULL, track );
+    apply_dem_data_common ( vtl, values[MA_VLP], tracks, TRUE );
+    g_list_free ( tracks );
+  }
+}
+
+/**
+ * apply_dem_data_sublayer:
+ *
+ * Apply DEM values to all the tracks or all the routes of the layer
+ */
+static void apply_dem_data_sublayer ( menu_array_sublayer values, gboolean skip_existing_elevations )
+{
+  VikTrwLayer *vtl = (VikTrwLayer *)values[MA_VTL];
+  GHashTable *ght = GPOINTER_TO_INT (values[MA_SUBTYPE]) == VIK_TRW_LAYER_SUBLAYER_ROUTES ? vtl->routes : vtl->tracks;
+  GList *tracks = g_hash_table_get_values ( ght );
+  if ( tracks )
+    apply_dem_data_common ( vtl, values[MA_VLP], tracks, skip_existing_elevations );
+  g_list_free ( tracks );
+}
+
+static void trw_layer_apply_dem_data_sublayer_all ( menu_array_sublayer values )
+{
+  apply_dem_data_sublayer ( values, FALSE );
+}
+
+static void trw_layer_apply_dem_data_sublayer_only_missing ( menu_array_sublayer values )
+{
+  apply_dem_data_sublayer ( values, TRUE );
 }
 
 /**
@@ -5856,59 +6552,77 @@ static void find_tracks_with_timestamp_type(gpointer key, gpointer value, gpoint
   *(user_data->result) = g_list_prepend(*(user_data->result), key);
 }
 
-/**
- * find_nearby_tracks_by_time:
- *
- * Called for each track in track hash table.
- *  If the original track (in user_data[1]) is close enough (threshold period in user_data[2])
- *  to the current track, then the current track is added to the list in user_data[0]
+/*
+ * The time span of a track, for merging by timestamp
  */
-static void find_nearby_tracks_by_time (gpointer key, gpointer value, gpointer user_data)
-{
-  VikTrack *trk = VIK_TRACK(value);
-
-  GList **nearby_tracks = ((gpointer *)user_data)[0];
-  VikTrack *orig_trk = VIK_TRACK(((gpointer *)user_data)[1]);
-
-  if ( !orig_trk || !orig_trk->trackpoints )
-    return;
-
-  /* outline: 
-   * detect reasons for not merging, and return
-   * if no reason is found not to merge, then do it.
-   */
+typedef struct {
+  VikTrack *trk;
+  time_t start; // First trackpoint
+  time_t end;   // Last trackpoint
+  time_t min;   // Earliest of all the trackpoints, i.e. the first once merged (which sorts them by time)
+  time_t max;   // Latest of all the trackpoints
+  gboolean merged;
+} MergeInterval;
 
-  twt_udata *udata = user_data;
-  // Exclude the original track from the compiled list
-  if (trk == udata->exclude) {
-    return;
+static void merge_interval_set_span ( MergeInterval *mi )
+{
+  GList *iter;
+  mi->min = mi->max = VIK_TRACKPOINT(mi->trk->trackpoints->data)->timestamp;
+  for ( iter = mi->trk->trackpoints->next; iter; iter = iter->next ) {
+    time_t ts = VIK_TRACKPOINT(iter->data)->timestamp;
+    if ( ts < mi->min )
+      mi->min = ts;
+    if ( ts > mi->max )
+      mi->max = ts;
   }
+}
 
-  time_t t1 = vik_track_get_tp_first(orig_trk)->timestamp;
-  time_t t2 = vik_track_get_tp_last(orig_trk)->timestamp;
+static gint merge_interval_compare_start ( gconstpointer a, gconstpointer b, gpointer user_data )
+{
+  time_t t1 = (*(MergeInterval**)a)->start, t2 = (*(MergeInterval**)b)->start;
+  if (t1 < t2) return -1;
+  if (t1 > t2) return 1;
+  return 0;
+}
 
-  if (trk->trackpoints) {
+static gint merge_interval_compare_end ( gconstpointer a, gconstpointer b, gpointer user_data )
+{
+  time_t t1 = (*(MergeInterval**)a)->end, t2 = (*(MergeInterval**)b)->end;
+  if (t1 < t2) return -1;
+  if (t1 > t2) return 1;
+  return 0;
+}
 
-    VikTrackpoint *p1 = vik_track_get_tp_first(trk);
-    VikTrackpoint *p2 = vik_track_get_tp_last(trk);
+/**
+ * merge_intervals_nearby:
+ * @intervals: Sorted by start (or end) time
+ * @by_end:    Whether to use the end times rather than the start times
+ *
+ * Adds those intervals not yet merged whose start (or end) is within the threshold period
+ *  either side of the given time to the list of nearby intervals
+ */
+static void merge_intervals_nearby ( MergeInterval **intervals, guint len, gboolean by_end, time_t when, guint threshold, GList **nearby )
+{
+  gint64 lo = (gint64)when - threshold;
+  gint64 hi = (gint64)when + threshold;
 
-    if (!p1->has_timestamp || !p2->has_timestamp) {
-      //g_print("no timestamp\n");
-      return;
-    }
+  // Binary search for the first one after the lower limit
+  guint first = 0, last = len;
+  while ( first < last ) {
+    guint mid = first + (last - first) / 2;
+    if ( (by_end ? intervals[mid]->end : intervals[mid]->start) > lo )
+      last = mid;
+    else
+      first = mid + 1;
+  }
 
-    guint threshold = GPOINTER_TO_UINT (((gpointer *)user_data)[2]);
-    //g_print("Got track named %s, times %d, %d\n", trk->name, p1->timestamp, p2->timestamp);
-    if (! (labs(t1 - p2->timestamp) < threshold ||
-      /*  p1 p2      t1 t2 */
-      labs(p1->timestamp - t2) < threshold)
-      /*  t1 t2      p1 p2 */
-    ) {
-      return;
+  guint ii;
+  for ( ii = first; ii < len && (by_end ? intervals[ii]->end : intervals[ii]->start) < hi; ii++ ) {
+    if ( !intervals[ii]->merged ) {
+      intervals[ii]->merged = TRUE;
+      *nearby = g_list_prepend ( *nearby, intervals[ii] );
     }
   }
-
-  *nearby_tracks = g_list_prepend(*nearby_tracks, value);
 }
 
 /* comparison function used to sort tracks; a and b are hash table keys */
@@ -5927,16 +6641,6 @@ static gint track_compare(gconstpointer a, gconstpointer b, gpointer user_data)
 }
 */
 
-/* comparison function used to sort trackpoints */
-static gint trackpoint_compare(gconstpointer a, gconstpointer b)
-{
-  time_t t1 = VIK_TRACKPOINT(a)->timestamp, t2 = VIK_TRACKPOINT(b)->timestamp;
-  
-  if (t1 < t2) return -1;
-  if (t1 > t2) return 1;
-  return 0;
-}
-
 /**
  * comparison function which can be used to sort tracks or waypoints by name
  */
@@ -6015,6 +6719,7 @@ static void trw_layer_merge_with_other ( menu_array_sublayer values )
   if (merge_list)
   {
     GList *l;
+    GList *merge_tracks = NULL;
     for (l = merge_list; l != NULL; l = g_list_next(l)) {
       VikTrack *merge_track;
       if ( track->is_route )
@@ -6022,15 +6727,21 @@ static void trw_layer_merge_with_other ( menu_array_sublayer values )
       else
         merge_track = vik_trw_layer_get_track ( vtl, l->data );
 
-      if (merge_track) {
-        vik_track_steal_and_append_trackpoints ( track, merge_track );
-        if ( track->is_route )
-          vik_trw_layer_delete_route (vtl, merge_track);
-        else
-          vik_trw_layer_delete_track (vtl, merge_track);
-        track->trackpoints = g_list_sort(track->trackpoints, trackpoint_compare);
-      }
+      if ( merge_track && !g_list_find ( merge_tracks, merge_track ) )
+        merge_tracks = g_list_prepend ( merge_tracks, merge_track );
     }
+    merge_tracks = g_list_reverse ( merge_tracks );
+
+    // Take all the trackpoints in one go, then remove the emptied tracks
+    vik_track_merge_by_time ( track, merge_tracks );
+    for (l = merge_tracks; l != NULL; l = g_list_next(l)) {
+      if ( track->is_route )
+        vik_trw_layer_delete_route (vtl, VIK_TRACK(l->data));
+      else
+        vik_trw_layer_delete_track (vtl, VIK_TRACK(l->data));
+    }
+    g_list_free(merge_tracks);
+
     for (l = merge_list; l != NULL; l = g_list_next(l))
       g_free(l->data);
     g_list_free(merge_list);
@@ -6271,50 +6982,89 @@ static void trw_layer_merge_by_timestamp ( menu_array_sublayer values )
     return;
   }
 
-  // keep attempting to merge all tracks until no merges within the time specified is possible
-  gboolean attempt_merge = TRUE;
-  GList *nearby_tracks = NULL;
-  GList *trps;
-  static gpointer params[3];
-
-  while ( attempt_merge ) {
-
-    // Don't try again unless tracks have changed
-    attempt_merge = FALSE;
+  if ( !orig_trk->trackpoints )
+    return;
 
-    trps = orig_trk->trackpoints;
-    if ( !trps )
-      return;
+  guint threshold = threshold_in_minutes*60; // In seconds
 
-    if (nearby_tracks) {
-      g_list_free(nearby_tracks);
-      nearby_tracks = NULL;
+  // Index the time span of all the other tracks once
+  // Tracks without any trackpoints are always merged (i.e. removed)
+  GList *nearby_tracks = NULL;
+  GArray *intervals = g_array_new ( FALSE, FALSE, sizeof(MergeInterval) );
+  GHashTableIter ht_iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &ht_iter, vtl->tracks );
+  while ( g_hash_table_iter_next ( &ht_iter, &key, &value ) ) {
+    VikTrack *trk = VIK_TRACK(value);
+    if ( trk == orig_trk )
+      continue;
+    if ( !trk->trackpoints ) {
+      nearby_tracks = g_list_prepend ( nearby_tracks, trk );
+      continue;
     }
+    VikTrackpoint *p1 = vik_track_get_tp_first(trk);
+    VikTrackpoint *p2 = vik_track_get_tp_last(trk);
+    if ( !p1->has_timestamp || !p2->has_timestamp )
+      continue;
+    MergeInterval mi = { trk, p1->timestamp, p2->timestamp, 0, 0, FALSE };
+    merge_interval_set_span ( &mi );
+    g_array_append_val ( intervals, mi );
+  }
+
+  guint len = intervals->len;
+  MergeInterval **by_start = g_new ( MergeInterval*, len );
+  MergeInterval **by_end = g_new ( MergeInterval*, len );
+  guint ii;
+  for ( ii = 0; ii < len; ii++ )
+    by_start[ii] = by_end[ii] = &g_array_index ( intervals, MergeInterval, ii );
+  g_qsort_with_data ( by_start, len, sizeof(MergeInterval*), merge_interval_compare_start, NULL );
+  g_qsort_with_data ( by_end, len, sizeof(MergeInterval*), merge_interval_compare_end, NULL );
+
+  // Find all the tracks to merge before moving any trackpoints, so they are merged only once:
+  //  keep looking for tracks ending near the start or starting near the end of what the merged track would be,
+  //  until no more within the time specified are found
+  time_t t1 = vik_track_get_tp_first(orig_trk)->timestamp;
+  time_t t2 = vik_track_get_tp_last(orig_trk)->timestamp;
+  MergeInterval orig_mi = { orig_trk, t1, t2, 0, 0, TRUE };
+  merge_interval_set_span ( &orig_mi );
+  time_t span_min = orig_mi.min, span_max = orig_mi.max;
+  // Merging even only empty tracks would sort the track, and so change its ends
+  gboolean changed = ( nearby_tracks != NULL );
+
+  while ( TRUE ) {
+    GList *nearby = NULL;
+    merge_intervals_nearby ( by_end, len, TRUE, t1, threshold, &nearby );
+    merge_intervals_nearby ( by_start, len, FALSE, t2, threshold, &nearby );
+    if ( !nearby && !changed )
+      break;
+    changed = FALSE;
 
-    params[0] = &nearby_tracks;
-    params[1] = orig_trk;
-    params[2] = GUINT_TO_POINTER (threshold_in_minutes*60); // In seconds
-
-    /* get a list of adjacent-in-time tracks */
-    g_hash_table_foreach(vtl->tracks, find_nearby_tracks_by_time, params);
-
-    /* merge them */
-    GList *l = nearby_tracks;
-    while ( l ) {
-      /* remove trackpoints from merged track, delete track */
-      vik_track_steal_and_append_trackpoints ( orig_trk, VIK_TRACK(l->data) );
-      vik_trw_layer_delete_track (vtl, VIK_TRACK(l->data));
-
-      // Tracks have changed, therefore retry again against all the remaining tracks
-      attempt_merge = TRUE;
-
-      l = g_list_next(l);
+    GList *l;
+    for ( l = nearby; l; l = g_list_next(l) ) {
+      MergeInterval *mi = l->data;
+      span_min = MIN ( span_min, mi->min );
+      span_max = MAX ( span_max, mi->max );
+      nearby_tracks = g_list_prepend ( nearby_tracks, mi->trk );
     }
+    g_list_free ( nearby );
 
-    orig_trk->trackpoints = g_list_sort(orig_trk->trackpoints, trackpoint_compare);
+    // Retry against the time span the merged track will have
+    t1 = span_min;
+    t2 = span_max;
   }
 
-  g_list_free(nearby_tracks);
+  if ( nearby_tracks ) {
+    nearby_tracks = g_list_reverse ( nearby_tracks );
+    vik_track_merge_by_time ( orig_trk, nearby_tracks );
+    GList *l;
+    for ( l = nearby_tracks; l; l = g_list_next(l) )
+      vik_trw_layer_delete_track ( vtl, VIK_TRACK(l->data) );
+    g_list_free ( nearby_tracks );
+  }
+
+  g_free ( by_start );
+  g_free ( by_end );
+  g_array_free ( intervals, TRUE );
 
   vik_layer_emit_update( VIK_LAYER(vtl) );
 }
@@ -6437,6 +7187,7 @@ static void trw_layer_split_by_timestamp ( menu_array_sublayer values )
   iter = newlists;
   // Only bother updating if the split results in new tracks
   if (g_list_length (newlists) > 1) {
+    vik_trw_layer_begin_bulk_insert ( vtl );
     while (iter) {
       gchar *new_tr_name;
       VikTrack *tr;
@@ -6452,7 +7203,7 @@ static void trw_layer_split_by_timestamp ( menu_array_sublayer values )
     }
     // Remove original track and then update the display
     vik_trw_layer_delete_track (vtl, track);
-    vik_layer_emit_update(VIK_LAYER(vtl));
+    vik_trw_layer_commit_bulk_insert ( vtl );
   }
   g_list_free(newlists);
 }
@@ -6518,6 +7269,7 @@ static void trw_layer_split_by_n_points ( menu_array_sublayer values )
   iter = newlists;
   // Only bother updating if the split results in new tracks
   if (g_list_length (newlists) > 1) {
+    vik_trw_layer_begin_bulk_insert ( vtl );
     while (iter) {
       gchar *new_tr_name;
       VikTrack *tr;
@@ -6543,7 +7295,7 @@ static void trw_layer_split_by_n_points ( menu_array_sublayer values )
       vik_trw_layer_delete_route (vtl, track);
     else
       vik_trw_layer_delete_track (vtl, track);
-    vik_layer_emit_update(VIK_LAYER(vtl));
+    vik_trw_layer_commit_bulk_insert ( vtl );
   }
   g_list_free(newlists);
 }
@@ -6575,18 +7327,19 @@ static void trw_layer_split_segments ( menu_array_sublayer values )
   VikTrack **tracks = vik_track_split_into_segments (trk, &ntracks);
   gchar *new_tr_name;
   guint i;
-  for ( i = 0; i < ntracks; i++ ) {
-    if ( tracks[i] ) {
-      new_tr_name = trw_layer_new_unique_sublayer_name ( vtl, VIK_TRW_LAYER_SUBLAYER_TRACK, trk->name);
-      vik_trw_layer_add_track ( vtl, new_tr_name, tracks[i] );
-      g_free ( new_tr_name );
-    }
-  }
   if ( tracks ) {
+    vik_trw_layer_begin_bulk_insert ( vtl );
+    for ( i = 0; i < ntracks; i++ ) {
+      if ( tracks[i] ) {
+        new_tr_name = trw_layer_new_unique_sublayer_name ( vtl, VIK_TRW_LAYER_SUBLAYER_TRACK, trk->name);
+        vik_trw_layer_add_track ( vtl, new_tr_name, tracks[i] );
+        g_free ( new_tr_name );
+      }
+    }
     g_free ( tracks );
-    // Remove original track
+    // Remove original track and then update the display
     vik_trw_layer_delete_track ( vtl, trk );
-    vik_layer_emit_update ( VIK_LAYER(vtl) );
+    vik_trw_layer_commit_bulk_insert ( vtl );
   }
   else {
     a_dialog_error_msg (VIK_GTK_WINDOW_FROM_LAYER(vtl), _("Can not split track as it has no segments"));
@@ -6618,6 +7371,8 @@ static void trw_layer_trackpoint_selected_delete ( VikTrwLayer *vtl, VikTrack *t
     // Delete current trackpoint
     vik_trackpoint_free ( vtl->current_tpl->data );
     trk->trackpoints = g_list_delete_link ( trk->trackpoints, vtl->current_tpl );
+    // No bounds to calculate for the now empty track, but anything derived from it is stale
+    vik_track_invalidate_index ( trk );
     trw_layer_cancel_current_tp ( vtl, FALSE );
   }
 }
@@ -7479,6 +8234,7 @@ static void trw_layer_waypoints_visibility_off ( menu_array_layer values )
   gpointer vis_data[2] = { VIK_LAYER(vtl)->vt, GINT_TO_POINTER(FALSE) };
   g_hash_table_foreach ( vtl->waypoints_iters, (GHFunc) trw_layer_iter_visibility, vis_data );
   g_hash_table_foreach ( vtl->waypoints, (GHFunc) trw_layer_waypoints_visibility, vis_data[1] );
+  trw_layer_waypoints_grid_invalidate ( vtl );
   // Redraw
   vik_layer_emit_update ( VIK_LAYER(vtl) );
 }
@@ -7492,6 +8248,7 @@ static void trw_layer_waypoints_visibility_on ( menu_array_layer values )
   gpointer vis_data[2] = { VIK_LAYER(vtl)->vt, GINT_TO_POINTER(TRUE) };
   g_hash_table_foreach ( vtl->waypoints_iters, (GHFunc) trw_layer_iter_visibility, vis_data );
   g_hash_table_foreach ( vtl->waypoints, (GHFunc) trw_layer_waypoints_visibility, vis_data[1] );
+  trw_layer_waypoints_grid_invalidate ( vtl );
   // Redraw
   vik_layer_emit_update ( VIK_LAYER(vtl) );
 }
@@ -7504,6 +8261,7 @@ static void trw_layer_waypoints_visibility_toggle ( menu_array_layer values )
   VikTrwLayer *vtl = VIK_TRW_LAYER(values[MA_VTL]);
   g_hash_table_foreach ( vtl->waypoints_iters, (GHFunc) trw_layer_iter_visibility_toggle, VIK_LAYER(vtl)->vt );
   g_hash_table_foreach ( vtl->waypoints, (GHFunc) trw_layer_waypoints_toggle_visibility, NULL );
+  trw_layer_waypoints_grid_invalidate ( vtl );
   // Redraw
   vik_layer_emit_update ( VIK_LAYER(vtl) );
 }
@@ -8180,6 +8938,25 @@ static gboolean trw_layer_sublayer_add_menu_items ( VikTrwLayer *l, GtkMenu *men
     g_signal_connect_swapped ( G_OBJECT(item), "activate", G_CALLBACK(trw_layer_tracks_stats), pass_along );
     gtk_menu_shell_append ( GTK_MENU_SHELL(menu), item );
     gtk_widget_show ( item );
+
+    GtkWidget *dem_submenu = gtk_menu_new ();
+    item = gtk_image_menu_item_new_with_mnemonic ( _("_Apply DEM Data") );
+    gtk_image_menu_item_set_image ( (GtkImageMenuItem*)item, gtk_image_new_from_stock ("vik-icon-DEM Download", GTK_ICON_SIZE_MENU) ); // Own icon - see stock_icons in vikwindow.c
+    gtk_menu_shell_append ( GTK_MENU_SHELL(menu), item );
+    gtk_widget_show ( item );
+    gtk_menu_item_set_submenu (GTK_MENU_ITEM (item), dem_submenu );
+
+    item = gtk_image_menu_item_new_with_mnemonic ( _("_Overwrite") );
+    g_signal_connect_swapped ( G_OBJECT(item), "activate", G_CALLBACK(trw_layer_apply_dem_data_sublayer_all), pass_along );
+    gtk_menu_shell_append ( GTK_MENU_SHELL(dem_submenu), item );
+    gtk_widget_set_tooltip_text (item, _("Overwrite any existing elevation values with DEM values for all tracks"));
+    gtk_widget_show ( item );
+
+    item = gtk_image_menu_item_new_with_mnemonic ( _("_Keep Existing") );
+    g_signal_connect_swapped ( G_OBJECT(item), "activate", G_CALLBACK(trw_layer_apply_dem_data_sublayer_only_missing), pass_along );
+    gtk_menu_shell_append ( GTK_MENU_SHELL(dem_submenu), item );
+    gtk_widget_set_tooltip_text (item, _("Keep existing elevation values, only attempt for missing values for all tracks"));
+    gtk_widget_show ( item );
   }
 
   if ( subtype == VIK_TRW_LAYER_SUBLAYER_ROUTES )
@@ -8258,6 +9035,25 @@ static gboolean trw_layer_sublayer_add_menu_items ( VikTrwLayer *l, GtkMenu *men
     g_signal_connect_swapped ( G_OBJECT(item), "activate", G_CALLBACK(trw_layer_routes_stats), pass_along );
     gtk_menu_shell_append ( GTK_MENU_SHELL(menu), item );
     gtk_widget_show ( item );
+
+    GtkWidget *dem_submenu = gtk_menu_new ();
+    item = gtk_image_menu_item_new_with_mnemonic ( _("_Apply DEM Data") );
+    gtk_image_menu_item_set_image ( (GtkImageMenuItem*)item, gtk_image_new_from_stock ("vik-icon-DEM Download", GTK_ICON_SIZE_MENU) ); // Own icon - see stock_icons in vikwindow.c
+    gtk_menu_shell_append ( GTK_MENU_SHELL(menu), item );
+    gtk_widget_show ( item );
+    gtk_menu_item_set_submenu (GTK_MENU_ITEM (item), dem_submenu );
+
+    item = gtk_image_menu_item_new_with_mnemonic ( _("_Overwrite") );
+    g_signal_connect_swapped ( G_OBJECT(item), "activate", G_CALLBACK(trw_layer_apply_dem_data_sublayer_all), pass_along );
+    gtk_menu_shell_append ( GTK_MENU_SHELL(dem_submenu), item );
+    gtk_widget_set_tooltip_text (item, _("Overwrite any existing elevation values with DEM values for all routes"));
+    gtk_widget_show ( item );
+
+    item = gtk_image_menu_item_new_with_mnemonic ( _("_Keep Existing") );
+    g_signal_connect_swapped ( G_OBJECT(item), "activate", G_CALLBACK(trw_layer_apply_dem_data_sublayer_only_missing), pass_along );
+    gtk_menu_shell_append ( GTK_MENU_SHELL(dem_submenu), item );
+    gtk_widget_set_tooltip_text (item, _("Keep existing elevation values, only attempt for missing values for all routes"));
+    gtk_widget_show ( item );
   }
 
 
@@ -8850,6 +9646,7 @@ static void trw_layer_insert_tp_beside_current_tp ( VikTrwLayer *vtl, gboolean b
         index = index + 1;
       // NB no recalculation of bounds since it is inserted between points
       trk->trackpoints = g_list_insert ( trk->trackpoints, tp_new, index );
+      vik_track_invalidate_index ( trk );
     }
   }
 }
@@ -8937,7 +9734,12 @@ static void trw_layer_tpwin_response ( VikTrwLayer *vtl, gint response )
     vik_layer_emit_update(VIK_LAYER(vtl));
   }
   else if ( response == VIK_TRW_LAYER_TPWIN_DATA_CHANGED )
+  {
+    // Position, time or altitude changed
+    if ( vtl->current_tp_track )
+      vik_track_calculate_bounds ( vtl->current_tp_track );
     vik_layer_emit_update(VIK_LAYER(vtl));
+  }
 }
 
 /**
@@ -9314,7 +10116,7 @@ static gboolean trw_layer_select_click ( VikTrwLayer *vtl, GdkEventButton *event
     if ( wp_params.closest_wp )  {
 
       // Select
-      vik_treeview_select_iter ( VIK_LAYER(vtl)->vt, g_hash_table_lookup ( vtl->waypoints_iters, wp_params.closest_wp_id ), TRUE );
+      trw_layer_select_item ( vtl, VIK_TRW_LAYER_SUBLAYER_WAYPOINT, wp_params.closest_wp_id );
 
       // Too easy to move it so must be holding shift to start immediately moving it
       //   or otherwise be previously selected but not have an image (otherwise clicking within image bounds (again) moves it)
@@ -9362,7 +10164,7 @@ static gboolean trw_layer_select_click ( VikTrwLayer *vtl, GdkEventButton *event
     if ( tp_params.closest_tp )  {
 
       // Always select + highlight the track
-      vik_treeview_select_iter ( VIK_LAYER(vtl)->vt, g_hash_table_lookup ( vtl->tracks_iters, tp_params.closest_track_id ), TRUE );
+      trw_layer_select_item ( vtl, VIK_TRW_LAYER_SUBLAYER_TRACK, tp_params.closest_track_id );
 
       tet->is_waypoint = FALSE;
 
@@ -9397,7 +10199,7 @@ static gboolean trw_layer_select_click ( VikTrwLayer *vtl, GdkEventButton *event
     if ( tp_params.closest_tp )  {
 
       // Always select + highlight the track
-      vik_treeview_select_iter ( VIK_LAYER(vtl)->vt, g_hash_table_lookup ( vtl->routes_iters, tp_params.closest_track_id ), TRUE );
+      trw_layer_select_item ( vtl, VIK_TRW_LAYER_SUBLAYER_ROUTE, tp_params.closest_track_id );
 
       tet->is_waypoint = FALSE;
 
@@ -9472,11 +10274,9 @@ static gboolean trw_layer_show_selected_viewport_menu ( VikTrwLayer *vtl, GdkEve
 
       if ( trkf && udataU.uuid ) {
 
-        GtkTreeIter *iter;
-        if ( track->is_route )
-          iter = g_hash_table_lookup ( vtl->routes_iters, udataU.uuid );
-        else
-          iter = g_hash_table_lookup ( vtl->tracks_iters, udataU.uuid );
+        GtkTreeIter *iter = trw_layer_get_item_iter ( vtl,
+                                                      track->is_route ? VIK_TRW_LAYER_SUBLAYER_ROUTE : VIK_TRW_LAYER_SUBLAYER_TRACK,
+                                                      udataU.uuid );
 
         trw_layer_sublayer_add_menu_items ( vtl,
                                             vtl->track_right_click_menu,
@@ -9510,7 +10310,7 @@ static gboolean trw_layer_show_selected_viewport_menu ( VikTrwLayer *vtl, GdkEve
       gpointer wpf = g_hash_table_find ( vtl->waypoints, (GHRFunc) trw_layer_waypoint_find_uuid, (gpointer) &udata );
 
       if ( wpf && udata.uuid ) {
-        GtkTreeIter *iter = g_hash_table_lookup ( vtl->waypoints_iters, udata.uuid );
+        GtkTreeIter *iter = trw_layer_get_item_iter ( vtl, VIK_TRW_LAYER_SUBLAYER_WAYPOINT, udata.uuid );
 
         trw_layer_sublayer_add_menu_items ( vtl,
                                             vtl->wp_right_click_menu,
@@ -9648,7 +10448,7 @@ static gboolean tool_edit_waypoint_click ( VikTrwLayer *vtl, GdkEventButton *eve
     else
       vtl->waypoint_rightclick = FALSE;
 
-    vik_treeview_select_iter ( VIK_LAYER(vtl)->vt, g_hash_table_lookup ( vtl->waypoints_iters, params.closest_wp_id ), TRUE );
+    trw_layer_select_item ( vtl, VIK_TRW_LAYER_SUBLAYER_WAYPOINT, params.closest_wp_id );
 
     vtl->current_wp = params.closest_wp;
     vtl->current_wp_id = params.closest_wp_id;
@@ -9748,7 +10548,7 @@ static gboolean tool_edit_waypoint_release ( VikTrwLayer *vtl, GdkEventButton *e
       g_object_ref_sink ( G_OBJECT(vtl->wp_right_click_menu) );
     if ( vtl->current_wp ) {
       vtl->wp_right_click_menu = GTK_MENU ( gtk_menu_new () );
-      trw_layer_sublayer_add_menu_items ( vtl, vtl->wp_right_click_menu, NULL, VIK_TRW_LAYER_SUBLAYER_WAYPOINT, vtl->current_wp_id, g_hash_table_lookup ( vtl->waypoints_iters, vtl->current_wp_id ), vvp );
+      trw_layer_sublayer_add_menu_items ( vtl, vtl->wp_right_click_menu, NULL, VIK_TRW_LAYER_SUBLAYER_WAYPOINT, vtl->current_wp_id, trw_layer_get_item_iter ( vtl, VIK_TRW_LAYER_SUBLAYER_WAYPOINT, vtl->current_wp_id ), vvp );
       gtk_menu_popup ( vtl->wp_right_click_menu, NULL, NULL, NULL, NULL, event->button, gtk_get_current_event_time() );
     }
     vtl->waypoint_rightclick = FALSE;
@@ -10261,7 +11061,7 @@ static gboolean tool_edit_trackpoint_click ( VikTrwLayer *vtl, GdkEventButton *e
 
   if ( params.closest_tp )
   {
-    vik_treeview_select_iter ( VIK_LAYER(vtl)->vt, g_hash_table_lookup ( vtl->tracks_iters, params.closest_track_id ), TRUE );
+    trw_layer_select_item ( vtl, VIK_TRW_LAYER_SUBLAYER_TRACK, params.closest_track_id );
     vtl->current_tpl = params.closest_tpl;
     vtl->current_tp_id = params.closest_track_id;
     vtl->current_tp_track = g_hash_table_lookup ( vtl->tracks, params.closest_track_id );
@@ -10276,7 +11076,7 @@ static gboolean tool_edit_trackpoint_click ( VikTrwLayer *vtl, GdkEventButton *e
 
   if ( params.closest_tp )
   {
-    vik_treeview_select_iter ( VIK_LAYER(vtl)->vt, g_hash_table_lookup ( vtl->routes_iters, params.closest_track_id ), TRUE );
+    trw_layer_select_item ( vtl, VIK_TRW_LAYER_SUBLAYER_ROUTE, params.closest_track_id );
     vtl->current_tpl = params.closest_tpl;
     vtl->current_tp_id = params.closest_track_id;
     vtl->current_tp_track = g_hash_table_lookup ( vtl->routes, params.closest_track_id );
@@ -10603,6 +11403,7 @@ void trw_layer_verify_thumbnails ( VikTrwLayer *vtl, GtkWidget *vp )
       tctd->vtl = vtl;
       tctd->pics = pics;
       a_background_thread ( BACKGROUND_POOL_LOCAL,
+                            BACKGROUND_PRIORITY_BULK, 0,
                             VIK_GTK_WINDOW_FROM_LAYER(vtl),
 			    tmp,
 			    (vik_thr_func) create_thumbnails_thread,
@@ -10722,6 +11523,8 @@ void trw_layer_calculate_bounds_waypoints ( VikTrwLayer *vtl )
   vtl->waypoints_bbox.east = bottomright.lon;
   vtl->waypoints_bbox.south = bottomright.lat;
   vtl->waypoints_bbox.west = topleft.lon;
+
+  trw_layer_waypoints_grid_invalidate ( vtl );
 }
 
 static void trw_layer_calculate_bounds_track ( gpointer id, VikTrack *trk )
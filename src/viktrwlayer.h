@@ -83,11 +83,16 @@ void vik_trw_layer_add_waypoint ( VikTrwLayer *vtl, gchar *name, VikWaypoint *wp
 void vik_trw_layer_add_track ( VikTrwLayer *vtl, gchar *name, VikTrack *t );
 void vik_trw_layer_add_route ( VikTrwLayer *vtl, gchar *name, VikTrack *t );
 
+/* Bracket adding many items so the treeview is sorted and the layer updated only once */
+void vik_trw_layer_begin_bulk_insert ( VikTrwLayer *vtl );
+void vik_trw_layer_commit_bulk_insert ( VikTrwLayer *vtl );
+
 // Waypoint returned is the first one
 VikWaypoint *vik_trw_layer_get_waypoint ( VikTrwLayer *vtl, const gchar *name );
 
 // Track returned is the first one
 VikTrack *vik_trw_layer_get_track ( VikTrwLayer *vtl, const gchar *name );
+gboolean vik_trw_layer_delete_waypoint ( VikTrwLayer *vtl, VikWaypoint *wp );
 gboolean vik_trw_layer_delete_track ( VikTrwLayer *vtl, VikTrack *trk );
 gboolean vik_trw_layer_delete_route ( VikTrwLayer *vtl, VikTrack *trk );
 
@@ -0,0 +1,420 @@
+/* -*- Mode: C; indent-tabs-mode: nil; c-basic-offset: 2; tab-width: 2 -*- */
+/*
+ * viking -- GPS Data and Topo Analyzer, Explorer, and Manager
+ *
+ * Copyright (C) 2026, The Viking developers
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+/*
+ * Applying DEM data to many trackpoints as a background job.
+ *
+ * The job runs as a pipeline:
+ *  1. Any SRTM tiles needed but not yet loaded are downloaded (when a DEM layer is given)
+ *  2. Each point is assigned to the DEM covering it, in parallel chunks
+ *  3. The points are reordered so those using the same DEM are processed together
+ *  4. The elevations are looked up and set, again in parallel chunks
+ *  5. Back in the main thread, the elevations are set on the tracks (unless they were edited meanwhile)
+ *
+ * The worker threads only use copies of the trackpoint positions,
+ *  so the tracks remain free to be edited whilst the job runs.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <glib/gi18n.h>
+
+#include "viking.h"
+#include "viktrwlayer_dem.h"
+#include "background.h"
+#include "dems.h"
+#include "util.h"
+
+// Keep chunks big enough that the thread overhead is irrelevant
+#define DEM_APPLY_MIN_CHUNK_SIZE 4096
+
+typedef struct {
+  VikTrack *trk;
+  guint version; // Of the track when the job was started
+  guint start;   // Index of its first trackpoint in the job
+} DemApplyTrack;
+
+typedef struct {
+  VikTrwLayer *vtl;
+  VikDEMLayer *vdl; // Optional, for adding missing SRTM tiles to. NULL if the layer has gone
+  gboolean download;
+  GList *downloaded; // Filenames of DEMs loaded by the job
+  DemApplyTrack *trks;
+  guint n_trks;
+  gboolean skip_existing;
+
+  VikCoord *coords;
+  guint n_tps;
+  gint16 *elevs;   // Per trackpoint, the result
+  gint *dem_index; // Per trackpoint, which DEM in the batch covers it
+  guint *order;    // Processing order with the trackpoints grouped by DEM
+  VikDemsBatch *batch;
+
+  guint threads;
+  guint chunk_size;
+  guint n_chunks;
+  GMutex *mutex;
+  GCond *cond;     // Signalled as each chunk is done
+  gint chunks_done;
+  volatile gint cancelled;
+  gboolean completed;
+} DemApplyJob;
+
+static void dem_apply_weak_ref_cb ( gpointer ptr, GObject *dead_vdl )
+{
+  DemApplyJob *job = ptr;
+  job->vdl = NULL;
+}
+
+/**
+ * Set the elevations on the tracks
+ *
+ * Returns: The number of trackpoints changed
+ */
+static gulong dem_apply_set_elevations ( DemApplyJob *job )
+{
+  gulong changed = 0;
+  guint tt;
+  for ( tt = 0; tt < job->n_trks; tt++ ) {
+    VikTrack *trk = job->trks[tt].trk;
+    // The trackpoints may no longer be the ones the elevations were found for
+    if ( trk->version != job->trks[tt].version )
+      continue;
+    guint ii = job->trks[tt].start;
+    guint end = tt+1 < job->n_trks ? job->trks[tt+1].start : job->n_tps;
+    gulong changed_trk = 0;
+    GList *iter;
+    for ( iter = trk->trackpoints; iter && ii < end; iter = iter->next ) {
+      VikTrackpoint *tp = VIK_TRACKPOINT(iter->data);
+      // The same selection as when the positions were collected
+      if ( job->skip_existing && tp->altitude != VIK_DEFAULT_ALTITUDE )
+        continue;
+      if ( job->elevs[ii] != VIK_DEM_INVALID_ELEVATION ) {
+        tp->altitude = job->elevs[ii];
+        changed_trk++;
+      }
+      ii++;
+    }
+    if ( changed_trk )
+      vik_track_invalidate_index ( trk );
+    changed += changed_trk;
+  }
+  return changed;
+}
+
+static gboolean dem_apply_job_finish ( DemApplyJob *job )
+{
+  // NB Back in the main thread, so the layers and tracks can be safely used
+  GList *iter;
+  if ( job->vdl ) {
+    gboolean added = FALSE;
+    for ( iter = job->downloaded; iter; iter = iter->next )
+      added = vik_dem_layer_add_file ( job->vdl, (const gchar*)iter->data ) || added;
+    // Newly loaded DEMs should be drawn
+    if ( added )
+      vik_layer_emit_update ( VIK_LAYER(job->vdl) );
+    g_object_weak_unref ( G_OBJECT(job->vdl), dem_apply_weak_ref_cb, job );
+  }
+  // The layer has its own references to the DEMs now
+  for ( iter = job->downloaded; iter; iter = iter->next ) {
+    a_dems_unref ( (const gchar*)iter->data );
+    g_free ( iter->data );
+  }
+  g_list_free ( job->downloaded );
+
+  if ( job->completed ) {
+    gulong changed = dem_apply_set_elevations ( job );
+
+    // Inform user how much was changed
+    gchar *msg = g_strdup_printf ( ngettext("%ld point adjusted", "%ld points adjusted", changed), changed );
+    vik_window_statusbar_update ( (VikWindow*)VIK_GTK_WINDOW_FROM_LAYER(job->vtl), msg, VIK_STATUSBAR_INFO );
+    g_free ( msg );
+
+    if ( changed )
+      vik_layer_emit_update ( VIK_LAYER(job->vtl) );
+  }
+
+  guint tt;
+  for ( tt = 0; tt < job->n_trks; tt++ )
+    vik_track_free ( job->trks[tt].trk );
+  g_free ( job->trks );
+  g_free ( job->elevs );
+  g_object_unref ( job->vtl );
+  g_free ( job );
+  return FALSE;
+}
+
+static void dem_apply_job_free ( DemApplyJob *job )
+{
+  if ( job->batch )
+    a_dems_batch_free ( job->batch );
+  g_free ( job->coords );
+  g_free ( job->dem_index );
+  g_free ( job->order );
+  vik_cond_free ( job->cond );
+  vik_mutex_free ( job->mutex );
+  gdk_threads_add_idle ( (GSourceFunc)dem_apply_job_finish, job );
+}
+
+/**
+ * run_chunks:
+ * @func:        The function to process a chunk (numbered from 1)
+ * @progress:    The number of chunks already processed in previous stages
+ *
+ * Process all the chunks in parallel, reporting progress as each chunk completes.
+ *
+ * Returns: FALSE if the job was cancelled
+ */
+static gboolean run_chunks ( DemApplyJob *job, GFunc func, guint progress, gpointer threaddata )
+{
+  job->chunks_done = 0;
+  GThreadPool *pool = g_thread_pool_new ( func, job, job->threads, FALSE, NULL );
+  guint chunk;
+  for ( chunk = 1; chunk <= job->n_chunks; chunk++ )
+    g_thread_pool_push ( pool, GUINT_TO_POINTER(chunk), NULL );
+
+  gboolean ok = TRUE;
+  guint reported = 0;
+  while ( ok && reported < job->n_chunks ) {
+    g_mutex_lock ( job->mutex );
+    while ( (guint)job->chunks_done == reported )
+      g_cond_wait ( job->cond, job->mutex );
+    guint done = job->chunks_done;
+    g_mutex_unlock ( job->mutex );
+
+    // One progress call per chunk, to match the number of items given to the background job
+    while ( reported < done ) {
+      reported++;
+      if ( a_background_thread_progress ( threaddata, (gdouble)(progress + reported) / (2 * job->n_chunks) ) ) {
+        ok = FALSE;
+        break;
+      }
+    }
+  }
+
+  if ( !ok )
+    g_atomic_int_set ( &job->cancelled, 1 );
+  // On cancel drop any chunks not yet started, but always wait for the running ones
+  g_thread_pool_free ( pool, !ok, TRUE );
+  return ok;
+}
+
+static void chunk_range ( DemApplyJob *job, gpointer data, guint *start, guint *end )
+{
+  guint chunk = GPOINTER_TO_UINT(data) - 1;
+  *start = chunk * job->chunk_size;
+  *end = MIN ( *start + job->chunk_size, job->n_tps );
+}
+
+static void chunk_done ( DemApplyJob *job )
+{
+  g_mutex_lock ( job->mutex );
+  job->chunks_done++;
+  g_cond_signal ( job->cond );
+  g_mutex_unlock ( job->mutex );
+}
+
+static void find_chunk ( gpointer data, DemApplyJob *job )
+{
+  if ( !g_atomic_int_get ( &job->cancelled ) ) {
+    guint ii, start, end;
+    chunk_range ( job, data, &start, &end );
+    for ( ii = start; ii < end; ii++ )
+      job->dem_index[ii] = a_dems_batch_find ( job->batch, &(job->coords[ii]) );
+  }
+  chunk_done ( job );
+}
+
+static void apply_chunk ( gpointer data, DemApplyJob *job )
+{
+  if ( !g_atomic_int_get ( &job->cancelled ) ) {
+    guint kk, start, end;
+    chunk_range ( job, data, &start, &end );
+    for ( kk = start; kk < end; kk++ ) {
+      guint ii = job->order[kk];
+      // Not covered by any DEM
+      if ( job->dem_index[ii] < 0 )
+        continue;
+      job->elevs[ii] = a_dems_batch_get_elev ( job->batch, job->dem_index[ii], &(job->coords[ii]) );
+    }
+  }
+  chunk_done ( job );
+}
+
+/**
+ * group_by_dem:
+ *
+ * Counting sort of the trackpoints by the DEM they use, so the lookups for each DEM are made together.
+ * Points not covered by any DEM go last.
+ */
+static void group_by_dem ( DemApplyJob *job )
+{
+  guint n_dems = a_dems_batch_get_count ( job->batch );
+  guint *starts = g_new0 ( guint, n_dems + 2 );
+  guint ii;
+  for ( ii = 0; ii < job->n_tps; ii++ ) {
+    gint bucket = job->dem_index[ii] < 0 ? n_dems : job->dem_index[ii];
+    starts[bucket+1]++;
+  }
+  for ( ii = 1; ii <= n_dems + 1; ii++ )
+    starts[ii] += starts[ii-1];
+  for ( ii = 0; ii < job->n_tps; ii++ ) {
+    gint bucket = job->dem_index[ii] < 0 ? n_dems : job->dem_index[ii];
+    job->order[starts[bucket]++] = ii;
+  }
+  g_free ( starts );
+}
+
+/**
+ * download_missing:
+ *
+ * Ensure the SRTM tiles for any points not currently covered by a DEM are available.
+ *
+ * Returns: FALSE if the job was cancelled
+ */
+static gboolean download_missing ( DemApplyJob *job, gpointer threaddata )
+{
+  GHashTable *cells = g_hash_table_new ( g_direct_hash, g_direct_equal );
+  VikDemsBatch *batch = a_dems_batch_new ( VIK_DEM_INTERPOL_NONE );
+  guint ii;
+  for ( ii = 0; ii < job->n_tps; ii++ ) {
+    if ( a_dems_batch_find ( batch, &(job->coords[ii]) ) < 0 ) {
+      struct LatLon ll;
+      vik_coord_to_latlon ( &(job->coords[ii]), &ll );
+      gint key = ((gint)floor(ll.lat) + 90) * 360 + ((gint)floor(ll.lon) + 180) + 1; // +1 to avoid NULL
+      g_hash_table_insert ( cells, GINT_TO_POINTER(key), GINT_TO_POINTER(key) );
+    }
+  }
+  a_dems_batch_free ( batch );
+
+  gboolean ok = TRUE;
+  GHashTableIter iter;
+  gpointer key, value;
+  g_hash_table_iter_init ( &iter, cells );
+  while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+    if ( a_background_testcancel ( threaddata ) ) {
+      ok = FALSE;
+      break;
+    }
+    gint cell = GPOINTER_TO_INT(key) - 1;
+    gchar *filename = vik_dem_layer_download_srtm_tile ( cell / 360 - 90, cell % 360 - 180 );
+    // Added to the layer once back in the main thread
+    if ( filename )
+      job->downloaded = g_list_prepend ( job->downloaded, filename );
+  }
+  g_hash_table_destroy ( cells );
+
+  return ok;
+}
+
+static void dem_apply_thread ( DemApplyJob *job, gpointer threaddata )
+{
+  // Dependency step: make sure the DEM data is available before applying it
+  if ( job->download && job->n_tps )
+    if ( !download_missing ( job, threaddata ) )
+      return;
+
+  job->batch = a_dems_batch_new ( VIK_DEM_INTERPOL_BEST );
+  if ( job->n_tps && a_dems_batch_get_count ( job->batch ) ) {
+    job->dem_index = g_new ( gint, job->n_tps );
+    job->order = g_new ( guint, job->n_tps );
+
+    if ( !run_chunks ( job, (GFunc)find_chunk, 0, threaddata ) )
+      return;
+    group_by_dem ( job );
+    if ( !run_chunks ( job, (GFunc)apply_chunk, job->n_chunks, threaddata ) )
+      return;
+  }
+
+  job->completed = TRUE;
+}
+
+/**
+ * vik_trw_layer_dem_apply:
+ * @vtl:           The layer the tracks belong to
+ * @tracks:        The list of tracks (and/or routes) to process. The list itself is not used after this call.
+ * @vdl:           When not NULL, any missing SRTM tiles will be downloaded into this DEM layer first
+ * @skip_existing: When TRUE, don't change the elevation of trackpoints that already have a value
+ *
+ * Apply DEM elevations to all the trackpoints of the tracks in a background job,
+ *  using multiple threads for large numbers of trackpoints.
+ * Tracks edited whilst the job runs are left alone.
+ * The result is reported via the statusbar.
+ */
+void vik_trw_layer_dem_apply ( VikTrwLayer *vtl,
+                               GList *tracks,
+                               VikDEMLayer *vdl,
+                               gboolean skip_existing )
+{
+  DemApplyJob *job = g_malloc0 ( sizeof(DemApplyJob) );
+  job->vtl = g_object_ref ( vtl );
+  if ( vdl ) {
+    job->vdl = vdl;
+    job->download = TRUE;
+    g_object_weak_ref ( G_OBJECT(vdl), dem_apply_weak_ref_cb, job );
+  }
+  job->skip_existing = skip_existing;
+  job->mutex = vik_mutex_new ();
+  job->cond = vik_cond_new ();
+
+  // Collect the trackpoint positions up front, so the work can be evenly split
+  GArray *coords = g_array_new ( FALSE, FALSE, sizeof(VikCoord) );
+  job->n_trks = g_list_length ( tracks );
+  job->trks = g_new ( DemApplyTrack, job->n_trks );
+  GList *iter;
+  guint tt = 0;
+  for ( iter = tracks; iter; iter = iter->next, tt++ ) {
+    VikTrack *trk = VIK_TRACK(iter->data);
+    vik_track_ref ( trk );
+    job->trks[tt].trk = trk;
+    job->trks[tt].version = trk->version;
+    job->trks[tt].start = coords->len;
+    GList *tp_iter;
+    for ( tp_iter = trk->trackpoints; tp_iter; tp_iter = tp_iter->next ) {
+      VikTrackpoint *tp = VIK_TRACKPOINT(tp_iter->data);
+      // Don't apply if the point already has a value and the overwrite is off
+      if ( !(skip_existing && tp->altitude != VIK_DEFAULT_ALTITUDE) )
+        g_array_append_val ( coords, tp->coord );
+    }
+  }
+  job->n_tps = coords->len;
+  job->coords = (VikCoord*)g_array_free ( coords, FALSE );
+  job->elevs = g_new ( gint16, job->n_tps );
+  guint ii;
+  for ( ii = 0; ii < job->n_tps; ii++ )
+    job->elevs[ii] = VIK_DEM_INVALID_ELEVATION;
+
+  job->threads = util_get_number_of_cpus ();
+  job->chunk_size = MAX ( job->n_tps / (job->threads * 4), DEM_APPLY_MIN_CHUNK_SIZE );
+  job->n_chunks = (job->n_tps + job->chunk_size - 1) / job->chunk_size;
+
+  a_background_thread ( BACKGROUND_POOL_LOCAL,
+                        BACKGROUND_PRIORITY_BULK, 0,
+                        VIK_GTK_WINDOW_FROM_LAYER(vtl),
+                        _("Applying DEM Data"),
+                        (vik_thr_func) dem_apply_thread,
+                        job,
+                        (vik_thr_free_func) dem_apply_job_free,
+                        NULL,
+                        2 * job->n_chunks );
+}
@@ -517,6 +517,7 @@ static void trw_layer_geotag_response_cb ( GtkDialog *dialog, gint resp, GeoTagW
 
 		// Processing lots of files can take time - so run a background effort
 		a_background_thread ( BACKGROUND_POOL_LOCAL,
+		                      BACKGROUND_PRIORITY_BULK, 0,
 		                      VIK_GTK_WINDOW_FROM_LAYER(options->vtl),
 		                      tmp,
 		                      (vik_thr_func) trw_layer_geotag_thread,
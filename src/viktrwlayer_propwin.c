@@ -38,6 +38,7 @@
 #endif
 #include "viktrwlayer.h"
 #include "viktrwlayer_propwin.h"
+#include "viktrackprofile.h"
 #include "dems.h"
 #include "viking.h"
 #include "vikviewport.h" /* ugh */
@@ -255,6 +256,80 @@ static void prop_widgets_free(PropWidgets *widgets)
   g_free(widgets);
 }
 
+/**
+ * make_map:
+ * @mins: Optionally returns a newly allocated array of the smallest value within each column
+ * @maxs: Optionally returns a newly allocated array of the largest value within each column
+ *
+ * Get the values for each column of a graph.
+ * Falls back to calculating directly from the track when it can't be profiled (e.g. timestamps out of order).
+ */
+static gdouble *make_map ( PropWidgets *widgets, VikTrackProfileMap map, gdouble **mins, gdouble **maxs )
+{
+  guint width = widgets->profile_width;
+  gdouble *lows = mins ? g_malloc ( sizeof(gdouble) * width ) : NULL;
+  gdouble *highs = maxs ? g_malloc ( sizeof(gdouble) * width ) : NULL;
+
+  gdouble *pts = vik_track_profile_make_map ( vik_track_get_profile(widgets->tr), map, width, lows, highs );
+  if ( !pts ) {
+    switch ( map ) {
+    case VIK_TRACK_PROFILE_ELEVATION_DISTANCE: pts = vik_track_make_elevation_map ( widgets->tr, width ); break;
+    case VIK_TRACK_PROFILE_GRADIENT_DISTANCE: pts = vik_track_make_gradient_map ( widgets->tr, width ); break;
+    case VIK_TRACK_PROFILE_SPEED_TIME: pts = vik_track_make_speed_map ( widgets->tr, width ); break;
+    case VIK_TRACK_PROFILE_DISTANCE_TIME: pts = vik_track_make_distance_map ( widgets->tr, width ); break;
+    case VIK_TRACK_PROFILE_ELEVATION_TIME: pts = vik_track_make_elevation_time_map ( widgets->tr, width ); break;
+    case VIK_TRACK_PROFILE_SPEED_DISTANCE: pts = vik_track_make_speed_dist_map ( widgets->tr, width ); break;
+    default: break;
+    }
+    if ( pts && lows )
+      memcpy ( lows, pts, sizeof(gdouble) * width );
+    if ( pts && highs )
+      memcpy ( highs, pts, sizeof(gdouble) * width );
+  }
+
+  if ( !pts ) {
+    g_free ( lows );
+    g_free ( highs );
+    lows = highs = NULL;
+  }
+  if ( mins )
+    *mins = lows;
+  if ( maxs )
+    *maxs = highs;
+  return pts;
+}
+
+/**
+ * convert_speeds:
+ *
+ * Convert from m/s into the speed units in use
+ */
+static void convert_speeds ( gdouble *speeds, guint count, vik_units_speed_t speed_units )
+{
+  guint i;
+  switch (speed_units) {
+  case VIK_UNITS_SPEED_KILOMETRES_PER_HOUR:
+    for ( i = 0; i < count; i++ ) {
+      speeds[i] = VIK_MPS_TO_KPH(speeds[i]);
+    }
+    break;
+  case VIK_UNITS_SPEED_MILES_PER_HOUR:
+    for ( i = 0; i < count; i++ ) {
+      speeds[i] = VIK_MPS_TO_MPH(speeds[i]);
+    }
+    break;
+  case VIK_UNITS_SPEED_KNOTS:
+    for ( i = 0; i < count; i++ ) {
+      speeds[i] = VIK_MPS_TO_KNOTS(speeds[i]);
+    }
+    break;
+  default:
+    // VIK_UNITS_SPEED_METRES_PER_SECOND:
+    // No need to convert as already in m/s
+    break;
+  }
+}
+
 static void minmax_array(const gdouble *array, gdouble *min, gdouble *max, gboolean NO_ALT_TEST, gint PROFILE_WIDTH)
 {
   *max = -1000;
@@ -1268,11 +1343,44 @@ void track_sd_move( GtkWidget *event_box, GdkEventMotion *event, PropWidgets *wi
   g_list_free(child);
 }
 
+/**
+ * draw_column_extents:
+ *
+ * Draw the part of each column between the average and the largest value,
+ *  so that peaks are not lost when many trackpoints share a column
+ */
+static void draw_column_extents ( GdkDrawable *pix, GdkGC *gc, const gdouble *values, const gdouble *maxs, gint width, gint bottom, gdouble min, gdouble scale )
+{
+  gint i;
+  for ( i = 0; i < width; i++ )
+    if ( !isnan(maxs[i]) && maxs[i] > values[i] )
+      gdk_draw_line ( pix, gc, i + MARGIN_X, bottom - scale*(values[i]-min), i + MARGIN_X, MAX(MARGIN_Y, bottom - scale*(maxs[i]-min)) );
+}
+
+/**
+ * draw_column_marks:
+ *
+ * Mark the range of values within each column,
+ *  rather than a mark for every trackpoint
+ */
+static void draw_column_marks ( GdkDrawable *pix, GdkGC *gc, const gdouble *mins, const gdouble *maxs, gint width, gint bottom, gdouble min, gdouble scale )
+{
+  gint i;
+  for ( i = 0; i < width; i++ ) {
+    if ( isnan(mins[i]) || isnan(maxs[i]) )
+      continue;
+    gint y_min = bottom - scale*(mins[i]-min);
+    gint y_max = bottom - scale*(maxs[i]-min);
+    gdk_draw_rectangle ( pix, gc, TRUE, i+MARGIN_X-2, y_max-2, 4, y_min-y_max+4 );
+  }
+}
+
 /**
  * Draws DEM points and a respresentative speed on the supplied pixmap
  *   (which is the elevations graph)
  */
-static void draw_dem_alt_speed_dist(VikTrack *tr,
+static void draw_dem_alt_speed_dist(const VikTrackProfile *profile,
+				    gdouble total_length,
 				    GdkDrawable *pix,
 				    GdkGC *alt_gc,
 				    GdkGC *speed_gc,
@@ -1286,25 +1394,23 @@ static void draw_dem_alt_speed_dist(VikTrack *tr,
 				    gboolean do_dem,
 				    gboolean do_speed)
 {
-  GList *iter;
   gdouble max_speed = 0;
-  gdouble total_length = vik_track_get_length_including_gaps(tr);
 
   // Calculate the max speed factor
   if (do_speed)
     max_speed = max_speed_in * 110 / 100;
 
-  gdouble dist = 0;
   gint h2 = height + MARGIN_Y; // Adjust height for x axis labelling offset
   gint achunk = chunksa[cia]*LINES;
 
-  for (iter = tr->trackpoints->next; iter; iter = iter->next) {
-    int x;
-    dist += vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-			     &(VIK_TRACKPOINT(iter->prev->data)->coord) );
-    x = (width * dist)/total_length + margin;
-    if (do_dem) {
-      gint16 elev = a_dems_get_elev_by_coord(&(VIK_TRACKPOINT(iter->data)->coord), VIK_DEM_INTERPOL_BEST);
+  if (do_dem) {
+    // Only one DEM lookup per column, using the trackpoint nearest to its centre
+    gint i;
+    for (i = 0; i < width; i++) {
+      VikTrackpoint *tp = vik_track_profile_get_tp_at_distance (profile, total_length * (i + 0.5) / width);
+      if (!tp)
+        continue;
+      gint16 elev = a_dems_get_elev_by_coord(&(tp->coord), VIK_DEM_INTERPOL_BEST);
       if ( elev != VIK_DEM_INVALID_ELEVATION ) {
 	// Convert into height units
 	if (a_vik_get_units_height () == VIK_UNITS_HEIGHT_FEET)
@@ -1316,17 +1422,21 @@ static void draw_dem_alt_speed_dist(VikTrack *tr,
 
         // consider chunk size
         int y_alt = h2 - ((height * elev)/achunk );
-        gdk_draw_rectangle(GDK_DRAWABLE(pix), alt_gc, TRUE, x-2, y_alt-2, 4, 4);
-      }
-    }
-    if (do_speed) {
-      // This is just a speed indicator - no actual values can be inferred by user
-      if (!isnan(VIK_TRACKPOINT(iter->data)->speed)) {
-        int y_speed = h2 - (height * VIK_TRACKPOINT(iter->data)->speed)/max_speed;
-        gdk_draw_rectangle(GDK_DRAWABLE(pix), speed_gc, TRUE, x-2, y_speed-2, 4, 4);
+        gdk_draw_rectangle(GDK_DRAWABLE(pix), alt_gc, TRUE, i+margin-2, y_alt-2, 4, 4);
       }
     }
   }
+  if (do_speed) {
+    // This is just a speed indicator - no actual values can be inferred by user
+    gdouble *mins = g_malloc ( sizeof(gdouble) * width );
+    gdouble *maxs = g_malloc ( sizeof(gdouble) * width );
+    gdouble *speeds = vik_track_profile_make_map ( profile, VIK_TRACK_PROFILE_GPS_SPEED_DISTANCE, width, mins, maxs );
+    if (speeds)
+      draw_column_marks ( pix, speed_gc, mins, maxs, width, h2, 0.0, height/max_speed );
+    g_free ( speeds );
+    g_free ( mins );
+    g_free ( maxs );
+  }
 }
 
 /**
@@ -1522,7 +1632,8 @@ static void draw_elevations (GtkWidget *image, VikTrack *tr, PropWidgets *widget
   if ( widgets->altitudes )
     g_free ( widgets->altitudes );
 
-  widgets->altitudes = vik_track_make_elevation_map ( tr, widgets->profile_width );
+  gdouble *lows, *highs;
+  widgets->altitudes = make_map ( widgets, VIK_TRACK_PROFILE_ELEVATION_DISTANCE, &lows, &highs );
 
   if ( widgets->altitudes == NULL )
     return;
@@ -1533,6 +1644,7 @@ static void draw_elevations (GtkWidget *image, VikTrack *tr, PropWidgets *widget
     // Convert altitudes into feet units
     for ( i = 0; i < widgets->profile_width; i++ ) {
       widgets->altitudes[i] = VIK_METERS_TO_FEET(widgets->altitudes[i]);
+      highs[i] = VIK_METERS_TO_FEET(highs[i]);
     }
   }
   // Otherwise leave in metres
@@ -1580,6 +1692,8 @@ static void draw_elevations (GtkWidget *image, VikTrack *tr, PropWidgets *widget
 
   /* draw elevations */
   guint height = MARGIN_Y+widgets->profile_height;
+  draw_column_extents ( GDK_DRAWABLE(pix), gtk_widget_get_style(window)->mid_gc[3], widgets->altitudes, highs, widgets->profile_width,
+                        height, mina, widgets->profile_height/(chunksa[widgets->cia]*LINES) );
   for ( i = 0; i < widgets->profile_width; i++ )
     if ( widgets->altitudes[i] == VIK_DEFAULT_ALTITUDE )
       gdk_draw_line ( GDK_DRAWABLE(pix), no_alt_info, 
@@ -1604,7 +1718,8 @@ static void draw_elevations (GtkWidget *image, VikTrack *tr, PropWidgets *widget
     if ( widgets->max_speed < 0.01 )
       widgets->max_speed = vik_track_get_max_speed(tr);
 
-    draw_dem_alt_speed_dist(tr,
+    draw_dem_alt_speed_dist(vik_track_get_profile(widgets->tr),
+			    widgets->track_length_inc_gaps,
 			    GDK_DRAWABLE(pix),
 			    dem_alt_gc,
 			    gps_speed_gc,
@@ -1627,13 +1742,15 @@ static void draw_elevations (GtkWidget *image, VikTrack *tr, PropWidgets *widget
 
   g_object_unref ( G_OBJECT(pix) );
   g_object_unref ( G_OBJECT(no_alt_info) );
+  g_free ( lows );
+  g_free ( highs );
 }
 
 /**
  * Draws representative speed on the supplied pixmap
  *   (which is the gradients graph)
  */
-static void draw_speed_dist(VikTrack *tr,
+static void draw_speed_dist(const VikTrackProfile *profile,
 				    GdkDrawable *pix,
 				    GdkGC *speed_gc,
 				    gdouble max_speed_in,
@@ -1642,27 +1759,22 @@ static void draw_speed_dist(VikTrack *tr,
 				    gint margin,
 				    gboolean do_speed)
 {
-  GList *iter;
   gdouble max_speed = 0;
-  gdouble total_length = vik_track_get_length_including_gaps(tr);
 
   // Calculate the max speed factor
   if (do_speed)
     max_speed = max_speed_in * 110 / 100;
 
-  gdouble dist = 0;
-  for (iter = tr->trackpoints->next; iter; iter = iter->next) {
-    int x;
-    dist += vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord),
-			     &(VIK_TRACKPOINT(iter->prev->data)->coord) );
-    x = (width * dist)/total_length + MARGIN_X;
-    if (do_speed) {
-      // This is just a speed indicator - no actual values can be inferred by user
-      if (!isnan(VIK_TRACKPOINT(iter->data)->speed)) {
-	int y_speed = height - (height * VIK_TRACKPOINT(iter->data)->speed)/max_speed;
-	gdk_draw_rectangle(GDK_DRAWABLE(pix), speed_gc, TRUE, x-2, y_speed-2, 4, 4);
-      }
-    }
+  if (do_speed) {
+    // This is just a speed indicator - no actual values can be inferred by user
+    gdouble *mins = g_malloc ( sizeof(gdouble) * width );
+    gdouble *maxs = g_malloc ( sizeof(gdouble) * width );
+    gdouble *speeds = vik_track_profile_make_map ( profile, VIK_TRACK_PROFILE_GPS_SPEED_DISTANCE, width, mins, maxs );
+    if (speeds)
+      draw_column_marks ( pix, speed_gc, mins, maxs, width, height, 0.0, height/max_speed );
+    g_free ( speeds );
+    g_free ( mins );
+    g_free ( maxs );
   }
 }
 
@@ -1677,7 +1789,7 @@ static void draw_gradients (GtkWidget *image, VikTrack *tr, PropWidgets *widgets
   if ( widgets->gradients )
     g_free ( widgets->gradients );
 
-  widgets->gradients = vik_track_make_gradient_map ( tr, widgets->profile_width );
+  widgets->gradients = make_map ( widgets, VIK_TRACK_PROFILE_GRADIENT_DISTANCE, NULL, NULL );
 
   if ( widgets->gradients == NULL )
     return;
@@ -1725,7 +1837,7 @@ static void draw_gradients (GtkWidget *image, VikTrack *tr, PropWidgets *widgets
     if ( widgets->max_speed < 0.01 )
       widgets->max_speed = vik_track_get_max_speed(tr);
 
-    draw_speed_dist(tr,
+    draw_speed_dist(vik_track_get_profile(widgets->tr),
 			    GDK_DRAWABLE(pix),
 			    gps_speed_gc,
 			    widgets->max_speed,
@@ -1768,38 +1880,23 @@ static void draw_vt ( GtkWidget *image, VikTrack *tr, PropWidgets *widgets)
   if ( widgets->speeds )
     g_free ( widgets->speeds );
 
-  widgets->speeds = vik_track_make_speed_map ( tr, widgets->profile_width );
+  gdouble *lows, *highs;
+  widgets->speeds = make_map ( widgets, VIK_TRACK_PROFILE_SPEED_TIME, &lows, &highs );
   if ( widgets->speeds == NULL )
     return;
 
   widgets->duration = vik_track_get_duration ( tr, TRUE );
   // Negative time or other problem
-  if ( widgets->duration <= 0 )
+  if ( widgets->duration <= 0 ) {
+    g_free ( lows );
+    g_free ( highs );
     return;
+  }
 
   // Convert into appropriate units
   vik_units_speed_t speed_units = a_vik_get_units_speed ();
-  switch (speed_units) {
-  case VIK_UNITS_SPEED_KILOMETRES_PER_HOUR:
-    for ( i = 0; i < widgets->profile_width; i++ ) {
-      widgets->speeds[i] = VIK_MPS_TO_KPH(widgets->speeds[i]);
-    }
-    break;
-  case VIK_UNITS_SPEED_MILES_PER_HOUR:
-    for ( i = 0; i < widgets->profile_width; i++ ) {
-      widgets->speeds[i] = VIK_MPS_TO_MPH(widgets->speeds[i]);
-    }
-    break;
-  case VIK_UNITS_SPEED_KNOTS:
-    for ( i = 0; i < widgets->profile_width; i++ ) {
-      widgets->speeds[i] = VIK_MPS_TO_KNOTS(widgets->speeds[i]);
-    }
-    break;
-  default:
-    // VIK_UNITS_SPEED_METRES_PER_SECOND:
-    // No need to convert as already in m/s
-    break;
-  }
+  convert_speeds ( widgets->speeds, widgets->profile_width, speed_units );
+  convert_speeds ( highs, widgets->profile_width, speed_units );
 
   GtkWidget *window = gtk_widget_get_toplevel (widgets->speed_box);
   GdkPixmap *pix = gdk_pixmap_new( gtk_widget_get_window(window), widgets->profile_width+MARGIN_X, widgets->profile_height+MARGIN_Y, -1 );
@@ -1849,6 +1946,8 @@ static void draw_vt ( GtkWidget *image, VikTrack *tr, PropWidgets *widgets)
 
   /* draw speeds */
   guint height = widgets->profile_height + MARGIN_Y;
+  draw_column_extents ( GDK_DRAWABLE(pix), gtk_widget_get_style(window)->mid_gc[3], widgets->speeds, highs, widgets->profile_width,
+                        height, mins, widgets->profile_height/(chunkss[widgets->cis]*LINES) );
   for ( i = 0; i < widgets->profile_width; i++ )
     gdk_draw_line ( GDK_DRAWABLE(pix), gtk_widget_get_style(window)->dark_gc[3],
                     i + MARGIN_X, height, i + MARGIN_X, height - widgets->profile_height*(widgets->speeds[i]-mins)/(chunkss[widgets->cis]*LINES) );
@@ -1860,32 +1959,13 @@ static void draw_vt ( GtkWidget *image, VikTrack *tr, PropWidgets *widgets)
     gdk_color_parse ( "red", &color );
     gdk_gc_set_rgb_fg_color ( gps_speed_gc, &color);
 
-    time_t beg_time = VIK_TRACKPOINT(tr->trackpoints->data)->timestamp;
-    time_t dur =  VIK_TRACKPOINT(g_list_last(tr->trackpoints)->data)->timestamp - beg_time;
-
-    GList *iter;
-    for (iter = tr->trackpoints; iter; iter = iter->next) {
-      gdouble gps_speed = VIK_TRACKPOINT(iter->data)->speed;
-      if (isnan(gps_speed))
-        continue;
-      switch (speed_units) {
-      case VIK_UNITS_SPEED_KILOMETRES_PER_HOUR:
-	gps_speed = VIK_MPS_TO_KPH(gps_speed);
-	break;
-      case VIK_UNITS_SPEED_MILES_PER_HOUR:
-	gps_speed = VIK_MPS_TO_MPH(gps_speed);
-	break;
-      case VIK_UNITS_SPEED_KNOTS:
-	gps_speed = VIK_MPS_TO_KNOTS(gps_speed);
-	break;
-      default:
-	// VIK_UNITS_SPEED_METRES_PER_SECOND:
-	// No need to convert as already in m/s
-	break;
-      }
-      int x = MARGIN_X + widgets->profile_width * (VIK_TRACKPOINT(iter->data)->timestamp - beg_time) / dur;
-      int y = height - widgets->profile_height*(gps_speed - mins)/(chunkss[widgets->cis]*LINES);
-      gdk_draw_rectangle(GDK_DRAWABLE(pix), gps_speed_gc, TRUE, x-2, y-2, 4, 4);
+    gdouble *gps_speeds = vik_track_profile_make_map ( vik_track_get_profile(widgets->tr), VIK_TRACK_PROFILE_GPS_SPEED_TIME, widgets->profile_width, lows, highs );
+    if ( gps_speeds ) {
+      convert_speeds ( lows, widgets->profile_width, speed_units );
+      convert_speeds ( highs, widgets->profile_width, speed_units );
+      draw_column_marks ( GDK_DRAWABLE(pix), gps_speed_gc, lows, highs, widgets->profile_width,
+                          height, mins, widgets->profile_height/(chunkss[widgets->cis]*LINES) );
+      g_free ( gps_speeds );
     }
     g_object_unref ( G_OBJECT(gps_speed_gc) );
   }
@@ -1894,6 +1974,8 @@ static void draw_vt ( GtkWidget *image, VikTrack *tr, PropWidgets *widgets)
   gdk_draw_rectangle(GDK_DRAWABLE(pix), gtk_widget_get_style(window)->black_gc, FALSE, MARGIN_X, MARGIN_Y, widgets->profile_width-1, widgets->profile_height-1);
 
   g_object_unref ( G_OBJECT(pix) );
+  g_free ( lows );
+  g_free ( highs );
 }
 
 /**
@@ -1907,7 +1989,7 @@ static void draw_dt ( GtkWidget *image, VikTrack *tr, PropWidgets *widgets )
   if ( widgets->distances )
     g_free ( widgets->distances );
 
-  widgets->distances = vik_track_make_distance_map ( tr, widgets->profile_width );
+  widgets->distances = make_map ( widgets, VIK_TRACK_PROFILE_DISTANCE_TIME, NULL, NULL );
   if ( widgets->distances == NULL )
     return;
 
@@ -2028,7 +2110,8 @@ static void draw_et ( GtkWidget *image, VikTrack *tr, PropWidgets *widgets )
   if ( widgets->ats )
     g_free ( widgets->ats );
 
-  widgets->ats = vik_track_make_elevation_time_map ( tr, widgets->profile_width );
+  gdouble *lows, *highs;
+  widgets->ats = make_map ( widgets, VIK_TRACK_PROFILE_ELEVATION_TIME, &lows, &highs );
 
   if ( widgets->ats == NULL )
     return;
@@ -2039,6 +2122,7 @@ static void draw_et ( GtkWidget *image, VikTrack *tr, PropWidgets *widgets )
     // Convert altitudes into feet units
     for ( i = 0; i < widgets->profile_width; i++ ) {
       widgets->ats[i] = VIK_METERS_TO_FEET(widgets->ats[i]);
+      highs[i] = VIK_METERS_TO_FEET(highs[i]);
     }
   }
   // Otherwise leave in metres
@@ -2052,8 +2136,11 @@ static void draw_et ( GtkWidget *image, VikTrack *tr, PropWidgets *widgets )
 
   widgets->duration = vik_track_get_duration ( widgets->tr, TRUE );
   // Negative time or other problem
-  if ( widgets->duration <= 0 )
+  if ( widgets->duration <= 0 ) {
+    g_free ( lows );
+    g_free ( highs );
     return;
+  }
 
   GtkWidget *window = gtk_widget_get_toplevel (widgets->elev_time_box);
   GdkPixmap *pix = gdk_pixmap_new( gtk_widget_get_window(window), widgets->profile_width+MARGIN_X, widgets->profile_height+MARGIN_Y, -1 );
@@ -2087,6 +2174,8 @@ static void draw_et ( GtkWidget *image, VikTrack *tr, PropWidgets *widgets )
 
   /* draw elevations */
   guint height = widgets->profile_height + MARGIN_Y;
+  draw_column_extents ( GDK_DRAWABLE(pix), gtk_widget_get_style(window)->mid_gc[3], widgets->ats, highs, widgets->profile_width,
+                        height, mina, widgets->profile_height/(chunksa[widgets->ciat]*LINES) );
   for ( i = 0; i < widgets->profile_width; i++ )
     gdk_draw_line ( GDK_DRAWABLE(pix), gtk_widget_get_style(window)->dark_gc[3],
                     i + MARGIN_X, height, i + MARGIN_X, height-widgets->profile_height*(widgets->ats[i]-mina)/(chunksa[widgets->ciat]*LINES) );
@@ -2102,8 +2191,10 @@ static void draw_et ( GtkWidget *image, VikTrack *tr, PropWidgets *widgets )
     gint achunk = chunksa[widgets->ciat]*LINES;
 
     for ( i = 0; i < widgets->profile_width; i++ ) {
-      // This could be slow doing this each time...
-      VikTrackpoint *tp = vik_track_get_closest_tp_by_percentage_time ( widgets->tr, ((gdouble)i/(gdouble)widgets->profile_width), NULL );
+      VikTrackpoint *tp = vik_track_profile_get_tp_at_time ( vik_track_get_profile(widgets->tr), widgets->duration*(gdouble)i/(gdouble)widgets->profile_width );
+      // Unordered timestamps can't be profiled
+      if ( !tp )
+        tp = vik_track_get_closest_tp_by_percentage_time ( widgets->tr, ((gdouble)i/(gdouble)widgets->profile_width), NULL );
       if ( tp ) {
         gint16 elev = a_dems_get_elev_by_coord(&(tp->coord), VIK_DEM_INTERPOL_SIMPLE);
         if ( elev != VIK_DEM_INVALID_ELEVATION ) {
@@ -2146,6 +2237,8 @@ static void draw_et ( GtkWidget *image, VikTrack *tr, PropWidgets *widgets )
   gdk_draw_rectangle(GDK_DRAWABLE(pix), gtk_widget_get_style(window)->black_gc, FALSE, MARGIN_X, MARGIN_Y, widgets->profile_width-1, widgets->profile_height-1);
 
   g_object_unref ( G_OBJECT(pix) );
+  g_free ( lows );
+  g_free ( highs );
 }
 
 /**
@@ -2160,33 +2253,15 @@ static void draw_sd ( GtkWidget *image, VikTrack *tr, PropWidgets *widgets)
   if ( widgets->speeds_dist )
     g_free ( widgets->speeds_dist );
 
-  widgets->speeds_dist = vik_track_make_speed_dist_map ( tr, widgets->profile_width );
+  gdouble *lows, *highs;
+  widgets->speeds_dist = make_map ( widgets, VIK_TRACK_PROFILE_SPEED_DISTANCE, &lows, &highs );
   if ( widgets->speeds_dist == NULL )
     return;
 
   // Convert into appropriate units
   vik_units_speed_t speed_units = a_vik_get_units_speed ();
-  switch (speed_units) {
-  case VIK_UNITS_SPEED_KILOMETRES_PER_HOUR:
-    for ( i = 0; i < widgets->profile_width; i++ ) {
-      widgets->speeds_dist[i] = VIK_MPS_TO_KPH(widgets->speeds_dist[i]);
-    }
-    break;
-  case VIK_UNITS_SPEED_MILES_PER_HOUR:
-    for ( i = 0; i < widgets->profile_width; i++ ) {
-      widgets->speeds_dist[i] = VIK_MPS_TO_MPH(widgets->speeds_dist[i]);
-    }
-    break;
-  case VIK_UNITS_SPEED_KNOTS:
-    for ( i = 0; i < widgets->profile_width; i++ ) {
-      widgets->speeds_dist[i] = VIK_MPS_TO_KNOTS(widgets->speeds_dist[i]);
-    }
-    break;
-  default:
-    // VIK_UNITS_SPEED_METRES_PER_SECOND:
-    // No need to convert as already in m/s
-    break;
-  }
+  convert_speeds ( widgets->speeds_dist, widgets->profile_width, speed_units );
+  convert_speeds ( highs, widgets->profile_width, speed_units );
 
   GtkWidget *window = gtk_widget_get_toplevel (widgets->speed_dist_box);
   GdkPixmap *pix = gdk_pixmap_new( gtk_widget_get_window(window), widgets->profile_width+MARGIN_X, widgets->profile_height+MARGIN_Y, -1 );
@@ -2237,6 +2312,8 @@ static void draw_sd ( GtkWidget *image, VikTrack *tr, PropWidgets *widgets)
 
   /* draw speeds */
   guint height = widgets->profile_height + MARGIN_Y;
+  draw_column_extents ( GDK_DRAWABLE(pix), gtk_widget_get_style(window)->mid_gc[3], widgets->speeds_dist, highs, widgets->profile_width,
+                        height, mins, widgets->profile_height/(chunkss[widgets->cisd]*LINES) );
   for ( i = 0; i < widgets->profile_width; i++ )
     gdk_draw_line ( GDK_DRAWABLE(pix), gtk_widget_get_style(window)->dark_gc[3],
                     i + MARGIN_X, height, i + MARGIN_X, height - widgets->profile_height*(widgets->speeds_dist[i]-mins)/(chunkss[widgets->cisd]*LINES) );
@@ -2249,33 +2326,13 @@ static void draw_sd ( GtkWidget *image, VikTrack *tr, PropWidgets *widgets)
     gdk_color_parse ( "red", &color );
     gdk_gc_set_rgb_fg_color ( gps_speed_gc, &color);
 
-    gdouble dist = vik_track_get_length_including_gaps(tr);
-    gdouble dist_tp = 0.0;
-
-    GList *iter = tr->trackpoints;
-    for (iter = iter->next; iter; iter = iter->next) {
-      gdouble gps_speed = VIK_TRACKPOINT(iter->data)->speed;
-      if (isnan(gps_speed))
-        continue;
-      switch (speed_units) {
-      case VIK_UNITS_SPEED_KILOMETRES_PER_HOUR:
-	gps_speed = VIK_MPS_TO_KPH(gps_speed);
-	break;
-      case VIK_UNITS_SPEED_MILES_PER_HOUR:
-	gps_speed = VIK_MPS_TO_MPH(gps_speed);
-	break;
-      case VIK_UNITS_SPEED_KNOTS:
-	gps_speed = VIK_MPS_TO_KNOTS(gps_speed);
-	break;
-      default:
-	// VIK_UNITS_SPEED_METRES_PER_SECOND:
-	// No need to convert as already in m/s
-	break;
-      }
-      dist_tp += vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord), &(VIK_TRACKPOINT(iter->prev->data)->coord) );
-      int x = MARGIN_X + (widgets->profile_width * dist_tp / dist);
-      int y = height - widgets->profile_height*(gps_speed - mins)/(chunkss[widgets->cisd]*LINES);
-      gdk_draw_rectangle(GDK_DRAWABLE(pix), gps_speed_gc, TRUE, x-2, y-2, 4, 4);
+    gdouble *gps_speeds = vik_track_profile_make_map ( vik_track_get_profile(widgets->tr), VIK_TRACK_PROFILE_GPS_SPEED_DISTANCE, widgets->profile_width, lows, highs );
+    if ( gps_speeds ) {
+      convert_speeds ( lows, widgets->profile_width, speed_units );
+      convert_speeds ( highs, widgets->profile_width, speed_units );
+      draw_column_marks ( GDK_DRAWABLE(pix), gps_speed_gc, lows, highs, widgets->profile_width,
+                          height, mins, widgets->profile_height/(chunkss[widgets->cisd]*LINES) );
+      g_free ( gps_speeds );
     }
     g_object_unref ( G_OBJECT(gps_speed_gc) );
   }
@@ -2284,6 +2341,8 @@ static void draw_sd ( GtkWidget *image, VikTrack *tr, PropWidgets *widgets)
   gdk_draw_rectangle(GDK_DRAWABLE(pix), gtk_widget_get_style(window)->black_gc, FALSE, MARGIN_X, MARGIN_Y, widgets->profile_width-1, widgets->profile_height-1);
 
   g_object_unref ( G_OBJECT(pix) );
+  g_free ( lows );
+  g_free ( highs );
 }
 #undef LINES
 
@@ -2644,7 +2703,7 @@ GtkWidget *vik_trw_layer_create_profile ( GtkWidget *window, PropWidgets *widget
   GtkWidget *eventbox;
 
   // First allocation
-  widgets->altitudes = vik_track_make_elevation_map ( widgets->tr, widgets->profile_width );
+  widgets->altitudes = make_map ( widgets, VIK_TRACK_PROFILE_ELEVATION_DISTANCE, NULL, NULL );
 
   if ( widgets->altitudes == NULL ) {
     *min_alt = *max_alt = VIK_DEFAULT_ALTITUDE;
@@ -2677,7 +2736,7 @@ GtkWidget *vik_trw_layer_create_gradient ( GtkWidget *window, PropWidgets *widge
   GtkWidget *eventbox;
 
   // First allocation
-  widgets->gradients = vik_track_make_gradient_map ( widgets->tr, widgets->profile_width );
+  widgets->gradients = make_map ( widgets, VIK_TRACK_PROFILE_GRADIENT_DISTANCE, NULL, NULL );
 
   if ( widgets->gradients == NULL ) {
     return NULL;
@@ -2707,7 +2766,7 @@ GtkWidget *vik_trw_layer_create_vtdiag ( GtkWidget *window, PropWidgets *widgets
   GtkWidget *eventbox;
 
   // First allocation
-  widgets->speeds = vik_track_make_speed_map ( widgets->tr, widgets->profile_width );
+  widgets->speeds = make_map ( widgets, VIK_TRACK_PROFILE_SPEED_TIME, NULL, NULL );
   if ( widgets->speeds == NULL )
     return NULL;
 
@@ -2758,7 +2817,7 @@ GtkWidget *vik_trw_layer_create_dtdiag ( GtkWidget *window, PropWidgets *widgets
   GtkWidget *eventbox;
 
   // First allocation
-  widgets->distances = vik_track_make_distance_map ( widgets->tr, widgets->profile_width );
+  widgets->distances = make_map ( widgets, VIK_TRACK_PROFILE_DISTANCE_TIME, NULL, NULL );
   if ( widgets->distances == NULL )
     return NULL;
 
@@ -2787,7 +2846,7 @@ GtkWidget *vik_trw_layer_create_etdiag ( GtkWidget *window, PropWidgets *widgets
   GtkWidget *eventbox;
 
   // First allocation
-  widgets->ats = vik_track_make_elevation_time_map ( widgets->tr, widgets->profile_width );
+  widgets->ats = make_map ( widgets, VIK_TRACK_PROFILE_ELEVATION_TIME, NULL, NULL );
   if ( widgets->ats == NULL )
     return NULL;
 
@@ -2815,7 +2874,7 @@ GtkWidget *vik_trw_layer_create_sddiag ( GtkWidget *window, PropWidgets *widgets
   GtkWidget *eventbox;
 
   // First allocation
-  widgets->speeds_dist = vik_track_make_speed_dist_map ( widgets->tr, widgets->profile_width );
+  widgets->speeds_dist = make_map ( widgets, VIK_TRACK_PROFILE_SPEED_DISTANCE, NULL, NULL );
   if ( widgets->speeds_dist == NULL )
     return NULL;
 
@@ -2912,6 +2971,7 @@ static void propwin_response_cb( GtkDialog *dialog, gint resp, PropWidgets *widg
         VikTrack **tracks = vik_track_split_into_segments(tr, &ntracks);
         gchar *new_tr_name;
         guint i;
+        vik_trw_layer_begin_bulk_insert ( vtl );
         for ( i = 0; i < ntracks; i++ )
         {
           if ( tracks[i] ) {
@@ -2936,8 +2996,8 @@ static void propwin_response_cb( GtkDialog *dialog, gint resp, PropWidgets *widg
             vik_trw_layer_delete_route ( vtl, tr );
           else
             vik_trw_layer_delete_track ( vtl, tr );
-          vik_layer_emit_update ( VIK_LAYER(vtl) ); /* chase thru the hoops */
         }
+        vik_trw_layer_commit_bulk_insert ( vtl ); /* chase thru the hoops */
       }
       break;
     case VIK_TRW_LAYER_PROPWIN_SPLIT_MARKER:
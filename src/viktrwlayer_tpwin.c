@@ -134,6 +134,7 @@ static void tpwin_sync_alt_to_tp ( VikTrwLayerTpwin *tpwin )
       tpwin->cur_tp->altitude = gtk_spin_button_get_value ( tpwin->alt );
       g_critical("Houston, we've had a problem. height=%d", height_units);
     }
+    gtk_dialog_response ( GTK_DIALOG(tpwin), VIK_TRW_LAYER_TPWIN_DATA_CHANGED );
   }
 }
 
@@ -146,6 +147,7 @@ static void tpwin_sync_ts_to_tp ( VikTrwLayerTpwin *tpwin )
     tpwin->cur_tp->timestamp = gtk_spin_button_get_value_as_int ( tpwin->ts );
 
     tpwin_update_times ( tpwin, tpwin->cur_tp );
+    gtk_dialog_response ( GTK_DIALOG(tpwin), VIK_TRW_LAYER_TPWIN_DATA_CHANGED );
   }
 }
 
@@ -194,6 +196,7 @@ static void tpwin_sync_time_to_tp ( GtkWidget* widget, GdkEventButton *event, Vi
   tpwin->cur_tp->timestamp = mytime;
   tpwin->cur_tp->has_timestamp = TRUE;
   // TODO: consider warning about unsorted times?
+  gtk_dialog_response ( GTK_DIALOG(tpwin), VIK_TRW_LAYER_TPWIN_DATA_CHANGED );
 
   // Clear the previous 'Add' image as now a time is set
   if ( gtk_button_get_image ( GTK_BUTTON(tpwin->time) ) )
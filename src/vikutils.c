@@ -37,7 +37,7 @@
 #include "settings.h"
 #include "ui_util.h"
 #include "dir.h"
-#include "misc/kdtree.h"
+#include "vikkdindex.h"
 
 #define FMT_MAX_NUMBER_CODES 9
 
@@ -570,15 +570,17 @@ gchar *vu_get_canonical_filename ( VikLayer *vl, const gchar *filename )
   return canonical;
 }
 
-static struct kdtree *kd = NULL;
+static VikKdIndex *kd = NULL;
 
 /**
  * load_ll_tz_dir
  * @dir: The directory from which to load the latlontz.txt file
+ * @positions: Array of lat, lon values to append to
+ * @timezones: Array of timezone strings to append to
  *
  * Returns: The number of elements within the latlontz.txt loaded
  */
-static gint load_ll_tz_dir ( const gchar *dir )
+static gint load_ll_tz_dir ( const gchar *dir, GArray *positions, GPtrArray *timezones )
 {
 	gint inserted = 0;
 	gchar *lltz = g_build_filename ( dir, "latlontz.txt", NULL );
@@ -593,18 +595,13 @@ static gint load_ll_tz_dir ( const gchar *dir )
 				guint nn = g_strv_length ( components );
 				if ( nn == 3 ) {
 					double pt[2] = { g_ascii_strtod (components[0], NULL), g_ascii_strtod (components[1], NULL) };
-					gchar *timezone = g_strchomp ( components[2] );
-					if ( kd_insert ( kd, pt, timezone ) )
-						g_critical ( "Insertion problem of %s for line %ld of latlontz.txt", timezone, line_num );
-					else
-						inserted++;
-					// NB Don't free timezone as it's part of the kdtree data now
-					g_free ( components[0] );
-					g_free ( components[1] );
+					g_array_append_vals ( positions, pt, 2 );
+					g_ptr_array_add ( timezones, g_strdup ( g_strchomp ( components[2] ) ) );
+					inserted++;
 				} else {
 					g_warning ( "Line %ld of latlontz.txt does not have 3 parts", line_num );
 				}
-				g_free ( components );
+				g_strfreev ( components );
 			}
 			fclose ( ff );
 		}
@@ -617,10 +614,37 @@ static gint load_ll_tz_dir ( const gchar *dir )
 	return inserted;
 }
 
+/**
+ * ll_tz_stamp:
+ *
+ * Returns: A value that changes whenever any of the latlontz.txt files is changed, added or removed
+ */
+static guint64 ll_tz_stamp ( gchar **data_dirs )
+{
+	guint64 stamp = 0;
+	guint n_data_dirs = g_strv_length ( data_dirs );
+	for (; n_data_dirs > 0; n_data_dirs--) {
+		gchar *lltz = g_build_filename ( data_dirs[n_data_dirs-1], "latlontz.txt", NULL );
+		GStatBuf stat_buf;
+		if ( g_stat ( lltz, &stat_buf ) == 0 ) {
+			stamp = stamp * 31 + g_str_hash ( lltz );
+			stamp = stamp * 31 + (guint64)stat_buf.st_size;
+			stamp = stamp * 31 + (guint64)stat_buf.st_mtime;
+		}
+		g_free ( lltz );
+	}
+	return stamp;
+}
+
+#define VIK_LL_TZ_SNAPSHOT "latlontz.kdi"
+
 /**
  * vu_setup_lat_lon_tz_lookup:
  *
  * Can be called multiple times but only initializes the lookup once
+ *
+ * The lookup is memory mapped from a snapshot in the Viking directory when it is up to date,
+ *  otherwise the text files are parsed and the snapshot is regenerated for next time.
  */
 void vu_setup_lat_lon_tz_lookup ()
 {
@@ -628,20 +652,34 @@ void vu_setup_lat_lon_tz_lookup ()
 	if ( kd )
 		return;
 
-	kd = kd_create(2);
-
 	// Look in the directories of data path
 	gchar **data_dirs = a_get_viking_data_path();
-	guint loaded = 0;
-	// Process directories in reverse order for priority
-	guint n_data_dirs = g_strv_length ( data_dirs );
-	for (; n_data_dirs > 0; n_data_dirs--) {
-		loaded += load_ll_tz_dir(data_dirs[n_data_dirs-1]);
+	guint64 stamp = ll_tz_stamp ( data_dirs );
+	gchar *snapshot = g_build_filename ( a_get_viking_dir(), VIK_LL_TZ_SNAPSHOT, NULL );
+
+	kd = vik_kd_index_new_from_file ( snapshot, stamp );
+	if ( !kd ) {
+		GArray *positions = g_array_new ( FALSE, FALSE, sizeof(gdouble) );
+		GPtrArray *timezones = g_ptr_array_new_with_free_func ( g_free );
+		guint loaded = 0;
+		// Process directories in reverse order for priority
+		guint n_data_dirs = g_strv_length ( data_dirs );
+		for (; n_data_dirs > 0; n_data_dirs--) {
+			loaded += load_ll_tz_dir(data_dirs[n_data_dirs-1], positions, timezones);
+		}
+
+		kd = vik_kd_index_new ( (gdouble*)positions->data, (const gchar * const *)timezones->pdata, loaded );
+		g_array_free ( positions, TRUE );
+		g_ptr_array_free ( timezones, TRUE );
+
+		if ( loaded )
+			(void)vik_kd_index_save ( kd, snapshot, stamp );
 	}
+	g_free ( snapshot );
 	g_strfreev ( data_dirs );
 
-	g_debug ( "%s: Loaded %d elements", __FUNCTION__, loaded );
-	if ( loaded == 0 )
+	g_debug ( "%s: Loaded %d elements", __FUNCTION__, vik_kd_index_get_count ( kd ) );
+	if ( vik_kd_index_get_count ( kd ) == 0 )
 		g_critical ( "%s: No lat/lon/timezones loaded", __FUNCTION__ );
 }
 
@@ -653,19 +691,8 @@ void vu_setup_lat_lon_tz_lookup ()
  */
 void vu_finalize_lat_lon_tz_lookup ()
 {
-	if ( kd ) {
-		kd_data_destructor ( kd, g_free );
-		kd_free ( kd );
-	}
-}
-
-static double dist_sq( double *a1, double *a2, int dims ) {
-  double dist_sq = 0, diff;
-  while( --dims >= 0 ) {
-    diff = (a1[dims] - a2[dims]);
-    dist_sq += diff*diff;
-  }
-  return dist_sq;
+	vik_kd_index_free ( kd );
+	kd = NULL;
 }
 
 static gchar* time_string_adjusted ( time_t *time, gint offset_s )
@@ -708,6 +735,7 @@ static gchar* time_string_tz ( time_t *time, const gchar *format, GTimeZone *tz
  *
  * Use the k-d tree method (http://en.wikipedia.org/wiki/Kd-tree) to quickly retreive
  *  the nearest location to the given position.
+ * No memory is allocated, so this is suitable to be called for every trackpoint.
  */
 gchar* vu_get_tz_at_location ( const VikCoord* vc )
 {
@@ -723,21 +751,9 @@ gchar* vu_get_tz_at_location ( const VikCoord* vc )
 	if ( !a_settings_get_double(VIK_SETTINGS_NEAREST_TZ_FACTOR, &nearest) )
 		nearest = 1.0;
 
-	struct kdres *presults = kd_nearest_range ( kd, pt, nearest );
-	while( !kd_res_end( presults ) ) {
-		double pos[2];
-		gchar *ans = (gchar*)kd_res_item ( presults, pos );
-		// compute the distance of the current result from the pt
-		double dist = sqrt( dist_sq( pt, pos, 2 ) );
-		if ( dist < nearest ) {
-			//printf( "NEARER node at (%.3f, %.3f, %.3f) is %.3f away is %s\n", pos[0], pos[1], pos[2], dist, ans );
-			nearest = dist;
-			tz = ans;
-		}
-		kd_res_next ( presults );
-	}
-	g_debug ( "TZ lookup found %d results - picked %s", kd_res_size(presults), tz );
-	kd_res_free ( presults );
+	gint found = vik_kd_index_nearest ( kd, pt, nearest, &nearest );
+	if ( found >= 0 )
+		tz = (gchar*)vik_kd_index_get_name ( kd, found );
 
 	return tz;
 }
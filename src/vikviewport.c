@@ -50,6 +50,7 @@
 #include "globals.h"
 #include "settings.h"
 #include "dialog.h"
+#include "perfstats.h"
 
 #define MERCATOR_FACTOR(x) ( (65536.0 / 180 / (x)) * 256.0 )
 
@@ -105,10 +106,19 @@ struct _VikViewport {
   /* subset of coord types. lat lon can be plotted in 2 ways, google or exp. */
   VikViewportDrawMode drawmode;
 
-  /* trigger stuff */
-  gpointer trigger;
-  GdkPixmap *snapshot_buffer;
-  gboolean half_drawn;
+  // Snapshots of the buffer part way through drawing the layers (LayerCacheEntry), most recently used first
+  GQueue *layer_cache;
+  guint layer_cache_max;
+  gboolean layer_cache_usable;
+  guint64 layer_cache_base;
+  // The view the snapshots were drawn for
+  VikCoord layer_cache_center;
+  gdouble layer_cache_xmpp, layer_cache_ympp;
+  gint layer_cache_width, layer_cache_height;
+  VikViewportDrawMode layer_cache_drawmode;
+
+  // Only for off-screen viewports: the window that determines the drawing depth
+  GdkWindow *offscreen_window;
 };
 
 static gdouble
@@ -161,12 +171,74 @@ VikViewport *vik_viewport_new ()
   return vv;
 }
 
+/**
+ * vik_viewport_new_offscreen:
+ * @vvp: The (realized) viewport to copy the view from
+ *
+ * Create a viewport that is not shown, but has the same view (position, zoom, colours, etc...) as @vvp
+ *  and so layers can be drawn into it, e.g. for generating images of any part of the map,
+ *  without disturbing the window.
+ *
+ * Free with g_object_unref()
+ */
+VikViewport *vik_viewport_new_offscreen ( VikViewport *vvp, gint width, gint height )
+{
+  VikViewport *off = vik_viewport_new ();
+  g_object_ref_sink ( off );
+
+  off->offscreen_window = g_object_ref ( gtk_widget_get_window(GTK_WIDGET(vvp)) );
+  off->coord_mode = vvp->coord_mode;
+  off->drawmode = vvp->drawmode;
+  off->center = vvp->center;
+  off->xmpp = vvp->xmpp;
+  off->ympp = vvp->ympp;
+  off->xmfactor = vvp->xmfactor;
+  off->ymfactor = vvp->ymfactor;
+  off->draw_scale = vvp->draw_scale;
+  off->draw_centermark = vvp->draw_centermark;
+  off->draw_highlight = vvp->draw_highlight;
+
+  vik_viewport_configure_manually ( off, width, height );
+
+  off->background_gc = vik_viewport_new_gc ( off, DEFAULT_BACKGROUND_COLOR, 1 );
+  gdk_gc_copy ( off->background_gc, vvp->background_gc );
+  off->background_color = vvp->background_color;
+  off->highlight_gc = vik_viewport_new_gc ( off, DEFAULT_HIGHLIGHT_COLOR, 1 );
+  gdk_gc_copy ( off->highlight_gc, vvp->highlight_gc );
+  off->highlight_color = vvp->highlight_color;
+  off->scale_bg_gc = vik_viewport_new_gc ( off, "grey", 3 );
+
+  viewport_utm_zone_check ( off );
+  return off;
+}
+
+/**
+ * vik_viewport_is_offscreen:
+ *
+ * Returns: TRUE if created by vik_viewport_new_offscreen()
+ */
+gboolean vik_viewport_is_offscreen ( VikViewport *vvp )
+{
+  return vvp->offscreen_window != NULL;
+}
+
+/**
+ * The window that buffers and GCs are made for
+ */
+static GdkWindow *viewport_window ( VikViewport *vvp )
+{
+  if ( vvp->offscreen_window )
+    return vvp->offscreen_window;
+  return gtk_widget_get_window(GTK_WIDGET(vvp));
+}
+
 #define VIK_SETTINGS_VIEW_LAST_LATITUDE "viewport_last_latitude"
 #define VIK_SETTINGS_VIEW_LAST_LONGITUDE "viewport_last_longitude"
 #define VIK_SETTINGS_VIEW_LAST_ZOOM_X "viewport_last_zoom_xpp"
 #define VIK_SETTINGS_VIEW_LAST_ZOOM_Y "viewport_last_zoom_ypp"
 #define VIK_SETTINGS_VIEW_HISTORY_SIZE "viewport_history_size"
 #define VIK_SETTINGS_VIEW_HISTORY_DIFF_DIST "viewport_history_diff_dist"
+#define VIK_SETTINGS_VIEW_LAYER_CACHE_SIZE "viewport_layer_cache_size"
 
 static void
 vik_viewport_init ( VikViewport *vvp )
@@ -226,9 +298,14 @@ vik_viewport_init ( VikViewport *vvp )
   vvp->draw_centermark = TRUE;
   vvp->draw_highlight = TRUE;
 
-  vvp->trigger = NULL;
-  vvp->snapshot_buffer = NULL;
-  vvp->half_drawn = FALSE;
+  vvp->offscreen_window = NULL;
+
+  vvp->layer_cache = g_queue_new ();
+  vvp->layer_cache_max = 6;
+  if ( a_settings_get_integer ( VIK_SETTINGS_VIEW_LAYER_CACHE_SIZE, &tmp ) )
+    vvp->layer_cache_max = tmp > 0 ? tmp : 0;
+  vvp->layer_cache_usable = FALSE;
+  vvp->layer_cache_base = 0;
 
   // Initiate center history
   update_centers ( vvp );
@@ -264,6 +341,8 @@ void vik_viewport_set_background_color ( VikViewport *vvp, const gchar *colornam
     gdk_gc_set_rgb_fg_color ( vvp->background_gc, &(vvp->background_color) );
   else
     g_warning("%s: Failed to parse color '%s'", __FUNCTION__, colorname);
+  // Cached drawing includes the background
+  vik_viewport_layer_cache_clear ( vvp );
 }
 
 void vik_viewport_set_background_gdkcolor ( VikViewport *vvp, GdkColor *color )
@@ -271,6 +350,7 @@ void vik_viewport_set_background_gdkcolor ( VikViewport *vvp, GdkColor *color )
   g_assert ( vvp && vvp->background_gc );
   vvp->background_color = *color;
   gdk_gc_set_rgb_fg_color ( vvp->background_gc, color );
+  vik_viewport_layer_cache_clear ( vvp );
 }
 
 GdkColor *vik_viewport_get_highlight_gdkcolor ( VikViewport *vvp )
@@ -318,7 +398,7 @@ GdkGC *vik_viewport_new_gc ( VikViewport *vvp, const gchar *colorname, gint thic
   GdkGC *rv = NULL;
   GdkColor color;
 
-  rv = gdk_gc_new ( gtk_widget_get_window(GTK_WIDGET(vvp)) );
+  rv = gdk_gc_new ( viewport_window(vvp) );
   if ( gdk_color_parse ( colorname, &color ) )
     gdk_gc_set_rgb_fg_color ( rv, &color );
   else
@@ -331,7 +411,7 @@ GdkGC *vik_viewport_new_gc_from_color ( VikViewport *vvp, GdkColor *color, gint
 {
   GdkGC *rv;
 
-  rv = gdk_gc_new ( gtk_widget_get_window(GTK_WIDGET(vvp)) );
+  rv = gdk_gc_new ( viewport_window(vvp) );
   gdk_gc_set_rgb_fg_color ( rv, color );
   gdk_gc_set_line_attributes ( rv, thickness, GDK_LINE_SOLID, GDK_CAP_ROUND, GDK_JOIN_ROUND );
   return rv;
@@ -347,12 +427,7 @@ void vik_viewport_configure_manually ( VikViewport *vvp, gint width, guint heigh
 
   if ( vvp->scr_buffer )
     g_object_unref ( G_OBJECT ( vvp->scr_buffer ) );
-  vvp->scr_buffer = gdk_pixmap_new ( gtk_widget_get_window(GTK_WIDGET(vvp)), vvp->width, vvp->height, -1 );
-
-  /* TODO trigger: only if this is enabled !!! */
-  if ( vvp->snapshot_buffer )
-    g_object_unref ( G_OBJECT ( vvp->snapshot_buffer ) );
-  vvp->snapshot_buffer = gdk_pixmap_new ( gtk_widget_get_window(GTK_WIDGET(vvp)), vvp->width, vvp->height, -1 );
+  vvp->scr_buffer = gdk_pixmap_new ( viewport_window(vvp), vvp->width, vvp->height, -1 );
 }
 
 
@@ -378,13 +453,6 @@ gboolean vik_viewport_configure ( VikViewport *vvp )
 
   vvp->scr_buffer = gdk_pixmap_new ( gtk_widget_get_window(GTK_WIDGET(vvp)), vvp->width, vvp->height, -1 );
 
-  /* TODO trigger: only if enabled! */
-  if ( vvp->snapshot_buffer )
-    g_object_unref ( G_OBJECT ( vvp->snapshot_buffer ) );
-
-  vvp->snapshot_buffer = gdk_pixmap_new ( gtk_widget_get_window(GTK_WIDGET(vvp)), vvp->width, vvp->height, -1 );
-  /* TODO trigger */
-
   /* this is down here so it can get a GC (necessary?) */
   if ( !vvp->background_gc )
   {
@@ -409,7 +477,7 @@ static void viewport_finalize ( GObject *gob )
 
   g_return_if_fail ( vvp != NULL );
 
-  if ( a_vik_get_startup_method ( ) == VIK_STARTUP_METHOD_LAST_LOCATION ) {
+  if ( a_vik_get_startup_method ( ) == VIK_STARTUP_METHOD_LAST_LOCATION && !vvp->offscreen_window ) {
     struct LatLon ll;
     vik_coord_to_latlon ( &(vvp->center), &ll );
     a_settings_set_double ( VIK_SETTINGS_VIEW_LAST_LATITUDE, ll.lat );
@@ -424,8 +492,8 @@ static void viewport_finalize ( GObject *gob )
   if ( vvp->scr_buffer )
     g_object_unref ( G_OBJECT ( vvp->scr_buffer ) );
 
-  if ( vvp->snapshot_buffer )
-    g_object_unref ( G_OBJECT ( vvp->snapshot_buffer ) );
+  vik_viewport_layer_cache_clear ( vvp );
+  g_queue_free ( vvp->layer_cache );
 
   if ( vvp->background_gc )
     g_object_unref ( G_OBJECT ( vvp->background_gc ) );
@@ -438,6 +506,9 @@ static void viewport_finalize ( GObject *gob )
     vvp->scale_bg_gc = NULL;
   }
 
+  if ( vvp->offscreen_window )
+    g_object_unref ( G_OBJECT ( vvp->offscreen_window ) );
+
   G_OBJECT_CLASS(parent_class)->finalize(gob);
 }
 
@@ -1307,6 +1378,19 @@ void vik_viewport_draw_line ( VikViewport *vvp, GdkGC *gc, gint x1, gint y1, gin
   }
 }
 
+/**
+ * vik_viewport_draw_segments:
+ *
+ * Draw many lines in one request.
+ * Unlike vik_viewport_draw_line() no clipping is done here,
+ *  so the segments should already have been through a_viewport_clip_line()
+ */
+void vik_viewport_draw_segments ( VikViewport *vvp, GdkGC *gc, GdkSegment *segs, gint nsegs )
+{
+  if ( nsegs > 0 )
+    gdk_draw_segments ( vvp->scr_buffer, gc, segs, nsegs );
+}
+
 void vik_viewport_draw_rectangle ( VikViewport *vvp, GdkGC *gc, gboolean filled, gint x1, gint y1, gint x2, gint y2 )
 {
   // Using 32 as half the default waypoint image size, so this draws ensures the highlight gets done
@@ -1323,11 +1407,90 @@ void vik_viewport_draw_string ( VikViewport *vvp, GdkFont *font, GdkGC *gc, gint
 void vik_viewport_draw_pixbuf ( VikViewport *vvp, GdkPixbuf *pixbuf, gint src_x, gint src_y,
                               gint dest_x, gint dest_y, gint w, gint h )
 {
-  gdk_draw_pixbuf ( vvp->scr_buffer,
-                    NULL,
-                    pixbuf,
-                    src_x, src_y, dest_x, dest_y, w, h,
-                    GDK_RGB_DITHER_NONE, 0, 0 );
+  vik_viewport_draw_pixbuf_with_alpha ( vvp, pixbuf, 255, src_x, src_y, dest_x, dest_y, w, h );
+}
+
+/**
+ * vik_viewport_draw_pixbuf_with_alpha:
+ * @alpha: The opacity to draw the pixbuf with, applied on top of any alpha channel it has
+ *
+ * Draw (part of) the pixbuf, as per vik_viewport_draw_pixbuf(), but blended onto the
+ *  buffer with the given opacity.
+ * This allows pixbufs (e.g. cached map tiles) to be kept as decoded, rather than
+ *  needing a separate copy for each opacity that they may be drawn with.
+ */
+void vik_viewport_draw_pixbuf_with_alpha ( VikViewport *vvp, GdkPixbuf *pixbuf, guint8 alpha,
+                                           gint src_x, gint src_y, gint dest_x, gint dest_y, gint w, gint h )
+{
+  if ( alpha == 0 )
+    return;
+
+  if ( alpha == 255 ) {
+    gdk_draw_pixbuf ( vvp->scr_buffer,
+                      NULL,
+                      pixbuf,
+                      src_x, src_y, dest_x, dest_y, w, h,
+                      GDK_RGB_DITHER_NONE, 0, 0 );
+    return;
+  }
+
+  // -1 means the rest of the pixbuf, as for gdk_draw_pixbuf()
+  if ( w < 0 )
+    w = gdk_pixbuf_get_width ( pixbuf ) - src_x;
+  if ( h < 0 )
+    h = gdk_pixbuf_get_height ( pixbuf ) - src_y;
+
+  // Skip anything entirely off screen
+  if ( dest_x >= vvp->width || dest_y >= vvp->height || dest_x + w <= 0 || dest_y + h <= 0 )
+    return;
+
+  // Cairo (i.e. pixman) has optimized blending of both RGB and RGBA sources
+  cairo_t *cr = gdk_cairo_create ( vvp->scr_buffer );
+  cairo_rectangle ( cr, dest_x, dest_y, w, h );
+  cairo_clip ( cr );
+  gdk_cairo_set_source_pixbuf ( cr, pixbuf, dest_x - src_x, dest_y - src_y );
+  cairo_paint_with_alpha ( cr, alpha / 255.0 );
+  cairo_destroy ( cr );
+}
+
+/**
+ * vik_viewport_draw_pixbuf_scaled:
+ * @src_x, @src_y, @src_w, @src_h: The area of the pixbuf to draw
+ * @dest_x, @dest_y, @dest_w, @dest_h: Where to draw it - scaling it to fit
+ *
+ * Draw part of the pixbuf resized on the fly, so that a differently sized version
+ *  of it doesn't need to be created (and then cached) to draw it at a different size.
+ */
+void vik_viewport_draw_pixbuf_scaled ( VikViewport *vvp, GdkPixbuf *pixbuf, guint8 alpha,
+                                       gdouble src_x, gdouble src_y, gdouble src_w, gdouble src_h,
+                                       gint dest_x, gint dest_y, gint dest_w, gint dest_h )
+{
+  if ( alpha == 0 || src_w <= 0.0 || src_h <= 0.0 || dest_w <= 0 || dest_h <= 0 )
+    return;
+
+  // Skip anything entirely off screen
+  if ( dest_x >= vvp->width || dest_y >= vvp->height || dest_x + dest_w <= 0 || dest_y + dest_h <= 0 )
+    return;
+
+  if ( src_w == dest_w && src_h == dest_h && src_x == (gint)src_x && src_y == (gint)src_y ) {
+    vik_viewport_draw_pixbuf_with_alpha ( vvp, pixbuf, alpha, src_x, src_y, dest_x, dest_y, dest_w, dest_h );
+    return;
+  }
+
+  cairo_t *cr = gdk_cairo_create ( vvp->scr_buffer );
+  cairo_rectangle ( cr, dest_x, dest_y, dest_w, dest_h );
+  cairo_clip ( cr );
+  cairo_translate ( cr, dest_x, dest_y );
+  cairo_scale ( cr, dest_w / src_w, dest_h / src_h );
+  gdk_cairo_set_source_pixbuf ( cr, pixbuf, -src_x, -src_y );
+  // Don't blend in transparency from beyond the edges of the pixbuf
+  cairo_pattern_set_extend ( cairo_get_source ( cr ), CAIRO_EXTEND_PAD );
+  cairo_pattern_set_filter ( cairo_get_source ( cr ), CAIRO_FILTER_BILINEAR );
+  if ( alpha == 255 )
+    cairo_paint ( cr );
+  else
+    cairo_paint_with_alpha ( cr, alpha / 255.0 );
+  cairo_destroy ( cr );
 }
 
 void vik_viewport_draw_arc ( VikViewport *vvp, GdkGC *gc, gboolean filled, gint x, gint y, gint width, gint height, gint angle1, gint angle2 )
@@ -1489,35 +1652,175 @@ VikViewportDrawMode vik_viewport_get_drawmode ( VikViewport *vvp )
   return vvp->drawmode;
 }
 
-/******** triggering *******/
-void vik_viewport_set_trigger ( VikViewport *vp, gpointer trigger )
+/******** layer cache *******/
+typedef struct {
+  guint64 key;
+  gboolean valid; // FALSE once the view has changed, but the pixmap can be reused
+  GdkPixmap *pixmap;
+} LayerCacheEntry;
+
+static void layer_cache_entry_free ( LayerCacheEntry *lce )
 {
-  vp->trigger = trigger;
+  g_object_unref ( G_OBJECT(lce->pixmap) );
+  g_free ( lce );
 }
 
-gpointer vik_viewport_get_trigger ( VikViewport *vp )
+void vik_viewport_layer_cache_clear ( VikViewport *vvp )
 {
-  return vp->trigger;
+  g_queue_foreach ( vvp->layer_cache, (GFunc)layer_cache_entry_free, NULL );
+  g_queue_clear ( vvp->layer_cache );
 }
 
-void vik_viewport_snapshot_save ( VikViewport *vp )
+static void layer_cache_invalidate ( VikViewport *vvp )
 {
-  gdk_draw_drawable ( vp->snapshot_buffer, vp->background_gc, vp->scr_buffer, 0, 0, 0, 0, -1, -1 );
+  GList *iter;
+  for ( iter = vvp->layer_cache->head; iter; iter = iter->next )
+    ((LayerCacheEntry*)iter->data)->valid = FALSE;
 }
 
-void vik_viewport_snapshot_load ( VikViewport *vp )
+/*
+ * Invalidate the cache if the view has changed since the snapshots were made.
+ * The pixmaps are kept for reuse unless the size has changed.
+ */
+static void layer_cache_check_view ( VikViewport *vvp )
 {
-  gdk_draw_drawable ( vp->scr_buffer, vp->background_gc, vp->snapshot_buffer, 0, 0, 0, 0, -1, -1 );
+  if ( vvp->layer_cache_width != vvp->width || vvp->layer_cache_height != vvp->height ) {
+    vik_viewport_layer_cache_clear ( vvp );
+    vvp->layer_cache_width = vvp->width;
+    vvp->layer_cache_height = vvp->height;
+  }
+  if ( vvp->layer_cache_xmpp != vvp->xmpp || vvp->layer_cache_ympp != vvp->ympp ||
+       vvp->layer_cache_drawmode != vvp->drawmode ||
+       !vik_coord_equals ( &vvp->layer_cache_center, &vvp->center ) ) {
+    layer_cache_invalidate ( vvp );
+    vvp->layer_cache_xmpp = vvp->xmpp;
+    vvp->layer_cache_ympp = vvp->ympp;
+    vvp->layer_cache_drawmode = vvp->drawmode;
+    vvp->layer_cache_center = vvp->center;
+  }
 }
 
-void vik_viewport_set_half_drawn(VikViewport *vp, gboolean half_drawn)
+/**
+ * vik_viewport_layer_cache_set_usable:
+ * @usable: TRUE only when the layers about to be drawn are unchanged since the last draw,
+ *          apart from those that have signalled an update (and so have a new version)
+ *
+ * Whether the next draw can restore the drawing of unchanged layers from the cache.
+ * Only ever used for the main (on screen) viewport.
+ */
+void vik_viewport_layer_cache_set_usable ( VikViewport *vvp, gboolean usable )
 {
-  vp->half_drawn = half_drawn;
+  vvp->layer_cache_usable = usable;
 }
 
-gboolean vik_viewport_get_half_drawn( VikViewport *vp )
+/**
+ * vik_viewport_layer_cache_invalidate:
+ *
+ * For a draw where the cache is not usable, as the layers may then be drawn
+ *  differently (e.g. a new selection or preference) without changing their versions.
+ * The pixmaps are kept for reuse.
+ */
+void vik_viewport_layer_cache_invalidate ( VikViewport *vvp )
+{
+  layer_cache_invalidate ( vvp );
+}
+
+/**
+ * vik_viewport_layer_cache_get_usable:
+ *
+ * Returns: TRUE if the current draw may use the cache
+ */
+gboolean vik_viewport_layer_cache_get_usable ( VikViewport *vvp )
 {
-  return vp->half_drawn;
+  return vvp->layer_cache_usable && !vvp->offscreen_window;
+}
+
+/**
+ * vik_viewport_layer_cache_get_base:
+ *
+ * The key of what has already been drawn into the buffer,
+ *  for layers made up of other layers to start their keys from
+ */
+guint64 vik_viewport_layer_cache_get_base ( VikViewport *vvp )
+{
+  return vvp->layer_cache_base;
+}
+
+void vik_viewport_layer_cache_set_base ( VikViewport *vvp, guint64 key )
+{
+  vvp->layer_cache_base = key;
+}
+
+/**
+ * vik_viewport_layer_cache_load:
+ * @key: Identifies the layers (and their versions) drawn so far
+ *
+ * Returns: TRUE if the buffer has been restored to a snapshot with this key,
+ *  taken at the same position, zoom and size
+ */
+gboolean vik_viewport_layer_cache_load ( VikViewport *vvp, guint64 key )
+{
+  if ( !vvp->layer_cache_usable || vvp->offscreen_window )
+    return FALSE;
+
+  layer_cache_check_view ( vvp );
+
+  GList *iter;
+  for ( iter = vvp->layer_cache->head; iter; iter = iter->next ) {
+    LayerCacheEntry *lce = iter->data;
+    if ( lce->valid && lce->key == key ) {
+      gdk_draw_drawable ( vvp->scr_buffer, vvp->background_gc, lce->pixmap, 0, 0, 0, 0, -1, -1 );
+      g_queue_unlink ( vvp->layer_cache, iter );
+      g_queue_push_head_link ( vvp->layer_cache, iter );
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+/**
+ * vik_viewport_layer_cache_save:
+ * @key: Identifies the layers (and their versions) drawn so far
+ *
+ * Keep a copy of the buffer as it is now, dropping the least recently used copy if the cache is full.
+ * Only when the cache is usable, i.e. for redraws due to layers updating,
+ *  as otherwise (e.g. when moving around) the copies would rarely be used before the view changes again.
+ */
+void vik_viewport_layer_cache_save ( VikViewport *vvp, guint64 key )
+{
+  if ( !vvp->layer_cache_usable || !vvp->layer_cache_max || vvp->offscreen_window || !vvp->scr_buffer )
+    return;
+
+  layer_cache_check_view ( vvp );
+
+  // Either the same snapshot or one no longer valid can be overwritten
+  GList *iter;
+  GList *found = NULL;
+  for ( iter = vvp->layer_cache->head; iter; iter = iter->next ) {
+    LayerCacheEntry *entry = iter->data;
+    if ( entry->valid && entry->key == key ) {
+      found = iter;
+      break;
+    }
+    if ( !entry->valid && !found )
+      found = iter;
+  }
+  LayerCacheEntry *lce = NULL;
+  if ( found ) {
+    lce = found->data;
+    g_queue_delete_link ( vvp->layer_cache, found );
+  }
+  if ( !lce && vvp->layer_cache->length >= vvp->layer_cache_max )
+    // Reuse the pixmap, since all the snapshots are the same size
+    lce = g_queue_pop_tail ( vvp->layer_cache );
+  if ( !lce ) {
+    lce = g_malloc ( sizeof(LayerCacheEntry) );
+    lce->pixmap = gdk_pixmap_new ( vvp->scr_buffer, vvp->width, vvp->height, -1 );
+  }
+  lce->key = key;
+  lce->valid = TRUE;
+  gdk_draw_drawable ( lce->pixmap, vvp->background_gc, vvp->scr_buffer, 0, 0, 0, 0, -1, -1 );
+  g_queue_push_head ( vvp->layer_cache, lce );
 }
 
 
@@ -61,6 +61,8 @@ GType vik_viewport_get_type ();
 
 /* Viking initialization */
 VikViewport *vik_viewport_new ();
+VikViewport *vik_viewport_new_offscreen ( VikViewport *vvp, gint width, gint height );
+gboolean vik_viewport_is_offscreen ( VikViewport *vvp );
 void vik_viewport_configure_manually ( VikViewport *vvp, gint width, guint height ); /* for off-screen viewports */
 gboolean vik_viewport_configure ( VikViewport *vp ); 
 
@@ -116,13 +118,15 @@ VikViewportDrawMode vik_viewport_get_drawmode ( VikViewport *vvp );
    /* Do not forget to update vik_viewport_get_drawmode_name() if you modify VikViewportDrawMode */
 
 
-/* Triggers */
-void vik_viewport_set_trigger ( VikViewport *vp, gpointer trigger );
-gpointer vik_viewport_get_trigger ( VikViewport *vp );
-void vik_viewport_snapshot_save ( VikViewport *vp );
-void vik_viewport_snapshot_load ( VikViewport *vp );
-void vik_viewport_set_half_drawn(VikViewport *vp, gboolean half_drawn);
-gboolean vik_viewport_get_half_drawn( VikViewport *vp );
+/* Cache of partly drawn layers */
+void vik_viewport_layer_cache_clear ( VikViewport *vvp );
+void vik_viewport_layer_cache_set_usable ( VikViewport *vvp, gboolean usable );
+gboolean vik_viewport_layer_cache_get_usable ( VikViewport *vvp );
+void vik_viewport_layer_cache_invalidate ( VikViewport *vvp );
+guint64 vik_viewport_layer_cache_get_base ( VikViewport *vvp );
+void vik_viewport_layer_cache_set_base ( VikViewport *vvp, guint64 key );
+gboolean vik_viewport_layer_cache_load ( VikViewport *vvp, guint64 key );
+void vik_viewport_layer_cache_save ( VikViewport *vvp, guint64 key );
 
 
 /***************************************************************************************************
@@ -136,6 +140,11 @@ void vik_viewport_pan_sync ( VikViewport *vvp, gint x_off, gint y_off );
 void vik_viewport_clear ( VikViewport *vvp );
 void vik_viewport_draw_pixbuf ( VikViewport *vvp, GdkPixbuf *pixbuf, gint src_x, gint src_y,
                               gint dest_x, gint dest_y, gint w, gint h );
+void vik_viewport_draw_pixbuf_with_alpha ( VikViewport *vvp, GdkPixbuf *pixbuf, guint8 alpha,
+                                           gint src_x, gint src_y, gint dest_x, gint dest_y, gint w, gint h );
+void vik_viewport_draw_pixbuf_scaled ( VikViewport *vvp, GdkPixbuf *pixbuf, guint8 alpha,
+                                       gdouble src_x, gdouble src_y, gdouble src_w, gdouble src_h,
+                                       gint dest_x, gint dest_y, gint dest_w, gint dest_h );
 gint vik_viewport_get_width ( VikViewport *vvp );
 gint vik_viewport_get_height ( VikViewport *vvp );
 
@@ -177,6 +186,7 @@ void vik_viewport_set_highlight_thickness ( VikViewport *vvp, gint thickness );
 /* Drawing primitives */
 void a_viewport_clip_line ( gint *x1, gint *y1, gint *x2, gint *y2 ); /* run this before drawing a line. vik_viewport_draw_line runs it for you */
 void vik_viewport_draw_line ( VikViewport *vvp, GdkGC *gc, gint x1, gint y1, gint x2, gint y2 );
+void vik_viewport_draw_segments ( VikViewport *vvp, GdkGC *gc, GdkSegment *segs, gint nsegs );
 void vik_viewport_draw_rectangle ( VikViewport *vvp, GdkGC *gc, gboolean filled, gint x1, gint y1, gint x2, gint y2 );
 void vik_viewport_draw_string ( VikViewport *vvp, GdkFont *font, GdkGC *gc, gint x1, gint y1, const gchar *string );
 void vik_viewport_draw_arc ( VikViewport *vvp, GdkGC *gc, gboolean filled, gint x, gint y, gint width, gint height, gint angle1, gint angle2 );
@@ -47,6 +47,8 @@
 #include "vikutils.h"
 #include "dir.h"
 #include "kmz.h"
+#include "pngwriter.h"
+#include "perfstats.h"
 
 #ifdef HAVE_STDLIB_H
 #include <stdlib.h>
@@ -109,6 +111,7 @@ static void center_changed_cb ( VikWindow *vw );
 static void window_configure_event ( VikWindow *vw );
 static void draw_sync ( VikWindow *vw );
 static void draw_redraw ( VikWindow *vw );
+static void draw_layers ( VikWindow *vw, VikViewport *vvp );
 static void draw_scroll  ( VikWindow *vw, GdkEventScroll *event );
 static void draw_click  ( VikWindow *vw, GdkEventButton *event );
 static void draw_release ( VikWindow *vw, GdkEventButton *event );
@@ -214,9 +217,10 @@ struct _VikWindow {
   GtkUIManager *uim;
 
   GThread  *thread;
-  /* half-drawn update */
+  /* partial redraw, of only the layers that have changed */
   VikLayer *trigger;
-  VikCoord trigger_center;
+  gpointer trigger_selected_vtl;
+  gboolean trigger_highlight;
 
   /* Store at this level for highlighted selection drawing since it applies to the viewport and the layers panel */
   /* Only one of these items can be selected at the same time */
@@ -485,6 +489,7 @@ void vik_window_new_window_finish ( VikWindow *vw )
       vik_statusbar_set_message ( vw->viking_vs, VIK_STATUSBAR_INFO, _("Trying to determine location...") );
 
       a_background_thread ( BACKGROUND_POOL_REMOTE,
+                            BACKGROUND_PRIORITY_PREFETCH, 0,
                             GTK_WINDOW(vw),
                             _("Determining location"),
                             (vik_thr_func) determine_location_thread,
@@ -1162,42 +1167,35 @@ static void window_configure_event ( VikWindow *vw )
 
 static void draw_redraw ( VikWindow *vw )
 {
-  VikCoord old_center = vw->trigger_center;
-  vw->trigger_center = *(vik_viewport_get_center(vw->viking_vvp));
   VikLayer *new_trigger = vw->trigger;
   vw->trigger = NULL;
-  VikLayer *old_trigger = VIK_LAYER(vik_viewport_get_trigger(vw->viking_vvp));
 
-  if ( ! new_trigger )
-    ; /* do nothing -- have to redraw everything. */
-  else if ( (old_trigger != new_trigger) || !vik_coord_equals(&old_center, &vw->trigger_center) || (new_trigger->type == VIK_LAYER_AGGREGATE) )
-    vik_viewport_set_trigger ( vw->viking_vvp, new_trigger ); /* todo: set to half_drawn mode if new trigger is above old */
-  else
-    vik_viewport_set_half_drawn ( vw->viking_vvp, TRUE );
+  // When the redraw is because layers have signalled an update, the other layers can come from the viewport's cache
+  //  (which itself checks the view hasn't moved).
+  // Except if the selected layer has changed, since that is drawn differently when highlighted.
+  // Otherwise have to redraw everything.
+  gboolean highlight = vik_viewport_get_draw_highlight ( vw->viking_vvp );
+  gboolean usable = new_trigger &&
+                    vw->trigger_selected_vtl == vw->selected_vtl &&
+                    vw->trigger_highlight == highlight;
+  vik_viewport_layer_cache_set_usable ( vw->viking_vvp, usable );
+  // Anything may look different now, so none of the earlier snapshots can be trusted
+  if ( !usable )
+    vik_viewport_layer_cache_invalidate ( vw->viking_vvp );
+  vw->trigger_selected_vtl = vw->selected_vtl;
+  vw->trigger_highlight = highlight;
 
   /* actually draw */
   vik_viewport_clear ( vw->viking_vvp);
-  // Main layer drawing
-  vik_layers_panel_draw_all ( vw->viking_vlp );
-  // Draw highlight (possibly again but ensures it is on top - especially for when tracks overlap)
-  if ( vik_viewport_get_draw_highlight (vw->viking_vvp) ) {
-    if ( vw->containing_vtl && (vw->selected_tracks || vw->selected_waypoints ) ) {
-      vik_trw_layer_draw_highlight_items ( vw->containing_vtl, vw->selected_tracks, vw->selected_waypoints, vw->viking_vvp );
-    }
-    else if ( vw->containing_vtl && (vw->selected_track || vw->selected_waypoint) ) {
-      vik_trw_layer_draw_highlight_item ( vw->containing_vtl, vw->selected_track, vw->selected_waypoint, vw->viking_vvp );
-    }
-    else if ( vw->selected_vtl ) {
-      vik_trw_layer_draw_highlight ( vw->selected_vtl, vw->viking_vvp );
-    }
-  }
+  // Main layer drawing and highlights
+  draw_layers ( vw, vw->viking_vvp );
   // Other viewport decoration items on top if they are enabled/in use
   vik_viewport_draw_scale ( vw->viking_vvp );
   vik_viewport_draw_copyright ( vw->viking_vvp );
   vik_viewport_draw_centermark ( vw->viking_vvp );
   vik_viewport_draw_logo ( vw->viking_vvp );
 
-  vik_viewport_set_half_drawn ( vw->viking_vvp, FALSE ); /* just in case. */
+  vik_viewport_layer_cache_set_usable ( vw->viking_vvp, FALSE );
 }
 
 gboolean draw_buf_done = TRUE;
@@ -3105,7 +3103,9 @@ void vik_window_open_file ( VikWindow *vw, const gchar *filename, gboolean chang
   vw->filename = g_strdup ( filename );
   gboolean success = FALSE;
   gboolean restore_original_filename = FALSE;
+  gint64 start = a_perf_now ();
   vw->loaded_type = a_file_load ( vik_layers_panel_get_top_layer(vw->viking_vlp), vw->viking_vvp, vw->containing_vtl, filename );
+  a_perf_record ( "io", "File load", start );
   switch ( vw->loaded_type )
   {
     case LOAD_TYPE_READ_FAILURE:
@@ -3366,7 +3366,10 @@ static gboolean window_save ( VikWindow *vw )
   vik_window_set_busy_cursor ( vw );
   gboolean success = TRUE;
 
-  if ( a_file_save ( vik_layers_panel_get_top_layer ( vw->viking_vlp ), vw->viking_vvp, vw->filename ) )
+  gint64 start = a_perf_now ();
+  gboolean saved = a_file_save ( vik_layers_panel_get_top_layer ( vw->viking_vlp ), vw->viking_vvp, vw->filename );
+  a_perf_record ( "io", "File save", start );
+  if ( saved )
   {
     update_recently_used_document ( vw, vw->filename );
   }
@@ -3626,6 +3629,11 @@ static void mapcache_flush_cb ( GtkAction *a, VikWindow *vw )
   a_mapcache_flush();
 }
 
+static void performance_cb ( GtkAction *a, VikWindow *vw )
+{
+  a_perf_show_window ( GTK_WINDOW(vw) );
+}
+
 static void menu_copy_centre_cb ( GtkAction *a, VikWindow *vw )
 {
   const VikCoord* coord;
@@ -3806,20 +3814,109 @@ static void zoom_to_cb ( GtkAction *a, VikWindow *vw )
   }
 }
 
-static void save_image_file ( VikWindow *vw, const gchar *fn, guint w, guint h, gdouble zoom, gboolean save_as_png, gboolean save_kmz )
+// Large images are generated in bands of this many rows, so only a part of the image is in memory at once
+#define IMAGE_EXPORT_BAND_HEIGHT 1024
+#define VIK_SETTINGS_IMAGE_EXPORT_BAND_HEIGHT "image_export_band_height"
+// Limit of generated parts waiting to be written out
+#define IMAGE_EXPORT_QUEUE_MAX 4
+
+typedef struct {
+  PngWriter *pw;       // Either streaming rows into a single PNG file
+  GdkPixbuf *whole;    //  or assembling the whole image in memory (for types that can't be streamed)
+  const gchar *type;   // For gdk_pixbuf_save()
+  gint failures;
+  GMutex *mutex;
+  GCond *cond;         // Signalled as each part is written out
+  guint pending;       // Parts given to the workers but not yet written out
+} ImageExport;
+
+typedef struct {
+  GdkPixbuf *pixbuf;
+  gchar *filename;     // When saving the part as a file of its own
+  guint src_y;         // Otherwise the rows of the part to use
+  guint rows;
+} ImageExportPart;
+
+/**
+ * Writing out is performed in worker threads, so this can take place while the next part is drawn
+ */
+static void image_export_worker ( ImageExportPart *part, ImageExport *ie )
+{
+  if ( part->filename ) {
+    GError *error = NULL;
+    if ( !gdk_pixbuf_save ( part->pixbuf, part->filename, ie->type, &error, NULL ) ) {
+      g_warning ( "Unable to write to file %s: %s", part->filename, error->message );
+      g_error_free ( error );
+      g_atomic_int_inc ( &ie->failures );
+    }
+    g_free ( part->filename );
+  }
+  else {
+    gint rowstride = gdk_pixbuf_get_rowstride ( part->pixbuf );
+    if ( !png_writer_write_rows ( ie->pw, gdk_pixbuf_get_pixels(part->pixbuf) + part->src_y * rowstride, rowstride, part->rows ) )
+      g_atomic_int_inc ( &ie->failures );
+  }
+  g_object_unref ( part->pixbuf );
+  g_free ( part );
+
+  g_mutex_lock ( ie->mutex );
+  ie->pending--;
+  g_cond_signal ( ie->cond );
+  g_mutex_unlock ( ie->mutex );
+}
+
+static void image_export_init ( ImageExport *ie, gboolean save_as_png )
 {
-  /* more efficient way: stuff draws directly to pixbuf (fork viewport) */
-  GdkPixbuf *pixbuf_to_save;
-  gdouble old_xmpp, old_ympp;
-  GError *error = NULL;
+  ie->pw = NULL;
+  ie->whole = NULL;
+  ie->type = save_as_png ? "png" : "jpeg";
+  ie->failures = 0;
+  ie->mutex = vik_mutex_new ();
+  ie->cond = vik_cond_new ();
+  ie->pending = 0;
+}
+
+static void image_export_clear ( ImageExport *ie )
+{
+  if ( ie->whole )
+    g_object_unref ( G_OBJECT(ie->whole) );
+  vik_cond_free ( ie->cond );
+  vik_mutex_free ( ie->mutex );
+}
 
+static void image_export_push ( ImageExport *ie, GThreadPool *pool, ImageExportPart *part )
+{
+  g_mutex_lock ( ie->mutex );
+  ie->pending++;
+  g_mutex_unlock ( ie->mutex );
+  g_thread_pool_push ( pool, part, NULL );
+}
+
+/**
+ * Keep memory use bounded by waiting for the writing out to catch up
+ */
+static void image_export_wait ( ImageExport *ie, guint max )
+{
+  g_mutex_lock ( ie->mutex );
+  while ( ie->pending >= max )
+    g_cond_wait ( ie->cond, ie->mutex );
+  g_mutex_unlock ( ie->mutex );
+}
+
+/**
+ * A modal dialog, so nothing can be changed in the windows (including closing them)
+ *  whilst the image is generated, as the display is kept alive meanwhile.
+ * The returned handler id is for the blocking of the dialog being closed,
+ *  which should be disconnected once finished.
+ */
+static GtkWidget *image_export_dialog_new ( VikWindow *vw, gulong *handler_id )
+{
   GtkWidget *msgbox = gtk_message_dialog_new ( GTK_WINDOW(vw),
                                                GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
                                                GTK_MESSAGE_INFO,
                                                GTK_BUTTONS_NONE,
-					       _("Generating image file...") );
-
-  g_signal_connect_swapped (msgbox, "response", G_CALLBACK (gtk_widget_destroy), msgbox);
+                                               _("Generating image file...") );
+  *handler_id = g_signal_connect ( msgbox, "delete-event", G_CALLBACK(gtk_true), NULL );
   // Ensure dialog shown
   gtk_widget_show_all ( msgbox );
   // Try harder...
@@ -3829,93 +3926,235 @@ static void save_image_file ( VikWindow *vw, const gchar *fn, guint w, guint h,
   // Despite many efforts & variations, GTK on my Linux system doesn't show the actual msgbox contents :(
   // At least the empty box can give a clue something's going on + the statusbar msg...
   // Windows version under Wine OK!
+  return msgbox;
+}
 
-  /* backup old zoom & set new */
-  old_xmpp = vik_viewport_get_xmpp ( vw->viking_vvp );
-  old_ympp = vik_viewport_get_ympp ( vw->viking_vvp );
-  vik_viewport_set_zoom ( vw->viking_vvp, zoom );
+static void image_export_progress ( VikWindow *vw, guint done, guint total )
+{
+  gchar *msg = g_strdup_printf ( _("Generating image file... %d%%"), (gint)(100.0 * done / total) );
+  vik_statusbar_set_message ( vw->viking_vs, VIK_STATUSBAR_INFO, msg );
+  g_free ( msg );
+  while ( gtk_events_pending() )
+    gtk_main_iteration ();
+}
 
-  /* reset width and height: */
-  vik_viewport_configure_manually ( vw->viking_vvp, w, h );
+static guint image_export_band_height ( void )
+{
+  gint height = IMAGE_EXPORT_BAND_HEIGHT;
+  gint tmp;
+  if ( a_settings_get_integer ( VIK_SETTINGS_IMAGE_EXPORT_BAND_HEIGHT, &tmp ) && tmp > 0 )
+    height = tmp;
+  return height;
+}
 
-  /* draw all layers */
-  draw_redraw ( vw );
+/**
+ * Draw all the layers and the highlighted items
+ */
+static void draw_layers ( VikWindow *vw, VikViewport *vvp )
+{
+  VikAggregateLayer *top = vik_layers_panel_get_top_layer ( vw->viking_vlp );
+  if ( VIK_LAYER(top)->visible ) {
+    gint64 start = a_perf_now ();
+    vik_aggregate_layer_draw ( top, vvp );
+    a_perf_record ( "draw", "All layers", start );
+  }
+  // Draw highlight (possibly again but ensures it is on top - especially for when tracks overlap)
+  if ( vik_viewport_get_draw_highlight (vvp) ) {
+    if ( vw->containing_vtl && (vw->selected_tracks || vw->selected_waypoints ) ) {
+      vik_trw_layer_draw_highlight_items ( vw->containing_vtl, vw->selected_tracks, vw->selected_waypoints, vvp );
+    }
+    else if ( vw->containing_vtl && (vw->selected_track || vw->selected_waypoint) ) {
+      vik_trw_layer_draw_highlight_item ( vw->containing_vtl, vw->selected_track, vw->selected_waypoint, vvp );
+    }
+    else if ( vw->selected_vtl ) {
+      vik_trw_layer_draw_highlight ( vw->selected_vtl, vvp );
+    }
+  }
+}
+
+/**
+ * Draw a part of an image in an off-screen viewport
+ *
+ * @top:    Whether this part is at the top of the image
+ * @bottom: Whether this part is at the bottom of the image
+ *
+ * The viewport decorations are only drawn on the part of the image they belong in
+ */
+static GdkPixbuf *draw_image_part ( VikWindow *vw, VikViewport *vvp, const VikCoord *center, gboolean top, gboolean bottom )
+{
+  vik_viewport_set_center_coord ( vvp, center, FALSE );
+  vik_viewport_clear ( vvp );
+  draw_layers ( vw, vvp );
+  if ( bottom ) {
+    vik_viewport_draw_scale ( vvp );
+    vik_viewport_draw_copyright ( vvp );
+  }
+  if ( top && bottom )
+    vik_viewport_draw_centermark ( vvp );
+  if ( top )
+    vik_viewport_draw_logo ( vvp );
+
+  return gdk_pixbuf_get_from_drawable ( NULL, GDK_DRAWABLE(vik_viewport_get_pixmap(vvp)), NULL, 0, 0, 0, 0,
+                                        vik_viewport_get_width(vvp), vik_viewport_get_height(vvp) );
+}
 
-  /* save buffer as file. */
-  pixbuf_to_save = gdk_pixbuf_get_from_drawable ( NULL, GDK_DRAWABLE(vik_viewport_get_pixmap ( vw->viking_vvp )), NULL, 0, 0, 0, 0, w, h);
-  if ( !pixbuf_to_save ) {
-    g_warning("Failed to generate internal pixmap size: %d x %d", w, h);
+/**
+ * The image is drawn in bands using an off-screen viewport, thus the window itself is left alone
+ *  and the image size is not limited by what the display can allocate.
+ * PNG files are written out a band at a time, so even very large images only need a small amount of memory.
+ */
+static void save_image_file ( VikWindow *vw, const gchar *fn, guint w, guint h, gdouble zoom, gboolean save_as_png, gboolean save_kmz )
+{
+  GError *error = NULL;
+
+  gulong handler_id;
+  GtkWidget *msgbox = image_export_dialog_new ( vw, &handler_id );
+  g_signal_connect_swapped (msgbox, "response", G_CALLBACK (gtk_widget_destroy), msgbox);
+
+  guint band_height = MIN(h, image_export_band_height());
+  VikViewport *vvp = vik_viewport_new_offscreen ( vw->viking_vvp, w, band_height );
+  vik_viewport_set_zoom ( vvp, zoom );
+  VikCoord center = *vik_viewport_get_center ( vvp );
+
+  ImageExport ie;
+  image_export_init ( &ie, save_as_png );
+  if ( save_as_png && !save_kmz ) {
+    ie.pw = png_writer_new ( fn, w, h, FALSE, &error );
+    if ( !ie.pw ) {
+      // Only assemble the whole image in memory when streaming is not supported in this build
+      if ( !g_error_matches ( error, G_FILE_ERROR, G_FILE_ERROR_NOSYS ) ) {
+        g_warning ( "Unable to write to file %s: %s", fn, error->message );
+        gchar *msg = g_markup_printf_escaped ( _("Failed to generate image file.\n\n%s"), error->message );
+        gtk_message_dialog_set_markup ( GTK_MESSAGE_DIALOG(msgbox), msg );
+        g_free ( msg );
+        g_error_free ( error );
+        goto cleanup;
+      }
+      g_clear_error ( &error );
+    }
+  }
+  if ( !ie.pw )
+    ie.whole = gdk_pixbuf_new ( GDK_COLORSPACE_RGB, FALSE, 8, w, h );
+  if ( !ie.pw && !ie.whole ) {
+    g_warning("Failed to generate internal image size: %d x %d", w, h);
     gtk_message_dialog_set_markup ( GTK_MESSAGE_DIALOG(msgbox), _("Failed to generate internal image.\n\nTry creating a smaller image.") );
     goto cleanup;
   }
 
-  int ans = 0; // Default to success
+  // Single thread so the bands are written in order
+  GThreadPool *pool = g_thread_pool_new ( (GFunc)image_export_worker, &ie, 1, TRUE, NULL );
+
+  for ( guint row = 0; row < h; row += band_height ) {
+    // The last band is aligned to the bottom of the image (overlapping the previous one),
+    //  so anything drawn at the bottom of the viewport is positioned correctly
+    guint top = MIN(row, h - band_height);
+    VikCoord band_center;
+    vik_viewport_set_center_coord ( vvp, &center, FALSE );
+    vik_viewport_screen_to_coord ( vvp, w/2, (gint)(band_height/2) + (gint)(top + band_height/2) - (gint)(h/2), &band_center );
 
-  if ( save_kmz ) {
-    gdouble north, east, south, west;
-    vik_viewport_get_min_max_lat_lon ( vw->viking_vvp, &south, &north, &west, &east );
-    ans = kmz_save_file ( pixbuf_to_save, fn, north, east, south, west );
+    GdkPixbuf *pixbuf = draw_image_part ( vw, vvp, &band_center, row == 0, row + band_height >= h );
+    if ( !pixbuf ) {
+      g_atomic_int_inc ( &ie.failures );
+      break;
+    }
+    guint rows = MIN(band_height, h - row);
+    if ( ie.pw ) {
+      ImageExportPart *part = g_malloc ( sizeof(ImageExportPart) );
+      part->pixbuf = pixbuf;
+      part->filename = NULL;
+      part->src_y = row - top;
+      part->rows = rows;
+      image_export_push ( &ie, pool, part );
+    }
+    else {
+      gdk_pixbuf_copy_area ( pixbuf, 0, row - top, w, rows, ie.whole, 0, row );
+      g_object_unref ( pixbuf );
+    }
+    image_export_progress ( vw, row + rows, h );
+    image_export_wait ( &ie, IMAGE_EXPORT_QUEUE_MAX );
   }
-  else {
-    gdk_pixbuf_save ( pixbuf_to_save, fn, save_as_png ? "png" : "jpeg", &error, NULL );
-    if (error) {
+
+  // Wait for everything to be written
+  g_thread_pool_free ( pool, FALSE, TRUE );
+
+  int ans = g_atomic_int_get ( &ie.failures ); // Default to success
+
+  if ( ie.pw ) {
+    if ( !png_writer_close ( ie.pw, &error ) ) {
       g_warning("Unable to write to file %s: %s", fn, error->message );
       g_error_free (error);
       ans = 42;
     }
   }
+  else if ( ans == 0 ) {
+    if ( save_kmz ) {
+      VikCoord tl, br;
+      struct LatLon ll_tl, ll_br;
+      vik_viewport_set_center_coord ( vvp, &center, FALSE );
+      vik_viewport_screen_to_coord ( vvp, 0, (gint)(band_height/2) - (gint)(h/2), &tl );
+      vik_viewport_screen_to_coord ( vvp, w, (gint)(band_height/2) + (gint)(h - h/2), &br );
+      vik_coord_to_latlon ( &tl, &ll_tl );
+      vik_coord_to_latlon ( &br, &ll_br );
+      ans = kmz_save_file ( ie.whole, fn, ll_tl.lat, ll_br.lon, ll_br.lat, ll_tl.lon );
+    }
+    else {
+      gdk_pixbuf_save ( ie.whole, fn, ie.type, &error, NULL );
+      if (error) {
+        g_warning("Unable to write to file %s: %s", fn, error->message );
+        g_error_free (error);
+        ans = 42;
+      }
+    }
+  }
 
   if ( ans == 0 )
     gtk_message_dialog_set_markup ( GTK_MESSAGE_DIALOG(msgbox), _("Image file generated.") );
   else
     gtk_message_dialog_set_markup ( GTK_MESSAGE_DIALOG(msgbox), _("Failed to generate image file.") );
 
-  g_object_unref ( G_OBJECT(pixbuf_to_save) );
-
  cleanup:
+  image_export_clear ( &ie );
+  g_object_unref ( vvp );
+
   vik_statusbar_set_message ( vw->viking_vs, VIK_STATUSBAR_INFO, "" );
+  g_signal_handler_disconnect ( msgbox, handler_id );
   gtk_dialog_add_button ( GTK_DIALOG(msgbox), GTK_STOCK_OK, GTK_RESPONSE_OK );
   gtk_dialog_run ( GTK_DIALOG(msgbox) ); // Don't care about the result
-
-  /* pretend like nothing happened ;) */
-  vik_viewport_set_xmpp ( vw->viking_vvp, old_xmpp );
-  vik_viewport_set_ympp ( vw->viking_vvp, old_ympp );
-  vik_viewport_configure ( vw->viking_vvp );
-  draw_update ( vw );
 }
 
+/**
+ * Each image is drawn using an off-screen viewport (so the window itself is left alone),
+ *  whilst the previous images are saved by a pool of worker threads.
+ */
 static void save_image_dir ( VikWindow *vw, const gchar *fn, guint w, guint h, gdouble zoom, gboolean save_as_png, guint tiles_w, guint tiles_h )
 {
   gulong size = sizeof(gchar) * (strlen(fn) + 15);
-  gchar *name_of_file = g_malloc ( size );
   guint x = 1, y = 1;
   struct UTM utm_orig, utm;
 
-  /* *** copied from above *** */
-  GdkPixbuf *pixbuf_to_save;
-  gdouble old_xmpp, old_ympp;
-  GError *error = NULL;
-
-  /* backup old zoom & set new */
-  old_xmpp = vik_viewport_get_xmpp ( vw->viking_vvp );
-  old_ympp = vik_viewport_get_ympp ( vw->viking_vvp );
-  vik_viewport_set_zoom ( vw->viking_vvp, zoom );
+  VikViewport *vvp = vik_viewport_new_offscreen ( vw->viking_vvp, w, h );
+  vik_viewport_set_zoom ( vvp, zoom );
 
-  /* reset width and height: do this only once for all images (same size) */
-  vik_viewport_configure_manually ( vw->viking_vvp, w, h );
-  /* *** end copy from above *** */
-
-  g_assert ( vik_viewport_get_coord_mode ( vw->viking_vvp ) == VIK_COORD_UTM );
+  g_assert ( vik_viewport_get_coord_mode ( vvp ) == VIK_COORD_UTM );
 
   if ( g_mkdir(fn,0777) != 0 )
     g_warning ( "%s: Failed to create directory %s", __FUNCTION__, fn );
 
-  utm_orig = *((const struct UTM *)vik_viewport_get_center ( vw->viking_vvp ));
+  utm_orig = *((const struct UTM *)vik_viewport_get_center ( vvp ));
+
+  gulong handler_id;
+  GtkWidget *msgbox = image_export_dialog_new ( vw, &handler_id );
+
+  ImageExport ie;
+  image_export_init ( &ie, save_as_png );
+  guint threads = util_get_number_of_cpus ();
+  GThreadPool *pool = g_thread_pool_new ( (GFunc)image_export_worker, &ie, threads, FALSE, NULL );
 
   for ( y = 1; y <= tiles_h; y++ )
   {
     for ( x = 1; x <= tiles_w; x++ )
     {
+      gchar *name_of_file = g_malloc ( size );
       g_snprintf ( name_of_file, size, "%s%cy%d-x%d.%s", fn, G_DIR_SEPARATOR, y, x, save_as_png ? "png" : "jpg" );
       utm = utm_orig;
       if ( tiles_w & 0x1 )
@@ -3927,33 +4166,42 @@ static void save_image_dir ( VikWindow *vw, const gchar *fn, guint w, guint h, g
       else /* even */
         utm.northing -= ((gdouble)y - (((gdouble)tiles_h)+1)/2) * (h*zoom);
 
-      /* move to correct place. */
-      vik_viewport_set_center_utm ( vw->viking_vvp, &utm, FALSE );
-
-      draw_redraw ( vw );
-
-      /* save buffer as file. */
-      pixbuf_to_save = gdk_pixbuf_get_from_drawable ( NULL, GDK_DRAWABLE(vik_viewport_get_pixmap ( vw->viking_vvp )), NULL, 0, 0, 0, 0, w, h);
-      gdk_pixbuf_save ( pixbuf_to_save, name_of_file, save_as_png ? "png" : "jpeg", &error, NULL );
-      if (error)
-      {
-        gchar *msg = g_strdup_printf (_("Unable to write to file %s: %s"), name_of_file, error->message );
-        vik_statusbar_set_message ( vw->viking_vs, VIK_STATUSBAR_INFO, msg );
-        g_free ( msg );
-        g_error_free (error);
+      VikCoord coord;
+      vik_coord_load_from_utm ( &coord, VIK_COORD_UTM, &utm );
+      GdkPixbuf *pixbuf = draw_image_part ( vw, vvp, &coord, TRUE, TRUE );
+      if ( !pixbuf ) {
+        g_free ( name_of_file );
+        g_atomic_int_inc ( &ie.failures );
+        continue;
       }
 
-      g_object_unref ( G_OBJECT(pixbuf_to_save) );
+      ImageExportPart *part = g_malloc ( sizeof(ImageExportPart) );
+      part->pixbuf = pixbuf;
+      part->filename = name_of_file;
+      part->src_y = 0;
+      part->rows = h;
+      image_export_push ( &ie, pool, part );
+
+      image_export_progress ( vw, (y-1)*tiles_w + x, tiles_w*tiles_h );
+      image_export_wait ( &ie, threads + IMAGE_EXPORT_QUEUE_MAX );
     }
   }
 
-  vik_viewport_set_center_utm ( vw->viking_vvp, &utm_orig, FALSE );
-  vik_viewport_set_xmpp ( vw->viking_vvp, old_xmpp );
-  vik_viewport_set_ympp ( vw->viking_vvp, old_ympp );
-  vik_viewport_configure ( vw->viking_vvp );
-  draw_update ( vw );
+  // Wait for all the files to be written
+  g_thread_pool_free ( pool, FALSE, TRUE );
+  image_export_clear ( &ie );
+  g_object_unref ( vvp );
+  g_signal_handler_disconnect ( msgbox, handler_id );
+  gtk_widget_destroy ( msgbox );
 
-  g_free ( name_of_file );
+  gint failures = g_atomic_int_get ( &ie.failures );
+  if ( failures ) {
+    gchar *msg = g_strdup_printf ( _("Unable to write %d image files in %s"), failures, fn );
+    vik_statusbar_set_message ( vw->viking_vs, VIK_STATUSBAR_INFO, msg );
+    g_free ( msg );
+  }
+  else
+    vik_statusbar_set_message ( vw->viking_vs, VIK_STATUSBAR_INFO, "" );
 }
 
 static void draw_to_image_file_current_window_cb(GtkWidget* widget,GdkEventButton *event,gpointer *pass_along)
@@ -4521,6 +4769,7 @@ static GtkActionEntry entries[] = {
   { "PanSouth",  NULL,                   N_("Pan _South"),                "<control>Down",  NULL,                                           (GCallback)draw_pan_cb },
   { "PanWest",   NULL,                   N_("Pan _West"),                 "<control>Left",  NULL,                                           (GCallback)draw_pan_cb },
   { "BGJobs",    GTK_STOCK_EXECUTE,      N_("Background _Jobs"),              NULL,         N_("Background Jobs"),                          (GCallback)a_background_show_window },
+  { "Performance", NULL,                 N_("Pe_rformance"),                  NULL,         N_("Drawing, cache and background job statistics"), (GCallback)performance_cb },
 
   { "Cut",       GTK_STOCK_CUT,          N_("Cu_t"),                          NULL,         N_("Cut selected layer"),                       (GCallback)menu_cut_layer_cb     },
   { "Copy",      GTK_STOCK_COPY,         N_("_Copy"),                         NULL,         N_("Copy selected layer"),                      (GCallback)menu_copy_layer_cb    },
@@ -0,0 +1,626 @@
+// Copyright: CC0
+// Benchmarks of the hot paths, run on deterministic synthetic data
+//  so results are comparable between builds and machines
+// Each benchmark prints one JSON object per line:
+//  {"benchmark":NAME,"items":N,"repeats":R,"min_s":T,"median_s":T,"items_per_s":N/T}
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gtk/gtk.h>
+#include "gpx.h"
+#include "gpspoint.h"
+#include "dem.h"
+#include "mapcache.h"
+#include "vikkdindex.h"
+#include "viktrackprofile.h"
+#include "viklayer.h"
+#include "viktrwlayer.h"
+#include "viklayer_defaults.h"
+#include "settings.h"
+#include "preferences.h"
+#include "globals.h"
+
+#define SEED 42
+#define MAX_REPEATS 50
+
+static gchar *filter = NULL;
+static gint repeats = 5;
+static gint scale = 1;
+
+typedef void (*BenchFunc) ( gpointer data );
+
+static gint compare_doubles ( gconstpointer a, gconstpointer b )
+{
+	gdouble da = *(const gdouble*)a, db = *(const gdouble*)b;
+	return (da > db) - (da < db);
+}
+
+static gboolean bench_wanted ( const gchar *name )
+{
+	return !filter || strstr ( name, filter );
+}
+
+/**
+ * Run func once to warm up, then time the given number of repeats
+ */
+static void bench ( const gchar *name, guint64 items, BenchFunc func, gpointer data )
+{
+	if ( !bench_wanted ( name ) )
+		return;
+
+	gdouble times[MAX_REPEATS];
+	GTimer *timer = g_timer_new ();
+	gint rr;
+	func ( data );
+	for ( rr = 0; rr < repeats; rr++ ) {
+		g_timer_start ( timer );
+		func ( data );
+		times[rr] = g_timer_elapsed ( timer, NULL );
+	}
+	g_timer_destroy ( timer );
+
+	qsort ( times, repeats, sizeof(gdouble), compare_doubles );
+	gdouble min = times[0];
+	gdouble median = times[repeats/2];
+	printf ( "{\"benchmark\":\"%s\",\"items\":%" G_GUINT64_FORMAT ",\"repeats\":%d,\"min_s\":%.6f,\"median_s\":%.6f,\"items_per_s\":%.1f}\n",
+	         name, items, repeats, min, median, min > 0 ? items / min : 0.0 );
+	fflush ( stdout );
+}
+
+static void bench_skipped ( const gchar *name, const gchar *reason )
+{
+	if ( bench_wanted ( name ) )
+		printf ( "{\"benchmark\":\"%s\",\"skipped\":\"%s\"}\n", name, reason );
+}
+
+// Synthetic data generators
+
+/**
+ * A random walk of one point per second, around a few kilometres of England
+ */
+static VikTrack *make_track ( GRand *rand, guint points )
+{
+	VikTrack *trk = vik_track_new ();
+	struct LatLon ll = { 52.0 + g_rand_double ( rand ), -1.0 - g_rand_double ( rand ) };
+	gdouble heading = g_rand_double_range ( rand, 0, 2*M_PI );
+	GList *tail = NULL;
+	guint ii;
+	for ( ii = 0; ii < points; ii++ ) {
+		VikTrackpoint *tp = vik_trackpoint_new ();
+		vik_coord_load_from_latlon ( &tp->coord, VIK_COORD_LATLON, &ll );
+		tp->has_timestamp = TRUE;
+		tp->timestamp = 1500000000 + ii;
+		tp->altitude = 200 + 100 * sin ( ii / 500.0 ) + g_rand_double_range ( rand, -2, 2 );
+		tail = vik_track_add_trackpoint_after_tail ( trk, tail, tp, FALSE );
+
+		// Roughly 5 to 15 metres per step
+		heading += g_rand_double_range ( rand, -0.2, 0.2 );
+		gdouble step = g_rand_double_range ( rand, 5, 15 ) / 111000.0;
+		ll.lat += step * cos ( heading );
+		ll.lon += step * sin ( heading ) / cos ( DEG2RAD(ll.lat) );
+	}
+	vik_track_calculate_bounds ( trk );
+	return trk;
+}
+
+static VikTrwLayer *make_trw ( VikViewport *vvp, guint tracks, guint points, guint waypoints )
+{
+	GRand *rand = g_rand_new_with_seed ( SEED );
+	VikTrwLayer *vtl = VIK_TRW_LAYER(vik_layer_create ( VIK_LAYER_TRW, vvp, FALSE ));
+	guint ii;
+	for ( ii = 0; ii < tracks; ii++ ) {
+		gchar *name = g_strdup_printf ( "Track%u", ii );
+		vik_trw_layer_add_track ( vtl, name, make_track ( rand, points ) );
+		g_free ( name );
+	}
+	for ( ii = 0; ii < waypoints; ii++ ) {
+		VikWaypoint *wp = vik_waypoint_new ();
+		struct LatLon ll = { 52.0 + g_rand_double ( rand ), -1.0 - g_rand_double ( rand ) };
+		vik_coord_load_from_latlon ( &wp->coord, VIK_COORD_LATLON, &ll );
+		wp->altitude = g_rand_double_range ( rand, 0, 500 );
+		gchar *name = g_strdup_printf ( "Waypoint%u", ii );
+		vik_trw_layer_add_waypoint ( vtl, name, wp );
+		g_free ( name );
+	}
+	trw_layer_calculate_bounds_waypoints ( vtl );
+	g_rand_free ( rand );
+	return vtl;
+}
+
+/**
+ * A one degree square in the style of an SRTM 3 arc second tile,
+ *  of gently rolling hills
+ */
+static VikDEM *make_dem ( guint size )
+{
+	VikDEM *dem = g_malloc0 ( sizeof(VikDEM) );
+	dem->horiz_units = VIK_DEM_HORIZ_LL_ARCSECONDS;
+	dem->orig_vert_units = VIK_DEM_VERT_DECIMETERS;
+	dem->east_scale = dem->north_scale = 3600.0 / (size - 1);
+	dem->min_east = -3600;
+	dem->min_north = 52 * 3600;
+	dem->max_east = dem->min_east + 3600;
+	dem->max_north = dem->min_north + 3600;
+	dem->n_columns = size;
+	dem->columns = g_ptr_array_new ();
+
+	guint col, row;
+	for ( col = 0; col < size; col++ ) {
+		VikDEMColumn *column = g_malloc ( sizeof(VikDEMColumn) );
+		column->east_west = dem->min_east + col * dem->east_scale;
+		column->south = dem->min_north;
+		column->n_points = size;
+		column->points = g_malloc ( size * sizeof(gint16) );
+		for ( row = 0; row < size; row++ )
+			column->points[row] = 300 + 150 * sin ( col / 40.0 ) * cos ( row / 55.0 ) + 40 * sin ( (col + row) / 7.0 );
+		g_ptr_array_add ( dem->columns, column );
+	}
+	return dem;
+}
+
+/**
+ * An opaque 256x256 tile with a pattern dependent on its position
+ */
+static GdkPixbuf *make_tile ( gint x, gint y )
+{
+	GdkPixbuf *pixbuf = gdk_pixbuf_new ( GDK_COLORSPACE_RGB, FALSE, 8, 256, 256 );
+	guchar *pixels = gdk_pixbuf_get_pixels ( pixbuf );
+	gint rowstride = gdk_pixbuf_get_rowstride ( pixbuf );
+	gint row, col;
+	for ( row = 0; row < 256; row++ )
+		for ( col = 0; col < 256; col++ ) {
+			guchar *p = pixels + row * rowstride + col * 3;
+			p[0] = (col + x) & 0xff;
+			p[1] = (row + y) & 0xff;
+			p[2] = (col ^ row) & 0xff;
+		}
+	return pixbuf;
+}
+
+// Track analysis
+
+#define TRACK_MAP_WIDTH 500
+
+typedef struct {
+	VikTrack *trk;
+	VikTrackProfileMap map;
+	gdouble *queries; // Fractions of the way along the track
+	guint query_count;
+} TrackBench;
+
+static void track_length ( TrackBench *tb )
+{
+	volatile gdouble length = vik_track_get_length ( tb->trk );
+	(void)length;
+}
+
+/**
+ * As after the track has been edited: the index and the profile on it are both rebuilt
+ */
+static void track_profile_build ( TrackBench *tb )
+{
+	vik_track_invalidate_index ( tb->trk );
+	vik_track_get_profile ( tb->trk );
+}
+
+/**
+ * As when the graphs are drawn at a new size
+ */
+static void track_profile_map ( TrackBench *tb )
+{
+	gdouble mins[TRACK_MAP_WIDTH], maxs[TRACK_MAP_WIDTH];
+	g_free ( vik_track_profile_make_map ( vik_track_get_profile ( tb->trk ), tb->map, TRACK_MAP_WIDTH, mins, maxs ) );
+}
+
+/**
+ * As when following the mouse over the graphs
+ */
+static void track_tp_by_dist ( TrackBench *tb )
+{
+	gdouble length = vik_track_get_length_including_gaps ( tb->trk );
+	volatile gsize found = 0;
+	guint ii;
+	for ( ii = 0; ii < tb->query_count; ii++ )
+		found += (gsize)vik_track_get_tp_by_dist ( tb->trk, length * tb->queries[ii], ii & 1, NULL );
+}
+
+static void track_closest_tp_by_percentage_dist ( TrackBench *tb )
+{
+	volatile gsize found = 0;
+	guint ii;
+	for ( ii = 0; ii < tb->query_count; ii++ )
+		found += (gsize)vik_track_get_closest_tp_by_percentage_dist ( tb->trk, tb->queries[ii], NULL );
+}
+
+static void track_closest_tp_by_percentage_time ( TrackBench *tb )
+{
+	volatile gsize found = 0;
+	guint ii;
+	for ( ii = 0; ii < tb->query_count; ii++ )
+		found += (gsize)vik_track_get_closest_tp_by_percentage_time ( tb->trk, tb->queries[ii], NULL );
+}
+
+static void bench_tracks ( void )
+{
+	GRand *rand = g_rand_new_with_seed ( SEED );
+	guint points = 200000 * scale;
+	TrackBench tb = { make_track ( rand, points ), VIK_TRACK_PROFILE_ELEVATION_DISTANCE, NULL, 1000000 * scale };
+	tb.queries = g_malloc ( tb.query_count * sizeof(gdouble) );
+	guint ii;
+	for ( ii = 0; ii < tb.query_count; ii++ )
+		tb.queries[ii] = g_rand_double ( rand );
+	g_rand_free ( rand );
+
+	bench ( "track_length", points, (BenchFunc)track_length, &tb );
+	bench ( "track_profile_build", points, (BenchFunc)track_profile_build, &tb );
+
+	const struct { const gchar *name; VikTrackProfileMap map; } maps[] = {
+		{ "track_profile_elevation_map", VIK_TRACK_PROFILE_ELEVATION_DISTANCE },
+		{ "track_profile_gradient_map", VIK_TRACK_PROFILE_GRADIENT_DISTANCE },
+		{ "track_profile_speed_map", VIK_TRACK_PROFILE_SPEED_TIME },
+		{ "track_profile_distance_map", VIK_TRACK_PROFILE_DISTANCE_TIME },
+		{ "track_profile_elevation_time_map", VIK_TRACK_PROFILE_ELEVATION_TIME },
+		{ "track_profile_speed_dist_map", VIK_TRACK_PROFILE_SPEED_DISTANCE },
+		{ "track_profile_gps_speed_map", VIK_TRACK_PROFILE_GPS_SPEED_TIME },
+	};
+	for ( ii = 0; ii < G_N_ELEMENTS(maps); ii++ ) {
+		tb.map = maps[ii].map;
+		bench ( maps[ii].name, TRACK_MAP_WIDTH, (BenchFunc)track_profile_map, &tb );
+	}
+
+	bench ( "track_tp_by_dist", tb.query_count, (BenchFunc)track_tp_by_dist, &tb );
+	bench ( "track_closest_tp_by_percentage_dist", tb.query_count, (BenchFunc)track_closest_tp_by_percentage_dist, &tb );
+	bench ( "track_closest_tp_by_percentage_time", tb.query_count, (BenchFunc)track_closest_tp_by_percentage_time, &tb );
+
+	g_free ( tb.queries );
+	vik_track_free ( tb.trk );
+}
+
+// File formats
+
+typedef struct {
+	VikTrwLayer *vtl;
+	gchar *filename;
+	gboolean gpx;
+} FileBench;
+
+static void file_write ( FileBench *fb )
+{
+	FILE *f = g_fopen ( fb->filename, "w" );
+	if ( fb->gpx )
+		a_gpx_write_file ( fb->vtl, f, NULL );
+	else
+		a_gpspoint_write_file ( fb->vtl, f );
+	fclose ( f );
+}
+
+static void file_read ( FileBench *fb )
+{
+	VikLayer *vl = vik_layer_create ( VIK_LAYER_TRW, NULL, FALSE );
+	FILE *f = g_fopen ( fb->filename, "r" );
+	if ( fb->gpx )
+		a_gpx_read_file ( VIK_TRW_LAYER(vl), f );
+	else
+		a_gpspoint_read_file ( VIK_TRW_LAYER(vl), f, NULL );
+	fclose ( f );
+	g_object_unref ( vl );
+}
+
+static void bench_files ( void )
+{
+	guint tracks = 10, points = 20000 * scale, waypoints = 1000 * scale;
+	guint64 items = tracks * points + waypoints;
+	FileBench fb = { make_trw ( NULL, tracks, points, waypoints ), NULL, TRUE };
+
+	gint fd = g_file_open_tmp ( "bench_viking_XXXXXX", &fb.filename, NULL );
+	if ( fd < 0 ) {
+		bench_skipped ( "gpx", "no temporary file" );
+		g_object_unref ( fb.vtl );
+		return;
+	}
+	close ( fd );
+
+	bench ( "gpx_write", items, (BenchFunc)file_write, &fb );
+	if ( bench_wanted ( "gpx_read" ) ) {
+		file_write ( &fb );
+		bench ( "gpx_read", items, (BenchFunc)file_read, &fb );
+	}
+
+	fb.gpx = FALSE;
+	bench ( "gpspoint_write", items, (BenchFunc)file_write, &fb );
+	if ( bench_wanted ( "gpspoint_read" ) ) {
+		file_write ( &fb );
+		bench ( "gpspoint_read", items, (BenchFunc)file_read, &fb );
+	}
+
+	g_remove ( fb.filename );
+	g_free ( fb.filename );
+	g_object_unref ( fb.vtl );
+}
+
+// Map tile cache
+
+#define MAPCACHE_TILES 64
+#define MAPCACHE_THREADS 4
+
+typedef struct {
+	GdkPixbuf *tiles[MAPCACHE_TILES];
+	guint ops;
+} MapcacheBench;
+
+typedef struct {
+	MapcacheBench *mb;
+	guint32 seed;
+} MapcacheThread;
+
+/**
+ * Mostly lookups of a working set that fits, with some adds, as when panning
+ */
+static gpointer mapcache_thread ( MapcacheThread *mt )
+{
+	GRand *rand = g_rand_new_with_seed ( mt->seed );
+	mapcache_extra_t extra = { 0.0 };
+	guint ii;
+	for ( ii = 0; ii < mt->mb->ops; ii++ ) {
+		gint tile = g_rand_int_range ( rand, 0, MAPCACHE_TILES );
+		gint x = tile % 8, y = tile / 8;
+		GdkPixbuf *pixbuf = a_mapcache_get ( x, y, 0, 13, 14, 1.0, 1.0, NULL );
+		if ( pixbuf )
+			g_object_unref ( pixbuf );
+		if ( !pixbuf || g_rand_int_range ( rand, 0, 10 ) == 0 )
+			a_mapcache_add ( mt->mb->tiles[tile], extra, x, y, 0, 13, 14, 1.0, 1.0, NULL );
+	}
+	g_rand_free ( rand );
+	return NULL;
+}
+
+static void mapcache_contended ( MapcacheBench *mb )
+{
+	GThread *threads[MAPCACHE_THREADS];
+	MapcacheThread mt[MAPCACHE_THREADS];
+	guint ii;
+	for ( ii = 0; ii < MAPCACHE_THREADS; ii++ ) {
+		mt[ii].mb = mb;
+		mt[ii].seed = SEED + ii;
+#if GLIB_CHECK_VERSION (2, 32, 0)
+		threads[ii] = g_thread_new ( "bench", (GThreadFunc)mapcache_thread, &mt[ii] );
+#else
+		threads[ii] = g_thread_create ( (GThreadFunc)mapcache_thread, &mt[ii], TRUE, NULL );
+#endif
+	}
+	for ( ii = 0; ii < MAPCACHE_THREADS; ii++ )
+		g_thread_join ( threads[ii] );
+}
+
+static void bench_mapcache ( void )
+{
+	MapcacheBench mb;
+	guint ii;
+	for ( ii = 0; ii < MAPCACHE_TILES; ii++ )
+		mb.tiles[ii] = make_tile ( ii % 8, ii / 8 );
+	mb.ops = 100000 * scale;
+
+	bench ( "mapcache_contended", (guint64)mb.ops * MAPCACHE_THREADS, (BenchFunc)mapcache_contended, &mb );
+
+	a_mapcache_flush ();
+	for ( ii = 0; ii < MAPCACHE_TILES; ii++ )
+		g_object_unref ( mb.tiles[ii] );
+}
+
+// Elevation lookups
+
+typedef struct {
+	VikDEM *dem;
+	gdouble *positions;
+	guint count;
+	gint16 (*lookup) ( VikDEM *dem, gdouble east, gdouble north );
+} DemBench;
+
+static void dem_lookup ( DemBench *db )
+{
+	volatile gint sum = 0;
+	guint ii;
+	for ( ii = 0; ii < db->count; ii++ )
+		sum += db->lookup ( db->dem, db->positions[2*ii], db->positions[2*ii+1] );
+}
+
+static void bench_dem ( void )
+{
+	GRand *rand = g_rand_new_with_seed ( SEED );
+	DemBench db = { make_dem ( 1201 ), NULL, 1000000 * scale, NULL };
+	db.positions = g_malloc ( 2 * db.count * sizeof(gdouble) );
+	guint ii;
+	for ( ii = 0; ii < db.count; ii++ ) {
+		db.positions[2*ii] = g_rand_double_range ( rand, db.dem->min_east, db.dem->max_east );
+		db.positions[2*ii+1] = g_rand_double_range ( rand, db.dem->min_north, db.dem->max_north );
+	}
+	g_rand_free ( rand );
+
+	const struct { const gchar *name; gint16 (*lookup) ( VikDEM *dem, gdouble east, gdouble north ); } lookups[] = {
+		{ "dem_east_north", vik_dem_get_east_north },
+		{ "dem_simple_interpol", vik_dem_get_simple_interpol },
+		{ "dem_shepard_interpol", vik_dem_get_shepard_interpol },
+		{ "dem_best_interpol", vik_dem_get_best_interpol },
+	};
+	for ( ii = 0; ii < G_N_ELEMENTS(lookups); ii++ ) {
+		db.lookup = lookups[ii].lookup;
+		bench ( lookups[ii].name, db.count, (BenchFunc)dem_lookup, &db );
+	}
+	g_free ( db.positions );
+	vik_dem_free ( db.dem );
+}
+
+// Timezone style nearest place lookups
+
+typedef struct {
+	gdouble *positions;
+	gchar **names;
+	guint count;
+	VikKdIndex *kdi;
+	gdouble *queries;
+	guint query_count;
+} KdBench;
+
+static void kd_build ( KdBench *kb )
+{
+	vik_kd_index_free ( vik_kd_index_new ( kb->positions, (const gchar * const *)kb->names, kb->count ) );
+}
+
+static void kd_nearest ( KdBench *kb )
+{
+	volatile gint found = 0;
+	guint ii;
+	for ( ii = 0; ii < kb->query_count; ii++ )
+		found += vik_kd_index_nearest ( kb->kdi, &kb->queries[2*ii], 5.0, NULL );
+}
+
+static void bench_kdindex ( void )
+{
+	GRand *rand = g_rand_new_with_seed ( SEED );
+	KdBench kb;
+	kb.count = 50000 * scale;
+	kb.positions = g_malloc ( 2 * kb.count * sizeof(gdouble) );
+	kb.names = g_malloc0 ( (kb.count + 1) * sizeof(gchar*) );
+	guint ii;
+	for ( ii = 0; ii < kb.count; ii++ ) {
+		kb.positions[2*ii] = g_rand_double_range ( rand, -90, 90 );
+		kb.positions[2*ii+1] = g_rand_double_range ( rand, -180, 180 );
+		kb.names[ii] = g_strdup_printf ( "Place%u", ii );
+	}
+	kb.query_count = 500000 * scale;
+	kb.queries = g_malloc ( 2 * kb.query_count * sizeof(gdouble) );
+	for ( ii = 0; ii < kb.query_count; ii++ ) {
+		kb.queries[2*ii] = g_rand_double_range ( rand, -90, 90 );
+		kb.queries[2*ii+1] = g_rand_double_range ( rand, -180, 180 );
+	}
+	g_rand_free ( rand );
+
+	bench ( "kdindex_build", kb.count, (BenchFunc)kd_build, &kb );
+	kb.kdi = vik_kd_index_new ( kb.positions, (const gchar * const *)kb.names, kb.count );
+	bench ( "kdindex_nearest", kb.query_count, (BenchFunc)kd_nearest, &kb );
+
+	vik_kd_index_free ( kb.kdi );
+	g_free ( kb.queries );
+	g_strfreev ( kb.names );
+	g_free ( kb.positions );
+}
+
+// Drawing
+
+typedef struct {
+	VikViewport *vvp;
+	VikCoord *coords;
+	guint count;
+	VikLayer *vl;
+} DrawBench;
+
+static void viewport_coord_to_screen ( DrawBench *db )
+{
+	volatile gint sum = 0;
+	gint x, y;
+	guint ii;
+	for ( ii = 0; ii < db->count; ii++ ) {
+		vik_viewport_coord_to_screen ( db->vvp, &db->coords[ii], &x, &y );
+		sum += x + y;
+	}
+}
+
+static void trw_draw ( DrawBench *db )
+{
+	vik_viewport_clear ( db->vvp );
+	vik_layer_draw ( db->vl, db->vvp );
+}
+
+static void bench_drawing ( gboolean have_display )
+{
+	if ( !have_display ) {
+		bench_skipped ( "viewport_coord_to_screen", "no display" );
+		bench_skipped ( "trw_draw", "no display" );
+		return;
+	}
+
+	// The viewport is realized but never shown, so drawing is only into its pixmap
+	GtkWidget *window = gtk_window_new ( GTK_WINDOW_TOPLEVEL );
+	DrawBench db;
+	db.vvp = vik_viewport_new ();
+	gtk_container_add ( GTK_CONTAINER(window), GTK_WIDGET(db.vvp) );
+	gtk_widget_realize ( GTK_WIDGET(db.vvp) );
+	vik_viewport_configure ( db.vvp );
+	vik_viewport_configure_manually ( db.vvp, 1920, 1080 );
+	vik_viewport_set_draw_highlight ( db.vvp, FALSE );
+
+	GRand *rand = g_rand_new_with_seed ( SEED );
+	db.count = 1000000 * scale;
+	db.coords = g_malloc ( db.count * sizeof(VikCoord) );
+	guint ii;
+	for ( ii = 0; ii < db.count; ii++ ) {
+		struct LatLon ll = { 52.0 + g_rand_double ( rand ), -1.0 - g_rand_double ( rand ) };
+		vik_coord_load_from_latlon ( &db.coords[ii], vik_viewport_get_coord_mode ( db.vvp ), &ll );
+	}
+	g_rand_free ( rand );
+
+	struct LatLon centre = { 52.5, -1.5 };
+	VikCoord coord;
+	vik_coord_load_from_latlon ( &coord, vik_viewport_get_coord_mode ( db.vvp ), &centre );
+	vik_viewport_set_center_coord ( db.vvp, &coord, FALSE );
+	vik_viewport_set_zoom ( db.vvp, 64.0 );
+
+	bench ( "viewport_coord_to_screen", db.count, (BenchFunc)viewport_coord_to_screen, &db );
+
+	guint tracks = 20, points = 10000 * scale, waypoints = 2000 * scale;
+	db.vl = VIK_LAYER(make_trw ( db.vvp, tracks, points, waypoints ));
+	bench ( "trw_draw", (guint64)tracks * points + waypoints, (BenchFunc)trw_draw, &db );
+
+	g_object_unref ( db.vl );
+	g_free ( db.coords );
+	gtk_widget_destroy ( window );
+}
+
+static GOptionEntry entries[] = {
+	{ "filter", 'f', 0, G_OPTION_ARG_STRING, &filter, "Only run benchmarks whose name contains this", "TEXT" },
+	{ "repeats", 'r', 0, G_OPTION_ARG_INT, &repeats, "Number of timed runs of each benchmark", "N" },
+	{ "scale", 's', 0, G_OPTION_ARG_INT, &scale, "Multiplier of the synthetic data sizes", "N" },
+	{ NULL }
+};
+
+int main ( int argc, char *argv[] )
+{
+	GError *error = NULL;
+	GOptionContext *context = g_option_context_new ( "- benchmark Viking" );
+	g_option_context_add_main_entries ( context, entries, NULL );
+	if ( !g_option_context_parse ( context, &argc, &argv, &error ) ) {
+		g_printerr ( "%s\n", error->message );
+		return EXIT_FAILURE;
+	}
+	g_option_context_free ( context );
+	repeats = CLAMP ( repeats, 1, MAX_REPEATS );
+	scale = MAX ( scale, 1 );
+
+#if !GLIB_CHECK_VERSION (2, 32, 0)
+	g_thread_init ( NULL );
+#endif
+	// Drawing needs a display, everything else does not
+	gboolean have_display = gtk_init_check ( &argc, &argv );
+#if !GLIB_CHECK_VERSION (2, 36, 0)
+	g_type_init ();
+#endif
+	a_settings_init ();
+	a_preferences_init ();
+	a_vik_preferences_init ();
+	a_layer_defaults_init ();
+	a_mapcache_init ();
+
+	bench_tracks ();
+	bench_files ();
+	bench_mapcache ();
+	bench_dem ();
+	bench_kdindex ();
+	bench_drawing ( have_display );
+
+	a_mapcache_uninit ();
+	return EXIT_SUCCESS;
+}
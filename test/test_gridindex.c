@@ -0,0 +1,243 @@
+// Copyright: CC0
+// Check the cells of the grid index match grouping the items by brute force,
+//  both for the whole world and for smaller areas
+#include <stdlib.h>
+#include <math.h>
+#include <glib.h>
+#include "vikgridindex.h"
+
+#define COUNT 3000
+#define QUERIES 200
+
+typedef struct {
+	gdouble lat, lon;
+	guint count;
+	gpointer item;
+	gboolean seen;
+} BruteCell;
+
+typedef struct {
+	GHashTable *cells;
+	gint level;
+	guint found;
+	gboolean ok;
+} Check;
+
+static gint64 brute_coord ( gdouble degrees, gdouble origin, gint level )
+{
+	gint64 cells = (gint64)1 << level;
+	gint64 cc = (gint64)floor ( (degrees - origin) / (360.0 / cells) );
+	return CLAMP ( cc, 0, cells - 1 );
+}
+
+static gint64 brute_key ( gdouble lat, gdouble lon, gint level )
+{
+	return (brute_coord ( lon, -180.0, level ) << 32) | brute_coord ( lat, -90.0, level );
+}
+
+/**
+ * Group the items into the cells of the level
+ */
+static GHashTable *brute_cells ( const gdouble *positions, gpointer *items, gint level )
+{
+	GHashTable *cells = g_hash_table_new_full ( g_int64_hash, g_int64_equal, g_free, g_free );
+	guint ii;
+	for ( ii = 0; ii < COUNT; ii++ ) {
+		gint64 key = brute_key ( positions[2*ii], positions[2*ii+1], level );
+		BruteCell *cell = g_hash_table_lookup ( cells, &key );
+		if ( !cell ) {
+			cell = g_new0 ( BruteCell, 1 );
+			cell->item = items[ii];
+			gint64 *pkey = g_new ( gint64, 1 );
+			*pkey = key;
+			g_hash_table_insert ( cells, pkey, cell );
+		}
+		else
+			cell->item = NULL;
+		cell->lat += positions[2*ii];
+		cell->lon += positions[2*ii+1];
+		cell->count++;
+	}
+	GHashTableIter iter;
+	gpointer value;
+	g_hash_table_iter_init ( &iter, cells );
+	while ( g_hash_table_iter_next ( &iter, NULL, &value ) ) {
+		BruteCell *cell = value;
+		cell->lat /= cell->count;
+		cell->lon /= cell->count;
+	}
+	return cells;
+}
+
+static void check_cluster ( const VikGridCluster *cluster, Check *check )
+{
+	// The centre of the items is always within their cell
+	gint64 key = brute_key ( cluster->lat, cluster->lon, check->level );
+	BruteCell *cell = g_hash_table_lookup ( check->cells, &key );
+	if ( !cell || cell->seen ) {
+		g_printerr ( "Level %d: unexpected or repeated cell at %f,%f\n", check->level, cluster->lat, cluster->lon );
+		check->ok = FALSE;
+		return;
+	}
+	cell->seen = TRUE;
+	if ( cluster->count != cell->count || cluster->item != cell->item ||
+	     fabs ( cluster->lat - cell->lat ) > 1e-9 || fabs ( cluster->lon - cell->lon ) > 1e-9 ) {
+		g_printerr ( "Level %d: cell at %f,%f has %d items but expected %d at %f,%f\n",
+		             check->level, cluster->lat, cluster->lon, cluster->count, cell->count, cell->lat, cell->lon );
+		check->ok = FALSE;
+	}
+	check->found++;
+}
+
+/**
+ * Every cell with items in the area is reported once, and no others
+ */
+static gboolean check_area ( VikGridIndex *gi, gint level, GHashTable *cells, const LatLonBBox *bbox )
+{
+	Check check = { cells, level, 0, TRUE };
+	GHashTableIter iter;
+	gpointer key, value;
+	g_hash_table_iter_init ( &iter, cells );
+	while ( g_hash_table_iter_next ( &iter, NULL, &value ) )
+		((BruteCell*)value)->seen = FALSE;
+
+	vik_grid_index_foreach ( gi, level, bbox, (VikGridClusterFunc)check_cluster, &check );
+	if ( !check.ok )
+		return FALSE;
+
+	gint64 gx1 = brute_coord ( bbox->west, -180.0, level ), gx2 = brute_coord ( bbox->east, -180.0, level );
+	gint64 gy1 = brute_coord ( bbox->south, -90.0, level ), gy2 = brute_coord ( bbox->north, -90.0, level );
+	guint expected = 0;
+	g_hash_table_iter_init ( &iter, cells );
+	while ( g_hash_table_iter_next ( &iter, &key, &value ) ) {
+		gint64 gx = *(gint64*)key >> 32;
+		gint64 gy = *(gint64*)key & 0xffffffff;
+		gboolean inside = gx >= gx1 && gx <= gx2 && gy >= gy1 && gy <= gy2;
+		if ( inside )
+			expected++;
+		if ( ((BruteCell*)value)->seen != inside ) {
+			g_printerr ( "Level %d: cell %d,%d %s\n", level, (gint)gx, (gint)gy, inside ? "missed" : "outside the area" );
+			return FALSE;
+		}
+	}
+	return check.found == expected;
+}
+
+static gboolean check_levels ( VikGridIndex *gi, const gdouble *positions, gpointer *items, gint *max_level )
+{
+	gint level;
+	guint last_cells = 0;
+	for ( level = 0; vik_grid_index_get_level ( gi, 360.0 / (1 << level) ) == level; level++ ) {
+		GHashTable *cells = brute_cells ( positions, items, level );
+		last_cells = g_hash_table_size ( cells );
+
+		// The whole world and so all the cells
+		LatLonBBox world = { -90.0, 90.0, 180.0, -180.0 };
+		if ( !check_area ( gi, level, cells, &world ) )
+			return FALSE;
+
+		// Areas of both a few cells (looked up one by one) and many cells (found by going through them all)
+		GRand *rand = g_rand_new_with_seed ( 42 + level );
+		guint qq;
+		for ( qq = 0; qq < QUERIES; qq++ ) {
+			gdouble size = (qq & 1) ? 360.0 / (1 << level) : g_rand_double_range ( rand, 1.0, 90.0 );
+			LatLonBBox bbox;
+			bbox.south = g_rand_double_range ( rand, -90.0, 90.0 - size / 2 );
+			bbox.north = bbox.south + size / 2;
+			bbox.west = g_rand_double_range ( rand, -180.0, 180.0 - size );
+			bbox.east = bbox.west + size;
+			if ( !check_area ( gi, level, cells, &bbox ) ) {
+				g_printerr ( "Level %d: area %d %f,%f to %f,%f\n", level, qq, bbox.south, bbox.west, bbox.north, bbox.east );
+				g_hash_table_destroy ( cells );
+				g_rand_free ( rand );
+				return FALSE;
+			}
+		}
+		g_rand_free ( rand );
+		g_hash_table_destroy ( cells );
+
+		// Levels stop once the cells hold only a few items on average
+		if ( last_cells * 4 > COUNT && vik_grid_index_get_level ( gi, 360.0 / (2 << level) ) >= 0 ) {
+			g_printerr ( "Level %d: has %d cells but there are more levels\n", level, last_cells );
+			return FALSE;
+		}
+	}
+	*max_level = level - 1;
+	if ( *max_level < 0 || last_cells * 4 <= COUNT ) {
+		g_printerr ( "Deepest level %d has only %d cells\n", *max_level, last_cells );
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static gboolean check_get_level ( VikGridIndex *gi, gint max_level )
+{
+	gint level;
+	for ( level = 0; level <= max_level; level++ ) {
+		gdouble size = 360.0 / (1 << level);
+		// Exactly the size of the cells, or a little smaller, is this level
+		if ( vik_grid_index_get_level ( gi, size ) != level || vik_grid_index_get_level ( gi, size * 0.999 ) != level )
+			return FALSE;
+		// A little larger needs the level above
+		if ( level > 0 && vik_grid_index_get_level ( gi, size * 1.001 ) != level - 1 )
+			return FALSE;
+	}
+	// Larger than the world is still the top level
+	if ( vik_grid_index_get_level ( gi, 1000.0 ) != 0 )
+		return FALSE;
+	// Finer than the index goes
+	if ( vik_grid_index_get_level ( gi, 360.0 / (2 << max_level) ) != -1 )
+		return FALSE;
+	if ( vik_grid_index_get_level ( gi, 0.0 ) != -1 || vik_grid_index_get_level ( gi, -1.0 ) != -1 )
+		return FALSE;
+	return TRUE;
+}
+
+int main ( int argc, char *argv[] )
+{
+	gdouble *positions = g_new ( gdouble, 2*COUNT );
+	gpointer *items = g_new ( gpointer, COUNT );
+
+	// Mostly around a few places, including on cell edges and the edges of the world
+	GRand *rand = g_rand_new_with_seed ( 1 );
+	guint ii;
+	for ( ii = 0; ii < COUNT; ii++ ) {
+		switch ( ii % 4 ) {
+		case 0:
+			positions[2*ii] = g_rand_double_range ( rand, -90, 90 );
+			positions[2*ii+1] = g_rand_double_range ( rand, -180, 180 );
+			break;
+		case 1:
+			positions[2*ii] = 51.5 + g_rand_double_range ( rand, -0.5, 0.5 );
+			positions[2*ii+1] = -0.1 + g_rand_double_range ( rand, -0.5, 0.5 );
+			break;
+		case 2:
+			positions[2*ii] = (gint)g_rand_double_range ( rand, -9, 9 ) * 10.0;
+			positions[2*ii+1] = (gint)g_rand_double_range ( rand, -18, 18 ) * 10.0;
+			break;
+		default:
+			positions[2*ii] = g_rand_boolean ( rand ) ? 90.0 : -90.0;
+			positions[2*ii+1] = g_rand_boolean ( rand ) ? 180.0 : -180.0;
+			break;
+		}
+		items[ii] = GUINT_TO_POINTER(ii+1);
+	}
+	g_rand_free ( rand );
+
+	VikGridIndex *gi = vik_grid_index_new ( NULL, NULL, 0 );
+	if ( vik_grid_index_get_level ( gi, 1.0 ) != -1 )
+		return 1;
+	vik_grid_index_free ( gi );
+
+	gi = vik_grid_index_new ( positions, items, COUNT );
+	gint max_level = -1;
+	if ( !check_levels ( gi, positions, items, &max_level ) )
+		return 2;
+	if ( !check_get_level ( gi, max_level ) )
+		return 3;
+
+	vik_grid_index_free ( gi );
+	g_free ( items );
+	g_free ( positions );
+	return 0;
+}
@@ -0,0 +1,134 @@
+// Copyright: CC0
+// Check the static k-d tree answers match a brute force search,
+//  both when built in memory and when mapped back from a snapshot
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include "vikkdindex.h"
+
+#define COUNT 5000
+#define QUERIES 2000
+#define MAX_RESULTS 64
+
+static gint brute_nearest ( const gdouble *pos, const gdouble *positions, gdouble range )
+{
+	gint best = -1;
+	gdouble best_dsq = range * range;
+	guint ii;
+	for ( ii = 0; ii < COUNT; ii++ ) {
+		gdouble dx = positions[2*ii] - pos[0];
+		gdouble dy = positions[2*ii+1] - pos[1];
+		if ( dx*dx + dy*dy < best_dsq ) {
+			best_dsq = dx*dx + dy*dy;
+			best = ii;
+		}
+	}
+	return best;
+}
+
+static guint brute_range ( const gdouble *pos, const gdouble *positions, gdouble range )
+{
+	guint found = 0;
+	guint ii;
+	for ( ii = 0; ii < COUNT; ii++ ) {
+		gdouble dx = positions[2*ii] - pos[0];
+		gdouble dy = positions[2*ii+1] - pos[1];
+		if ( dx*dx + dy*dy <= range*range )
+			found++;
+	}
+	return found;
+}
+
+static gboolean check ( VikKdIndex *kdi, const gdouble *positions, gchar **names )
+{
+	GRand *rand = g_rand_new_with_seed ( 42 );
+	guint results[MAX_RESULTS];
+	guint qq;
+	for ( qq = 0; qq < QUERIES; qq++ ) {
+		gdouble pos[2] = { g_rand_double_range ( rand, -90, 90 ), g_rand_double_range ( rand, -180, 180 ) };
+		gdouble range = g_rand_double_range ( rand, 0.1, 5.0 );
+
+		gint expected = brute_nearest ( pos, positions, range );
+		gint ans = vik_kd_index_nearest ( kdi, pos, range, NULL );
+		if ( (expected < 0) != (ans < 0) ) {
+			g_printerr ( "Query %d: nearest found %d but expected %d\n", qq, ans, expected );
+			return FALSE;
+		}
+		if ( ans >= 0 ) {
+			// Ties may legitimately pick another entry, so compare distances
+			gdouble found[2];
+			vik_kd_index_get_position ( kdi, ans, found );
+			gdouble dsq_found = (found[0]-pos[0])*(found[0]-pos[0]) + (found[1]-pos[1])*(found[1]-pos[1]);
+			const gdouble *want = &positions[2*expected];
+			gdouble dsq_expected = (want[0]-pos[0])*(want[0]-pos[0]) + (want[1]-pos[1])*(want[1]-pos[1]);
+			if ( dsq_found != dsq_expected ) {
+				g_printerr ( "Query %d: nearest is %s but expected %s\n", qq, vik_kd_index_get_name ( kdi, ans ), names[expected] );
+				return FALSE;
+			}
+			// The name must still belong to the position
+			gint idx = atoi ( vik_kd_index_get_name ( kdi, ans ) + strlen("Place") );
+			if ( positions[2*idx] != found[0] || positions[2*idx+1] != found[1] ) {
+				g_printerr ( "Query %d: name %s does not match its position\n", qq, vik_kd_index_get_name ( kdi, ans ) );
+				return FALSE;
+			}
+		}
+
+		guint count = vik_kd_index_nearest_range ( kdi, pos, range, results, MAX_RESULTS );
+		guint expected_count = MIN ( brute_range ( pos, positions, range ), MAX_RESULTS );
+		if ( count != expected_count ) {
+			g_printerr ( "Query %d: range found %d but expected %d\n", qq, count, expected_count );
+			return FALSE;
+		}
+	}
+	g_rand_free ( rand );
+	return TRUE;
+}
+
+int main ( int argc, char *argv[] )
+{
+	gdouble *positions = g_new ( gdouble, 2*COUNT );
+	gchar **names = g_new0 ( gchar*, COUNT+1 );
+
+	// Deliberately clustered so that some points coincide
+	GRand *rand = g_rand_new_with_seed ( 1 );
+	guint ii;
+	for ( ii = 0; ii < COUNT; ii++ ) {
+		positions[2*ii] = (gint)g_rand_double_range ( rand, -900, 900 ) / 10.0;
+		positions[2*ii+1] = (gint)g_rand_double_range ( rand, -1800, 1800 ) / 10.0;
+		names[ii] = g_strdup_printf ( "Place%d", ii );
+	}
+	g_rand_free ( rand );
+
+	VikKdIndex *kdi = vik_kd_index_new ( positions, (const gchar * const *)names, COUNT );
+	if ( !check ( kdi, positions, names ) )
+		return 1;
+
+	gchar *filename = NULL;
+	gint fd = g_file_open_tmp ( "test_kdindex_XXXXXX", &filename, NULL );
+	if ( fd < 0 )
+		return 2;
+	close ( fd );
+
+	if ( !vik_kd_index_save ( kdi, filename, 1234 ) )
+		return 3;
+	vik_kd_index_free ( kdi );
+
+	if ( vik_kd_index_new_from_file ( filename, 4321 ) ) {
+		g_printerr ( "Snapshot with a different stamp was accepted\n" );
+		return 4;
+	}
+	kdi = vik_kd_index_new_from_file ( filename, 1234 );
+	if ( !kdi || vik_kd_index_get_count ( kdi ) != COUNT )
+		return 5;
+	if ( !check ( kdi, positions, names ) )
+		return 6;
+
+	vik_kd_index_free ( kdi );
+	(void)g_remove ( filename );
+	g_free ( filename );
+	g_strfreev ( names );
+	g_free ( positions );
+	return 0;
+}
@@ -0,0 +1,155 @@
+// Copyright: CC0
+// Check finding trackpoints by distance and time via the track's index
+//  gives the same answers as walking along the track
+#include <stdlib.h>
+#include <math.h>
+#include <glib.h>
+#include "viktrack.h"
+
+#define POINTS 2000
+#define QUERIES 5000
+
+static VikTrackpoint *walk_by_dist ( VikTrack *trk, gdouble meters_from_start, gboolean get_next_point, gdouble *tp_metres_from_start )
+{
+	gdouble current_dist = 0.0;
+	gdouble current_inc = 0.0;
+	GList *iter = trk->trackpoints->next;
+	while ( iter ) {
+		current_inc = vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord), &(VIK_TRACKPOINT(iter->prev->data)->coord) );
+		current_dist += current_inc;
+		if ( current_dist >= meters_from_start )
+			break;
+		iter = iter->next;
+	}
+	if ( !iter )
+		return NULL;
+	*tp_metres_from_start = current_dist;
+	if ( !get_next_point ) {
+		*tp_metres_from_start = current_dist - current_inc;
+		return VIK_TRACKPOINT(iter->prev->data);
+	}
+	return VIK_TRACKPOINT(iter->data);
+}
+
+static VikTrackpoint *walk_by_percentage_dist ( VikTrack *tr, gdouble reldist )
+{
+	gdouble dist = vik_track_get_length_including_gaps ( tr ) * reldist;
+	gdouble current_dist = 0.0;
+	gdouble current_inc = 0.0;
+	GList *iter = tr->trackpoints->next;
+	GList *last_iter = NULL;
+	while ( iter ) {
+		current_inc = vik_coord_diff ( &(VIK_TRACKPOINT(iter->data)->coord), &(VIK_TRACKPOINT(iter->prev->data)->coord) );
+		current_dist += current_inc;
+		if ( current_dist >= dist )
+			break;
+		last_iter = iter;
+		iter = iter->next;
+	}
+	if ( !iter )
+		return last_iter ? VIK_TRACKPOINT(last_iter->data) : NULL;
+	if ( iter->prev && fabs(current_dist-current_inc-dist) < fabs(current_dist-dist) )
+		iter = iter->prev;
+	return VIK_TRACKPOINT(iter->data);
+}
+
+static VikTrackpoint *walk_by_percentage_time ( VikTrack *tr, gdouble reltime )
+{
+	time_t t_start = VIK_TRACKPOINT(tr->trackpoints->data)->timestamp;
+	time_t t_end = VIK_TRACKPOINT(g_list_last(tr->trackpoints)->data)->timestamp;
+	time_t t_pos = t_start + (t_end - t_start) * reltime;
+	GList *iter = tr->trackpoints;
+	while ( iter ) {
+		if ( VIK_TRACKPOINT(iter->data)->timestamp == t_pos )
+			break;
+		if ( VIK_TRACKPOINT(iter->data)->timestamp > t_pos ) {
+			if ( iter->prev == NULL )
+				break;
+			time_t t_before = t_pos - VIK_TRACKPOINT(iter->prev->data)->timestamp;
+			time_t t_after = VIK_TRACKPOINT(iter->data)->timestamp - t_pos;
+			if ( t_before <= t_after )
+				iter = iter->prev;
+			break;
+		}
+		else if ( (iter->next == NULL) && (t_pos < (VIK_TRACKPOINT(iter->data)->timestamp + 3)) )
+			break;
+		iter = iter->next;
+	}
+	return iter ? VIK_TRACKPOINT(iter->data) : NULL;
+}
+
+static gboolean check ( VikTrack *trk, GRand *rand, const gchar *what )
+{
+	gdouble length = vik_track_get_length_including_gaps ( trk );
+	guint qq;
+	for ( qq = 0; qq < QUERIES; qq++ ) {
+		gdouble dist = g_rand_double_range ( rand, -10, length + 10 );
+		gboolean next = g_rand_boolean ( rand );
+		gdouble expected_dist = 0.0, found_dist = 0.0;
+		VikTrackpoint *expected = walk_by_dist ( trk, dist, next, &expected_dist );
+		VikTrackpoint *found = vik_track_get_tp_by_dist ( trk, dist, next, &found_dist );
+		if ( expected != found || (found && fabs(expected_dist - found_dist) > 1e-6) ) {
+			g_printerr ( "%s: distance %f (next %d) found %p at %f but expected %p at %f\n", what, dist, next, found, found_dist, expected, expected_dist );
+			return FALSE;
+		}
+
+		gdouble rel = g_rand_double_range ( rand, -0.01, 1.01 );
+		if ( walk_by_percentage_dist ( trk, rel ) != vik_track_get_closest_tp_by_percentage_dist ( trk, rel, NULL ) ) {
+			g_printerr ( "%s: relative distance %f gives the wrong trackpoint\n", what, rel );
+			return FALSE;
+		}
+		if ( walk_by_percentage_time ( trk, rel ) != vik_track_get_closest_tp_by_percentage_time ( trk, rel, NULL ) ) {
+			g_printerr ( "%s: relative time %f gives the wrong trackpoint\n", what, rel );
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+int main ( int argc, char *argv[] )
+{
+	GRand *rand = g_rand_new_with_seed ( 42 );
+	VikTrack *trk = vik_track_new ();
+	struct LatLon ll = { 51.0, -1.0 };
+	time_t t = 1500000000;
+	guint ii;
+	for ( ii = 0; ii < POINTS; ii++ ) {
+		VikTrackpoint *tp = vik_trackpoint_new ();
+		// Some repeated positions and times
+		if ( g_rand_int_range ( rand, 0, 10 ) ) {
+			ll.lat += g_rand_double_range ( rand, -0.001, 0.001 );
+			ll.lon += g_rand_double_range ( rand, -0.001, 0.001 );
+			t += g_rand_int_range ( rand, 0, 30 );
+		}
+		vik_coord_load_from_latlon ( &tp->coord, VIK_COORD_LATLON, &ll );
+		tp->timestamp = t;
+		tp->has_timestamp = TRUE;
+		vik_track_add_trackpoint ( trk, tp, FALSE );
+	}
+	vik_track_calculate_bounds ( trk );
+
+	gboolean ok = check ( trk, rand, "Ordered" );
+
+	// Adding a point must be seen
+	VikTrackpoint *tp = vik_trackpoint_new ();
+	ll.lat += 0.01;
+	vik_coord_load_from_latlon ( &tp->coord, VIK_COORD_LATLON, &ll );
+	tp->timestamp = t + 60;
+	vik_track_add_trackpoint ( trk, tp, TRUE );
+	if ( ok && vik_track_get_closest_tp_by_percentage_dist ( trk, 1.0, NULL ) != tp ) {
+		g_printerr ( "Added trackpoint not found\n" );
+		ok = FALSE;
+	}
+
+	// Times out of order fall back to walking the track
+	for ( ii = 0; ii < 20; ii++ ) {
+		VikTrackpoint *tp1 = g_list_nth_data ( trk->trackpoints, g_rand_int_range ( rand, 1, POINTS ) );
+		tp1->timestamp -= g_rand_int_range ( rand, 100, 1000 );
+	}
+	vik_track_invalidate_index ( trk );
+	ok = ok && check ( trk, rand, "Unordered" );
+
+	vik_track_free ( trk );
+	g_rand_free ( rand );
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}